@@ -0,0 +1,278 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/KeyframeAnimation.h"
+#include "../CibraryEngine/SkeletalAnimation.h"
+#include "../CibraryEngine/UberModel.h"
+
+/*
+ * Sampling a looping walk-like clip for 500 characters every frame; the clip has 24 keyframes which pose every bone of the
+ * soldier.zzz skeleton (except that each keyframe leaves a few bones out), since there are no animation files in the Files
+ * directory. Compares the old KeyframeAnimation::UpdatePose (reproduced below, as it was before poses kept their bones in
+ * slots), KeyframeAnimation as it is now, and CompiledAnimationPose with and without quantized keys, each character starting
+ * at a different point in the clip; checks that the compiled poses agree with KeyframeAnimation, and that a compiled clip
+ * written out and read back in is written out the same way again
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int character_count = 500;
+	const unsigned int frames = 300;
+
+	const unsigned int clip_frames = 24;
+	const float clip_frame_duration = 0.1f;
+
+	namespace Old
+	{
+		class KeyframeAnimation : public CibraryEngine::KeyframeAnimation
+		{
+			public:
+
+				unordered_map<unsigned int, BoneInfluence> bones;
+
+				KeyframeAnimation(const CibraryEngine::KeyframeAnimation& source) : CibraryEngine::KeyframeAnimation(source), bones() { }
+
+				void SetBonePose(unsigned int which, Vec3 ori, Vec3 pos, float weight) { bones[which] = BoneInfluence(ori, pos, weight); }
+
+				void UpdatePose(TimingInfo time)
+				{
+					if (Advance(time))
+					{
+						Keyframe cur = frames[current_index];
+
+						bool interpolate = cur.next != -1;
+
+						if (interpolate)
+						{
+							Keyframe nxt = frames[cur.next];
+
+							float b_frac = current_time / cur.duration, a_frac = 1 - b_frac;
+
+							boost::unordered_set<unsigned int> cur_names;
+							boost::unordered_set<unsigned int> next_names;
+
+							unordered_map<unsigned int, BoneInfluence>::iterator map_iter;
+							boost::unordered_set<unsigned int>::iterator set_iter;
+
+							for(map_iter = cur.values.begin(); map_iter != cur.values.end(); ++map_iter)
+								cur_names.insert(map_iter->first);
+							for(map_iter = nxt.values.begin(); map_iter != nxt.values.end(); ++map_iter)
+								next_names.insert(map_iter->first);
+
+							boost::unordered_set<unsigned int> shared_names(cur_names);
+							for(set_iter = shared_names.begin(); set_iter != shared_names.end();)
+							{
+								if(next_names.find(*set_iter) == next_names.end())
+									set_iter = shared_names.erase(set_iter);
+								else
+									++set_iter;
+							}
+							for(set_iter = cur_names.begin(); set_iter != cur_names.end();)
+							{
+								if(shared_names.find(*set_iter) != shared_names.end())
+									set_iter = cur_names.erase(set_iter);
+								else
+									++set_iter;
+							}
+							for(set_iter = next_names.begin(); set_iter != next_names.end();)
+							{
+								if(shared_names.find(*set_iter) != shared_names.end())
+									set_iter = next_names.erase(set_iter);
+								else
+									++set_iter;
+							}
+
+							for(set_iter = cur_names.begin(); set_iter != cur_names.end(); ++set_iter)
+							{
+								BoneInfluence vec = cur.values[*set_iter];
+								SetBonePose(*set_iter, vec.ori * a_frac, vec.pos * a_frac, vec.div * a_frac);
+							}
+							for(set_iter = next_names.begin(); set_iter != next_names.end(); ++set_iter)
+							{
+								BoneInfluence vec = nxt.values[*set_iter];
+								SetBonePose(*set_iter, vec.ori * b_frac, vec.pos * b_frac, vec.div * b_frac);
+							}
+							for(set_iter = shared_names.begin(); set_iter != shared_names.end(); ++set_iter)
+							{
+								BoneInfluence cur_vec = cur.values[*set_iter];
+								BoneInfluence next_vec = nxt.values[*set_iter];
+								SetBonePose(*set_iter, cur_vec.ori * a_frac + next_vec.ori * b_frac, cur_vec.pos * a_frac + next_vec.pos * b_frac, cur_vec.div * a_frac + next_vec.div * b_frac);
+							}
+						}
+						else
+						{
+							for(unordered_map<unsigned int, BoneInfluence>::iterator iter = cur.values.begin(); iter != cur.values.end(); ++iter)
+							{
+								BoneInfluence vec = cur.values[iter->first];
+								SetBonePose(iter->first, vec.ori, vec.pos, vec.div);
+							}
+						}
+					}
+					else
+						SetActive(false);
+				}
+		};
+	}
+
+	/**
+	 * Makes a looping clip which moves every bone of the skeleton back and forth, and the first bone up and down; each keyframe
+	 * leaves out every 7th bone (a different 7th each time), but never the same bone in two keyframes in a row, so every bone is
+	 * posed on every frame
+	 */
+	void MakeClip(Skeleton* skeleton, KeyframeAnimation& anim, BenchmarkRandom& random)
+	{
+		vector<Vec3> swing;
+		for(unsigned int i = 0; i < skeleton->bones.size(); ++i)
+			swing.push_back(Vec3(random.Next(-0.6f, 0.6f), random.Next(-0.3f, 0.3f), random.Next(-0.2f, 0.2f)));
+
+		for(unsigned int f = 0; f < clip_frames; ++f)
+		{
+			Keyframe kf(clip_frame_duration);
+			kf.next = (f + 1) % clip_frames;
+
+			float phase = sin(f * 6.2831853f / clip_frames);
+			for(unsigned int i = 0; i < skeleton->bones.size(); ++i)
+				if((i + f) % 7 != 0)
+					kf.values[skeleton->bones[i]->name] = BoneInfluence(swing[i] * phase, i == 0 ? Vec3(0, fabs(phase) * 0.1f, 0) : Vec3(), 1);
+
+			anim.frames.push_back(kf);
+		}
+	}
+
+	// the largest difference between what the two poses do to any bone
+	float CompareInfluences(Pose* a, Pose* b)
+	{
+		float result = 0.0f;
+		for(unsigned int i = 0; i < a->bone_names.size(); ++i)
+			for(unsigned int j = 0; j < b->bone_names.size(); ++j)
+				if(a->bone_names[i] == b->bone_names[j])
+				{
+					const BoneInfluence &x = a->bone_influences[i], &y = b->bone_influences[j];
+					result = max(result, (x.ori - y.ori).ComputeMagnitude());
+					result = max(result, (x.pos - y.pos).ComputeMagnitude());
+					result = max(result, fabs(x.div - y.div));
+				}
+		return result;
+	}
+
+	// writes the clip out, reads it back in, and writes that out too; returns whether both times wrote the same bytes
+	bool CheckRoundTrip(CompiledAnimation* anim)
+	{
+		ostringstream first;
+		if(CompiledAnimation::WriteCompiledAnimation(first, anim) != 0)
+			return false;
+
+		istringstream in(first.str());
+		CompiledAnimation* read = NULL;
+		if(CompiledAnimation::ReadCompiledAnimation(in, &read) != 0)
+			return false;
+
+		ostringstream second;
+		bool ok = CompiledAnimation::WriteCompiledAnimation(second, read) == 0 && second.str() == first.str();
+
+		delete read;
+		return ok;
+	}
+
+	template<class T> double TimeUpdates(vector<T*>& poses, TimingInfo time)
+	{
+		double start = GetSeconds();
+		for(typename vector<T*>::iterator iter = poses.begin(); iter != poses.end(); ++iter)
+			(*iter)->UpdatePose(time);
+		return GetSeconds() - start;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	UberModel* model = NULL;
+	if(UberModelLoader::LoadZZZ(model, "Files/Models/soldier.zzz") != 0 || model->bones.empty())
+	{
+		printf("couldn't load the skeleton of Files/Models/soldier.zzz; run this from the repository root\n");
+		return 1;
+	}
+	Skeleton* skeleton = model->CreateSkeleton();
+
+	BenchmarkRandom random(12345);
+
+	KeyframeAnimation clip("walk");
+	MakeClip(skeleton, clip, random);
+
+	CompiledAnimation compiled(clip), quantized(clip, true);
+
+	vector<Old::KeyframeAnimation*> old_poses;
+	vector<KeyframeAnimation*> keyframe_poses;
+	vector<CompiledAnimationPose*> compiled_poses, quantized_poses;
+
+	for(unsigned int i = 0; i < character_count; ++i)
+	{
+		old_poses.push_back(new Old::KeyframeAnimation(clip));
+		keyframe_poses.push_back(new KeyframeAnimation(clip));
+		compiled_poses.push_back(new CompiledAnimationPose(&compiled));
+		quantized_poses.push_back(new CompiledAnimationPose(&quantized));
+
+		// start each character somewhere else in the clip, a small step at a time so KeyframeAnimation doesn't skip ahead
+		TimingInfo step(0.05f, 0.0f);
+		for(unsigned int j = 0; j < i % (clip_frames * 2); ++j)
+		{
+			old_poses[i]->UpdatePose(step);
+			keyframe_poses[i]->UpdatePose(step);
+			compiled_poses[i]->UpdatePose(step);
+			quantized_poses[i]->UpdatePose(step);
+		}
+	}
+
+	double old_time = 0.0, keyframe_time = 0.0, compiled_time = 0.0, quantized_time = 0.0;
+	float compiled_error = 0.0f, quantized_error = 0.0f;
+
+	TimingInfo time(1.0f / 60.0f, 0.0f);
+	for(unsigned int frame = 0; frame < frames; ++frame)
+	{
+		old_time += TimeUpdates(old_poses, time);
+		keyframe_time += TimeUpdates(keyframe_poses, time);
+		compiled_time += TimeUpdates(compiled_poses, time);
+		quantized_time += TimeUpdates(quantized_poses, time);
+
+		for(unsigned int i = 0; i < character_count; ++i)
+		{
+			compiled_error = max(compiled_error, CompareInfluences(keyframe_poses[i], compiled_poses[i]));
+			quantized_error = max(quantized_error, CompareInfluences(compiled_poses[i], quantized_poses[i]));
+		}
+
+		time.total += time.elapsed;
+	}
+
+	bool round_trips = CheckRoundTrip(&compiled) && CheckRoundTrip(&quantized);
+
+	char extra[64];
+	unsigned int keys = 0;
+	for(vector<CompiledAnimation::Channel>::iterator iter = compiled.channels.begin(); iter != compiled.channels.end(); ++iter)
+		keys += iter->times.size();
+	printf("%u characters, %u bones, %u keyframes compiled into %u keys\n", character_count, skeleton->bones.size(), clip_frames, keys);
+
+	Report("old KeyframeAnimation", old_time * 1000.0 / frames);
+	Report("KeyframeAnimation", keyframe_time * 1000.0 / frames);
+	sprintf(extra, "max difference %g", compiled_error);
+	Report("CompiledAnimationPose", compiled_time * 1000.0 / frames, extra);
+	sprintf(extra, "max difference %g", quantized_error);
+	Report("CompiledAnimationPose, quantized", quantized_time * 1000.0 / frames, extra);
+
+	printf("write/read/write round trips %s\n", round_trips ? "matched" : "DIDN'T match");
+
+	for(unsigned int i = 0; i < character_count; ++i)
+	{
+		delete old_poses[i];
+		delete keyframe_poses[i];
+		delete compiled_poses[i];
+		delete quantized_poses[i];
+	}
+
+	skeleton->Dispose();
+	delete skeleton;
+
+	model->Dispose();
+	delete model;
+
+	return round_trips && compiled_error < 1e-4f && quantized_error < 1e-3f ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../CibraryEngine/StdAfx.h"
+
+/*
+ * Shared by the benchmark drivers in this directory; each driver is a console program of its own, to be linked
+ * against CibraryEngine (and whatever else the parts of it being measured need), and run from the repository root
+ * so the Files directory can be found
+ */
+namespace Benchmarks
+{
+	using namespace std;
+
+	/** Seconds since some arbitrary point, from the high-resolution performance counter */
+	inline double GetSeconds()
+	{
+		LARGE_INTEGER t, freq;
+		QueryPerformanceCounter(&t);
+		QueryPerformanceFrequency(&freq);
+
+		return double(t.QuadPart) / double(freq.QuadPart);
+	}
+
+	/** Deterministic pseudo-random numbers, so every run of a benchmark does the same work */
+	struct BenchmarkRandom
+	{
+		unsigned int state;
+
+		BenchmarkRandom(unsigned int seed) : state(seed) { }
+
+		unsigned int Next() { state = state * 1664525 + 1013904223; return state >> 8; }
+		float Next(float min, float max) { return min + (max - min) * (Next() & 0xFFFF) / 65536.0f; }
+	};
+
+	/** Prints one result line, in the form all of the drivers use */
+	inline void Report(const string& what, double ms, const string& extra = "")
+	{
+		printf("%-52s %10.3f ms", what.c_str(), ms);
+		if(!extra.empty())
+			printf("   %s", extra.c_str());
+		printf("\n");
+	}
+}
@@ -0,0 +1,158 @@
+#include "RagdollScene.h"
+
+/*
+ * What collapsing corpse ragdolls saves: 200 ragdolls dropped onto the nbridge level are timed while they fall, while
+ * they lie asleep in the world, and after each has been collapsed into one static compound body the way
+ * Corpse::Freeze does it; then the fall is timed again with each ragdoll merged into one dynamic compound body from
+ * the start, the way Corpse merges those far from the camera. The collapse is done here by the same steps as
+ * Corpse::Collapse, since Corpse itself needs the whole TestGame around it
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ragdoll_count = 200;
+	const unsigned int frames = 120;
+	const unsigned int max_settle_frames = 1200;
+
+	btTransform ToBulletTransform(const Vec3& pos, const Quaternion& ori) { return btTransform(btQuaternion(ori.x, ori.y, ori.z, ori.w), btVector3(pos.x, pos.y, pos.z)); }
+
+	// replaces each ragdoll with a single body holding its bones' shapes in their current pose; dynamic if merged, static if not
+	void Collapse(RagdollScene& scene, bool merged, vector<RigidBodyInfo*>& lod_bodies)
+	{
+		for(vector<RagdollScene::Ragdoll>::iterator iter = scene.ragdolls.begin(); iter != scene.ragdolls.end(); ++iter)
+		{
+			Vec3 center, vel;
+			for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+			{
+				center += (*jter)->GetPosition();
+				vel += (*jter)->GetLinearVelocity();
+			}
+			center /= float(iter->bodies.size());
+			vel /= float(iter->bodies.size());
+
+			btCompoundShape* lod_shape = new btCompoundShape();
+			for(unsigned int i = 0; i < iter->bodies.size(); ++i)
+				lod_shape->addChildShape(ToBulletTransform(iter->bodies[i]->GetPosition() - center, iter->bodies[i]->GetOrientation()), iter->shapes[i]);
+
+			for(vector<ConeTwistConstraint*>::iterator jter = iter->constraints.begin(); jter != iter->constraints.end(); ++jter)
+			{
+				scene.physics->RemoveConstraint(*jter);
+				(*jter)->Dispose();
+				delete *jter;
+			}
+			iter->constraints.clear();
+
+			for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+			{
+				scene.physics->RemoveRigidBody(*jter);
+				(*jter)->DisposePreservingCollisionShape();
+				delete *jter;
+			}
+			iter->bodies.clear();
+			iter->shapes.clear();
+
+			RigidBodyInfo* lod_body = new RigidBodyInfo(lod_shape, merged ? MassInfo::FromCollisionShape(lod_shape, iter->total_mass) : MassInfo(), center, Quaternion::Identity(), RagdollScene::ragdoll_group);
+			if(merged)
+			{
+				lod_body->SetLinearVelocity(vel);
+
+				lod_body->SetDamping(0.05f, 0.85f);
+				lod_body->SetDeactivationTime(0.8f);
+				lod_body->SetSleepingThresholds(1.6f, 2.5f);
+			}
+			lod_body->SetFriction(1.0f);
+			lod_body->SetRestitution(0.01f);
+
+			scene.physics->AddRigidBody(lod_body);
+			lod_bodies.push_back(lod_body);
+		}
+	}
+
+	// the compound shapes go with their bodies, but the bone shapes in them belong to the model
+	void DisposeLODBodies(PhysicsWorld* world, vector<RigidBodyInfo*>& lod_bodies)
+	{
+		for(vector<RigidBodyInfo*>::iterator iter = lod_bodies.begin(); iter != lod_bodies.end(); ++iter)
+		{
+			world->RemoveRigidBody(*iter);
+			(*iter)->Dispose();
+			delete *iter;
+		}
+		lod_bodies.clear();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	printf("%u ragdolls, times are per 1/60 s step\n", ragdoll_count);
+
+	// ragdolls all the way through: falling, then asleep, then frozen
+	{
+		PhysicsWorld* world = new PhysicsWorld();
+		RagdollScene scene(world);
+		if(!scene.Load())
+			return 1;
+
+		BenchmarkRandom random(12345);
+		scene.AddRagdolls(ragdoll_count, random);
+
+		stringstream falling;
+		double falling_ms = scene.Run(frames);
+		falling << scene.GetActiveBodyCount() << " of " << scene.GetBodyCount() << " bodies active";
+		Report("ragdolls, falling", falling_ms, falling.str());
+
+		unsigned int settle = 0;
+		while(scene.GetActiveBodyCount() > 0 && settle < max_settle_frames)
+		{
+			scene.Run(10);
+			settle += 10;
+		}
+
+		stringstream asleep;
+		double asleep_ms = scene.Run(frames);
+		asleep << scene.GetActiveBodyCount() << " of " << scene.GetBodyCount() << " bodies active, after " << settle << " more steps";
+		Report("ragdolls, asleep", asleep_ms, asleep.str());
+
+		unsigned int bones = scene.GetBodyCount();
+
+		vector<RigidBodyInfo*> lod_bodies;
+		Collapse(scene, false, lod_bodies);
+
+		stringstream frozen;
+		frozen << bones << " bones frozen into " << lod_bodies.size() << " static bodies";
+		Report("frozen", scene.Run(frames), frozen.str());
+
+		DisposeLODBodies(world, lod_bodies);
+		scene.Dispose();
+		world->Dispose();
+		delete world;
+	}
+
+	// merged from the start, as if they were all far from the camera
+	{
+		PhysicsWorld* world = new PhysicsWorld();
+		RagdollScene scene(world);
+		if(!scene.Load())
+			return 1;
+
+		BenchmarkRandom random(12345);
+		scene.AddRagdolls(ragdoll_count, random);
+
+		unsigned int bones = scene.GetBodyCount();
+
+		vector<RigidBodyInfo*> lod_bodies;
+		Collapse(scene, true, lod_bodies);
+
+		stringstream merged;
+		merged << bones << " bones merged into " << lod_bodies.size() << " dynamic bodies";
+		Report("merged, falling", scene.Run(frames), merged.str());
+
+		DisposeLODBodies(world, lod_bodies);
+		scene.Dispose();
+		world->Dispose();
+		delete world;
+	}
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/Entity.h"
+#include "../CibraryEngine/VisibilityTree.h"
+#include "../CibraryEngine/CameraView.h"
+#include "../CibraryEngine/Sphere.h"
+
+/*
+ * Frustum culling of 20,000 entity bounding spheres scattered over a 1000 unit wide disc, with a camera in the middle
+ * turning a little each frame and a tenth of the entities moving; compares testing every sphere against the camera
+ * (what it would take to cull without the tree) with VisibilityTree::Update for the ones which moved plus
+ * VisibilityTree::Cull, and checks that both find the same number of visible entities
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int entity_count = 20000;
+	const unsigned int frames = 300;
+
+	struct Ball : public Entity
+	{
+		Sphere sphere;
+
+		Ball(const Sphere& sphere) : Entity(NULL), sphere(sphere) { }
+		bool GetVisBounds(Sphere& bounds) { bounds = sphere; return true; }
+	};
+
+	CameraView GetCamera(unsigned int frame)
+	{
+		float yaw = frame * 0.02f;
+		Vec3 forward(sin(yaw), 0, cos(yaw));
+
+		return CameraView(Vec3(0, 10, 0), forward, Vec3(0, 1, 0), -0.16f, 0.16f, 0.09f, -0.09f, 0.1f, 400.0f);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkRandom random(12345);
+
+	vector<Ball*> balls;
+	for(unsigned int i = 0; i < entity_count; ++i)
+	{
+		float angle = random.Next(0.0f, 6.2831853f), distance = sqrt(random.Next(0.0f, 1.0f)) * 500.0f;
+		balls.push_back(new Ball(Sphere(Vec3(cos(angle) * distance, random.Next(0.0f, 20.0f), sin(angle) * distance), random.Next(0.5f, 3.0f))));
+	}
+
+	VisibilityTree tree;
+	vector<int> proxies;
+	for(unsigned int i = 0; i < entity_count; ++i)
+		proxies.push_back(tree.Insert(balls[i]));
+
+	vector<Entity*> visible;
+	double brute_time = 0.0, update_time = 0.0, cull_time = 0.0;
+	unsigned int brute_visible = 0, tree_visible = 0, mismatched_frames = 0;
+
+	for(unsigned int frame = 0; frame < frames; ++frame)
+	{
+		for(unsigned int i = frame % 10; i < entity_count; i += 10)
+			balls[i]->sphere.center += Vec3(random.Next(-0.3f, 0.3f), 0, random.Next(-0.3f, 0.3f));
+
+		CameraView camera = GetCamera(frame);
+
+		double start = GetSeconds();
+		unsigned int frame_visible = 0;
+		for(vector<Ball*>::iterator iter = balls.begin(); iter != balls.end(); ++iter)
+			if(camera.CheckSphereVisibility((*iter)->sphere))
+				++frame_visible;
+		brute_time += GetSeconds() - start;
+
+		start = GetSeconds();
+		for(unsigned int i = frame % 10; i < entity_count; i += 10)
+			tree.Update(proxies[i]);
+		update_time += GetSeconds() - start;
+
+		visible.clear();
+		start = GetSeconds();
+		tree.Cull(&camera, visible);
+		cull_time += GetSeconds() - start;
+
+		brute_visible += frame_visible;
+		tree_visible += visible.size();
+		if(visible.size() != frame_visible)
+			++mismatched_frames;
+	}
+
+	printf("%u entities, %u frames, about %u visible per frame\n", entity_count, frames, brute_visible / frames);
+
+	Report("CheckSphereVisibility on every entity", brute_time * 1000.0 / frames);
+	Report("VisibilityTree::Update, for the moved tenth", update_time * 1000.0 / frames);
+
+	stringstream extra;
+	extra << tree.GetVisibleCount() << " visible, " << tree.GetCulledCount() << " culled in the last frame";
+	Report("VisibilityTree::Cull", cull_time * 1000.0 / frames, extra.str());
+
+	for(unsigned int i = 0; i < entity_count; ++i)
+		tree.Remove(proxies[i]);
+	tree.Dispose();
+
+	for(vector<Ball*>::iterator iter = balls.begin(); iter != balls.end(); ++iter)
+		delete *iter;
+
+	if(mismatched_frames != 0)
+	{
+		printf("the tree and the brute-force test disagreed in %u frames\n", mismatched_frames);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/Entity.h"
+#include "../CibraryEngine/EntityRegistry.h"
+
+/*
+ * Update and removal throughput of EntityRegistry, with 50,000 lightweight entities of two types, compared with the
+ * list<Entity*> that GameState used to keep; each frame every entity is updated, and 5% of them are removed and
+ * replaced, the way GameState::Update does it (flag, then remove in a batch, then add the new ones)
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int entity_count = 50000;
+	const unsigned int frames = 200;
+	const unsigned int removals_per_frame = entity_count / 20;
+
+	struct Walker : public Entity
+	{
+		float pos, vel;
+
+		Walker() : Entity(NULL), pos(0.0f), vel(1.0f) { }
+		void Update(TimingInfo time) { pos += vel * time.elapsed; }
+	};
+
+	struct Spinner : public Entity
+	{
+		float angle;
+
+		Spinner() : Entity(NULL), angle(0.0f) { }
+		void Update(TimingInfo time) { angle += time.elapsed; if(angle > 6.2831853f) angle -= 6.2831853f; }
+	};
+
+	Entity* NewEntity(unsigned int i) { return i % 2 == 0 ? (Entity*)new Walker() : (Entity*)new Spinner(); }
+
+	// deterministic choice of which entities get removed, so every variant does the same work
+	unsigned int rng_state = 12345;
+	unsigned int NextRandom() { rng_state = rng_state * 1664525 + 1013904223; return rng_state >> 8; }
+
+	void RunRegistry(bool bucket_by_type)
+	{
+		EntityRegistry registry;
+		registry.bucket_by_type = bucket_by_type;
+
+		vector<EntityHandle> handles;
+		for(unsigned int i = 0; i < entity_count; ++i)
+			handles.push_back(registry.Add(NewEntity(i)));
+
+		vector<unsigned int> removing;
+		TimingInfo time(1.0f / 60.0f, 0.0f);
+
+		rng_state = 12345;
+		double update_time = 0.0, remove_time = 0.0;
+		for(unsigned int frame = 0; frame < frames; ++frame)
+		{
+			double start = GetSeconds();
+			for(unsigned int i = 0; i < registry.GetBucketCount(); ++i)
+			{
+				vector<Entity*>& bucket = registry.GetBucket(i);
+				for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
+					(*iter)->Update(time);
+			}
+			double updated = GetSeconds();
+
+			for(unsigned int i = 0; i < removals_per_frame; ++i)
+			{
+				unsigned int index = NextRandom() % entity_count;
+				Entity* e = registry.Get(handles[index]);
+				if(e->is_valid)
+				{
+					e->is_valid = false;
+					removing.push_back(index);
+				}
+			}
+
+			for(vector<unsigned int>::iterator iter = removing.begin(); iter != removing.end(); ++iter)
+			{
+				Entity* e = registry.Get(handles[*iter]);
+				registry.Remove(handles[*iter]);
+				delete e;
+			}
+			for(vector<unsigned int>::iterator iter = removing.begin(); iter != removing.end(); ++iter)
+				handles[*iter] = registry.Add(NewEntity(*iter));
+			removing.clear();
+
+			double removed = GetSeconds();
+
+			update_time += updated - start;
+			remove_time += removed - updated;
+		}
+
+		string name = bucket_by_type ? "EntityRegistry, bucketed by type" : "EntityRegistry, one bucket";
+		Report(name + ": update", update_time * 1000.0 / frames);
+		Report(name + ": remove and replace", remove_time * 1000.0 / frames);
+
+		for(unsigned int i = 0; i < entity_count; ++i)
+			delete registry.Get(handles[i]);
+	}
+
+	void RunList()
+	{
+		list<Entity*> entities;
+		vector<Entity*> by_index;
+		for(unsigned int i = 0; i < entity_count; ++i)
+		{
+			by_index.push_back(NewEntity(i));
+			entities.push_back(by_index.back());
+		}
+
+		vector<unsigned int> removing;
+		TimingInfo time(1.0f / 60.0f, 0.0f);
+
+		rng_state = 12345;
+		double update_time = 0.0, remove_time = 0.0;
+		for(unsigned int frame = 0; frame < frames; ++frame)
+		{
+			double start = GetSeconds();
+			for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+				(*iter)->Update(time);
+			double updated = GetSeconds();
+
+			for(unsigned int i = 0; i < removals_per_frame; ++i)
+			{
+				unsigned int index = NextRandom() % entity_count;
+				if(by_index[index]->is_valid)
+				{
+					by_index[index]->is_valid = false;
+					removing.push_back(index);
+				}
+			}
+
+			// what GameState::Update used to do: walk the whole list, erasing the invalid entities one node at a time
+			for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end();)
+			{
+				Entity* e = *iter;
+				if(e->is_valid)
+					++iter;
+				else
+				{
+					iter = entities.erase(iter);
+					delete e;
+				}
+			}
+			for(vector<unsigned int>::iterator iter = removing.begin(); iter != removing.end(); ++iter)
+			{
+				by_index[*iter] = NewEntity(*iter);
+				entities.push_back(by_index[*iter]);
+			}
+			removing.clear();
+
+			double removed = GetSeconds();
+
+			update_time += updated - start;
+			remove_time += removed - updated;
+		}
+
+		Report("list<Entity*>: update", update_time * 1000.0 / frames);
+		Report("list<Entity*>: remove and replace", remove_time * 1000.0 / frames);
+
+		for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+			delete *iter;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	printf("%u entities, %u frames, %u removals per frame; times are per frame\n", entity_count, frames, removals_per_frame);
+
+	RunList();
+	RunRegistry(false);
+	RunRegistry(true);
+
+	return 0;
+}
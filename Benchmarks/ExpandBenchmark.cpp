@@ -0,0 +1,177 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/ParticleMaterial.h"
+#include "../CibraryEngine/BillboardMaterial.h"
+
+/*
+ * The CPU side of drawing particles: ParticleMaterialBatch::Expand turning 100,000 sprites (a quarter of them not yet
+ * emitted or already expired) into camera-facing quads, and BillboardMaterial::Batch::Expand doing the same for 100,000
+ * trail segments, against the one-at-a-time loops they replaced (reproduced below). Nothing is uploaded, so no GL context
+ * is needed. Returns nonzero if the two ever write a different number of vertices
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int particle_count = 100000;
+	const unsigned int segment_count = 100000;
+	const unsigned int repeats = 50;
+
+	const Vec3 camera_position(3.0f, 20.0f, -40.0f);
+	const Vec3 camera_right(0.8f, 0.0f, 0.6f);
+	const Vec3 camera_up(0.0f, 1.0f, 0.0f);
+
+	template<class V> double Checksum(const vector<V>& vertices, unsigned int count)
+	{
+		double checksum = 0.0;
+		for(unsigned int i = 0; i < count; ++i)
+			checksum += vertices[i].x + vertices[i].y + vertices[i].z;
+		return checksum;
+	}
+}
+
+namespace Old
+{
+	unsigned int Expand(const ParticleMaterialBatch& batch, const Vec3& camera_right, const Vec3& camera_up, ParticleVertex* out)
+	{
+		ParticleVertex* start = out;
+		for(unsigned int i = 0; i < batch.count; ++i)
+		{
+			if(batch.age[i] < 0 || batch.age[i] >= batch.max_age[i])
+				continue;
+
+			Vec3 pos(batch.x[i], batch.y[i], batch.z[i]);
+			float w = batch.age[i] / batch.max_age[i];
+
+			float c = batch.cos_angle[i] * batch.radius[i], s = batch.sin_angle[i] * batch.radius[i];
+			Vec3 use_right = camera_right * c + camera_up * s;
+			Vec3 use_up = camera_up * c - camera_right * s;
+
+			Vec3 corners[] = { pos - use_right - use_up, pos - use_right + use_up, pos + use_right + use_up, pos + use_right - use_up };
+			float uv[][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+			for(unsigned int j = 0; j < 4; ++j, ++out)
+			{
+				out->x = corners[j].x;	out->y = corners[j].y;	out->z = corners[j].z;
+				out->u = uv[j][0];		out->v = uv[j][1];		out->w = w;
+			}
+		}
+		return out - start;
+	}
+
+	unsigned int Expand(const BillboardMaterial::Batch& batch, const Vec3& camera_position, BillboardVertex* out)
+	{
+		BillboardVertex* start = out;
+		for(unsigned int i = 0; i < batch.count; ++i)
+		{
+			const BillboardMaterial::NodeData& s = batch.segments[i];
+
+			Vec3 normal = Vec3::Cross(s.front - camera_position, s.front - s.back);
+			normal *= s.width * 0.5f / normal.ComputeMagnitude();
+
+			Vec3 positions[] = { s.front + normal, s.front, s.back, s.back + normal, s.front, s.front - normal, s.back - normal, s.back };
+			float us[] = { s.front_u, s.front_u, s.back_u, s.back_u, s.front_u, s.front_u, s.back_u, s.back_u };
+			float vs[] = { 0.0f, 0.5f, 0.5f, 0.0f, 0.5f, 1.0f, 1.0f, 0.5f };
+			for(unsigned int j = 0; j < 8; ++j, ++out)
+			{
+				out->x = positions[j].x;	out->y = positions[j].y;	out->z = positions[j].z;
+				out->u = us[j];				out->v = vs[j];
+				out->red = s.red;			out->green = s.green;		out->blue = s.blue;		out->alpha = s.alpha;
+			}
+		}
+		return out - start;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkRandom random(12345);
+	int result = 0;
+
+	// sprites
+	vector<float> x(particle_count), y(particle_count), z(particle_count), radius(particle_count), cos_angle(particle_count), sin_angle(particle_count), age(particle_count), max_age(particle_count);
+	for(unsigned int i = 0; i < particle_count; ++i)
+	{
+		x[i] = random.Next(-50, 50);
+		y[i] = random.Next(0, 10);
+		z[i] = random.Next(-50, 50);
+		radius[i] = random.Next(0.05f, 0.5f);
+
+		float angle = random.Next(0.0f, 6.2831853f);
+		cos_angle[i] = cosf(angle);
+		sin_angle[i] = sinf(angle);
+
+		max_age[i] = 1.0f;
+		age[i] = random.Next(-0.125f, 1.125f);
+	}
+
+	ParticleMaterialBatch batch(particle_count);
+	batch.x = &x[0];					batch.y = &y[0];					batch.z = &z[0];
+	batch.radius = &radius[0];
+	batch.cos_angle = &cos_angle[0];	batch.sin_angle = &sin_angle[0];
+	batch.age = &age[0];				batch.max_age = &max_age[0];
+
+	vector<ParticleVertex> particle_vertices(particle_count * 4);
+
+	unsigned int old_written = 0, new_written = 0;
+	double start = GetSeconds();
+	for(unsigned int i = 0; i < repeats; ++i)
+		old_written = Old::Expand(batch, camera_right, camera_up, &particle_vertices[0]);
+	double old_time = GetSeconds() - start;
+	double old_checksum = Checksum(particle_vertices, old_written);
+
+	start = GetSeconds();
+	for(unsigned int i = 0; i < repeats; ++i)
+		new_written = batch.Expand(camera_right, camera_up, &particle_vertices[0]);
+	double new_time = GetSeconds() - start;
+	double new_checksum = Checksum(particle_vertices, new_written);
+
+	char extra[128];
+	sprintf(extra, "%u vertices, checksum %.6e", old_written, old_checksum);
+	Report("one at a time: 100,000 sprites", old_time * 1000.0 / repeats, extra);
+	sprintf(extra, "%u vertices, checksum %.6e", new_written, new_checksum);
+	Report("ParticleMaterialBatch::Expand: 100,000 sprites", new_time * 1000.0 / repeats, extra);
+
+	if(old_written != new_written)
+	{
+		printf("FAILED: the sprites' vertex counts differ\n");
+		result = 1;
+	}
+
+	// trail segments
+	vector<BillboardMaterial::NodeData> segments;
+	for(unsigned int i = 0; i < segment_count; ++i)
+	{
+		Vec3 front(random.Next(-50, 50), random.Next(0, 10), random.Next(-50, 50));
+		Vec3 back = front + Vec3(random.Next(-0.5f, 0.5f), random.Next(-0.5f, 0.5f), random.Next(-0.5f, 0.5f));
+		segments.push_back(BillboardMaterial::NodeData(front, back, random.Next(0.02f, 0.1f)));
+	}
+	BillboardMaterial::Batch trail(&segments[0], segment_count);
+
+	vector<BillboardVertex> segment_vertices(segment_count * 8);
+
+	start = GetSeconds();
+	for(unsigned int i = 0; i < repeats; ++i)
+		old_written = Old::Expand(trail, camera_position, &segment_vertices[0]);
+	old_time = GetSeconds() - start;
+	old_checksum = Checksum(segment_vertices, old_written);
+
+	start = GetSeconds();
+	for(unsigned int i = 0; i < repeats; ++i)
+		new_written = trail.Expand(camera_position, &segment_vertices[0]);
+	new_time = GetSeconds() - start;
+	new_checksum = Checksum(segment_vertices, new_written);
+
+	sprintf(extra, "%u vertices, checksum %.6e", old_written, old_checksum);
+	Report("one at a time: 100,000 segments", old_time * 1000.0 / repeats, extra);
+	sprintf(extra, "%u vertices, checksum %.6e", new_written, new_checksum);
+	Report("BillboardMaterial::Batch::Expand: 100,000 segments", new_time * 1000.0 / repeats, extra);
+
+	if(old_written != new_written)
+	{
+		printf("FAILED: the trail segments' vertex counts differ\n");
+		result = 1;
+	}
+
+	return result;
+}
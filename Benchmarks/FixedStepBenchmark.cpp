@@ -0,0 +1,123 @@
+#include "RagdollScene.h"
+
+/*
+ * 100 ragdolls falling onto the nbridge level, stepped with an uneven frame time (mostly 60 fps, some 30 fps frames,
+ * and a 100 ms hitch every couple of seconds), once with one variable-length step per Update and once in fixed-step
+ * mode; reports the time per Update, the solver's share of it, and the substep counts from PhysicsStepStats. Then
+ * it checks that a second of 144 fps frames simulates a second's worth of fixed steps
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ragdoll_count = 100;
+	const unsigned int frames = 600;
+
+	float FrameTime(unsigned int frame)
+	{
+		if(frame % 150 == 149)
+			return 0.1f;
+		else if(frame % 7 == 3)
+			return 1.0f / 30.0f;
+		else
+			return 1.0f / 60.0f;
+	}
+
+	void Run(const string& name, float step, unsigned int max_substeps)
+	{
+		PhysicsWorld* world = new PhysicsWorld();
+		world->SetFixedTimeStep(step, max_substeps);
+
+		RagdollScene scene(world);
+		if(scene.Load())
+		{
+			BenchmarkRandom random(12345);
+			scene.AddRagdolls(ragdoll_count, random);
+
+			TimingInfo time(0.0f, 0.0f);
+			double total_ms = 0.0, solver_ms = 0.0, worst_ms = 0.0;
+			unsigned int substeps = 0, dropped = 0;
+
+			for(unsigned int i = 0; i < frames; ++i)
+			{
+				time.elapsed = FrameTime(i);
+				time.total += time.elapsed;
+
+				world->Update(time);
+
+				const PhysicsStepStats& stats = world->GetStepStats();
+				total_ms += stats.step_ms;
+				solver_ms += stats.solver_ms;
+				worst_ms = max(worst_ms, (double)stats.step_ms);
+				substeps += stats.substeps;
+				dropped += stats.dropped_steps;
+			}
+
+			stringstream extra;
+			extra << "worst " << worst_ms << " ms, solver " << solver_ms / frames << " ms, " << substeps << " substeps, " << dropped << " dropped";
+			Report(name, total_ms / frames, extra.str());
+		}
+
+		scene.Dispose();
+		world->Dispose();
+		delete world;
+	}
+
+	// the fixed steps should keep pace with the frames, however short they are
+	bool CheckHighFrameRate()
+	{
+		PhysicsWorld* world = new PhysicsWorld();
+		world->SetFixedTimeStep(1.0f / 60.0f, 4);
+
+		RagdollScene scene(world);
+		bool ok = scene.Load();
+		if(ok)
+		{
+			BenchmarkRandom random(12345);
+			scene.AddRagdolls(1, random);
+
+			TimingInfo time(1.0f / 144.0f, 0.0f);
+			unsigned int substeps = 0;
+			for(unsigned int i = 0; i < 144; ++i)
+			{
+				time.total += time.elapsed;
+				world->Update(time);
+
+				const PhysicsStepStats& stats = world->GetStepStats();
+				substeps += stats.substeps;
+
+				if(stats.interpolation < 0.0f || stats.interpolation > 1.0f || stats.substeps > 1)
+				{
+					printf("at 144 fps, frame %u had %u substeps and interpolation %f\n", i, stats.substeps, stats.interpolation);
+					ok = false;
+				}
+			}
+
+			if(substeps < 59 || substeps > 60)
+			{
+				printf("one second at 144 fps ran %u steps of 1/60 s\n", substeps);
+				ok = false;
+			}
+		}
+
+		scene.Dispose();
+		world->Dispose();
+		delete world;
+
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	printf("%u ragdolls, %u frames of uneven length\n", ragdoll_count, frames);
+
+	Run("variable step", 0.0f, 0);
+	Run("fixed step of 1/60 s, at most 4 per Update", 1.0f / 60.0f, 4);
+
+	if(!CheckHighFrameRate())
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/ParticleSystem.h"
+#include "../CibraryEngine/ParticleMaterial.h"
+#include "../CibraryEngine/BillboardMaterial.h"
+#include "../CibraryEngine/Texture2D.h"
+#include "../CibraryEngine/SceneRenderer.h"
+#include "../CibraryEngine/RenderNode.h"
+#include "../CibraryEngine/CameraView.h"
+#include "../CibraryEngine/TimingInfo.h"
+
+/*
+ * A ParticleSystem kept topped up to 100,000 particles, half of them dirt (a sprite, no trail, as StaticLevelGeometry emits)
+ * and half blood (a trail, no sprite, as Dood emits), with the same lifetimes, gravity and damping the game uses. Times
+ * Emit, Update and Vis each frame; nothing is drawn, so no GL context is needed. Update uses the SSE kernel or the scalar
+ * one, whichever ParticleSystem.cpp was built with; the checksum of the positions Vis hands over should come out the same
+ * (to within float rounding) either way
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int particle_count = 100000;
+	const unsigned int frames = 200;
+
+	struct Totals
+	{
+		unsigned int sprites, segments;
+		double checksum;
+
+		Totals() : sprites(0), segments(0), checksum(0.0) { }
+	};
+
+	// adds up what the particle system's RenderNodes would draw
+	void Tally(SceneRenderer& renderer, ParticleMaterial* sprite_material, Totals& totals)
+	{
+		for(vector<RenderNode>::iterator iter = renderer.objects.begin(); iter != renderer.objects.end(); ++iter)
+		{
+			if(iter->material == sprite_material)
+			{
+				ParticleMaterialBatch* batch = (ParticleMaterialBatch*)iter->data;
+
+				totals.sprites += batch->count;
+				for(unsigned int i = 0; i < batch->count; ++i)
+					totals.checksum += batch->x[i] + batch->y[i] + batch->z[i];
+			}
+			else
+			{
+				BillboardMaterial::Batch* batch = (BillboardMaterial::Batch*)iter->data;
+
+				totals.segments += batch->count;
+				for(unsigned int i = 0; i < batch->count; ++i)
+				{
+					const BillboardMaterial::NodeData& segment = batch->segments[i];
+					totals.checksum += segment.front.x + segment.front.y + segment.front.z;
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkRandom random(12345);
+
+	Texture2D dirt_texture(1, 1, NULL, false, false), blood_texture(1, 1, NULL, false, false);
+	ParticleMaterial* dirt_material = new ParticleMaterial(&dirt_texture, Alpha);
+	BillboardMaterial* blood_material = new BillboardMaterial(&blood_texture, Alpha);
+
+	CameraView camera(Vec3(0, 10, -40), Vec3(0, 0, 1), Vec3(0, 1, 0), -0.16f, 0.16f, 0.09f, -0.09f, 0.1f, 400.0f);
+	SceneRenderer renderer(&camera);
+
+	ParticleSystem particles;
+	TimingInfo time(1.0f / 60.0f, 0.0f);
+
+	double emit_time = 0.0, update_time = 0.0, vis_time = 0.0;
+	unsigned int emitted = 0;
+	Totals totals;
+
+	for(unsigned int frame = 0; frame < frames; ++frame)
+	{
+		// replace the particles which have gone away, alternating between dirt and blood
+		double start = GetSeconds();
+		for(unsigned int i = particles.GetParticleCount(); i < particle_count; ++i, ++emitted)
+		{
+			Vec3 pos(random.Next(-20.0f, 20.0f), random.Next(0.0f, 2.0f), random.Next(-20.0f, 20.0f));
+			Vec3 vel(random.Next(-5.0f, 5.0f), random.Next(0.0f, 5.0f), random.Next(-5.0f, 5.0f));
+
+			if(emitted % 2 == 0)
+				particles.Emit(dirt_material, NULL, pos, vel, 0.05f, -1.5707963f, 1.0f, 9.8f, 2.0f);
+			else
+				particles.Emit(NULL, blood_material, pos, vel, random.Next(0.05f, 0.15f), random.Next(0.0f, 6.2831853f), 0.25f, 9.8f, 0.05f);
+		}
+		emit_time += GetSeconds() - start;
+
+		start = GetSeconds();
+		particles.Update(time);
+		update_time += GetSeconds() - start;
+
+		start = GetSeconds();
+		particles.Vis(&renderer);
+		vis_time += GetSeconds() - start;
+
+		Tally(renderer, dirt_material, totals);
+		renderer.Cleanup();
+
+		time.total += time.elapsed;
+	}
+
+	printf("%u particles, %u frames, %u emitted in all\n", particle_count, frames, emitted);
+
+	Report("ParticleSystem::Emit", emit_time * 1000.0 / frames);
+	Report("ParticleSystem::Update", update_time * 1000.0 / frames);
+
+	char extra[128];
+	sprintf(extra, "%u sprites and %u trail segments per frame", totals.sprites / frames, totals.segments / frames);
+	Report("ParticleSystem::Vis", vis_time * 1000.0 / frames, extra);
+
+	printf("checksum of positions: %.6e\n", totals.checksum);
+
+	particles.Clear();
+
+	dirt_material->Dispose();
+	delete dirt_material;
+	blood_material->Dispose();
+	delete blood_material;
+
+	return 0;
+}
@@ -0,0 +1,412 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/NavGraph.h"
+#include "../CibraryEngine/Pathfinding.h"
+
+/*
+ * A* searches between 500 random pairs of nodes of Files/Levels/TestNav.nav, with the PathSearch from before the
+ * binary heap and search arenas (reproduced below, as it was) and with the current one; reports nodes expanded per
+ * millisecond, since the two break ties between equal costs differently and so don't expand quite the same nodes.
+ * The PathService cache is cleared after every search, and flow fields are turned off, so each search is run from
+ * scratch.
+ *
+ * Then HierarchicalPathSearch is compared with PathSearch, on the same pairs of TestNav.nav and on 500 pairs of a
+ * grid laid out the way TestGame's BuildNavGraph lays it out (over a made-up heightfield, with a few walls in it),
+ * each with clusters 8 columns across; reports expansions and how much longer the hierarchical paths are
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int search_count = 500;
+
+	// the PathSearch implementation from before the binary heap, with a count of the nodes expanded added
+	namespace Old
+	{
+		struct Edge
+		{
+			unsigned int to;
+			float cost;
+
+			Edge() : to(0), cost(0) { }
+			Edge(unsigned int to, float cost) : to(to), cost(cost) { }
+		};
+		struct PriorityQueue
+		{
+			list<unsigned int> queue;
+			vector<float>* priorities;
+
+			PriorityQueue(vector<float>* priorities) : queue(), priorities(priorities) { }
+
+			unsigned int Pop()
+			{
+				if(queue.empty())
+					return 0;
+				else
+				{
+					unsigned int result = queue.front();
+					queue.pop_front();
+					return result;
+				}
+			}
+
+			void Insert(unsigned int node)
+			{
+				float priority = (*priorities)[node];
+				list<unsigned int>::iterator iter;
+				for(iter = queue.begin(); iter != queue.end(); ++iter)
+					if((*priorities)[*iter] > priority)
+					{
+						queue.insert(iter, node);
+						break;
+					}
+				if(iter == queue.end())
+					queue.push_back(node);
+			}
+
+			bool Empty() { return queue.empty(); }
+
+			void ChangePriority(unsigned int node)
+			{
+				for(list<unsigned int>::iterator iter = queue.begin(); iter != queue.end(); ++iter)
+					if(*iter == node)
+					{
+						queue.erase(iter);
+						break;
+					}
+				Insert(node);
+			}
+		};
+
+		struct PathSearch
+		{
+			unsigned int graph;
+			unsigned int source;
+			unsigned int target;
+
+			bool finished;
+			unsigned int expansions;
+
+			list<unsigned int> solution;
+
+			vector<unsigned int> nodes;
+			vector<Edge*> shortest_path_tree;
+			vector<Edge*> search_frontier;
+			map<unsigned int, unsigned int> node_to_index;
+			vector<float> f_costs;
+			vector<float> g_costs;
+			PriorityQueue pq;
+
+			PathSearch(unsigned int graph, unsigned int source, unsigned int target) :
+				graph(graph),
+				source(source),
+				target(target),
+				finished(false),
+				expansions(0),
+				solution(),
+				nodes(NavGraph::GetAllNodes(graph)),
+				shortest_path_tree(nodes.size(), NULL),
+				search_frontier(nodes.size(), NULL),
+				node_to_index(),
+				f_costs(nodes.size(), 0.0f),
+				g_costs(nodes.size(), 0.0f),
+				pq(&f_costs)
+			{
+				for(unsigned int i = 0; i < nodes.size(); ++i)
+					node_to_index[nodes[i]] = i;
+
+				pq.Insert(node_to_index[source]);
+			}
+
+			void Solve()
+			{
+				while(!pq.Empty())
+				{
+					unsigned int closest = pq.Pop();
+					++expansions;
+
+					shortest_path_tree[closest] = search_frontier[closest];
+					if(nodes[closest] == target)
+					{
+						finished = true;
+						break;
+					}
+
+					Vec3 pos_a = NavGraph::GetNodePosition(graph, nodes[closest]);
+
+					vector<unsigned int> edges = NavGraph::GetNodeEdges(graph, nodes[closest], NavGraph::PD_OUT);
+					for(vector<unsigned int>::iterator iter = edges.begin(); iter != edges.end(); ++iter)
+					{
+						Vec3 pos_b = NavGraph::GetNodePosition(graph, *iter);
+						float edge_cost = NavGraph::GetEdgeCost(graph, nodes[closest], *iter);
+						float g_cost = g_costs[closest] + edge_cost;
+
+						unsigned int index = node_to_index[*iter];
+
+						if(search_frontier[index] == NULL || g_cost < g_costs[index] && shortest_path_tree[index] == NULL)
+						{
+							float h_cost = (pos_a - pos_b).ComputeMagnitude();
+							f_costs[index] = g_cost + h_cost;
+							g_costs[index] = g_cost;
+							if(search_frontier[index] == NULL)
+								pq.Insert(index);
+							else
+							{
+								pq.ChangePriority(index);
+								delete search_frontier[index];
+							}
+							search_frontier[index] = new Edge(nodes[closest], edge_cost);
+						}
+					}
+				}
+
+				finished = true;
+
+				list<unsigned int> results;
+				unsigned int cur = target;
+				while(cur != source)
+				{
+					Edge* edge = shortest_path_tree[node_to_index[cur]];
+					if(edge != NULL)
+					{
+						results.push_back(cur);
+						cur = edge->to;
+					}
+					else
+					{
+						results.clear();
+						break;
+					}
+				}
+				results.reverse();
+
+				for(vector<Edge*>::iterator iter = search_frontier.begin(); iter != search_frontier.end(); ++iter)
+					delete *iter;
+
+				solution = results;
+			}
+		};
+	}
+
+	void ReportRate(const string& name, double seconds, unsigned int expansions, unsigned int paths_found)
+	{
+		stringstream extra;
+		extra << expansions << " nodes expanded, " << (unsigned int)(expansions / (seconds * 1000.0)) << " per ms, " << paths_found << " paths found";
+		Report(name, seconds * 1000.0, extra.str());
+	}
+
+	vector<pair<unsigned int, unsigned int> > PickEndpoints(const vector<unsigned int>& nodes, BenchmarkRandom& random)
+	{
+		vector<pair<unsigned int, unsigned int> > endpoints;
+		for(unsigned int i = 0; i < search_count; ++i)
+			endpoints.push_back(pair<unsigned int, unsigned int>(nodes[random.Next() % nodes.size()], nodes[random.Next() % nodes.size()]));
+		return endpoints;
+	}
+
+	float GetPathCost(unsigned int graph, unsigned int source, const list<unsigned int>& path)
+	{
+		float cost = 0.0f;
+		unsigned int prev = source;
+		for(list<unsigned int>::const_iterator iter = path.begin(); iter != path.end(); ++iter)
+		{
+			cost += NavGraph::GetEdgeCost(graph, prev, *iter);
+			prev = *iter;
+		}
+		return cost;
+	}
+
+	// layout of the grid of nav nodes generated by TestGame's BuildNavGraph
+	const unsigned int grid_res = 50;
+	const float grid_min = -98.0f, grid_max = 98.0f, grid_size = grid_max - grid_min;
+	const float grid_coeff = grid_size / grid_res;
+
+	// each NavHierarchy cluster covers this many columns of the nav grid on a side, as in TestGame
+	const unsigned int nav_cluster_res = 8;
+
+	// the same rule as TestGame's MaybeCreateEdge
+	void MaybeCreateEdge(unsigned int graph, unsigned int my_node, unsigned int other_node)
+	{
+		Vec3 delta = NavGraph::GetNodePosition(graph, other_node) - NavGraph::GetNodePosition(graph, my_node);
+
+		float dy = delta.y;
+		float dxz = sqrtf(delta.x * delta.x + delta.z * delta.z);
+		float slope = dy / dxz;
+		float cost = dxz + dy;
+		if(slope < 0.5f && dy > -8.0f)
+			NavGraph::NewEdge(graph, my_node, other_node, cost);
+	}
+
+	/**
+	 * Makes a graph the way BuildNavGraph does, with one node per column of the grid, on gently rolling ground, except where
+	 * three walls (each with a gap in it) leave no floor; each node gets edges to its eight neighbors
+	 */
+	unsigned int BuildGridGraph()
+	{
+		unsigned int graph = NavGraph::NewNavGraph(NULL);
+
+		vector<unsigned int> nodes(grid_res * grid_res, 0);
+		for(unsigned int i = 0; i < grid_res; ++i)
+			for(unsigned int j = 0; j < grid_res; ++j)
+			{
+				bool wall = (i == 12 && j < 40) || (i == 25 && j > 10) || (i == 37 && (j < 20 || j > 26));
+				if(wall)
+					continue;
+
+				float x = grid_min + (float)i * grid_coeff, z = grid_min + (float)j * grid_coeff;
+				nodes[i * grid_res + j] = NavGraph::NewNode(graph, Vec3(x, 4.0f * sin(x * 0.05f) * cos(z * 0.04f), z));
+			}
+
+		for(unsigned int i = 0; i < grid_res; ++i)
+			for(unsigned int j = 0; j < grid_res; ++j)
+			{
+				unsigned int my_node = nodes[i * grid_res + j];
+				if(my_node == 0)
+					continue;
+
+				for(int di = -1; di <= 1; ++di)
+					for(int dj = -1; dj <= 1; ++dj)
+					{
+						int oi = (int)i + di, oj = (int)j + dj;
+						if((di != 0 || dj != 0) && oi >= 0 && oj >= 0 && oi < (int)grid_res && oj < (int)grid_res && nodes[oi * grid_res + oj] != 0)
+							MaybeCreateEdge(graph, my_node, nodes[oi * grid_res + oj]);
+					}
+			}
+
+		return graph;
+	}
+
+	/** Runs PathSearch and HierarchicalPathSearch between each pair of endpoints; returns false if they didn't find paths between the same pairs */
+	bool CompareHierarchical(const string& name, unsigned int graph, float cluster_size, Vec3 origin, const vector<pair<unsigned int, unsigned int> >& endpoints)
+	{
+		double start = GetSeconds();
+		NavHierarchy hierarchy(graph, cluster_size, origin);
+		double build_time = GetSeconds() - start;
+
+		stringstream build_extra;
+		build_extra << hierarchy.GetClusterCount() << " clusters, " << hierarchy.GetEntranceCount() << " entrances";
+		Report(name + ": building the NavHierarchy", build_time * 1000.0, build_extra.str());
+
+		vector<list<unsigned int> > flat_paths, hierarchical_paths;
+		unsigned int flat_expansions = 0, flat_found = 0, hierarchical_expansions = 0, hierarchical_found = 0;
+
+		start = GetSeconds();
+		for(unsigned int i = 0; i < endpoints.size(); ++i)
+		{
+			PathSearch search(graph, endpoints[i].first, endpoints[i].second);
+			search.Solve();
+
+			flat_expansions += search.GetExpansions();
+			flat_paths.push_back(search.GetSolution());
+			flat_found += flat_paths.back().empty() ? 0 : 1;
+
+			search.Dispose();
+			PathService::ClearCache();
+		}
+		ReportRate(name + ": PathSearch", GetSeconds() - start, flat_expansions, flat_found);
+
+		start = GetSeconds();
+		for(unsigned int i = 0; i < endpoints.size(); ++i)
+		{
+			HierarchicalPathSearch search(&hierarchy, endpoints[i].first, endpoints[i].second);
+			search.Solve();
+
+			hierarchical_expansions += search.GetExpansions();
+			hierarchical_paths.push_back(search.GetSolution());
+			hierarchical_found += hierarchical_paths.back().empty() ? 0 : 1;
+
+			search.Dispose();
+			PathService::ClearCache();			// endpoints in the same cluster are searched with a PathSearch
+		}
+		ReportRate(name + ": HierarchicalPathSearch", GetSeconds() - start, hierarchical_expansions, hierarchical_found);
+
+		// how much more the hierarchical paths cost, for the pairs both found paths between (excluding a node's path to itself)
+		float total_flat = 0.0f, total_hierarchical = 0.0f, worst_ratio = 1.0f;
+		unsigned int mismatches = 0;
+		for(unsigned int i = 0; i < endpoints.size(); ++i)
+		{
+			if(flat_paths[i].empty() != hierarchical_paths[i].empty())
+				++mismatches;
+			else if(!flat_paths[i].empty())
+			{
+				float flat_cost = GetPathCost(graph, endpoints[i].first, flat_paths[i]);
+				float hierarchical_cost = GetPathCost(graph, endpoints[i].first, hierarchical_paths[i]);
+
+				total_flat += flat_cost;
+				total_hierarchical += hierarchical_cost;
+				if(flat_cost > 0.0f)
+					worst_ratio = max(worst_ratio, hierarchical_cost / flat_cost);
+			}
+		}
+
+		printf("%s: hierarchical paths cost %.3f times as much overall, %.3f times at worst; %u searches found a path with only one of them\n", name.c_str(), total_hierarchical / total_flat, worst_ratio, mismatches);
+
+		hierarchy.Dispose();
+
+		return mismatches == 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int graph = LoadNavGraph(NULL, "Files/Levels/TestNav.nav");
+	vector<unsigned int> nodes = graph != 0 ? NavGraph::GetAllNodes(graph) : vector<unsigned int>();
+	if(nodes.size() < 2)
+	{
+		printf("couldn't load Files/Levels/TestNav.nav; run this from the repository root\n");
+		return 1;
+	}
+
+	BenchmarkRandom random(12345);
+	vector<pair<unsigned int, unsigned int> > endpoints = PickEndpoints(nodes, random);
+
+	printf("%u nodes, %u searches\n", nodes.size(), search_count);
+
+	unsigned int old_expansions = 0, old_found = 0;
+	double start = GetSeconds();
+	for(unsigned int i = 0; i < search_count; ++i)
+	{
+		Old::PathSearch search(graph, endpoints[i].first, endpoints[i].second);
+		search.Solve();
+
+		old_expansions += search.expansions;
+		old_found += search.solution.empty() ? 0 : 1;
+	}
+	ReportRate("old PathSearch (sorted list, map of nodes)", GetSeconds() - start, old_expansions, old_found);
+
+	PathService::flow_field_threshold = 0;
+
+	unsigned int new_expansions = 0, new_found = 0;
+	start = GetSeconds();
+	for(unsigned int i = 0; i < search_count; ++i)
+	{
+		PathSearch search(graph, endpoints[i].first, endpoints[i].second);
+		search.Solve();
+
+		new_expansions += search.GetExpansions();
+		new_found += search.GetSolution().empty() ? 0 : 1;
+
+		search.Dispose();
+		PathService::ClearCache();
+	}
+	ReportRate("PathSearch (binary heap, search arenas)", GetSeconds() - start, new_expansions, new_found);
+
+	// TestNav.nav was made by an older BuildNavGraph, with 25 columns 7.84 units apart, starting at -98
+	printf("\n");
+	const float testnav_coeff = 196.0f / 25.0f;
+	bool ok = CompareHierarchical("TestNav", graph, testnav_coeff * nav_cluster_res, Vec3(-98.0f - testnav_coeff * 0.5f, 0, -98.0f - testnav_coeff * 0.5f), endpoints);
+
+	NavGraph::DeleteNavGraph(graph);
+
+	unsigned int grid = BuildGridGraph();
+	vector<unsigned int> grid_nodes = NavGraph::GetAllNodes(grid);
+	sort(grid_nodes.begin(), grid_nodes.end());				// so the endpoints don't depend on hash order
+
+	printf("\n%u nodes in the grid\n", grid_nodes.size());
+	vector<pair<unsigned int, unsigned int> > grid_endpoints = PickEndpoints(grid_nodes, random);
+	ok &= CompareHierarchical("grid", grid, grid_coeff * nav_cluster_res, Vec3(grid_min - grid_coeff * 0.5f, 0, grid_min - grid_coeff * 0.5f), grid_endpoints);
+
+	NavGraph::DeleteNavGraph(grid);
+
+	return ok ? 0 : 1;
+}
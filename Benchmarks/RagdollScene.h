@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Benchmark.h"
+
+#include "../CibraryEngine/Physics.h"
+#include "../CibraryEngine/Matrix.h"
+#include "../CibraryEngine/UberModel.h"
+#include "../CibraryEngine/Sphere.h"
+
+/*
+ * A headless physics scene shared by the physics benchmarks and Tests/PhysicsDeterminismTest: the nbridge level
+ * geometry, with soldier ragdolls dropped onto it. The ragdolls are built the way Corpse builds them (same shapes,
+ * joints and body settings), but from the rest pose, since there's no character to take the pose from
+ */
+namespace Benchmarks
+{
+	using namespace CibraryEngine;
+
+	class RagdollScene
+	{
+		public:
+
+			// same values as StaticLevelGeometry::collision_group and Shootable::collision_group in the TestProject
+			static const short level_group = 0x100;
+			static const short ragdoll_group = 0x80;
+
+			struct Ragdoll
+			{
+				vector<RigidBodyInfo*> bodies;
+				vector<btCollisionShape*> shapes;			// the shape of each body; these belong to the model
+				vector<ConeTwistConstraint*> constraints;
+				float total_mass;
+
+				Ragdoll() : bodies(), shapes(), constraints(), total_mass(0) { }
+			};
+
+			PhysicsWorld* physics;
+
+			UberModel* level_model;
+			UberModel* ragdoll_model;
+
+			RigidBodyInfo* level_body;
+			vector<Ragdoll> ragdolls;
+
+			RagdollScene(PhysicsWorld* physics) : physics(physics), level_model(NULL), ragdoll_model(NULL), level_body(NULL), ragdolls() { }
+
+			/** Loads the models and adds the level to the world; returns false (after saying why) if the models couldn't be loaded */
+			bool Load()
+			{
+				if(UberModelLoader::LoadZZZ(level_model, "Files/Models/nbridge.zzz") != 0 || level_model->bone_physics.empty())
+				{
+					printf("couldn't load the collision shape of Files/Models/nbridge.zzz; run this from the repository root\n");
+					return false;
+				}
+				if(UberModelLoader::LoadZZZ(ragdoll_model, "Files/Models/soldier.zzz") != 0 || ragdoll_model->bone_physics.empty())
+				{
+					printf("couldn't load the bone physics of Files/Models/soldier.zzz; run this from the repository root\n");
+					return false;
+				}
+
+				level_body = new RigidBodyInfo(level_model->bone_physics[0].shape, MassInfo(), Vec3(), Quaternion::Identity(), level_group);
+				physics->AddRigidBody(level_body);
+
+				return true;
+			}
+
+			/**
+			 * Drops count ragdolls onto the level, in a grid around its middle with 2 units between them; each one starts a few units above
+			 * the ground below it, with a random heading and a little random velocity, so they land in a tangle
+			 */
+			void AddRagdolls(unsigned int count, BenchmarkRandom& random)
+			{
+				Sphere bounds = level_model->GetBoundingSphere();
+				unsigned int side = (unsigned int)ceil(sqrt(float(count)));
+
+				for(unsigned int i = 0; i < count; ++i)
+				{
+					float x = bounds.center.x + (float(i % side) - side * 0.5f) * 2.0f;
+					float z = bounds.center.z + (float(i / side) - side * 0.5f) * 2.0f;
+
+					btVector3 top(x, bounds.center.y + bounds.radius, z), bottom(x, bounds.center.y - bounds.radius, z);
+					btCollisionWorld::ClosestRayResultCallback ground(top, bottom);
+					physics->RayTest(Vec3(top.getX(), top.getY(), top.getZ()), Vec3(bottom.getX(), bottom.getY(), bottom.getZ()), ground, level_group);
+
+					float y = ground.hasHit() ? ground.m_hitPointWorld.getY() : bounds.center.y;
+
+					Quaternion ori = Quaternion::FromAxisAngle(0, 1, 0, random.Next(0, 6.2831853f));
+					Vec3 vel = Vec3(random.Next(-2, 2), random.Next(-1, 1), random.Next(-2, 2));
+
+					AddRagdoll(Vec3(x, y + random.Next(1.0f, 4.0f), z), ori, vel);
+				}
+			}
+
+			void AddRagdoll(Vec3 pos, Quaternion ori, Vec3 vel)
+			{
+				Ragdoll ragdoll;
+
+				const vector<UberModel::Bone>& bones = ragdoll_model->bones;
+				vector<int> body_indices(bones.size(), -1);
+				vector<UberModel::BonePhysics*> bone_physes(bones.size(), (UberModel::BonePhysics*)NULL);
+
+				Mat4 whole_xform = Mat4::FromPositionAndOrientation(pos, ori);
+
+				for(unsigned int i = 0; i < bones.size(); ++i)
+				{
+					UberModel::BonePhysics* phys = NULL;
+					for(unsigned int j = 0; j < ragdoll_model->bone_physics.size(); ++j)
+						if(ragdoll_model->bone_physics[j].bone_name == bones[i].name)
+							phys = &ragdoll_model->bone_physics[j];
+
+					if(phys == NULL || phys->shape == NULL)
+						continue;
+
+					bone_physes[i] = phys;
+
+					RigidBodyInfo* rigid_body = new RigidBodyInfo(phys->shape, MassInfo::FromCollisionShape(phys->shape, phys->mass), whole_xform.TransformVec3(bones[i].pos, 1), ori, ragdoll_group);
+					rigid_body->SetLinearVelocity(vel);
+
+					// same as Corpse
+					rigid_body->SetDamping(0.05f, 0.85f);
+					rigid_body->SetDeactivationTime(0.8f);
+					rigid_body->SetSleepingThresholds(1.6f, 2.5f);
+
+					rigid_body->SetFriction(1.0f);
+					rigid_body->SetRestitution(0.01f);
+
+					physics->AddRigidBody(rigid_body);
+					ragdoll.total_mass += phys->mass;
+
+					body_indices[i] = ragdoll.bodies.size();
+					ragdoll.bodies.push_back(rigid_body);
+					ragdoll.shapes.push_back(phys->shape);
+				}
+
+				for(unsigned int i = 0; i < bones.size(); ++i)
+				{
+					unsigned int parent = bones[i].parent;							// 1-based; 0 means it's a root bone
+					if(body_indices[i] == -1 || parent == 0 || body_indices[parent - 1] == -1)
+						continue;
+
+					UberModel::BonePhysics* phys = bone_physes[i];
+
+					ConeTwistConstraint* c = new ConeTwistConstraint(ragdoll.bodies[body_indices[i]], ragdoll.bodies[body_indices[parent - 1]], Quaternion::Identity(), Vec3(), phys->ori, phys->pos);
+					c->SetLimit(phys->span);
+					c->SetDamping(0.1f);
+
+					physics->AddConstraint(c, true);
+					ragdoll.constraints.push_back(c);
+				}
+
+				ragdolls.push_back(ragdoll);
+			}
+
+			unsigned int GetBodyCount()
+			{
+				unsigned int total = 0;
+				for(vector<Ragdoll>::iterator iter = ragdolls.begin(); iter != ragdolls.end(); ++iter)
+					total += iter->bodies.size();
+				return total;
+			}
+
+			unsigned int GetActiveBodyCount()
+			{
+				unsigned int total = 0;
+				for(vector<Ragdoll>::iterator iter = ragdolls.begin(); iter != ragdolls.end(); ++iter)
+					for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+						if((*jter)->IsActive())
+							++total;
+				return total;
+			}
+
+			/** Steps the world frames times at 60 fps; returns the average time per step, in milliseconds */
+			double Run(unsigned int frames)
+			{
+				TimingInfo time(1.0f / 60.0f, 0.0f);
+
+				double start = GetSeconds();
+				for(unsigned int i = 0; i < frames; ++i)
+				{
+					physics->Update(time);
+					time.total += time.elapsed;
+				}
+
+				return (GetSeconds() - start) * 1000.0 / frames;
+			}
+
+			/** Takes everything back out of the world and deletes it; the shapes belong to the models, which are disposed of last */
+			void Dispose()
+			{
+				for(vector<Ragdoll>::iterator iter = ragdolls.begin(); iter != ragdolls.end(); ++iter)
+				{
+					for(vector<ConeTwistConstraint*>::iterator jter = iter->constraints.begin(); jter != iter->constraints.end(); ++jter)
+					{
+						physics->RemoveConstraint(*jter);
+						(*jter)->Dispose();
+						delete *jter;
+					}
+
+					for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+					{
+						physics->RemoveRigidBody(*jter);
+						(*jter)->DisposePreservingCollisionShape();
+						delete *jter;
+					}
+				}
+				ragdolls.clear();
+
+				if(level_body != NULL)
+				{
+					physics->RemoveRigidBody(level_body);
+					level_body->DisposePreservingCollisionShape();
+					delete level_body;
+					level_body = NULL;
+				}
+
+				if(level_model != NULL)		{ level_model->Dispose();	delete level_model;		level_model = NULL; }
+				if(ragdoll_model != NULL)	{ ragdoll_model->Dispose();	delete ragdoll_model;	ragdoll_model = NULL; }
+			}
+	};
+}
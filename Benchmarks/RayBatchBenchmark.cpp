@@ -0,0 +1,129 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/Physics.h"
+#include "../CibraryEngine/UberModel.h"
+#include "../CibraryEngine/TaskPool.h"
+#include "../CibraryEngine/Sphere.h"
+
+/*
+ * 10,000 rays against the nbridge level geometry (Files/Models/nbridge.zzz), the way shots were traced before
+ * RayTestBatch (one RayTest each, collecting every hit in a callback, then sorting them), and with RayTestBatch on
+ * 0 to (cores - 1) worker threads. Needs Bullet, like the rest of the physics code
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ray_count = 10000;
+	const unsigned int repeats = 20;
+
+	// what Shot::MyRayResultCallback used to do
+	struct AllHitsCallback : public btCollisionWorld::RayResultCallback
+	{
+		vector<RayHit> hits;
+
+		btScalar addSingleResult(btCollisionWorld::LocalRayResult& ray_result, bool normal_in_world_space)
+		{
+			btVector3 normal = ray_result.m_hitNormalLocal;
+			hits.push_back(RayHit(ray_result.m_collisionObject->getUserPointer(), ray_result.m_hitFraction, Vec3(normal.getX(), normal.getY(), normal.getZ())));
+			return 1;
+		}
+	};
+
+	bool HitCloser(const RayHit& a, const RayHit& b) { return a.fraction < b.fraction; }
+
+	void RunBatch(PhysicsWorld* world, vector<RayQuery>& rays, unsigned int threads)
+	{
+		TaskPool* pool = threads > 0 ? new TaskPool(threads) : NULL;
+		RayBatchResult results;
+
+		world->RayTestBatch(&rays[0], rays.size(), results, pool);			// warm up, so the result vectors are already allocated
+
+		double start = GetSeconds();
+		for(unsigned int i = 0; i < repeats; ++i)
+			world->RayTestBatch(&rays[0], rays.size(), results, pool);
+		double elapsed = GetSeconds() - start;
+
+		stringstream name, extra;
+		name << "RayTestBatch, " << threads << " worker threads";
+		extra << results.hits.size() << " hits";
+		Report(name.str(), elapsed * 1000.0 / repeats, extra.str());
+
+		if(pool != NULL)
+		{
+			pool->Dispose();
+			delete pool;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	UberModel* model = NULL;
+	if(UberModelLoader::LoadZZZ(model, "Files/Models/nbridge.zzz") != 0 || model->bone_physics.empty())
+	{
+		printf("couldn't load the collision shape of Files/Models/nbridge.zzz; run this from the repository root\n");
+		return 1;
+	}
+
+	PhysicsWorld* world = new PhysicsWorld();
+
+	RigidBodyInfo* level = new RigidBodyInfo(model->bone_physics[0].shape, MassInfo(), Vec3(), Quaternion::Identity(), 0x100);
+	level->SetCustomCollisionEnabled(model);
+	world->AddRigidBody(level);
+
+	// rays between random points in the level's bounding sphere, about as long as the ones shots trace in a frame
+	Sphere bounds = model->GetBoundingSphere();
+	BenchmarkRandom random(12345);
+
+	vector<RayQuery> rays;
+	for(unsigned int i = 0; i < ray_count; ++i)
+	{
+		Vec3 from = bounds.center + Vec3(random.Next(-1, 1), random.Next(-1, 1), random.Next(-1, 1)) * bounds.radius;
+		Vec3 dir = Vec3::Normalize(Vec3(random.Next(-1, 1), random.Next(-1, 0.2f), random.Next(-1, 1)), 2.0f);
+		rays.push_back(RayQuery(from, from + dir, 0x100));
+	}
+
+	printf("%u rays, times are per batch of all of them\n", ray_count);
+
+	AllHitsCallback callback;
+	unsigned int callback_hits = 0;
+
+	double start = GetSeconds();
+	for(unsigned int i = 0; i < repeats; ++i)
+	{
+		callback_hits = 0;
+		for(vector<RayQuery>::iterator iter = rays.begin(); iter != rays.end(); ++iter)
+		{
+			callback.hits.clear();
+			callback.m_closestHitFraction = 1.0f;
+
+			world->RayTest(iter->from, iter->to, callback);
+			sort(callback.hits.begin(), callback.hits.end(), HitCloser);
+
+			callback_hits += callback.hits.size();
+		}
+	}
+	double elapsed = GetSeconds() - start;
+
+	stringstream extra;
+	extra << callback_hits << " hits";
+	Report("RayTest with an all-hits callback, one at a time", elapsed * 1000.0 / repeats, extra.str());
+
+	unsigned int cores = boost::thread::hardware_concurrency();
+	for(unsigned int threads = 0; threads < max(cores, 1u); threads = threads == 0 ? 1 : threads * 2)
+		RunBatch(world, rays, threads);
+
+	world->RemoveRigidBody(level);
+	level->DisposePreservingCollisionShape();
+	delete level;
+
+	world->Dispose();
+	delete world;
+
+	model->Dispose();
+	delete model;
+
+	return 0;
+}
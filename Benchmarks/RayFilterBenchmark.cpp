@@ -0,0 +1,128 @@
+#include "RagdollScene.h"
+
+#include "../CibraryEngine/Entity.h"
+
+/*
+ * Terrain height queries (the vertical rays of TestGame::GetTerrainHeight) through a pile of 200 ragdolls lying on
+ * the nbridge level, done the old way (every hit reaches the callback, which dynamic_casts its user pointer to find
+ * the level) and the new way (RayTest with the level's collision group as the mask, so the ragdoll bodies are skipped
+ * before any narrowphase test)
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ragdoll_count = 200;
+	const unsigned int settle_frames = 90;
+	const unsigned int ray_count = 10000;
+
+	// stand-ins for StaticLevelGeometry and the corpse's bone Shootables
+	struct LevelEntity : public Entity { LevelEntity() : Entity(NULL) { } };
+	struct BoneEntity : public Entity { BoneEntity() : Entity(NULL) { } };
+
+	// what TestGame::GetTerrainHeight's callback used to be
+	struct CastingCallback : public btCollisionWorld::RayResultCallback
+	{
+		float result;
+
+		btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
+		{
+			void* void_pointer = rayResult.m_collisionObject->getUserPointer();
+			if(void_pointer != NULL)
+			{
+				LevelEntity* level = dynamic_cast<LevelEntity*>((Entity*)void_pointer);
+				if(level != NULL)
+				{
+					float frac = rayResult.m_hitFraction;
+					if(frac > result)
+						result = frac;
+				}
+			}
+			return 1;
+		}
+	};
+
+	// what it is now
+	struct FilteredCallback : public btCollisionWorld::RayResultCallback
+	{
+		float result;
+
+		btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
+		{
+			float frac = rayResult.m_hitFraction;
+			if(frac > result)
+				result = frac;
+
+			return 1;
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	PhysicsWorld* world = new PhysicsWorld();
+	RagdollScene scene(world);
+	if(!scene.Load())
+		return 1;
+
+	BenchmarkRandom random(12345);
+	scene.AddRagdolls(ragdoll_count, random);
+
+	LevelEntity level_entity;
+	BoneEntity bone_entity;
+	scene.level_body->SetCustomCollisionEnabled(&level_entity);
+	for(vector<RagdollScene::Ragdoll>::iterator iter = scene.ragdolls.begin(); iter != scene.ragdolls.end(); ++iter)
+		for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+			(*jter)->SetCustomCollisionEnabled(&bone_entity);
+
+	scene.Run(settle_frames);						// let them land, so the rays go through the pile
+	printf("%u ragdolls, %u bodies; %u vertical rays over the pile\n", ragdoll_count, scene.GetBodyCount(), ray_count);
+
+	// the rays go over the area the ragdolls were dropped onto
+	Sphere bounds = scene.level_model->GetBoundingSphere();
+	float half_width = ceil(sqrt(float(ragdoll_count)));
+	float bottom = bounds.center.y - bounds.radius, top = bounds.center.y + bounds.radius;
+
+	vector<Vec3> points;
+	for(unsigned int i = 0; i < ray_count; ++i)
+		points.push_back(Vec3(bounds.center.x + random.Next(-half_width, half_width), 0, bounds.center.z + random.Next(-half_width, half_width)));
+
+	double casting_total = 0.0, filtered_total = 0.0;
+
+	double start = GetSeconds();
+	for(vector<Vec3>::iterator iter = points.begin(); iter != points.end(); ++iter)
+	{
+		CastingCallback callback;
+		callback.result = 0;
+
+		world->RayTest(Vec3(iter->x, bottom, iter->z), Vec3(iter->x, top, iter->z), callback);
+		casting_total += callback.result;
+	}
+	double casting_ms = (GetSeconds() - start) * 1000.0;
+
+	start = GetSeconds();
+	for(vector<Vec3>::iterator iter = points.begin(); iter != points.end(); ++iter)
+	{
+		FilteredCallback callback;
+		callback.result = 0;
+
+		world->RayTest(Vec3(iter->x, bottom, iter->z), Vec3(iter->x, top, iter->z), callback, RagdollScene::level_group);
+		filtered_total += callback.result;
+	}
+	double filtered_ms = (GetSeconds() - start) * 1000.0;
+
+	// both ways should find the same heights; if they don't, the timings aren't comparable
+	stringstream casting_extra, filtered_extra;
+	casting_extra << "height sum " << casting_total * (top - bottom);
+	filtered_extra << "height sum " << filtered_total * (top - bottom) << ", " << casting_ms / filtered_ms << "x as fast";
+
+	Report("RayTest, dynamic_cast in the callback", casting_ms, casting_extra.str());
+	Report("RayTest, masked to the level's group", filtered_ms, filtered_extra.str());
+
+	scene.Dispose();
+	world->Dispose();
+	delete world;
+
+	return 0;
+}
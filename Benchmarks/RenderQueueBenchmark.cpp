@@ -0,0 +1,128 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/SceneRenderer.h"
+#include "../CibraryEngine/RenderNode.h"
+#include "../CibraryEngine/Material.h"
+
+/*
+ * SceneRenderer::BeginRender with 100,000 synthetic RenderNodes using 200 materials of 8 classes, a fifth of them
+ * translucent, compared with the BeginRender from before the flat render queue (reproduced below, as it was: maps of
+ * material to vector<RenderNode>, and a sorted list of the translucent ones). Nothing is drawn, so no GL context is
+ * needed; each frame the nodes are submitted again, sorted, and cleaned up, and only the sorting is timed
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int node_count = 100000;
+	const unsigned int material_count = 200;
+	const unsigned int frames = 50;
+
+	struct NullMaterial : public Material
+	{
+		NullMaterial(unsigned int mclass_id, BlendStyle blend_style) : Material(mclass_id, blend_style, false) { }
+
+		void BeginDraw(SceneRenderer* renderer) { }
+		void EndDraw() { }
+		void Draw(RenderNode node) { }
+		void Cleanup(RenderNode node) { }
+		bool Equals(Material* other) { return other == this; }
+	};
+
+	// SceneRenderer::BeginRender from before the flat render queue
+	struct RNDistanceComp { bool operator() (RenderNode& lhs, RenderNode& rhs) { return lhs.distance < rhs.distance; } };
+
+	struct OldRenderer
+	{
+		map<Material*, vector<RenderNode> > material_model_lists;
+		map<Material*, vector<RenderNode> > opaque_items;
+		map<Material*, vector<RenderNode> > translucent_items;
+		list<RenderNode> sorted_translucent_items;
+
+		vector<RenderNode> objects;
+
+		void BeginRender()
+		{
+			material_model_lists = map<Material*, vector<RenderNode> >();
+			for(vector<RenderNode>::iterator iter = objects.begin(); iter != objects.end(); ++iter)
+			{
+				RenderNode model = *iter;
+				if (material_model_lists.find(model.material) == material_model_lists.end())
+					material_model_lists[model.material] = vector<RenderNode>();
+				material_model_lists[model.material].push_back(model);
+			}
+
+			translucent_items = map<Material*, vector<RenderNode> >();
+			opaque_items = map<Material*, vector<RenderNode> >();
+			for(map<Material*, vector<RenderNode> >::iterator iter = material_model_lists.begin(); iter != material_model_lists.end(); ++iter)
+			{
+				Material* mat = iter->first;
+				if (mat->blend_style == Opaque)
+					opaque_items[mat] = material_model_lists[mat];
+				else
+					translucent_items[mat] = material_model_lists[mat];
+			}
+
+			sorted_translucent_items = list<RenderNode>();
+			for(map<Material*, vector<RenderNode> >::iterator iter = translucent_items.begin(); iter != translucent_items.end(); ++iter)
+				sorted_translucent_items.insert(sorted_translucent_items.end(), iter->second.begin(), iter->second.end());
+
+			sorted_translucent_items.sort<RNDistanceComp>(RNDistanceComp());
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkRandom random(12345);
+
+	vector<Material*> materials;
+	for(unsigned int i = 0; i < material_count; ++i)
+	{
+		BlendStyle blend = i % 5 == 4 ? (i % 2 == 0 ? Alpha : Additive) : Opaque;
+		materials.push_back(new NullMaterial(i % 8, blend));
+	}
+
+	vector<RenderNode> nodes;
+	for(unsigned int i = 0; i < node_count; ++i)
+		nodes.push_back(RenderNode(materials[random.Next() % material_count], NULL, random.Next(0.0f, 500.0f)));
+
+	printf("%u nodes, %u materials, %u frames\n", node_count, material_count, frames);
+
+	OldRenderer old_renderer;
+	double old_time = 0.0;
+	for(unsigned int i = 0; i <= frames; ++i)
+	{
+		old_renderer.objects = nodes;
+
+		double start = GetSeconds();
+		old_renderer.BeginRender();
+		if(i > 0)											// the first frame is a warm-up
+			old_time += GetSeconds() - start;
+	}
+
+	stringstream old_extra;
+	old_extra << old_renderer.sorted_translucent_items.size() << " translucent";
+	Report("old BeginRender (maps of vectors, sorted list)", old_time * 1000.0 / frames, old_extra.str());
+
+	SceneRenderer renderer(NULL);
+	double new_time = 0.0;
+	for(unsigned int i = 0; i <= frames; ++i)
+	{
+		renderer.objects.insert(renderer.objects.end(), nodes.begin(), nodes.end());
+
+		double start = GetSeconds();
+		renderer.BeginRender();
+		if(i > 0)
+			new_time += GetSeconds() - start;
+
+		renderer.Cleanup();
+	}
+	Report("SceneRenderer::BeginRender (radix-sorted queue)", new_time * 1000.0 / frames);
+
+	for(vector<Material*>::iterator iter = materials.begin(); iter != materials.end(); ++iter)
+		delete *iter;
+
+	return 0;
+}
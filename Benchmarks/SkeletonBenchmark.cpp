@@ -0,0 +1,173 @@
+#include "Benchmark.h"
+
+#include "../CibraryEngine/SkeletalAnimation.h"
+#include "../CibraryEngine/UberModel.h"
+
+/*
+ * Evaluating the bone matrices of 1000 copies of the soldier.zzz skeleton every frame, with every bone's pose changing
+ * each frame; compares the old recursive Bone::GetTransformationMatrix (reproduced below, as it was before
+ * Skeleton::GetBoneMatrices did a single pass) for each bone with Skeleton::GetBoneMatrices, and checks that they agree.
+ * Also times GetBoneMatrices when only a few bones at the ends of the hierarchy move, and when nothing moves
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int character_count = 1000;
+	const unsigned int frames = 100;
+
+	const unsigned int moving_bones = 4;
+
+	namespace Old
+	{
+		Mat4 GetTransformationMatrix(Bone* bone)
+		{
+			Quaternion rotation = bone->rest_ori * bone->ori;
+
+			if (bone->parent == NULL)
+				return Mat4::Translation(bone->pos) * Mat4::FromQuaternion(rotation);
+			else
+			{
+				Mat4 parent_xform = GetTransformationMatrix(bone->parent);
+				Mat4 to_rest_pos = Mat4::Translation(bone->rest_pos);
+				Mat4 from_rest_pos = Mat4::Translation(-bone->rest_pos);
+				Mat4 rotation_mat = Mat4::FromQuaternion(rotation);
+				Mat4 offset = Mat4::Translation(bone->pos);
+				return parent_xform * to_rest_pos * rotation_mat * offset * from_rest_pos;
+			}
+		}
+
+		vector<Mat4> GetBoneMatrices(Skeleton* skeleton)
+		{
+			vector<Mat4> matrices = vector<Mat4>();
+
+			unsigned int bones_count = skeleton->bones.size();
+			for(unsigned int i = 0; i < bones_count; ++i)
+				matrices.push_back(GetTransformationMatrix(skeleton->bones[i]));
+
+			return matrices;
+		}
+	}
+
+	// a different small rotation for each of the listed bones of each character, changing from frame to frame
+	void Animate(Skeleton* skeleton, unsigned int character, unsigned int frame, const vector<unsigned int>& indices)
+	{
+		for(vector<unsigned int>::const_iterator iter = indices.begin(); iter != indices.end(); ++iter)
+		{
+			unsigned int i = *iter;
+			float t = frame * 0.05f + character * 0.37f + i * 0.61f;
+			skeleton->bones[i]->ori = Quaternion::FromPYR(sin(t) * 0.3f, sin(t * 1.3f) * 0.2f, cos(t * 0.7f) * 0.1f);
+		}
+	}
+
+	// how many bones (counting the bone itself) there are between a bone and the root of its hierarchy
+	unsigned int GetDepth(Bone* bone)
+	{
+		unsigned int depth = 0;
+		for(; bone != NULL; bone = bone->parent)
+			++depth;
+		return depth;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	UberModel* model = NULL;
+	if(UberModelLoader::LoadZZZ(model, "Files/Models/soldier.zzz") != 0 || model->bones.empty())
+	{
+		printf("couldn't load the skeleton of Files/Models/soldier.zzz; run this from the repository root\n");
+		return 1;
+	}
+
+	Skeleton* prototype = model->CreateSkeleton();
+	unsigned int bone_count = prototype->bones.size(), max_depth = 0;
+	for(unsigned int i = 0; i < bone_count; ++i)
+		max_depth = max(max_depth, GetDepth(prototype->bones[i]));
+
+	// every bone, and the first few bones nothing is attached to
+	vector<unsigned int> all_bones, leaf_bones;
+	for(unsigned int i = 0; i < bone_count; ++i)
+	{
+		all_bones.push_back(i);
+
+		bool leaf = true;
+		for(unsigned int j = 0; j < bone_count; ++j)
+			if(prototype->bones[j]->parent == prototype->bones[i])
+				leaf = false;
+		if(leaf && leaf_bones.size() < moving_bones)
+			leaf_bones.push_back(i);
+	}
+
+	vector<Skeleton*> skeletons;
+	for(unsigned int i = 0; i < character_count; ++i)
+		skeletons.push_back(new Skeleton(prototype));
+
+	double old_time = 0.0, new_time = 0.0, few_time = 0.0, still_time = 0.0;
+	float max_error = 0.0f;
+
+	for(unsigned int frame = 0; frame < frames; ++frame)
+	{
+		for(unsigned int i = 0; i < character_count; ++i)
+			Animate(skeletons[i], i, frame, all_bones);
+
+		vector<vector<Mat4> > old_matrices(character_count);
+
+		double start = GetSeconds();
+		for(unsigned int i = 0; i < character_count; ++i)
+			old_matrices[i] = Old::GetBoneMatrices(skeletons[i]);
+		old_time += GetSeconds() - start;
+
+		start = GetSeconds();
+		for(unsigned int i = 0; i < character_count; ++i)
+			skeletons[i]->GetBoneMatrices();
+		new_time += GetSeconds() - start;
+
+		for(unsigned int i = 0; i < character_count; ++i)
+		{
+			const vector<Mat4>& matrices = skeletons[i]->GetBoneMatrices();
+			for(unsigned int j = 0; j < bone_count; ++j)
+				for(unsigned int k = 0; k < 16; ++k)
+					max_error = max(max_error, fabs(matrices[j].values[k] - old_matrices[i][j].values[k]));
+		}
+
+		for(unsigned int i = 0; i < character_count; ++i)
+			Animate(skeletons[i], i, frame + frames, leaf_bones);
+
+		start = GetSeconds();
+		for(unsigned int i = 0; i < character_count; ++i)
+			skeletons[i]->GetBoneMatrices();
+		few_time += GetSeconds() - start;
+
+		start = GetSeconds();
+		for(unsigned int i = 0; i < character_count; ++i)
+			skeletons[i]->GetBoneMatrices();
+		still_time += GetSeconds() - start;
+	}
+
+	char extra[64];
+	sprintf(extra, "%u bones, up to %u deep", bone_count, max_depth);
+	printf("%u characters, %s\n", character_count, extra);
+
+	Report("old recursion, every bone moving", old_time * 1000.0 / frames);
+	Report("GetBoneMatrices, every bone moving", new_time * 1000.0 / frames);
+	sprintf(extra, "%u leaf bones", leaf_bones.size());
+	Report("GetBoneMatrices, a few bones moving", few_time * 1000.0 / frames, extra);
+	Report("GetBoneMatrices, nothing moving", still_time * 1000.0 / frames);
+
+	sprintf(extra, "%g", max_error);
+	printf("largest difference between the old and new matrices: %s\n", extra);
+
+	for(unsigned int i = 0; i < character_count; ++i)
+	{
+		skeletons[i]->Dispose();
+		delete skeletons[i];
+	}
+	prototype->Dispose();
+	delete prototype;
+
+	model->Dispose();
+	delete model;
+
+	return max_error < 1e-4f ? 0 : 1;
+}
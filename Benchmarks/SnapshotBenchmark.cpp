@@ -0,0 +1,75 @@
+#include "RagdollScene.h"
+
+/*
+ * PhysicsWorld::Snapshot and Restore on a world of 500 or so ragdoll bodies (with their constraints) lying on the
+ * nbridge level, each done once per simulated tick for 600 ticks, into and out of a reused stream, as a rollback
+ * client would; the time of the step itself is reported alongside for scale
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int min_bodies = 500;
+	const unsigned int ticks = 600;
+}
+
+int main(int argc, char** argv)
+{
+	PhysicsWorld* world = new PhysicsWorld();
+	RagdollScene scene(world);
+	if(!scene.Load())
+		return 1;
+
+	// each of the model's bone physics entries becomes one body per ragdoll
+	unsigned int bodies_per_ragdoll = scene.ragdoll_model->bone_physics.size();
+
+	BenchmarkRandom random(12345);
+	scene.AddRagdolls((min_bodies + bodies_per_ragdoll - 1) / bodies_per_ragdoll, random);
+
+	TimingInfo time(1.0f / 60.0f, 0.0f);
+	stringstream buffer;
+	double step_time = 0.0, snapshot_time = 0.0, restore_time = 0.0;
+	unsigned int bytes = 0;
+
+	for(unsigned int i = 0; i < ticks; ++i)
+	{
+		double start = GetSeconds();
+		world->Update(time);
+		time.total += time.elapsed;
+		step_time += GetSeconds() - start;
+
+		buffer.clear();
+		buffer.seekp(0);
+
+		start = GetSeconds();
+		world->Snapshot(buffer);
+		snapshot_time += GetSeconds() - start;
+
+		bytes = (unsigned int)buffer.tellp();
+		buffer.seekg(0);
+
+		start = GetSeconds();
+		if(int error = world->Restore(buffer))
+		{
+			printf("Restore returned error %i\n", error);
+			return 1;
+		}
+		restore_time += GetSeconds() - start;
+	}
+
+	stringstream extra;
+	extra << scene.GetBodyCount() << " bodies in " << scene.ragdolls.size() << " ragdolls";
+	Report("PhysicsWorld::Update", step_time * 1000.0 / ticks, extra.str());
+
+	stringstream size;
+	size << bytes << " bytes";
+	Report("PhysicsWorld::Snapshot", snapshot_time * 1000.0 / ticks, size.str());
+	Report("PhysicsWorld::Restore", restore_time * 1000.0 / ticks);
+
+	scene.Dispose();
+	world->Dispose();
+	delete world;
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include "RagdollScene.h"
+
+/*
+ * Step time against solver thread count (PhysicsWorld::SetSolverThreads), with 50 and 200 ragdolls dropped onto the
+ * nbridge level; each ragdoll is its own simulation island until they start piling up on each other. The same scene
+ * is rebuilt for each thread count, and timed over the first 5 seconds of simulation, while most of it is awake
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int frames = 300;
+
+	bool Run(unsigned int ragdoll_count, unsigned int threads)
+	{
+		PhysicsWorld* world = new PhysicsWorld(threads);
+		world->SetFixedTimeStep(1.0f / 60.0f, 1);
+
+		RagdollScene scene(world);
+		bool ok = scene.Load();
+		if(ok)
+		{
+			BenchmarkRandom random(12345);
+			scene.AddRagdolls(ragdoll_count, random);
+
+			double ms = scene.Run(frames);
+
+			stringstream name, extra;
+			name << ragdoll_count << " ragdolls, " << threads << " solver threads";
+			extra << scene.GetActiveBodyCount() << " of " << scene.GetBodyCount() << " bodies still awake";
+			Report(name.str(), ms, extra.str());
+		}
+
+		scene.Dispose();
+		world->Dispose();
+		delete world;
+
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+#ifndef BT_NO_PROFILE
+	printf("built without BT_NO_PROFILE, so SetSolverThreads is ignored and every run is single-threaded\n");
+#endif
+
+	unsigned int cores = max(boost::thread::hardware_concurrency(), 1u);
+
+	unsigned int counts[] = { 50, 200 };
+	for(unsigned int i = 0; i < 2; ++i)
+		for(unsigned int threads = 0; threads < cores; threads = threads == 0 ? 1 : threads * 2)
+			if(!Run(counts[i], threads))
+				return 1;
+
+	return 0;
+}
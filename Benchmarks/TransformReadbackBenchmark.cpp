@@ -0,0 +1,132 @@
+#include "RagdollScene.h"
+
+/*
+ * Reading back every bone transform of 200 ragdolls each frame, the way Corpse does: converting a position and
+ * orientation to a matrix per body (what RigidBodyInfo::GetTransformationMatrix used to do after fetching the
+ * transform from the motion state), calling GetTransformationMatrix, and walking PhysicsWorld::GetTransforms directly.
+ * Before timing, it removes a quarter of the ragdolls and checks that the published arrays still line up with the
+ * bodies left in the world
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ragdoll_count = 200;
+	const unsigned int frames = 300;
+
+	bool Close(const float* a, const float* b, unsigned int count)
+	{
+		for(unsigned int i = 0; i < count; ++i)
+			if(fabs(a[i] - b[i]) > 0.0001f)
+				return false;
+		return true;
+	}
+
+	bool CheckTransforms(PhysicsWorld* world, RagdollScene& scene)
+	{
+		const RigidBodyTransforms& transforms = world->GetTransforms();
+
+		unsigned int expected = scene.GetBodyCount() + 1;			// + 1 for the level
+		if(transforms.Count() != expected || transforms.matrices.size() != expected * 12)
+		{
+			printf("%u transforms published for %u bodies\n", transforms.Count(), expected);
+			return false;
+		}
+
+		vector<bool> used(expected, false);
+		for(vector<RagdollScene::Ragdoll>::iterator iter = scene.ragdolls.begin(); iter != scene.ragdolls.end(); ++iter)
+			for(vector<RigidBodyInfo*>::iterator jter = iter->bodies.begin(); jter != iter->bodies.end(); ++jter)
+			{
+				unsigned int index = (*jter)->GetTransformIndex();
+				if(index >= expected || used[index])
+				{
+					printf("transform index %u is out of range or shared\n", index);
+					return false;
+				}
+				used[index] = true;
+
+				// the published matrix has to agree with the published position and orientation
+				Mat4 mat = Mat4::FromPositionAndOrientation(transforms.positions[index], transforms.orientations[index]);
+				if(!Close(mat.values, &transforms.matrices[index * 12], 12))
+				{
+					printf("published matrix %u doesn't match its position and orientation\n", index);
+					return false;
+				}
+			}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	PhysicsWorld* world = new PhysicsWorld();
+	RagdollScene scene(world);
+	if(!scene.Load())
+		return 1;
+
+	BenchmarkRandom random(12345);
+	scene.AddRagdolls(ragdoll_count, random);
+	scene.Run(60);
+
+	// removing bodies moves others' entries in the arrays; take out every fourth ragdoll
+	for(unsigned int i = scene.ragdolls.size(); i-- > 0; )
+		if(i % 4 == 0)
+		{
+			RagdollScene::Ragdoll& ragdoll = scene.ragdolls[i];
+			for(vector<ConeTwistConstraint*>::iterator iter = ragdoll.constraints.begin(); iter != ragdoll.constraints.end(); ++iter)
+			{
+				world->RemoveConstraint(*iter);
+				(*iter)->Dispose();
+				delete *iter;
+			}
+			for(vector<RigidBodyInfo*>::iterator iter = ragdoll.bodies.begin(); iter != ragdoll.bodies.end(); ++iter)
+			{
+				world->RemoveRigidBody(*iter);
+				(*iter)->DisposePreservingCollisionShape();
+				delete *iter;
+			}
+			scene.ragdolls.erase(scene.ragdolls.begin() + i);
+		}
+
+	scene.Run(60);
+	bool ok = CheckTransforms(world, scene);
+
+	vector<RigidBodyInfo*> bodies;
+	for(vector<RagdollScene::Ragdoll>::iterator iter = scene.ragdolls.begin(); iter != scene.ragdolls.end(); ++iter)
+		bodies.insert(bodies.end(), iter->bodies.begin(), iter->bodies.end());
+
+	printf("%u bodies, read back %u times\n", bodies.size(), frames);
+
+	// the readback only; the world isn't stepped in between, so each way reads the same transforms
+	float checksum = 0.0f;
+	double start = GetSeconds();
+	for(unsigned int frame = 0; frame < frames; ++frame)
+		for(vector<RigidBodyInfo*>::iterator iter = bodies.begin(); iter != bodies.end(); ++iter)
+			checksum += Mat4::FromPositionAndOrientation((*iter)->GetPosition(), (*iter)->GetOrientation()).values[3];
+	Report("position and orientation, converted per body", (GetSeconds() - start) * 1000.0 / frames);
+
+	start = GetSeconds();
+	for(unsigned int frame = 0; frame < frames; ++frame)
+		for(vector<RigidBodyInfo*>::iterator iter = bodies.begin(); iter != bodies.end(); ++iter)
+			checksum += (*iter)->GetTransformationMatrix().values[3];
+	Report("RigidBodyInfo::GetTransformationMatrix", (GetSeconds() - start) * 1000.0 / frames);
+
+	start = GetSeconds();
+	for(unsigned int frame = 0; frame < frames; ++frame)
+	{
+		const RigidBodyTransforms& transforms = world->GetTransforms();
+		for(vector<RigidBodyInfo*>::iterator iter = bodies.begin(); iter != bodies.end(); ++iter)
+			checksum += transforms.matrices[(*iter)->GetTransformIndex() * 12 + 3];
+	}
+	Report("PhysicsWorld::GetTransforms lookup", (GetSeconds() - start) * 1000.0 / frames);
+
+	printf("checksum %f\n", checksum);
+
+	scene.Dispose();
+	world->Dispose();
+	delete world;
+
+	return ok ? 0 : 1;
+}
@@ -5,12 +5,26 @@
 #include "RenderNode.h"
 #include "SceneRenderer.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+	#define BILLBOARD_MATERIAL_SSE				// compute the edges of four segments at a time
+	#include <xmmintrin.h>
+#endif
+
 namespace CibraryEngine
 {
 	/*
 	 * BillboardMaterial methods
 	 */
-	BillboardMaterial::BillboardMaterial(Texture2D* texture, BlendStyle mode) : Material(5, mode, false), texture(texture) { texture->clamp = true; }
+	BillboardMaterial::BillboardMaterial(Texture2D* texture, BlendStyle mode) : Material(5, mode, false), texture(texture), vertices(), vertex_count(0), vbo(0) { texture->clamp = true; }
+
+	void BillboardMaterial::InnerDispose()
+	{
+		if(vbo != 0)
+		{
+			glDeleteBuffers(1, &vbo);
+			vbo = 0;
+		}
+	}
 
 	void BillboardMaterial::BeginDraw(SceneRenderer* renderer)
 	{
@@ -46,13 +60,51 @@ namespace CibraryEngine
 		glDepthMask(false);
 
 		GLDEBUG();
-		glBegin(GL_QUADS);
+
+		vertex_count = 0;
+	}
+
+	void BillboardMaterial::EndDraw()
+	{
+		if(vertex_count == 0)
+			return;
+
+		if(vbo == 0)
+			glGenBuffers(1, &vbo);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(BillboardVertex), &vertices[0], GL_STREAM_DRAW);
+
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(BillboardVertex), (void*)0);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(BillboardVertex), (void*)(3 * sizeof(float)));
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(4, GL_FLOAT, sizeof(BillboardVertex), (void*)(5 * sizeof(float)));
+
+		glDrawArrays(GL_QUADS, 0, vertex_count);
+
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);			// don't leave hardware vbo on
+
+		vertex_count = 0;
+
+		GLDEBUG();
 	}
 
-	void BillboardMaterial::EndDraw() { glEnd(); }
+	void BillboardMaterial::Draw(RenderNode node)
+	{
+		Batch* batch = (Batch*)node.data;
 
-	void BillboardMaterial::Draw(RenderNode node) { ((NodeData*)node.data)->Execute(camera_position); }
-	void BillboardMaterial::Cleanup(RenderNode node) { delete node.data; }
+		// only ever grows, so once it's big enough this doesn't touch the heap
+		if(vertices.size() < vertex_count + batch->count * 8)
+			vertices.resize(vertex_count + batch->count * 8);
+
+		vertex_count += batch->Expand(camera_position, &vertices[vertex_count]);
+	}
+	void BillboardMaterial::Cleanup(RenderNode node) { }
 
 	bool BillboardMaterial::Equals(Material* other)
 	{ 
@@ -82,41 +134,92 @@ namespace CibraryEngine
 	{
 	}
 
-	void BillboardMaterial::NodeData::Execute(Vec3 camera_position)
+
+
+
+
+	/*
+	 * BillboardMaterial::Batch methods
+	 */
+	BillboardMaterial::Batch::Batch(NodeData* segments, unsigned int count) : segments(segments), count(count) { }
+
+	static void PutVertex(BillboardVertex*& out, const Vec3& pos, float u, float v, const BillboardMaterial::NodeData& segment)
 	{
-		glColor4f(red, green, blue, alpha);
-
-		Vec3 normal, pos, anti_normal;
-		pos = front - back;
-		normal = Vec3::Normalize(front - camera_position);            // temporarily uses the same variable to store it
-		normal = Vec3::Cross(normal, pos);
-		normal *= width * 0.5f / normal.ComputeMagnitude();
-		anti_normal = -normal;
-
-		Vec3 points[6];
-		points[0] = front + normal;
-		points[1] = front;
-		points[2] = front + anti_normal;
-		points[3] = back + normal;
-		points[4] = back;
-		points[5] = back + anti_normal;
-
-		glTexCoord3f(front_u,	0.0f, 0);
-		glVertex3f(points[0].x, points[0].y, points[0].z);
-		glTexCoord3f(front_u,	0.5f, 0);
-		glVertex3f(points[1].x, points[1].y, points[1].z);
-		glTexCoord3f(back_u,	0.5f, 0);
-		glVertex3f(points[4].x, points[4].y, points[4].z);
-		glTexCoord3f(back_u,	0.0f, 0);
-		glVertex3f(points[3].x, points[3].y, points[3].z);
-
-		glTexCoord3f(front_u,	0.5f, 0);
-		glVertex3f(points[1].x, points[1].y, points[1].z);
-		glTexCoord3f(front_u,	1.0f, 0);
-		glVertex3f(points[2].x, points[2].y, points[2].z);
-		glTexCoord3f(back_u,	1.0f, 0);
-		glVertex3f(points[5].x, points[5].y, points[5].z);
-		glTexCoord3f(back_u,	0.5f, 0);
-		glVertex3f(points[4].x, points[4].y, points[4].z);
+		out->x = pos.x;					out->y = pos.y;					out->z = pos.z;
+		out->u = u;						out->v = v;
+		out->red = segment.red;			out->green = segment.green;		out->blue = segment.blue;		out->alpha = segment.alpha;
+		++out;
+	}
+
+	// the segment is a strip along its length, as wide as its width, and facing the camera; normal goes from its middle to one edge
+	static void PutSegment(BillboardVertex*& out, const BillboardMaterial::NodeData& segment, const Vec3& normal)
+	{
+		const Vec3& front = segment.front;
+		const Vec3& back = segment.back;
+
+		PutVertex(out, front + normal,	segment.front_u,	0.0f, segment);
+		PutVertex(out, front,			segment.front_u,	0.5f, segment);
+		PutVertex(out, back,			segment.back_u,		0.5f, segment);
+		PutVertex(out, back + normal,	segment.back_u,		0.0f, segment);
+
+		PutVertex(out, front,			segment.front_u,	0.5f, segment);
+		PutVertex(out, front - normal,	segment.front_u,	1.0f, segment);
+		PutVertex(out, back - normal,	segment.back_u,		1.0f, segment);
+		PutVertex(out, back,			segment.back_u,		0.5f, segment);
+	}
+
+	unsigned int BillboardMaterial::Batch::Expand(const Vec3& camera_position, BillboardVertex* out) const
+	{
+		BillboardVertex* start = out;
+		unsigned int i = 0;
+
+#ifdef BILLBOARD_MATERIAL_SSE
+		const __m128 cx = _mm_set1_ps(camera_position.x), cy = _mm_set1_ps(camera_position.y), cz = _mm_set1_ps(camera_position.z);
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		float nx[4], ny[4], nz[4];
+
+		for(; i + 4 <= count; i += 4)
+		{
+			const NodeData* s = segments + i;
+
+			__m128 fx = _mm_setr_ps(s[0].front.x, s[1].front.x, s[2].front.x, s[3].front.x);
+			__m128 fy = _mm_setr_ps(s[0].front.y, s[1].front.y, s[2].front.y, s[3].front.y);
+			__m128 fz = _mm_setr_ps(s[0].front.z, s[1].front.z, s[2].front.z, s[3].front.z);
+
+			// direction along each segment, and the direction from the camera to its front
+			__m128 dx = _mm_sub_ps(fx, _mm_setr_ps(s[0].back.x, s[1].back.x, s[2].back.x, s[3].back.x));
+			__m128 dy = _mm_sub_ps(fy, _mm_setr_ps(s[0].back.y, s[1].back.y, s[2].back.y, s[3].back.y));
+			__m128 dz = _mm_sub_ps(fz, _mm_setr_ps(s[0].back.z, s[1].back.z, s[2].back.z, s[3].back.z));
+			__m128 ex = _mm_sub_ps(fx, cx), ey = _mm_sub_ps(fy, cy), ez = _mm_sub_ps(fz, cz);
+
+			// their cross product is perpendicular to both; scale it to half the width
+			__m128 x = _mm_sub_ps(_mm_mul_ps(ey, dz), _mm_mul_ps(ez, dy));
+			__m128 y = _mm_sub_ps(_mm_mul_ps(ez, dx), _mm_mul_ps(ex, dz));
+			__m128 z = _mm_sub_ps(_mm_mul_ps(ex, dy), _mm_mul_ps(ey, dx));
+
+			__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			__m128 scale = _mm_div_ps(_mm_mul_ps(_mm_setr_ps(s[0].width, s[1].width, s[2].width, s[3].width), half), len);
+
+			_mm_storeu_ps(nx, _mm_mul_ps(x, scale));
+			_mm_storeu_ps(ny, _mm_mul_ps(y, scale));
+			_mm_storeu_ps(nz, _mm_mul_ps(z, scale));
+
+			for(unsigned int j = 0; j < 4; ++j)
+				PutSegment(out, s[j], Vec3(nx[j], ny[j], nz[j]));
+		}
+#endif
+
+		for(; i < count; ++i)
+		{
+			const NodeData& s = segments[i];
+
+			Vec3 normal = Vec3::Cross(s.front - camera_position, s.front - s.back);
+			normal *= s.width * 0.5f / normal.ComputeMagnitude();
+
+			PutSegment(out, s, normal);
+		}
+
+		return out - start;
 	}
 }
@@ -8,6 +8,16 @@
 
 namespace CibraryEngine
 {
+	using namespace std;
+
+	/** A vertex of the stream BillboardMaterial draws */
+	struct BillboardVertex
+	{
+		float x, y, z;
+		float u, v;
+		float red, green, blue, alpha;
+	};
+
 	class BillboardMaterial : public Material
 	{
 		private:
@@ -16,6 +26,15 @@ namespace CibraryEngine
 
 			Texture2D* texture;
 
+			// everything drawn between BeginDraw and EndDraw goes in here, and gets uploaded to the vbo all at once
+			vector<BillboardVertex> vertices;
+			unsigned int vertex_count;
+			unsigned int vbo;
+
+		protected:
+
+			void InnerDispose();
+
 		public:
 
 			BillboardMaterial(Texture2D* texture, BlendStyle mode);
@@ -34,8 +53,21 @@ namespace CibraryEngine
 				float front_u, back_u;
 
 				NodeData(Vec3 position, Vec3 back, float width);
+			};
+
+			/** Node data for this material: some number of segments, drawn all at once */
+			struct Batch
+			{
+				NodeData* segments;
+				unsigned int count;
+
+				Batch(NodeData* segments, unsigned int count);
 
-				void Execute(Vec3 camera_position);
+				/**
+				 * Expands the segments into strips facing the camera (two quads each, for GL_QUADS), and returns how many vertices it wrote;
+				 * out must have room for 8 * count of them. This doesn't use GL, so it can be called from anywhere
+				 */
+				unsigned int Expand(const Vec3& camera_position, BillboardVertex* out) const;
 			};
 	};
 }
@@ -23,6 +23,8 @@ namespace CibraryEngine
 		bs(Vec3(), -1),
 		trailhead(trailhead)
 	{
+		update_stage = 1;			// Update only touches the trail itself, but reads its TrailHead, which may follow an entity updated in stage 0 (e.g. a Shot)
+
 		AddNode();
 	}
 
@@ -92,25 +94,34 @@ namespace CibraryEngine
 
 	void BillboardTrail::Vis(SceneRenderer* renderer)
 	{
-		//if (renderer->camera->CheckSphereVisibility(GetBoundingSphere()))
+		if(node_count < 2)
+			return;
+
+		// one node for the whole trail, sorted by where its head is
+		unsigned int segment_count = node_count - 1;
+		BillboardMaterial::NodeData* segments = (BillboardMaterial::NodeData*)renderer->frame_data.Allocate(sizeof(BillboardMaterial::NodeData) * segment_count);
+
+		for (unsigned int i = 0; i < segment_count; ++i)
 		{
-			for (unsigned int i = 0; i + 1 < node_count; ++i)
-			{
-				TrailNode& a = trail[i + 1];
-				TrailNode& b = trail[i];
+			TrailNode& a = trail[i + 1];
+			TrailNode& b = trail[i];
 
-				Vec3 front = a.pos, rear = b.pos;
+			BillboardMaterial::NodeData* node_data = new (&segments[i]) BillboardMaterial::NodeData(a.pos, b.pos, width);
 
-				Vec3 cameraPos = renderer->camera->GetPosition();
-				Vec3 fromCamera = a.pos - cameraPos;
+			node_data->front_u = a.age / a.max_age;
+			node_data->back_u = b.age / b.max_age;
+		}
 
-				BillboardMaterial::NodeData* node_data = new BillboardMaterial::NodeData(front, rear, width);
+		BillboardMaterial::Batch* batch = new (renderer->frame_data.Allocate(sizeof(BillboardMaterial::Batch))) BillboardMaterial::Batch(segments, segment_count);
+		renderer->objects.push_back(RenderNode(material, batch, Vec3::Dot(renderer->camera->GetForward(), trail[segment_count].pos)));
+	}
 
-				node_data->front_u = a.age / a.max_age;
-				node_data->back_u = b.age / b.max_age;
+	bool BillboardTrail::GetVisBounds(Sphere& bounds)
+	{
+		if(node_count == 0)
+			return false;
 
-				renderer->objects.push_back(RenderNode(material, node_data, Vec3::Dot(renderer->camera->GetForward(), front)));
-			}
-		}
+		bounds = GetBoundingSphere();
+		return true;
 	}
 }
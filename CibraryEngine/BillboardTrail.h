@@ -28,6 +28,7 @@ namespace CibraryEngine
 				TrailNode(Vec3 pos, float age, float max_age) : pos(pos), age(age), max_age(max_age) { }
 			};
 
+			/** Called from Update, which runs in parallel update stage 2, so it should only read the entity it follows, and that entity should be updated in an earlier stage */
 			struct TrailHead { virtual bool operator()(TrailNode& node) = 0; };
 
 		private:
@@ -51,6 +52,7 @@ namespace CibraryEngine
 			BillboardTrail(GameState* gs, TrailHead* trailhead, BillboardMaterial* material, float width);
 			void Update(TimingInfo time);
 			void Vis(SceneRenderer* renderer);
+			bool GetVisBounds(Sphere& bounds);
 
 			TrailHead* trailhead;
 
@@ -11,6 +11,8 @@ namespace CibraryEngine
 	{
 		public:
 
+			virtual ~Component() { }
+
 			virtual void Update(TimingInfo time);
 			virtual void Vis(SceneRenderer* renderer);
 	};
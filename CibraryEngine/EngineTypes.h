@@ -1,9 +1,12 @@
 #pragma once
 
 #include "Entity.h"
+#include "EntityRegistry.h"
 #include "EntityList.h"
 
 #include "GameState.h"
+#include "VisibilityTree.h"
+#include "TaskPool.h"
 
 #include "Scripting.h"
 
@@ -8,14 +8,10 @@
 namespace CibraryEngine
 {
 
-	map<unsigned int, Entity*> all_entities = map<unsigned int, Entity*>();
-	unsigned long int next_id = 1;
-
-
 	/*
 	 * Entity methods
 	 */
-	Entity::Entity(GameState* gs) : id(next_id++), scripting_handle(NULL), game_state(gs), is_valid(true) { all_entities[id] = this; }
+	Entity::Entity(GameState* gs) : handle(), scripting_handle(NULL), game_state(gs), is_valid(true), vis_proxy(-1), update_stage(0), needs_merge(false) { }
 	Entity::~Entity() { Dispose(); }
 
 	void Entity::Update(TimingInfo time)
@@ -24,6 +20,8 @@ namespace CibraryEngine
 			(*iter)->Update(time);
 	}
 
+	void Entity::MergeUpdate(TimingInfo time) { }
+
 	void Entity::Vis(SceneRenderer* renderer)
 	{
 		for(vector<Component*>::iterator iter = components.begin(); iter != components.end(); ++iter)
@@ -32,9 +30,10 @@ namespace CibraryEngine
 
 	void Entity::VisCleanup() { }
 
+	bool Entity::GetVisBounds(Sphere& bounds) { return false; }
+
 	void Entity::InnerDispose()
 	{
-		all_entities[id] = NULL;
 		if(scripting_handle != NULL)
 			*scripting_handle = NULL;
 	}
@@ -42,7 +41,7 @@ namespace CibraryEngine
 	void Entity::Spawned() { }
 	void Entity::DeSpawned() { }
 
-	unsigned long int Entity::GetID() { return id; }
+	EntityHandle Entity::GetHandle() { return handle; }
 
 	Entity** Entity::GetScriptingHandle()
 	{
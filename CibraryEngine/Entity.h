@@ -4,6 +4,7 @@
 #include "TimingInfo.h"
 
 #include "Disposable.h"
+#include "EntityRegistry.h"
 
 namespace CibraryEngine
 {
@@ -12,13 +13,16 @@ namespace CibraryEngine
 	class GameState;
 	class SceneRenderer;
 	class Component;
+	class Sphere;
 
 	/** Class representing an entity within the simulation */
 	class Entity : public Disposable
 	{
+		friend class GameState;
+
 		private:
 
-			unsigned long int id;
+			EntityHandle handle;
 
 			Entity** scripting_handle;
 
@@ -37,6 +41,20 @@ namespace CibraryEngine
 			/** Whether this entity is valid; if not, it may be removed from the GameState */
 			bool is_valid;
 
+			/** Index of this entity's proxy in the GameState's VisibilityTree, or -1 if it isn't in one */
+			int vis_proxy;
+
+			/**
+			 * Which stage of GameState::Update this entity gets updated in; 0 (the default) means serially, on the main thread
+			 *
+			 * An entity in a later stage declares its Update thread-safe: it may run on a worker thread, concurrently with
+			 * every other entity in the same stage, so it may only modify the entity itself, may only read entities from
+			 * earlier stages, and mustn't Spawn anything or use Random3D. Anything like that goes in MergeUpdate instead.
+			 */
+			unsigned int update_stage;
+			/** Set this during a parallel Update to have MergeUpdate called afterward, on the main thread */
+			bool needs_merge;
+
 
 
 
@@ -47,11 +65,15 @@ namespace CibraryEngine
 
 			/** Updates the entity given how much time has elapsed */
 			virtual void Update(TimingInfo time);
+			/** Called on the main thread, after all of the update stages, if needs_merge was set; entities which are updated in parallel can spawn things here */
+			virtual void MergeUpdate(TimingInfo time);
 
 			/** Lets this entity tell the renderer how to draw it */
 			virtual void Vis(SceneRenderer* renderer);
 			/** Allows the entity to clean up anything it created in a call to Vis */
 			virtual void VisCleanup();
+			/** Gets a sphere containing everything this entity draws in Vis, for frustum culling; if this returns false, the entity is never culled */
+			virtual bool GetVisBounds(Sphere& bounds);
 
 			/** Called when the Entity is spawned into the GameState */
 			virtual void Spawned();
@@ -60,7 +82,8 @@ namespace CibraryEngine
 
 
 
-			unsigned long int GetID();
+			/** Gets a handle to this entity, with which GameState::GetEntity can find it (or find out that it's gone); this is only valid once the entity has been added to the GameState's registry */
+			EntityHandle GetHandle();
 
 			virtual Entity** GetScriptingHandle();
 	};
@@ -0,0 +1,114 @@
+#include "StdAfx.h"
+#include "EntityRegistry.h"
+
+#include "Entity.h"
+
+namespace CibraryEngine
+{
+	/*
+	 * EntityRegistry methods
+	 */
+	EntityRegistry::EntityRegistry() : slots(), free_slots(), buckets(), count(0), bucket_by_type(false) { }
+
+	EntityHandle EntityRegistry::Add(Entity* entity)
+	{
+		// find the entity's bucket; there are only ever a handful, so a linear search is fine
+		const type_info* type = bucket_by_type ? &typeid(*entity) : NULL;
+
+		unsigned int bucket = 0;
+		while(bucket < buckets.size() && buckets[bucket].type != type)
+			++bucket;
+
+		if(bucket == buckets.size())
+		{
+			buckets.push_back(Bucket());
+			buckets.back().type = type;
+		}
+
+		unsigned int slot;
+		if(free_slots.empty())
+		{
+			slot = slots.size();
+
+			Slot s;
+			s.generation = 1;
+			slots.push_back(s);
+		}
+		else
+		{
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+
+		Bucket& b = buckets[bucket];
+
+		Slot& s = slots[slot];
+		s.entity = entity;
+		s.bucket = bucket;
+		s.index = b.entities.size();
+
+		b.entities.push_back(entity);
+		b.slots.push_back(slot);
+
+		++count;
+
+		return EntityHandle(slot, s.generation);
+	}
+
+	void EntityRegistry::Remove(EntityHandle handle)
+	{
+		if(Get(handle) == NULL)
+			return;
+
+		Slot& s = slots[handle.slot];
+		Bucket& b = buckets[s.bucket];
+
+		// swap and pop
+		unsigned int last = b.entities.size() - 1;
+		if(s.index != last)
+		{
+			b.entities[s.index] = b.entities[last];
+			b.slots[s.index] = b.slots[last];
+			slots[b.slots[s.index]].index = s.index;
+		}
+		b.entities.pop_back();
+		b.slots.pop_back();
+
+		s.entity = NULL;
+		if(++s.generation == 0)				// skip generation 0 on wraparound
+			s.generation = 1;
+		free_slots.push_back(handle.slot);
+
+		--count;
+	}
+
+	Entity* EntityRegistry::Get(EntityHandle handle)
+	{
+		if(handle.slot < slots.size() && slots[handle.slot].generation == handle.generation)
+			return slots[handle.slot].entity;
+		return NULL;
+	}
+
+	void EntityRegistry::Clear()
+	{
+		for(unsigned int i = 0; i < slots.size(); ++i)
+		{
+			Slot& s = slots[i];
+			if(s.entity != NULL)
+			{
+				s.entity = NULL;
+				if(++s.generation == 0)
+					s.generation = 1;
+				free_slots.push_back(i);
+			}
+		}
+
+		buckets.clear();
+		count = 0;
+	}
+
+	unsigned int EntityRegistry::Count() { return count; }
+
+	unsigned int EntityRegistry::GetBucketCount() { return buckets.size(); }
+	vector<Entity*>& EntityRegistry::GetBucket(unsigned int index) { return buckets[index].entities; }
+}
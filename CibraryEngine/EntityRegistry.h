@@ -0,0 +1,85 @@
+#pragma once
+
+#include "StdAfx.h"
+
+#include <typeinfo>
+
+namespace CibraryEngine
+{
+	using namespace std;
+
+	class Entity;
+
+	/** Stable reference to an entity in an EntityRegistry; once the entity is removed, the handle resolves to NULL, even after its slot gets reused */
+	struct EntityHandle
+	{
+		unsigned int slot;
+		unsigned int generation;				// generation 0 is never in use, so a default-constructed handle doesn't refer to anything
+
+		EntityHandle() : slot(0), generation(0) { }
+		EntityHandle(unsigned int slot, unsigned int generation) : slot(slot), generation(generation) { }
+
+		bool operator ==(const EntityHandle& other) const { return slot == other.slot && generation == other.generation; }
+		bool operator !=(const EntityHandle& other) const { return slot != other.slot || generation != other.generation; }
+	};
+
+	/**
+	 * Contiguous storage for the entities of a GameState (a slot map); entities are kept in arrays of pointers, optionally one array for
+	 * each concrete type, so a loop over a bucket calls the same Update over and over. Removal swaps the last entity of the bucket into
+	 * the removed one's place, so the order of a bucket is only stable between removals
+	 */
+	class EntityRegistry
+	{
+		private:
+
+			struct Slot
+			{
+				Entity* entity;
+				unsigned int generation;			// incremented every time the slot is freed
+				unsigned int bucket, index;
+			};
+
+			struct Bucket
+			{
+				const type_info* type;				// NULL if bucket_by_type is false
+				vector<Entity*> entities;
+				vector<unsigned int> slots;			// the slot of each of the entities
+			};
+
+			vector<Slot> slots;
+			vector<unsigned int> free_slots;
+
+			vector<Bucket> buckets;
+			unsigned int count;
+
+			// not copyable
+			EntityRegistry(const EntityRegistry& other);
+			void operator=(const EntityRegistry& other);
+
+		public:
+
+			/**
+			 * If true, each concrete type of entity gets its own bucket; only takes effect while the registry is empty. GameState
+			 * updates the buckets one after another, so this also means every entity of one type is updated before any of the next
+			 */
+			bool bucket_by_type;
+
+			EntityRegistry();
+
+			/** Adds an entity, and returns a handle to it */
+			EntityHandle Add(Entity* entity);
+			/** Removes the entity with the given handle, by moving the last entity of its bucket into its place */
+			void Remove(EntityHandle handle);
+			/** Gets the entity with the given handle, or NULL if it has been removed */
+			Entity* Get(EntityHandle handle);
+
+			/** Removes everything, and invalidates every handle */
+			void Clear();
+
+			/** Total number of entities in all of the buckets */
+			unsigned int Count();
+
+			unsigned int GetBucketCount();
+			vector<Entity*>& GetBucket(unsigned int index);
+	};
+}
@@ -0,0 +1,98 @@
+#include "StdAfx.h"
+#include "FrameAllocator.h"
+
+#include "DebugLog.h"
+
+namespace CibraryEngine
+{
+	/*
+	 * FrameAllocator methods
+	 */
+	FrameAllocator::FrameAllocator(size_t block_size) :
+		blocks(),
+		current_block(0),
+		offset(0),
+		block_size(block_size),
+		frame_bytes(0),
+		last_frame_bytes(0),
+		peak_bytes(0),
+#ifdef _DEBUG
+		debug(true)
+#else
+		debug(false)
+#endif
+	{
+	}
+
+	FrameAllocator::~FrameAllocator()
+	{
+		for(vector<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+			delete[] iter->memory;
+		blocks.clear();
+	}
+
+	void* FrameAllocator::Allocate(size_t size, size_t alignment)
+	{
+		// try the current block, then any later ones (left over from busier frames)
+		for(; current_block < blocks.size(); ++current_block, offset = 0)
+		{
+			Block& block = blocks[current_block];
+
+			size_t start = ((size_t)block.memory + offset + alignment - 1) & ~(alignment - 1);
+			size_t end = start + size;
+			if(end <= (size_t)block.memory + block.size)
+			{
+				frame_bytes += end - ((size_t)block.memory + offset);
+				offset = end - (size_t)block.memory;
+
+				return (void*)start;
+			}
+		}
+
+		// nothing had room; this only happens while warming up, or for an unusually busy frame
+		Block block;
+		block.size = max(block_size, size + alignment);
+		block.memory = new char[block.size];
+		blocks.push_back(block);
+
+		current_block = blocks.size() - 1;
+		offset = 0;
+
+		return Allocate(size, alignment);
+	}
+
+	void FrameAllocator::Reset()
+	{
+		if(debug)
+		{
+			for(unsigned int i = 0; i < blocks.size() && i <= current_block; ++i)
+				memset(blocks[i].memory, 0xDD, i == current_block ? offset : blocks[i].size);
+
+			if(frame_bytes > peak_bytes)
+			{
+				stringstream ss;
+				ss << "FrameAllocator: new peak of " << frame_bytes << " bytes in one frame (" << GetCapacity() << " bytes reserved)" << endl;
+				Debug(ss.str());
+			}
+		}
+
+		last_frame_bytes = frame_bytes;
+		peak_bytes = max(peak_bytes, frame_bytes);
+
+		frame_bytes = 0;
+		current_block = 0;
+		offset = 0;
+	}
+
+	size_t FrameAllocator::GetFrameBytes() { return frame_bytes; }
+	size_t FrameAllocator::GetLastFrameBytes() { return last_frame_bytes; }
+	size_t FrameAllocator::GetPeakBytes() { return max(peak_bytes, frame_bytes); }
+
+	size_t FrameAllocator::GetCapacity()
+	{
+		size_t total = 0;
+		for(vector<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+			total += iter->size;
+		return total;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "StdAfx.h"
+
+namespace CibraryEngine
+{
+	using namespace std;
+
+	/**
+	 * Bump allocator for data which only needs to live until the end of a frame, e.g. the node data of RenderNodes;
+	 * everything allocated is released at once by Reset, without running any destructors. The memory blocks are kept
+	 * from one frame to the next, so once it's warmed up it doesn't touch the heap at all
+	 *
+	 * Use placement new to construct things in it, e.g. new (allocator.Allocate(sizeof(Foo))) Foo(...)
+	 */
+	class FrameAllocator
+	{
+		private:
+
+			struct Block
+			{
+				char* memory;
+				size_t size;
+			};
+
+			vector<Block> blocks;
+			unsigned int current_block;
+			size_t offset;						// within the current block
+
+			size_t block_size;
+
+			size_t frame_bytes;					// bytes allocated since the last Reset, including padding
+			size_t last_frame_bytes;
+			size_t peak_bytes;
+
+			// not copyable
+			FrameAllocator(const FrameAllocator& other);
+			void operator=(const FrameAllocator& other);
+
+		public:
+
+			/** If true, Reset fills the released memory with 0xDD (so anything still using it will notice), and writes to the debug log whenever a frame sets a new peak */
+			bool debug;
+
+			FrameAllocator(size_t block_size = 64 * 1024);
+			~FrameAllocator();
+
+			/** Allocates the given number of bytes; alignment must be a power of two */
+			void* Allocate(size_t size, size_t alignment = 16);
+
+			/** Releases everything which has been allocated since the last Reset */
+			void Reset();
+
+			/** Bytes allocated since the last Reset */
+			size_t GetFrameBytes();
+			/** Bytes which had been allocated when Reset was last called */
+			size_t GetLastFrameBytes();
+			/** The most bytes that have been allocated between two Resets */
+			size_t GetPeakBytes();
+			/** Total size of the memory blocks held */
+			size_t GetCapacity();
+	};
+}
@@ -3,6 +3,8 @@
 #include "Physics.h"
 
 #include "IKSolver.h"
+#include "VisibilityTree.h"
+#include "TaskPool.h"
 
 #include "Entity.h"
 #include "EntityList.h"
@@ -12,10 +14,11 @@
 
 namespace CibraryEngine
 {
-	GameState::GameState() : spawn_directly(true), entities(), spawning(), content(NULL), network_role(NR_SinglePlayer), sound_system(NULL)
+	GameState::GameState() : spawn_directly(true), update_stages(), entities(), spawning(), removing(), content(NULL), network_role(NR_SinglePlayer), sound_system(NULL), update_pool(NULL)
 	{
 		physics_world = new PhysicsWorld(); 
 		ik_solver = new IKSolver(physics_world); 
+		vis_tree = new VisibilityTree();
 
 		total_game_time = elapsed_game_time = 0.0f;
 	}
@@ -27,16 +30,20 @@ namespace CibraryEngine
 		spawn_directly = false;			// don't let anybody spawn anything now
 
 		// dispose of already-spawned entities
-		for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+		for(unsigned int i = 0; i < entities.GetBucketCount(); ++i)
 		{
-			(*iter)->DeSpawned();
-			(*iter)->Dispose();
-			delete *iter;
+			vector<Entity*>& bucket = entities.GetBucket(i);
+			for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
+			{
+				(*iter)->DeSpawned();
+				(*iter)->Dispose();
+				delete *iter;
+			}
 		}
-		entities.clear();
+		entities.Clear();
 
-		// dispose of entities that never entered the main list, as well
-		for(list<Entity*>::iterator iter = spawning.begin(); iter != spawning.end(); ++iter)
+		// dispose of entities that never entered the registry, as well
+		for(vector<Entity*>::iterator iter = spawning.begin(); iter != spawning.end(); ++iter)
 		{
 			(*iter)->Dispose();
 			delete *iter;
@@ -53,6 +60,13 @@ namespace CibraryEngine
 			delete ik_solver;
 			ik_solver = NULL;
 		}
+
+		if(vis_tree != NULL)
+		{
+			vis_tree->Dispose();
+			delete vis_tree;
+			vis_tree = NULL;
+		}
 	}
 
 	void GameState::Update(TimingInfo time)
@@ -62,29 +76,86 @@ namespace CibraryEngine
 
 		spawn_directly = false;
 
-		list<Entity*>::iterator iter = entities.begin();
-		while(iter != entities.end())
+		// entities which aren't thread-safe get updated first, on the main thread; the rest are sorted by stage
+		for(vector<vector<Entity*> >::iterator iter = update_stages.begin(); iter != update_stages.end(); ++iter)
+			iter->clear();
+
+		unsigned int bucket_count = entities.GetBucketCount();
+		for(unsigned int i = 0; i < bucket_count; ++i)
 		{
-			Entity* e = *iter;
-			e->Update(time);
-			if(e->is_valid)
-				++iter;
-			else
+			vector<Entity*>& bucket = entities.GetBucket(i);
+			for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
+			{
+				Entity* e = *iter;
+				if(e->update_stage == 0)
+					e->Update(time);
+				else
+				{
+					if(e->update_stage >= update_stages.size())
+						update_stages.resize(e->update_stage + 1);
+					update_stages[e->update_stage].push_back(e);
+				}
+			}
+		}
+
+		// each parallel stage can read the results of the stages before it
+		for(unsigned int i = 1; i < update_stages.size(); ++i)
+			UpdateStage(update_stages[i], time);
+
+		// back to the main thread, for anything which had to wait until everyone was done, and to find the invalid entities
+		for(unsigned int i = 0; i < bucket_count; ++i)
+		{
+			vector<Entity*>& bucket = entities.GetBucket(i);
+			for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
 			{
-				e->DeSpawned();
-				e->Dispose();
-				iter = entities.erase(iter);
+				Entity* e = *iter;
+				if(e->needs_merge)
+				{
+					e->needs_merge = false;
+					e->MergeUpdate(time);
+				}
+
+				if(!e->is_valid)
+					removing.push_back(e);
 			}
 		}
 
+		// remove them all at once, now that nothing is iterating over the registry
+		for(vector<Entity*>::iterator iter = removing.begin(); iter != removing.end(); ++iter)
+		{
+			Entity* e = *iter;
+
+			vis_tree->Remove(e->vis_proxy);
+			e->vis_proxy = -1;
+
+			e->DeSpawned();
+			e->Dispose();
+
+			entities.Remove(e->handle);
+			e->handle = EntityHandle();
+		}
+		removing.clear();
+
 		physics_world->Update(time);
 
+		// now that everything has moved, update the entities' bounding spheres
+		for(unsigned int i = 0; i < bucket_count; ++i)
+		{
+			vector<Entity*>& bucket = entities.GetBucket(i);
+			for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
+				vis_tree->Update((*iter)->vis_proxy);
+		}
+
 		spawn_directly = true;
 
-		for(list<Entity*>::iterator jter = spawning.begin(); jter != spawning.end(); ++jter)
+		for(vector<Entity*>::iterator iter = spawning.begin(); iter != spawning.end(); ++iter)
 		{
-			(*jter)->Spawned();
-			entities.push_back(*jter);
+			Entity* e = *iter;
+
+			e->Spawned();
+			e->handle = entities.Add(e);
+
+			e->vis_proxy = vis_tree->Insert(e);
 		}
 		spawning.clear();
 
@@ -92,14 +163,51 @@ namespace CibraryEngine
 			sound_system->Update(time);
 	}
 
+	// how many entities a worker updates at a time
+	static const unsigned int update_chunk_size = 64;
+
+	struct UpdateStageTask : public TaskPool::Task
+	{
+		vector<Entity*>& stage;
+		TimingInfo time;
+
+		UpdateStageTask(vector<Entity*>& stage, TimingInfo time) : stage(stage), time(time) { }
+
+		void Run(unsigned int chunk)
+		{
+			unsigned int begin = chunk * update_chunk_size;
+			unsigned int end = min(begin + update_chunk_size, (unsigned int)stage.size());
+
+			for(unsigned int i = begin; i < end; ++i)
+				stage[i]->Update(time);
+		}
+	};
+
+	void GameState::UpdateStage(vector<Entity*>& stage, TimingInfo time)
+	{
+		if(stage.empty())
+			return;
+
+		UpdateStageTask task(stage, time);
+		unsigned int chunks = (stage.size() + update_chunk_size - 1) / update_chunk_size;
+
+		if(update_pool != NULL)
+			update_pool->Run(task, chunks);
+		else
+			for(unsigned int i = 0; i < chunks; ++i)
+				task.Run(i);
+	}
+
 	void GameState::Draw(int width, int height) { }
 
 	Entity* GameState::Spawn(Entity* e)
 	{
 		if(spawn_directly)
 		{
-			entities.push_back(e);
+			e->handle = entities.Add(e);
 			e->Spawned();
+
+			e->vis_proxy = vis_tree->Insert(e);
 		}
 		else
 			spawning.push_back(e);
@@ -107,14 +215,20 @@ namespace CibraryEngine
 		return e;
 	}
 
+	Entity* GameState::GetEntity(EntityHandle handle) { return entities.Get(handle); }
+
 	EntityList GameState::GetQualifyingEntities(EntityQualifier& cond)
 	{
 		vector<Entity*> ent_vector;
-		for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+		for(unsigned int i = 0; i < entities.GetBucketCount(); ++i)
 		{
-			Entity *ent = *iter;
-			if(cond.Accept(ent))
-				ent_vector.push_back(ent);
+			vector<Entity*>& bucket = entities.GetBucket(i);
+			for(vector<Entity*>::iterator iter = bucket.begin(); iter != bucket.end(); ++iter)
+			{
+				Entity *ent = *iter;
+				if(cond.Accept(ent))
+					ent_vector.push_back(ent);
+			}
 		}
 
 		return EntityList(ent_vector);
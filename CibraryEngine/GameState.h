@@ -3,6 +3,7 @@
 #include "StdAfx.h"
 #include "Disposable.h"
 #include "TimingInfo.h"
+#include "EntityRegistry.h"
 
 namespace CibraryEngine
 {
@@ -11,6 +12,8 @@ namespace CibraryEngine
 	class PhysicsWorld;
 	class SoundSystem;
 	class IKSolver;
+	class VisibilityTree;
+	class TaskPool;
 
 	class Entity;
 	struct ContentMan;
@@ -34,10 +37,15 @@ namespace CibraryEngine
 
 			bool spawn_directly;
 
+			vector<vector<Entity*> > update_stages;			// the entities in each parallel update stage; kept around so Update doesn't have to reallocate them
+
+			void UpdateStage(vector<Entity*>& stage, TimingInfo time);
+
 		protected:
 
-			list<Entity*> entities;
-			list<Entity*> spawning;
+			EntityRegistry entities;
+			vector<Entity*> spawning;
+			vector<Entity*> removing;					// entities which became invalid during Update; they're removed all at once, at the end of it
 
 			virtual void InnerDispose();
 
@@ -54,6 +62,12 @@ namespace CibraryEngine
 
 			IKSolver* ik_solver;
 
+			/** Bounding volume hierarchy of the entities, for culling those which are outside the camera's frustum */
+			VisibilityTree* vis_tree;
+
+			/** If not NULL, the entities of each parallel update stage are divided among this pool's threads; otherwise they're all updated on the main thread. Either way the results are the same */
+			TaskPool* update_pool;
+
 			/** The total amount of game time that has passed */
 			float total_game_time;
 
@@ -75,6 +89,9 @@ namespace CibraryEngine
 			/** Spawns an Entity, and returns it (for convenience); depending on when it is called, the entity may not be added to the entities list until the next simulation step */
 			virtual Entity* Spawn(Entity* entity);				// returns the spawned entity (for convenience)
 
+			/** Gets the entity with the given handle, or NULL if it has been removed */
+			Entity* GetEntity(EntityHandle handle);
+
 			/** Gets a list of all entities meeting the specified condition*/
 			EntityList GetQualifyingEntities(EntityQualifier& cond);
 
@@ -26,10 +26,12 @@
 #include "CameraView.h"
 #include "Material.h"
 #include "RenderNode.h"
+#include "FrameAllocator.h"
 #include "SceneRenderer.h"
 
 #include "ParticleMaterial.h"
 #include "BillboardTrail.h"
 #include "BillboardMaterial.h"
+#include "ParticleSystem.h"
 
 #include "UnclampedVertexBoneWeightInfo.h"
@@ -99,10 +99,10 @@ namespace CibraryEngine
 			imp_time.elapsed = 0;
 		}
 
-		for(unordered_map<unsigned int, BoneInfluence>::iterator iter = keyframe_animation->bones.begin(); iter != keyframe_animation->bones.end(); ++iter)
+		for(unsigned int i = 0; i < keyframe_animation->bone_names.size(); ++i)
 		{
-			BoneInfluence& binf = iter->second;
-			SetBonePose(iter->first, binf.ori, binf.pos, binf.div);
+			BoneInfluence& binf = keyframe_animation->bone_influences[i];
+			SetBonePose(keyframe_animation->bone_names[i], binf.ori, binf.pos, binf.div);
 		}
 	}
 
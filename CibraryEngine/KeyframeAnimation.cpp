@@ -6,7 +6,6 @@
 namespace CibraryEngine
 {
 	using boost::unordered_map;
-	using boost::unordered_set;
 
 	/*
 	 * Keyframe methods
@@ -64,7 +63,7 @@ namespace CibraryEngine
 	{
 		if (Advance(time))
 		{
-			Keyframe cur = frames[current_index];
+			Keyframe& cur = frames[current_index];
 
 			// linearly interpolate (lerp) only if this is not the final frame of the animation
 			// TODO: maybe make it possible to force interpolation off? for certain keyframes only?
@@ -72,73 +71,384 @@ namespace CibraryEngine
 
 			if (interpolate)
 			{
-				Keyframe nxt = frames[cur.next];                                      // the next frame in the animation
+				Keyframe& nxt = frames[cur.next];                                     // the next frame in the animation
 
 				float b_frac = current_time / cur.duration, a_frac = 1 - b_frac;                   // lerp coefficients
 
-				unordered_set<unsigned int> cur_names;
-				unordered_set<unsigned int> next_names;
+				unordered_map<unsigned int, BoneInfluence>::iterator iter, found;
 
-				unordered_map<unsigned int, BoneInfluence>::iterator map_iter;
-				unordered_set<unsigned int>::iterator set_iter;
+				// bones in the current frame, lerped with the next frame if it has them too...
+				for(iter = cur.values.begin(); iter != cur.values.end(); ++iter)
+				{
+					const BoneInfluence& cur_vec = iter->second;
+
+					found = nxt.values.find(iter->first);
+					if(found == nxt.values.end())
+						SetBonePose(iter->first, cur_vec.ori * a_frac, cur_vec.pos * a_frac, cur_vec.div * a_frac);
+					else
+					{
+						const BoneInfluence& next_vec = found->second;
+						SetBonePose(iter->first, cur_vec.ori * a_frac + next_vec.ori * b_frac, cur_vec.pos * a_frac + next_vec.pos * b_frac, cur_vec.div * a_frac + next_vec.div * b_frac);
+					}
+				}
+				// ...and bones only in the next frame
+				for(iter = nxt.values.begin(); iter != nxt.values.end(); ++iter)
+					if(cur.values.find(iter->first) == cur.values.end())
+					{
+						const BoneInfluence& vec = iter->second;
+						SetBonePose(iter->first, vec.ori * b_frac, vec.pos * b_frac, vec.div * b_frac);
+					}
+			}
+			else
+			{
+				// here we can forego the extra vector and scalar multiplications that are necessary for lerp
+				for(unordered_map<unsigned int, BoneInfluence>::iterator iter = cur.values.begin(); iter != cur.values.end(); ++iter)
+				{
+					const BoneInfluence& vec = iter->second;
+					SetBonePose(iter->first, vec.ori, vec.pos, vec.div);
+				}
+			}
+		}
+		else
+			SetActive(false);
+	}
+
+
+
+
+	/*
+	 * CompiledAnimation::Channel methods
+	 */
+	CompiledAnimation::Channel::Channel() : bone(0), times(), keys(), quantized_keys()
+	{
+		for(int i = 0; i < 7; ++i)
+		{
+			quantize_min[i] = 0.0f;
+			quantize_scale[i] = 0.0f;
+		}
+	}
+
+	BoneInfluence CompiledAnimation::Channel::GetKey(unsigned int index) const
+	{
+		if(quantized_keys.empty())
+			return keys[index];
+
+		BoneInfluence result;
+		float* values = &result.ori.x;						// ori, pos, and div are 7 consecutive floats
+
+		const unsigned short* quantized = &quantized_keys[index * 7];
+		for(int i = 0; i < 7; ++i)
+			values[i] = quantize_min[i] + quantized[i] * quantize_scale[i];
+
+		return result;
+	}
+
+	BoneInfluence CompiledAnimation::Channel::Sample(float time, unsigned int& cursor) const
+	{
+		unsigned int last = times.size() - 1;
+
+		if(time <= times[0])
+		{
+			cursor = 0;
+			return GetKey(0);
+		}
+		if(time >= times[last])
+		{
+			cursor = last;
+			return GetKey(last);
+		}
+
+		// usually time is still between the same two keys as last time, or has moved on to the next pair
+		if(cursor >= last || time < times[cursor] || time >= times[cursor + 1])
+		{
+			if(cursor + 1 < last && time >= times[cursor + 1] && time < times[cursor + 2])
+				++cursor;
+			else
+				cursor = upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+		}
+
+		float b_frac = (time - times[cursor]) / (times[cursor + 1] - times[cursor]), a_frac = 1 - b_frac;
+
+		if(!quantized_keys.empty())
+		{
+			// lerp the quantized values, and dequantize once
+			BoneInfluence result;
+			float* values = &result.ori.x;
+
+			const unsigned short* a = &quantized_keys[cursor * 7];
+			const unsigned short* b = a + 7;
+			for(int i = 0; i < 7; ++i)
+				values[i] = quantize_min[i] + (a[i] * a_frac + b[i] * b_frac) * quantize_scale[i];
+
+			return result;
+		}
+
+		BoneInfluence a = keys[cursor], b = keys[cursor + 1];
+		return BoneInfluence(a.ori * a_frac + b.ori * b_frac, a.pos * a_frac + b.pos * b_frac, a.div * a_frac + b.div * b_frac);
+	}
+
+
+
+
+	/*
+	 * CompiledAnimation methods
+	 */
+	CompiledAnimation::CompiledAnimation() : name(""), duration(0.0f), loop_time(-1.0f), quantized(false), channels() { }
+
+	CompiledAnimation::CompiledAnimation(KeyframeAnimation& source, bool quantize) : name(source.name), duration(0.0f), loop_time(-1.0f), quantized(quantize), channels()
+	{
+		// find the order the frames play in, and when each one starts
+		vector<int> sequence;
+		vector<float> start_times;
+		vector<int> sequence_index(source.frames.size(), -1);
+
+		int next = source.frames.empty() ? -1 : 0;
+		while(next != -1 && sequence_index[next] == -1)
+		{
+			sequence_index[next] = sequence.size();
+			sequence.push_back(next);
+			start_times.push_back(duration);
 
-				for(map_iter = cur.values.begin(); map_iter != cur.values.end(); ++map_iter)
-					cur_names.insert(map_iter->first);
-				for(map_iter = nxt.values.begin(); map_iter != nxt.values.end(); ++map_iter)
-					next_names.insert(map_iter->first);
+			duration += source.frames[next].duration;
+			next = source.frames[next].next;
+		}
+
+		// the last key of each channel is either where it loops back to, or a copy of the final frame, which isn't lerped
+		int end_frame = next;
+		if(next != -1)
+			loop_time = start_times[sequence_index[next]];
+		else if(!sequence.empty())
+			end_frame = sequence.back();
 
-				// find the list of bone names used in both bones...
-				unordered_set<unsigned int> shared_names(cur_names);
-				for(set_iter = shared_names.begin(); set_iter != shared_names.end();)
+		// one channel per bone, in the order they first appear
+		unordered_map<unsigned int, unsigned int> channel_indices;
+		for(vector<int>::iterator iter = sequence.begin(); iter != sequence.end(); ++iter)
+		{
+			Keyframe& frame = source.frames[*iter];
+			for(unordered_map<unsigned int, BoneInfluence>::iterator jter = frame.values.begin(); jter != frame.values.end(); ++jter)
+				if(channel_indices.find(jter->first) == channel_indices.end())
 				{
-					if(next_names.find(*set_iter) == next_names.end())
-						set_iter = shared_names.erase(set_iter);
-					else
-						++set_iter;
+					channel_indices[jter->first] = channels.size();
+
+					channels.push_back(Channel());
+					channels.back().bone = jter->first;
 				}
-				// ...and remove those names from the other two lists
-				for(set_iter = cur_names.begin(); set_iter != cur_names.end();)
+		}
+
+		unsigned int key_count = sequence.size() + 1;
+		for(vector<Channel>::iterator iter = channels.begin(); iter != channels.end(); ++iter)
+		{
+			Channel& channel = *iter;
+
+			for(unsigned int i = 0; i < key_count; ++i)
+			{
+				Keyframe& frame = source.frames[i < sequence.size() ? sequence[i] : end_frame];
+				unordered_map<unsigned int, BoneInfluence>::iterator found = frame.values.find(channel.bone);
+
+				BoneInfluence key = found == frame.values.end() ? BoneInfluence() : found->second;
+
+				// leave out keys which are the same as the keys on either side of them
+				if(i > 0 && i + 1 < key_count && memcmp(&key, &channel.keys.back(), sizeof(BoneInfluence)) == 0)
 				{
-					if(shared_names.find(*set_iter) != shared_names.end())
-						set_iter = cur_names.erase(set_iter);
-					else
-						++set_iter;
+					Keyframe& next_frame = source.frames[i + 1 < sequence.size() ? sequence[i + 1] : end_frame];
+					unordered_map<unsigned int, BoneInfluence>::iterator next_found = next_frame.values.find(channel.bone);
+
+					BoneInfluence next_key = next_found == next_frame.values.end() ? BoneInfluence() : next_found->second;
+					if(memcmp(&key, &next_key, sizeof(BoneInfluence)) == 0)
+						continue;
 				}
-				for(set_iter = next_names.begin(); set_iter != next_names.end();)
+
+				channel.times.push_back(i < sequence.size() ? start_times[i] : duration);
+				channel.keys.push_back(key);
+			}
+
+			if(quantize)
+			{
+				unsigned int channel_keys = channel.keys.size();
+
+				for(int j = 0; j < 7; ++j)
 				{
-					if(shared_names.find(*set_iter) != shared_names.end())
-						set_iter = next_names.erase(set_iter);
-					else
-						++set_iter;
+					float min_value = (&channel.keys[0].ori.x)[j], max_value = min_value;
+					for(unsigned int i = 1; i < channel_keys; ++i)
+					{
+						float value = (&channel.keys[i].ori.x)[j];
+						min_value = min(min_value, value);
+						max_value = max(max_value, value);
+					}
+
+					channel.quantize_min[j] = min_value;
+					channel.quantize_scale[j] = (max_value - min_value) / 65535.0f;
 				}
 
-				for(set_iter = cur_names.begin(); set_iter != cur_names.end(); ++set_iter)
+				channel.quantized_keys.resize(channel_keys * 7);
+				for(unsigned int i = 0; i < channel_keys; ++i)
+					for(int j = 0; j < 7; ++j)
+					{
+						float scale = channel.quantize_scale[j];
+						float steps = scale > 0 ? ((&channel.keys[i].ori.x)[j] - channel.quantize_min[j]) / scale : 0.0f;
+
+						channel.quantized_keys[i * 7 + j] = (unsigned short)max(0.0f, min(65535.0f, steps + 0.5f));
+					}
+
+				channel.keys.clear();
+			}
+		}
+	}
+
+	bool CompiledAnimation::WrapTime(float& time) const
+	{
+		if(time < 0)
+			time = 0;
+
+		if(loop_time < 0)
+			return time <= duration;
+
+		if(time >= duration)
+		{
+			float loop_duration = duration - loop_time;
+			time = loop_duration > 0 ? loop_time + fmod(time - loop_time, loop_duration) : loop_time;
+		}
+		return true;
+	}
+
+	void CompiledAnimation::Sample(float time, unsigned int* cursors, BoneInfluence* results) const
+	{
+		for(vector<Channel>::const_iterator iter = channels.begin(); iter != channels.end(); ++iter)
+			*(results++) = iter->Sample(time, *(cursors++));
+	}
+
+	int CompiledAnimation::ReadCompiledAnimation(istream& stream, CompiledAnimation** result)
+	{
+		CompiledAnimation* temp = new CompiledAnimation();
+
+		temp->name = ReadString1(stream);
+		temp->duration = ReadSingle(stream);
+		temp->loop_time = ReadSingle(stream);
+		temp->quantized = ReadBool(stream);
+
+		unsigned int channel_count = ReadUInt32(stream);
+		for(unsigned int i = 0; i < channel_count && stream; ++i)
+		{
+			temp->channels.push_back(Channel());
+			Channel& channel = temp->channels.back();
+
+			string bone_name = ReadString1(stream);
+			unsigned int key_count = ReadUInt32(stream);
+
+			if(bone_name.empty() || key_count == 0)
+			{
+				delete temp;
+				return 2;
+			}
+
+			channel.bone = Bone::string_table[bone_name];
+
+			for(unsigned int j = 0; j < key_count && stream; ++j)
+				channel.times.push_back(ReadSingle(stream));
+
+			if(temp->quantized)
+			{
+				for(int j = 0; j < 7; ++j)
 				{
-					BoneInfluence vec = cur.values[*set_iter];
-					SetBonePose(*set_iter, vec.ori * a_frac, vec.pos * a_frac, vec.div * a_frac);
+					channel.quantize_min[j] = ReadSingle(stream);
+					channel.quantize_scale[j] = ReadSingle(stream);
 				}
-				for(set_iter = next_names.begin(); set_iter != next_names.end(); ++set_iter)
+
+				for(unsigned int j = 0; j < key_count * 7 && stream; ++j)
+					channel.quantized_keys.push_back(ReadUInt16(stream));
+			}
+			else
+			{
+				for(unsigned int j = 0; j < key_count && stream; ++j)
 				{
-					BoneInfluence vec = nxt.values[*set_iter];
-					SetBonePose(*set_iter, vec.ori * b_frac, vec.pos * b_frac, vec.div * b_frac);
+					BoneInfluence key;
+					key.ori = ReadVec3(stream);
+					key.pos = ReadVec3(stream);
+					key.div = ReadSingle(stream);
+
+					channel.keys.push_back(key);
 				}
-				for(set_iter = shared_names.begin(); set_iter != shared_names.end(); ++set_iter)
+			}
+		}
+
+		if(!stream)
+		{
+			delete temp;
+			return 1;
+		}
+
+		*result = temp;
+		return 0;
+	}
+
+	int CompiledAnimation::WriteCompiledAnimation(ostream& stream, CompiledAnimation* anim)
+	{
+		WriteString1(anim->name, stream);
+		WriteSingle(anim->duration, stream);
+		WriteSingle(anim->loop_time, stream);
+		WriteBool(anim->quantized, stream);
+
+		WriteUInt32(anim->channels.size(), stream);
+		for(vector<Channel>::iterator iter = anim->channels.begin(); iter != anim->channels.end(); ++iter)
+		{
+			Channel& channel = *iter;
+
+			WriteString1(Bone::string_table[channel.bone], stream);
+
+			unsigned int key_count = channel.times.size();
+			WriteUInt32(key_count, stream);
+
+			for(unsigned int i = 0; i < key_count; ++i)
+				WriteSingle(channel.times[i], stream);
+
+			if(anim->quantized)
+			{
+				for(int i = 0; i < 7; ++i)
 				{
-					BoneInfluence cur_vec = cur.values[*set_iter];
-					BoneInfluence next_vec = nxt.values[*set_iter];
-					SetBonePose(*set_iter, cur_vec.ori * a_frac + next_vec.ori * b_frac, cur_vec.pos * a_frac + next_vec.pos * b_frac, cur_vec.div * a_frac + next_vec.div * b_frac);
+					WriteSingle(channel.quantize_min[i], stream);
+					WriteSingle(channel.quantize_scale[i], stream);
 				}
+
+				for(unsigned int i = 0; i < key_count * 7; ++i)
+					WriteUInt16(channel.quantized_keys[i], stream);
 			}
 			else
 			{
-				// here we can forego the extra vector and scalar multiplications that are necessary for lerp
-				for(unordered_map<unsigned int, BoneInfluence>::iterator iter = cur.values.begin(); iter != cur.values.end(); ++iter)
+				for(unsigned int i = 0; i < key_count; ++i)
 				{
-					BoneInfluence vec = cur.values[iter->first];
-					SetBonePose(iter->first, vec.ori, vec.pos, vec.div);
+					BoneInfluence& key = channel.keys[i];
+					WriteVec3(key.ori, stream);
+					WriteVec3(key.pos, stream);
+					WriteSingle(key.div, stream);
 				}
 			}
 		}
+
+		return stream ? 0 : 1;
+	}
+
+
+
+
+	/*
+	 * CompiledAnimationPose methods
+	 */
+	CompiledAnimationPose::CompiledAnimationPose(CompiledAnimation* animation) : Pose(), cursors(animation->channels.size()), animation(animation), current_time(0.0f)
+	{
+		// give each channel the slot with the same index, so the samples can be written straight into bone_influences
+		for(vector<CompiledAnimation::Channel>::iterator iter = animation->channels.begin(); iter != animation->channels.end(); ++iter)
+			GetBoneSlot(iter->bone);
+	}
+
+	void CompiledAnimationPose::UpdatePose(TimingInfo time)
+	{
+		current_time += time.elapsed;
+
+		if(animation->WrapTime(current_time))
+		{
+			if(!cursors.empty())
+				animation->Sample(current_time, &cursors[0], &bone_influences[0]);
+		}
 		else
 			SetActive(false);
 	}
@@ -51,4 +51,97 @@ namespace CibraryEngine
 			/** Advances the animation and poses bones */
 			virtual void UpdatePose(TimingInfo time);
 	};
+
+	/**
+	 * A KeyframeAnimation compiled for playback, with one channel of timed keys per bone instead of a map of bones per keyframe;
+	 * one of these can be shared by any number of CompiledAnimationPoses
+	 */
+	class CompiledAnimation
+	{
+		public:
+
+			/** The keys for a single bone; between two keys, the bone's influence is lerped from one to the other */
+			struct Channel
+			{
+				/** Name of the bone this channel poses */
+				unsigned int bone;
+
+				/** When each key happens, in ascending order; the first is at 0, the last at the animation's duration */
+				vector<float> times;
+
+				/** The influence at each key, if the animation isn't quantized */
+				vector<BoneInfluence> keys;
+
+				/** The influence at each key as 7 unsigned shorts (ori, pos, div), if the animation is quantized */
+				vector<unsigned short> quantized_keys;
+				/** The value each component of a quantized key starts from */
+				float quantize_min[7];
+				/** How much each step of a component of a quantized key is worth */
+				float quantize_scale[7];
+
+				Channel();
+
+				/** Gets the influence at the specified key */
+				BoneInfluence GetKey(unsigned int index) const;
+
+				/** Gets the influence at the specified time; cursor is the key the previous call for this channel started from, and is updated */
+				BoneInfluence Sample(float time, unsigned int& cursor) const;
+			};
+
+			/** The name of the animation */
+			string name;
+
+			/** Length of the animation, in seconds */
+			float duration;
+			/** When the animation goes back to after reaching the end, or -1 if it stops there */
+			float loop_time;
+
+			/** Whether the channels' keys are stored as quantized_keys instead of keys */
+			bool quantized;
+
+			/** The channels of this animation, one per bone it affects */
+			vector<Channel> channels;
+
+			/** Initializes an empty CompiledAnimation */
+			CompiledAnimation();
+			/**
+			 * Compiles a KeyframeAnimation, by following its frames from the first one until one is reached for the second time, or
+			 * one has no next frame; a bone missing from some keyframes is given a key with no influence at those frames, and keys
+			 * which are the same as the ones before and after them are left out
+			 */
+			CompiledAnimation(KeyframeAnimation& source, bool quantize = false);
+
+			/** Maps a time since the animation began into the animation, wrapping around if it loops; returns false if it's over */
+			bool WrapTime(float& time) const;
+
+			/** Gets the influence of each channel at the specified time, which should be wrapped already; there must be a cursor and a result per channel */
+			void Sample(float time, unsigned int* cursors, BoneInfluence* results) const;
+
+			/** Reads a compiled animation from a stream, and returns 0 if ok or an int error code */
+			static int ReadCompiledAnimation(istream& stream, CompiledAnimation** result);
+			/** Writes a compiled animation to a stream, and returns 0 if ok or an int error code */
+			static int WriteCompiledAnimation(ostream& stream, CompiledAnimation* anim);
+	};
+
+	/** Pose class which plays a CompiledAnimation */
+	class CompiledAnimationPose : public Pose
+	{
+		private:
+
+			vector<unsigned int> cursors;
+
+		public:
+
+			/** The animation being played; the pose's bone slots are set up for this animation, so it shouldn't be changed */
+			CompiledAnimation* animation;
+
+			/** Time since the animation began, wrapped around if it loops */
+			float current_time;
+
+			/** Initializes a CompiledAnimationPose, playing the specified animation from the beginning */
+			CompiledAnimationPose(CompiledAnimation* animation);
+
+			/** Advances the animation and poses bones */
+			virtual void UpdatePose(TimingInfo time);
+	};
 }
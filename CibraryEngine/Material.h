@@ -50,7 +50,10 @@ namespace CibraryEngine
 			/** Abstract function called when a RenderNode using this material is drawn */
 			virtual void Draw(RenderNode node) = 0;
 
-			/** Abstract function to clean up any resources created while drawing stuff */
+			/**
+			 * Abstract function to clean up any resources created while drawing stuff; node data allocated from the
+			 * SceneRenderer's frame_data must not be deleted here, since frame_data releases all of it at once
+			 */
 			virtual void Cleanup(RenderNode node) = 0;
 
 			/** Abstract function to determine whether on material equals another; implementations should check mclass_id! */
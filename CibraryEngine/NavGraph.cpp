@@ -122,6 +122,355 @@ namespace CibraryEngine
 		}
 	}
 
+	/*
+	 * Frozen copy of a graph, in compressed sparse row form; nodes are addressed by a dense index (in order of
+	 * increasing node id), and each node's out-edges (or in-edges) are a contiguous range of the edge arrays
+	 */
+	struct CompiledNavGraph
+	{
+		static const unsigned int INVALID_INDEX = 0xFFFFFFFF;
+
+		vector<unsigned int> node_ids;						// dense index --> node id
+		vector<unsigned int> id_to_index;					// node id --> dense index, or INVALID_INDEX
+		vector<Vec3> positions;
+
+		vector<unsigned int> out_offsets;					// out-edges of node i are [out_offsets[i], out_offsets[i + 1])
+		vector<unsigned int> out_targets;
+		vector<float> out_costs;
+
+		vector<unsigned int> in_offsets;					// in-edges of node i are [in_offsets[i], in_offsets[i + 1])
+		vector<unsigned int> in_sources;
+		vector<float> in_costs;
+
+		CompiledNavGraph() : node_ids(), id_to_index(), positions(), out_offsets(), out_targets(), out_costs(), in_offsets(), in_sources(), in_costs() { }
+
+		unsigned int GetIndex(unsigned int id) { return id < id_to_index.size() ? id_to_index[id] : INVALID_INDEX; }
+
+		void Build(unordered_map<unsigned int, NavNode*>& nodes, unsigned int node_id_bound)
+		{
+			node_ids.clear();
+			positions.clear();
+			id_to_index.assign(node_id_bound, INVALID_INDEX);
+
+			for(unsigned int id = 1; id < node_id_bound; ++id)
+			{
+				unordered_map<unsigned int, NavNode*>::iterator found = nodes.find(id);
+				if(found != nodes.end())
+				{
+					id_to_index[id] = node_ids.size();
+					node_ids.push_back(id);
+					positions.push_back(found->second->pos);
+				}
+			}
+
+			unsigned int node_count = node_ids.size();
+
+			out_offsets.assign(node_count + 1, 0);
+			out_targets.clear();
+			out_costs.clear();
+
+			in_offsets.assign(node_count + 1, 0);
+
+			for(unsigned int i = 0; i < node_count; ++i)
+			{
+				NavNode* node = nodes[node_ids[i]];
+
+				out_offsets[i] = out_targets.size();
+				for(map<unsigned int, NavEdge*>::iterator iter = node->edges.begin(); iter != node->edges.end(); ++iter)
+				{
+					unsigned int target = GetIndex(iter->first);
+					out_targets.push_back(target);
+					out_costs.push_back(iter->second->cost);
+
+					++in_offsets[target + 1];
+				}
+			}
+			out_offsets[node_count] = out_targets.size();
+
+			// in-edges: prefix sum of the in-degrees, then scatter each out-edge into its target's range
+			for(unsigned int i = 0; i < node_count; ++i)
+				in_offsets[i + 1] += in_offsets[i];
+
+			in_sources.resize(out_targets.size());
+			in_costs.resize(out_targets.size());
+
+			vector<unsigned int> cursors(in_offsets.begin(), in_offsets.end() - 1);
+			for(unsigned int i = 0; i < node_count; ++i)
+				for(unsigned int j = out_offsets[i]; j < out_offsets[i + 1]; ++j)
+				{
+					unsigned int k = cursors[out_targets[j]]++;
+					in_sources[k] = i;
+					in_costs[k] = out_costs[j];
+				}
+		}
+	};
+
+	/*
+	 * NavGraphSnapshot private implementation struct
+	 */
+	struct NavGraphSnapshot::Imp
+	{
+		CompiledNavGraph compiled;
+		unsigned int edit_count;
+
+		boost::mutex mutex;
+		unsigned int ref_count;
+
+		Imp(CompiledNavGraph& compiled, unsigned int edit_count) : compiled(compiled), edit_count(edit_count), mutex(), ref_count(1) { }
+	};
+
+
+
+
+	/*
+	 * NavGraphSnapshot methods
+	 */
+	NavGraphSnapshot::NavGraphSnapshot(Imp* imp) : imp(imp) { }
+	NavGraphSnapshot::~NavGraphSnapshot() { delete imp; imp = NULL; }
+
+	void NavGraphSnapshot::AddRef() { boost::mutex::scoped_lock lock(imp->mutex); ++imp->ref_count; }
+
+	void NavGraphSnapshot::Release()
+	{
+		bool last;
+		{
+			boost::mutex::scoped_lock lock(imp->mutex);
+			last = --imp->ref_count == 0;
+		}
+
+		if(last)
+			delete this;
+	}
+
+	unsigned int NavGraphSnapshot::GetEditCount() { return imp->edit_count; }
+	unsigned int NavGraphSnapshot::GetNodeIDBound() { return imp->compiled.id_to_index.size(); }
+
+	bool NavGraphSnapshot::HasNode(unsigned int node) { return imp->compiled.GetIndex(node) != CompiledNavGraph::INVALID_INDEX; }
+
+	Vec3 NavGraphSnapshot::GetNodePosition(unsigned int node)
+	{
+		unsigned int index = imp->compiled.GetIndex(node);
+		return index == CompiledNavGraph::INVALID_INDEX ? Vec3() : imp->compiled.positions[index];
+	}
+
+	void NavGraphSnapshot::GetNodeOutEdges(unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs)
+	{
+		neighbors.clear();
+		costs.clear();
+
+		CompiledNavGraph& c = imp->compiled;
+
+		unsigned int index = c.GetIndex(node);
+		if(index != CompiledNavGraph::INVALID_INDEX)
+			for(unsigned int i = c.out_offsets[index]; i < c.out_offsets[index + 1]; ++i)
+			{
+				neighbors.push_back(c.node_ids[c.out_targets[i]]);
+				costs.push_back(c.out_costs[i]);
+			}
+	}
+
+	void NavGraphSnapshot::GetNodeInEdges(unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs)
+	{
+		neighbors.clear();
+		costs.clear();
+
+		CompiledNavGraph& c = imp->compiled;
+
+		unsigned int index = c.GetIndex(node);
+		if(index != CompiledNavGraph::INVALID_INDEX)
+			for(unsigned int i = c.in_offsets[index]; i < c.in_offsets[index + 1]; ++i)
+			{
+				neighbors.push_back(c.node_ids[c.in_sources[i]]);
+				costs.push_back(c.in_costs[i]);
+			}
+	}
+
+
+
+
+	/*
+	 * Uniform grid over the x-z positions of a graph's nodes, for nearest-node and radius queries; cells are
+	 * hashed, so the grid doesn't need to know the extents of the level in advance
+	 */
+	struct NavNodeGrid
+	{
+		struct Entry
+		{
+			unsigned int id;
+			Vec3 pos;
+
+			Entry(unsigned int id, Vec3 pos) : id(id), pos(pos) { }
+		};
+
+		// candidate nodes found by a query, to be sorted nearest-first (ties broken by id, so results are deterministic)
+		struct Candidate
+		{
+			float dist_sq;
+			unsigned int id;
+
+			Candidate() : dist_sq(0), id(0) { }
+			Candidate(float dist_sq, unsigned int id) : dist_sq(dist_sq), id(id) { }
+
+			bool operator <(const Candidate& other) const { return dist_sq < other.dist_sq || dist_sq == other.dist_sq && id < other.id; }
+		};
+
+		float cell_size;
+		float inv_cell_size;
+
+		unordered_map<unsigned long long, vector<Entry> > cells;
+		unsigned int count;
+
+		// range of cell coordinates which have ever been occupied; bounds how far a nearest-node search has to look
+		int min_x, max_x, min_z, max_z;
+
+		NavNodeGrid(float cell_size) : cell_size(cell_size), inv_cell_size(1.0f / cell_size), cells(), count(0), min_x(0), max_x(-1), min_z(0), max_z(-1) { }
+
+		int CellCoord(float f) { return (int)floor(f * inv_cell_size); }
+		static unsigned long long CellKey(int x, int z) { return ((unsigned long long)(unsigned int)x << 32) | (unsigned int)z; }
+
+		void Insert(unsigned int id, Vec3 pos)
+		{
+			int x = CellCoord(pos.x), z = CellCoord(pos.z);
+
+			if(count == 0 && max_x < min_x)
+			{
+				min_x = max_x = x;
+				min_z = max_z = z;
+			}
+			else
+			{
+				min_x = min(min_x, x);
+				max_x = max(max_x, x);
+				min_z = min(min_z, z);
+				max_z = max(max_z, z);
+			}
+
+			cells[CellKey(x, z)].push_back(Entry(id, pos));
+			++count;
+		}
+
+		void Remove(unsigned int id, Vec3 pos)
+		{
+			unordered_map<unsigned long long, vector<Entry> >::iterator found = cells.find(CellKey(CellCoord(pos.x), CellCoord(pos.z)));
+			if(found == cells.end())
+				return;
+
+			vector<Entry>& cell = found->second;
+			for(unsigned int i = 0; i < cell.size(); ++i)
+				if(cell[i].id == id)
+				{
+					cell[i] = cell.back();
+					cell.pop_back();
+					--count;
+
+					break;
+				}
+		}
+
+		void Move(unsigned int id, Vec3 old_pos, Vec3 new_pos)
+		{
+			int old_x = CellCoord(old_pos.x), old_z = CellCoord(old_pos.z);
+			int new_x = CellCoord(new_pos.x), new_z = CellCoord(new_pos.z);
+
+			if(old_x == new_x && old_z == new_z)
+			{
+				vector<Entry>& cell = cells[CellKey(old_x, old_z)];
+				for(unsigned int i = 0; i < cell.size(); ++i)
+					if(cell[i].id == id)
+						cell[i].pos = new_pos;
+			}
+			else
+			{
+				Remove(id, old_pos);
+				Insert(id, new_pos);
+			}
+		}
+
+		void Clear()
+		{
+			cells.clear();
+			count = 0;
+
+			min_x = min_z = 0;
+			max_x = max_z = -1;
+		}
+
+		void AddCellCandidates(int x, int z, Vec3 pos, float max_dist_sq, vector<Candidate>& results)
+		{
+			unordered_map<unsigned long long, vector<Entry> >::iterator found = cells.find(CellKey(x, z));
+			if(found == cells.end())
+				return;
+
+			vector<Entry>& cell = found->second;
+			for(vector<Entry>::iterator iter = cell.begin(); iter != cell.end(); ++iter)
+			{
+				float dist_sq = (iter->pos - pos).ComputeMagnitudeSquared();
+				if(max_dist_sq < 0 || dist_sq <= max_dist_sq)
+					results.push_back(Candidate(dist_sq, iter->id));
+			}
+		}
+
+		/** Finds the k nodes nearest to pos, nearest first, by searching rings of cells outward from the one containing pos */
+		void GetNearest(Vec3 pos, unsigned int k, vector<Candidate>& results)
+		{
+			results.clear();
+			if(k == 0 || count == 0)
+				return;
+
+			int cx = CellCoord(pos.x), cz = CellCoord(pos.z);
+			int max_ring = max(max(abs(cx - min_x), abs(cx - max_x)), max(abs(cz - min_z), abs(cz - max_z)));
+
+			for(int ring = 0; ring <= max_ring; ++ring)
+			{
+				for(int x = cx - ring; x <= cx + ring; ++x)
+				{
+					if(x < min_x || x > max_x)
+						continue;
+
+					// interior rows of the ring only have the two end cells
+					int z_step = (x == cx - ring || x == cx + ring) ? 1 : max(1, ring * 2);
+					for(int z = cz - ring; z <= cz + ring; z += z_step)
+						if(z >= min_z && z <= max_z)
+							AddCellCandidates(x, z, pos, -1.0f, results);
+				}
+
+				// anything in a cell further out than this ring is at least this far away (horizontally)
+				if(results.size() >= k)
+				{
+					partial_sort(results.begin(), results.begin() + k, results.end());
+					results.resize(k);
+
+					float reach = ring * cell_size;
+					if(results.back().dist_sq <= reach * reach)
+						return;
+				}
+			}
+
+			sort(results.begin(), results.end());
+			if(results.size() > k)
+				results.resize(k);
+		}
+
+		/** Finds all of the nodes within the given distance of pos, nearest first */
+		void GetInRadius(Vec3 pos, float radius, vector<Candidate>& results)
+		{
+			results.clear();
+			if(count == 0 || radius < 0)
+				return;
+
+			int x0 = max(min_x, CellCoord(pos.x - radius)), x1 = min(max_x, CellCoord(pos.x + radius));
+			int z0 = max(min_z, CellCoord(pos.z - radius)), z1 = min(max_z, CellCoord(pos.z + radius));
+
+			for(int x = x0; x <= x1; ++x)
+				for(int z = z0; z <= z1; ++z)
+					AddCellCandidates(x, z, pos, radius * radius, results);
+
+			sort(results.begin(), results.end());
+		}
+	};
+
+	const unsigned int CompiledNavGraph::INVALID_INDEX;
+
 	struct NavGraphObject : public Disposable
 	{
 		protected:						// non-public only because Disposable says so
@@ -132,6 +481,15 @@ namespace CibraryEngine
 					delete iter->second;
 				nodes.clear();
 
+				compiled_valid = false;
+				grid.Clear();
+
+				if(snapshot != NULL)
+				{
+					snapshot->Release();
+					snapshot = NULL;
+				}
+
 				Disposable::InnerDispose();
 			}
 
@@ -141,6 +499,45 @@ namespace CibraryEngine
 
 			unordered_map<unsigned int, NavNode*> nodes;
 
+			// built on demand from the nodes above, and thrown out whenever they are edited
+			CompiledNavGraph compiled;
+			bool compiled_valid;
+
+			CompiledNavGraph& GetCompiled()
+			{
+				if(!compiled_valid)
+				{
+					compiled.Build(nodes, next_node_id);
+					compiled_valid = true;
+				}
+				return compiled;
+			}
+			void InvalidateCompiled() { compiled_valid = false; ++edit_count; }
+
+			unsigned int edit_count;
+
+			// copy of the compiled graph handed out to other threads; replaced once the edit count changes
+			NavGraphSnapshot* snapshot;
+
+			NavGraphSnapshot* GetSnapshot()
+			{
+				if(snapshot != NULL && snapshot->GetEditCount() != edit_count)
+				{
+					snapshot->Release();
+					snapshot = NULL;
+				}
+
+				if(snapshot == NULL)
+					snapshot = new NavGraphSnapshot(new NavGraphSnapshot::Imp(GetCompiled(), edit_count));
+
+				snapshot->AddRef();
+				return snapshot;
+			}
+
+			// spatial index of node positions, kept up to date as nodes are added, removed, or moved
+			NavNodeGrid grid;
+			vector<NavNodeGrid::Candidate> query_results;
+
 			NavNode* GetNodeByID(unsigned int id)
 			{
 				unordered_map<unsigned int, NavNode*>::iterator found = nodes.find(id);
@@ -161,6 +558,12 @@ namespace CibraryEngine
 			
 			NavGraphObject(GameState* game_state) :
 				nodes(),
+				compiled(),
+				compiled_valid(false),
+				edit_count(0),
+				snapshot(NULL),
+				grid(8.0f),
+				query_results(),
 				next_node_id(1),
 				game_state(game_state)
 			{
@@ -169,6 +572,9 @@ namespace CibraryEngine
 			unsigned int NewNode(Vec3 pos)
 			{
 				nodes[next_node_id] = new NavNode(pos);
+				grid.Insert(next_node_id, pos);
+				InvalidateCompiled();
+
 				return next_node_id++;
 			}
 
@@ -177,6 +583,8 @@ namespace CibraryEngine
 				unordered_map<unsigned int, NavNode*>::iterator found = nodes.find(id);
 				if(found != nodes.end())
 				{
+					grid.Remove(id, found->second->pos);
+
 					// this destructor will delete any edges from this node...
 					delete found->second;
 					nodes.erase(found);
@@ -184,6 +592,8 @@ namespace CibraryEngine
 					// ...but we also need to delete edges from other nodes to this node
 					for(unordered_map<unsigned int, NavNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
 						iter->second->DeleteEdge(id);
+
+					InvalidateCompiled();
 				}
 			}
 
@@ -195,13 +605,25 @@ namespace CibraryEngine
 				return results;
 			}
 
-			vector<unsigned int> GetVisibleNodes(Vec3 pos)
+			unsigned int GetNodeIDBound() { return next_node_id; }
+
+			vector<unsigned int> GetVisibleNodes(Vec3 pos, unsigned int max_results, float max_distance)
 			{
+				// raycasts are the expensive part, so check the nearest candidates first and stop once we have enough
+				if(max_distance >= 0)
+					grid.GetInRadius(pos, max_distance, query_results);
+				else
+					grid.GetNearest(pos, grid.count, query_results);
+
 				vector<unsigned int> results;
-				for(unordered_map<unsigned int, NavNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+				for(vector<NavNodeGrid::Candidate>::iterator iter = query_results.begin(); iter != query_results.end(); ++iter)
 				{
-					if(VisionBlocker::CheckLineOfSight(game_state->physics_world, pos, iter->second->pos))
-						results.push_back(iter->first);
+					if(VisionBlocker::CheckLineOfSight(game_state->physics_world, pos, GetNodeByID(iter->id)->pos))
+					{
+						results.push_back(iter->id);
+						if(results.size() == max_results)
+							break;
+					}
 				}
 
 				return results;
@@ -209,21 +631,43 @@ namespace CibraryEngine
 
 			unsigned int GetNearestNode(Vec3 pos)
 			{
-				unsigned int result = 0;
-				float closest = 0;
+				grid.GetNearest(pos, 1, query_results);
+				return query_results.empty() ? 0 : query_results[0].id;
+			}
 
-				for(unordered_map<unsigned int, NavNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+			vector<unsigned int> GetNearestNodes(Vec3 pos, unsigned int k)
+			{
+				grid.GetNearest(pos, k, query_results);
+
+				vector<unsigned int> results;
+				for(vector<NavNodeGrid::Candidate>::iterator iter = query_results.begin(); iter != query_results.end(); ++iter)
+					results.push_back(iter->id);
+				return results;
+			}
+
+			vector<unsigned int> GetNodesInRadius(Vec3 pos, float radius)
+			{
+				grid.GetInRadius(pos, radius, query_results);
+
+				vector<unsigned int> results;
+				for(vector<NavNodeGrid::Candidate>::iterator iter = query_results.begin(); iter != query_results.end(); ++iter)
+					results.push_back(iter->id);
+				return results;
+			}
+
+			Vec3 GetPosition(unsigned int node)
+			{
+				if(compiled_valid)
 				{
-					Vec3 node_pos = iter->second->pos;
-					float dist_sq = (pos - node_pos).ComputeMagnitudeSquared();
-					if(result == 0 || dist_sq < closest)
-					{
-						closest = dist_sq;
-						result = iter->first;
-					}
+					unsigned int index = compiled.GetIndex(node);
+					if(index != CompiledNavGraph::INVALID_INDEX)
+						return compiled.positions[index];
 				}
+				else if(NavNode* n = GetNodeByID(node))
+					return n->pos;
 
-				return result;
+				navgraph_error = NavGraph::ERR_INVALID_NODE;
+				return Vec3();
 			}
 
 			vector<unsigned int> GetEdges(unsigned int node_id, NavGraph::PathDirection dir)
@@ -236,25 +680,68 @@ namespace CibraryEngine
 					return results;
 				}
 
-				NavNode* node = GetNodeByID(node_id);
-				if(!node)
+				CompiledNavGraph& c = GetCompiled();
+
+				unsigned int index = c.GetIndex(node_id);
+				if(index == CompiledNavGraph::INVALID_INDEX)
 				{
 					navgraph_error = NavGraph::ERR_INVALID_NODE;
 					return results;
 				}
 
 				if(dir & NavGraph::PD_OUT)
-					for(map<unsigned int, NavEdge*>::iterator iter = node->edges.begin(); iter != node->edges.end(); ++iter)
-						results.push_back(iter->first);
+					for(unsigned int i = c.out_offsets[index]; i < c.out_offsets[index + 1]; ++i)
+						results.push_back(c.node_ids[c.out_targets[i]]);
 
 				if(dir & NavGraph::PD_IN)
-					for(unordered_map<unsigned int, NavNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
-						if(iter->second->GetEdgeByID(node_id))
-							results.push_back(iter->first);
+					for(unsigned int i = c.in_offsets[index]; i < c.in_offsets[index + 1]; ++i)
+						results.push_back(c.node_ids[c.in_sources[i]]);
 
 				return results;
 			}
 
+			void GetOutEdges(unsigned int node_id, vector<unsigned int>& neighbors, vector<float>& costs)
+			{
+				neighbors.clear();
+				costs.clear();
+
+				CompiledNavGraph& c = GetCompiled();
+
+				unsigned int index = c.GetIndex(node_id);
+				if(index == CompiledNavGraph::INVALID_INDEX)
+				{
+					navgraph_error = NavGraph::ERR_INVALID_NODE;
+					return;
+				}
+
+				for(unsigned int i = c.out_offsets[index]; i < c.out_offsets[index + 1]; ++i)
+				{
+					neighbors.push_back(c.node_ids[c.out_targets[i]]);
+					costs.push_back(c.out_costs[i]);
+				}
+			}
+
+			void GetInEdges(unsigned int node_id, vector<unsigned int>& neighbors, vector<float>& costs)
+			{
+				neighbors.clear();
+				costs.clear();
+
+				CompiledNavGraph& c = GetCompiled();
+
+				unsigned int index = c.GetIndex(node_id);
+				if(index == CompiledNavGraph::INVALID_INDEX)
+				{
+					navgraph_error = NavGraph::ERR_INVALID_NODE;
+					return;
+				}
+
+				for(unsigned int i = c.in_offsets[index]; i < c.in_offsets[index + 1]; ++i)
+				{
+					neighbors.push_back(c.node_ids[c.in_sources[i]]);
+					costs.push_back(c.in_costs[i]);
+				}
+			}
+
 			bool HasEdge(unsigned int a, unsigned int b, NavGraph::PathDirection dir)
 			{
 				if(dir > NavGraph::PD_EITHER)
@@ -278,7 +765,24 @@ namespace CibraryEngine
 
 			float GetEdgeCost(unsigned int from, unsigned int to)
 			{
-				
+				if(compiled_valid)
+				{
+					unsigned int from_index = compiled.GetIndex(from);
+					unsigned int to_index = compiled.GetIndex(to);
+					if(from_index == CompiledNavGraph::INVALID_INDEX || to_index == CompiledNavGraph::INVALID_INDEX)
+					{
+						navgraph_error = NavGraph::ERR_INVALID_NODE;
+						return 0.0f;
+					}
+
+					for(unsigned int i = compiled.out_offsets[from_index]; i < compiled.out_offsets[from_index + 1]; ++i)
+						if(compiled.out_targets[i] == to_index)
+							return compiled.out_costs[i];
+
+					navgraph_error = NavGraph::ERR_INVALID_EDGE;
+					return 0.0f;
+				}
+
 				if(!GetNodeByID(from) || !GetNodeByID(to))
 				{
 					navgraph_error = NavGraph::ERR_INVALID_NODE;
@@ -296,7 +800,15 @@ namespace CibraryEngine
 			void SetPosition(unsigned int node, Vec3 pos)
 			{
 				if(NavNode* n = GetNodeByID(node))
+				{
+					grid.Move(node, n->pos, pos);
+
 					n->pos = pos;
+					if(compiled_valid)
+						compiled.positions[compiled.GetIndex(node)] = pos;			// positions don't affect the structure, so just patch the compiled copy
+
+					++edit_count;
+				}
 				else
 					navgraph_error = NavGraph::ERR_INVALID_NODE;
 			}
@@ -307,6 +819,8 @@ namespace CibraryEngine
 					if(NavNode* to_node = GetNodeByID(to))
 					{
 						from_node->NewEdge(to, cost);
+						InvalidateCompiled();
+
 						return;
 					}
 
@@ -321,6 +835,8 @@ namespace CibraryEngine
 					if(NavNode* to_node = GetNodeByID(to))
 					{
 						from_node->DeleteEdge(to);
+						InvalidateCompiled();
+
 						return;
 					}
 				
@@ -399,11 +915,47 @@ namespace CibraryEngine
 		}
 	}
 
-	vector<unsigned int> NavGraph::GetVisibleNodes(unsigned int graph, Vec3 pos)
+	unsigned int NavGraph::GetEditCount(unsigned int graph)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			return obj->edit_count;
+		else
+		{
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+			return 0;
+		}
+	}
+
+	unsigned int NavGraph::GetNodeIDBound(unsigned int graph)
 	{
 		NavGraphObject* obj = GetGraphByID(graph);
 		if(obj)
-			return obj->GetVisibleNodes(pos);
+			return obj->GetNodeIDBound();
+		else
+		{
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+			return 0;
+		}
+	}
+
+	NavGraphSnapshot* NavGraph::GetSnapshot(unsigned int graph)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			return obj->GetSnapshot();
+		else
+		{
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+			return NULL;
+		}
+	}
+
+	vector<unsigned int> NavGraph::GetVisibleNodes(unsigned int graph, Vec3 pos, unsigned int max_results, float max_distance)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			return obj->GetVisibleNodes(pos, max_results, max_distance);
 		else
 		{
 			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
@@ -423,11 +975,35 @@ namespace CibraryEngine
 		}
 	}
 
+	vector<unsigned int> NavGraph::GetNearestNodes(unsigned int graph, Vec3 pos, unsigned int k)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			return obj->GetNearestNodes(pos, k);
+		else
+		{
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+			return vector<unsigned int>();
+		}
+	}
+
+	vector<unsigned int> NavGraph::GetNodesInRadius(unsigned int graph, Vec3 pos, float radius)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			return obj->GetNodesInRadius(pos, radius);
+		else
+		{
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+			return vector<unsigned int>();
+		}
+	}
+
 	Vec3 NavGraph::GetNodePosition(unsigned int graph, unsigned int node)
 	{
 		NavGraphObject* obj = GetGraphByID(graph);
 		if(obj)
-			return obj->nodes[node]->pos;
+			return obj->GetPosition(node);
 		else
 		{
 			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
@@ -447,6 +1023,34 @@ namespace CibraryEngine
 		}
 	}
 
+	void NavGraph::GetNodeOutEdges(unsigned int graph, unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			obj->GetOutEdges(node, neighbors, costs);
+		else
+		{
+			neighbors.clear();
+			costs.clear();
+
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+		}
+	}
+
+	void NavGraph::GetNodeInEdges(unsigned int graph, unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs)
+	{
+		NavGraphObject* obj = GetGraphByID(graph);
+		if(obj)
+			obj->GetInEdges(node, neighbors, costs);
+		else
+		{
+			neighbors.clear();
+			costs.clear();
+
+			navgraph_error = NavGraph::ERR_INVALID_GRAPH;
+		}
+	}
+
 	bool NavGraph::NodeHasEdge(unsigned int graph, unsigned int node, unsigned int other, NavGraph::PathDirection dir)
 	{
 		NavGraphObject* obj = GetGraphByID(graph);
@@ -12,6 +12,38 @@ namespace CibraryEngine
 
 	struct Vec3;
 
+	/**
+	 * Immutable copy of a NavGraph's nodes and edges, as of one edit count; unlike the NavGraph functions, it is safe
+	 * to read from any thread. Get one with NavGraph::GetSnapshot, and Release it when finished with it
+	 */
+	class NavGraphSnapshot
+	{
+		friend class NavGraph;
+		friend struct NavGraphObject;
+
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+			NavGraphSnapshot(Imp* imp);
+			~NavGraphSnapshot();
+
+		public:
+
+			void AddRef();
+			void Release();												// deletes the snapshot once nothing else references it
+
+			unsigned int GetEditCount();
+			unsigned int GetNodeIDBound();
+
+			bool HasNode(unsigned int node);
+			Vec3 GetNodePosition(unsigned int node);
+
+			void GetNodeOutEdges(unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs);	// clears and refills the passed-in vectors
+			void GetNodeInEdges(unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs);
+	};
+
 	class NavGraph : public Disposable
 	{
 		private:
@@ -44,11 +76,18 @@ namespace CibraryEngine
 
 			// graph getter functions
 			static vector<unsigned int> GetAllNodes(unsigned int graph);
-			static vector<unsigned int> GetVisibleNodes(unsigned int graph, Vec3 pos);			// this function is expensive, so don't call it too often
+			static unsigned int GetEditCount(unsigned int graph);								// incremented every time the graph is modified; anything derived from the graph can compare this to see if it's stale
+			static unsigned int GetNodeIDBound(unsigned int graph);								// node ids are handed out sequentially, so every node id is less than this
+			static NavGraphSnapshot* GetSnapshot(unsigned int graph);							// shared between callers until the graph is edited; the caller must Release it. NULL if the graph doesn't exist
+			static vector<unsigned int> GetVisibleNodes(unsigned int graph, Vec3 pos, unsigned int max_results = 0, float max_distance = -1.0f);	// raycasts nearest-first and stops after max_results (0 = no limit); still expensive, so don't call it too often
 			static unsigned int GetNearestNode(unsigned int graph, Vec3 pos);					// screw visibility, just find the nearest node
+			static vector<unsigned int> GetNearestNodes(unsigned int graph, Vec3 pos, unsigned int k);			// the k nearest nodes, nearest first
+			static vector<unsigned int> GetNodesInRadius(unsigned int graph, Vec3 pos, float radius);			// all nodes within radius, nearest first
 
 			static Vec3 GetNodePosition(unsigned int graph, unsigned int node);
 			static vector<unsigned int> GetNodeEdges(unsigned int graph, unsigned int node, PathDirection dir);
+			static void GetNodeOutEdges(unsigned int graph, unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs);		// clears and refills the passed-in vectors
+			static void GetNodeInEdges(unsigned int graph, unsigned int node, vector<unsigned int>& neighbors, vector<float>& costs);		// same, but for edges leading into the node
 			static bool NodeHasEdge(unsigned int graph, unsigned int node, unsigned int other, PathDirection dir);
 
 			static float GetEdgeCost(unsigned int graph, unsigned int from, unsigned int to);
@@ -11,6 +11,11 @@
 
 #include "DebugLog.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+	#define PARTICLE_MATERIAL_SSE				// compute the corners of four sprites at a time
+	#include <xmmintrin.h>
+#endif
+
 namespace CibraryEngine
 {
 	/*
@@ -21,8 +26,58 @@ namespace CibraryEngine
 		Texture* tex;
 		bool is_3d;
 
-		Imp(Texture2D* tex) : tex(tex), is_3d(false) { }
-		Imp(Texture3D* tex) : tex(tex), is_3d(true) { }
+		Vec3 camera_right, camera_up;
+
+		// everything drawn between BeginDraw and EndDraw goes in here, and gets uploaded to the vbo all at once
+		vector<ParticleVertex> vertices;
+		unsigned int vertex_count;
+		unsigned int vbo;
+
+		Imp(Texture2D* tex) : tex(tex), is_3d(false), camera_right(), camera_up(), vertices(), vertex_count(0), vbo(0) { }
+		Imp(Texture3D* tex) : tex(tex), is_3d(true), camera_right(), camera_up(), vertices(), vertex_count(0), vbo(0) { }
+
+		~Imp()
+		{
+			if(vbo != 0)
+			{
+				glDeleteBuffers(1, &vbo);
+				vbo = 0;
+			}
+		}
+
+		void Add(ParticleMaterialBatch* batch)
+		{
+			// only ever grows, so once it's big enough this doesn't touch the heap
+			if(vertices.size() < vertex_count + batch->count * 4)
+				vertices.resize(vertex_count + batch->count * 4);
+
+			vertex_count += batch->Expand(camera_right, camera_up, &vertices[vertex_count]);
+		}
+
+		void DrawVertices()
+		{
+			if(vertex_count == 0)
+				return;
+
+			if(vbo == 0)
+				glGenBuffers(1, &vbo);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(ParticleVertex), &vertices[0], GL_STREAM_DRAW);
+
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glVertexPointer(3, GL_FLOAT, sizeof(ParticleVertex), (void*)0);
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(3, GL_FLOAT, sizeof(ParticleVertex), (void*)(3 * sizeof(float)));
+
+			glDrawArrays(GL_QUADS, 0, vertex_count);
+
+			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+			glDisableClientState(GL_VERTEX_ARRAY);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);			// don't leave hardware vbo on
+
+			vertex_count = 0;
+		}
 	};
 
 
@@ -106,12 +161,16 @@ namespace CibraryEngine
 		glPushMatrix();
 		glLoadIdentity();
 
-		glBegin(GL_QUADS);
+		glColor4f(1, 1, 1, 1);
+
+		imp->camera_right = renderer->camera->GetRight();
+		imp->camera_up = renderer->camera->GetUp();
+		imp->vertex_count = 0;
 	}
 
 	void ParticleMaterial::EndDraw()
 	{
-		glEnd();
+		imp->DrawVertices();
 
 		if (IsTexture3D())
 			glDisable(GL_TEXTURE_3D);
@@ -125,36 +184,99 @@ namespace CibraryEngine
 
 		GLDEBUG();
 	}
-	void ParticleMaterial::Draw(RenderNode node) { ((ParticleMaterialNodeData*)node.data)->Execute(); }
+	void ParticleMaterial::Draw(RenderNode node) { imp->Add((ParticleMaterialBatch*)node.data); }
 
-	void ParticleMaterial::Cleanup(RenderNode node) { delete (ParticleMaterialNodeData*)node.data; }
+	void ParticleMaterial::Cleanup(RenderNode node) { }
 
 
 
 
 	/*
-	 * ParticleMaterialNodeData methods
+	 * ParticleMaterialBatch methods
 	 */
-	ParticleMaterialNodeData::ParticleMaterialNodeData(Vec3 pos, float radius, float angle, CameraView* camera) : radius(radius), pos(pos), angle(angle), red(1), green(1), blue(1), alpha(1), third_coord(0), camera_view(camera) { }
+	ParticleMaterialBatch::ParticleMaterialBatch(unsigned int count) : count(count), x(NULL), y(NULL), z(NULL), radius(NULL), cos_angle(NULL), sin_angle(NULL), age(NULL), max_age(NULL) { }
 
-	void PMNDVert(Vec3 vert) { glVertex3f(vert.x, vert.y, vert.z); }
+	static void PutVertex(ParticleVertex*& out, const Vec3& pos, float u, float v, float w)
+	{
+		out->x = pos.x;	out->y = pos.y;	out->z = pos.z;
+		out->u = u;		out->v = v;		out->w = w;
+		++out;
+	}
 
-	void ParticleMaterialNodeData::Execute()
+	unsigned int ParticleMaterialBatch::Expand(const Vec3& camera_right, const Vec3& camera_up, ParticleVertex* out) const
 	{
-		glColor4f(red, green, blue, alpha);
-
-		Vec3 cam_right = camera_view->GetRight() * radius;
-		Vec3 cam_up = camera_view->GetUp() * radius;
-		Vec3 use_right = cam_right * cos(angle) + cam_up * sin(angle);
-		Vec3 use_up = cam_right * -sin(angle) + cam_up * cos(angle);
-
-		glTexCoord3f(0, 0, third_coord);
-		PMNDVert(pos - use_right - use_up);
-		glTexCoord3f(0, 1, third_coord);
-		PMNDVert(pos - use_right + use_up);
-		glTexCoord3f(1, 1, third_coord);
-		PMNDVert(pos + use_right + use_up);
-		glTexCoord3f(1, 0, third_coord);
-		PMNDVert(pos + use_right - use_up);
+		ParticleVertex* start = out;
+		unsigned int i = 0;
+
+#ifdef PARTICLE_MATERIAL_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 rx = _mm_set1_ps(camera_right.x), ry = _mm_set1_ps(camera_right.y), rz = _mm_set1_ps(camera_right.z);
+		const __m128 ux = _mm_set1_ps(camera_up.x), uy = _mm_set1_ps(camera_up.y), uz = _mm_set1_ps(camera_up.z);
+
+		float corners[4][3][4];				// corner, axis, particle
+		float third[4];
+
+		for(; i + 4 <= count; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(age + i), m = _mm_loadu_ps(max_age + i);
+
+			int drawn = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(a, zero), _mm_cmplt_ps(a, m)));
+			if(drawn == 0)
+				continue;
+
+			__m128 r = _mm_loadu_ps(radius + i);
+			__m128 c = _mm_mul_ps(_mm_loadu_ps(cos_angle + i), r);
+			__m128 s = _mm_mul_ps(_mm_loadu_ps(sin_angle + i), r);
+
+			// the camera's right and up vectors, rotated by the angle of each sprite and scaled by its radius
+			__m128 hx = _mm_add_ps(_mm_mul_ps(rx, c), _mm_mul_ps(ux, s));
+			__m128 hy = _mm_add_ps(_mm_mul_ps(ry, c), _mm_mul_ps(uy, s));
+			__m128 hz = _mm_add_ps(_mm_mul_ps(rz, c), _mm_mul_ps(uz, s));
+			__m128 vx = _mm_sub_ps(_mm_mul_ps(ux, c), _mm_mul_ps(rx, s));
+			__m128 vy = _mm_sub_ps(_mm_mul_ps(uy, c), _mm_mul_ps(ry, s));
+			__m128 vz = _mm_sub_ps(_mm_mul_ps(uz, c), _mm_mul_ps(rz, s));
+
+			__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+
+			__m128 lx = _mm_sub_ps(px, hx), ly = _mm_sub_ps(py, hy), lz = _mm_sub_ps(pz, hz);			// left edge
+			__m128 gx = _mm_add_ps(px, hx), gy = _mm_add_ps(py, hy), gz = _mm_add_ps(pz, hz);			// right edge
+
+			_mm_storeu_ps(corners[0][0], _mm_sub_ps(lx, vx));	_mm_storeu_ps(corners[0][1], _mm_sub_ps(ly, vy));	_mm_storeu_ps(corners[0][2], _mm_sub_ps(lz, vz));
+			_mm_storeu_ps(corners[1][0], _mm_add_ps(lx, vx));	_mm_storeu_ps(corners[1][1], _mm_add_ps(ly, vy));	_mm_storeu_ps(corners[1][2], _mm_add_ps(lz, vz));
+			_mm_storeu_ps(corners[2][0], _mm_add_ps(gx, vx));	_mm_storeu_ps(corners[2][1], _mm_add_ps(gy, vy));	_mm_storeu_ps(corners[2][2], _mm_add_ps(gz, vz));
+			_mm_storeu_ps(corners[3][0], _mm_sub_ps(gx, vx));	_mm_storeu_ps(corners[3][1], _mm_sub_ps(gy, vy));	_mm_storeu_ps(corners[3][2], _mm_sub_ps(gz, vz));
+
+			_mm_storeu_ps(third, _mm_div_ps(a, m));
+
+			for(unsigned int j = 0; j < 4; ++j)
+				if(drawn & (1 << j))
+				{
+					PutVertex(out, Vec3(corners[0][0][j], corners[0][1][j], corners[0][2][j]), 0, 0, third[j]);
+					PutVertex(out, Vec3(corners[1][0][j], corners[1][1][j], corners[1][2][j]), 0, 1, third[j]);
+					PutVertex(out, Vec3(corners[2][0][j], corners[2][1][j], corners[2][2][j]), 1, 1, third[j]);
+					PutVertex(out, Vec3(corners[3][0][j], corners[3][1][j], corners[3][2][j]), 1, 0, third[j]);
+				}
+		}
+#endif
+
+		for(; i < count; ++i)
+		{
+			if(age[i] < 0 || age[i] >= max_age[i])
+				continue;
+
+			Vec3 pos(x[i], y[i], z[i]);
+			float third_coord = age[i] / max_age[i];
+
+			float c = cos_angle[i] * radius[i], s = sin_angle[i] * radius[i];
+			Vec3 use_right = camera_right * c + camera_up * s;
+			Vec3 use_up = camera_up * c - camera_right * s;
+
+			PutVertex(out, pos - use_right - use_up, 0, 0, third_coord);
+			PutVertex(out, pos - use_right + use_up, 0, 1, third_coord);
+			PutVertex(out, pos + use_right + use_up, 1, 1, third_coord);
+			PutVertex(out, pos + use_right - use_up, 1, 0, third_coord);
+		}
+
+		return out - start;
 	}
 }
@@ -43,18 +43,29 @@ namespace CibraryEngine
 			void Cleanup(RenderNode node);
 	};
 
-	struct ParticleMaterialNodeData
+	/** A vertex of the stream ParticleMaterial draws; the third texture coordinate picks the frame of an animated (3D) texture */
+	struct ParticleVertex
 	{
-		float radius;
-		Vec3 pos;
-		float angle;
-		float red, green, blue, alpha;
+		float x, y, z;
+		float u, v, w;
+	};
+
+	/** Node data for a ParticleMaterial: a bunch of camera-facing sprites, drawn all at once; the arrays aren't copied, so they have to stay valid until it's drawn */
+	struct ParticleMaterialBatch
+	{
+		unsigned int count;
 
-		float third_coord;
-		CameraView* camera_view;
+		const float *x, *y, *z;
+		const float *radius;
+		const float *cos_angle, *sin_angle;		// rotation of each sprite within the plane of the screen
+		const float *age, *max_age;				// the third texture coordinate is age / max_age; particles with age outside [0, max_age) aren't drawn
 
-		ParticleMaterialNodeData(Vec3 pos, float radius, float angle, CameraView* camera);
+		ParticleMaterialBatch(unsigned int count);
 
-		void Execute();
+		/**
+		 * Expands the particles into quads facing the camera (4 vertices each, for GL_QUADS), and returns how many vertices it wrote; out
+		 * must have room for 4 * count of them. This doesn't use GL, so it can be called from anywhere
+		 */
+		unsigned int Expand(const Vec3& camera_right, const Vec3& camera_up, ParticleVertex* out) const;
 	};
 }
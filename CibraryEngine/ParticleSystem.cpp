@@ -0,0 +1,433 @@
+#include "StdAfx.h"
+#include "ParticleSystem.h"
+
+#include "ParticleMaterial.h"
+#include "BillboardMaterial.h"
+
+#include "CameraView.h"
+#include "RenderNode.h"
+#include "SceneRenderer.h"
+#include "TimingInfo.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define PARTICLE_SYSTEM_SSE				// integrate the particles four at a time
+	#include <emmintrin.h>
+#endif
+
+namespace CibraryEngine
+{
+#ifdef PARTICLE_SYSTEM_SSE
+	// e^x for four floats at once; Cephes' expf, as adapted for SSE by Julien Pommier's sse_mathfun
+	static __m128 ExpPS(__m128 x)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+		x = _mm_max_ps(x, _mm_set1_ps(-88.3762626647949f));
+
+		// express e^x as 2^n * e^g, with n = floor(x * log2(e) + 0.5)
+		__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+		__m128 tmp = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+		fx = _mm_sub_ps(tmp, _mm_and_ps(_mm_cmpgt_ps(tmp, fx), one));
+
+		x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+		x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+		__m128 z = _mm_mul_ps(x, x);
+		__m128 y = _mm_set1_ps(1.9875691500e-4f);
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+		y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+		y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+		// build 2^n from its exponent bits
+		__m128i n = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(0x7f));
+		return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(n, 23)));
+	}
+
+	// where mask is set, a; elsewhere, b
+	static __m128 Select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#endif
+
+
+
+
+	/*
+	 * ParticleSystem private implementation struct
+	 */
+	struct ParticleSystem::Imp
+	{
+		enum
+		{
+			trail_samples = 8,				// positions remembered for drawing each particle's trail, the last of which is where it expired
+			trail_ended = 0x80				// flag in Pool::samples, set once the last sample has been taken
+		};
+
+		// all the particles which use a particular pair of materials
+		struct Pool
+		{
+			ParticleMaterial* material;
+			BillboardMaterial* trail_material;
+
+			unsigned int count;
+
+			// one element per particle; the capacity is always a multiple of 4, so the SIMD kernel can run past the end
+			vector<float> x, y, z;
+			vector<float> vx, vy, vz;
+			vector<float> age, max_age;
+			vector<float> radius, cos_angle, sin_angle;
+			vector<float> gravity, damp;
+
+			// trail_samples elements per particle, oldest first; only used if there's a trail material
+			vector<float> tx, ty, tz, tage;
+			vector<unsigned char> samples;					// how many trail samples each particle has, plus the trail_ended flag
+
+			Pool(ParticleMaterial* material, BillboardMaterial* trail_material) :
+				material(material),
+				trail_material(trail_material),
+				count(0),
+				x(), y(), z(),
+				vx(), vy(), vz(),
+				age(), max_age(),
+				radius(), cos_angle(), sin_angle(),
+				gravity(), damp(),
+				tx(), ty(), tz(), tage(),
+				samples()
+			{
+			}
+
+			void Grow()
+			{
+				unsigned int capacity = max((unsigned int)x.size() * 2, 64u);
+
+				x.resize(capacity);			y.resize(capacity);				z.resize(capacity);
+				vx.resize(capacity);		vy.resize(capacity);			vz.resize(capacity);
+				age.resize(capacity);		max_age.resize(capacity);
+				radius.resize(capacity);	cos_angle.resize(capacity);		sin_angle.resize(capacity);
+				gravity.resize(capacity);	damp.resize(capacity);
+
+				if(trail_material != NULL)
+				{
+					tx.resize(capacity * trail_samples);
+					ty.resize(capacity * trail_samples);
+					tz.resize(capacity * trail_samples);
+					tage.resize(capacity * trail_samples);
+					samples.resize(capacity);
+				}
+			}
+
+			void Emit(Vec3 pos, Vec3 vel, float radius_, float angle_, float lifetime, float gravity_, float damp_)
+			{
+				if(count == x.size())
+					Grow();
+
+				unsigned int i = count++;
+
+				x[i] = pos.x;			y[i] = pos.y;			z[i] = pos.z;
+				vx[i] = vel.x;			vy[i] = vel.y;			vz[i] = vel.z;
+				age[i] = 0.0f;			max_age[i] = lifetime;
+				radius[i] = radius_;	cos_angle[i] = cos(angle_);	sin_angle[i] = sin(angle_);
+				gravity[i] = gravity_;	damp[i] = damp_;
+
+				if(trail_material != NULL)
+				{
+					samples[i] = 0;
+					Sample(i);
+				}
+			}
+
+			// same as Particle::Update used to do for each particle; once a particle has expired it stops moving, but keeps aging, so its trail can fade out
+			void Integrate(float timestep)
+			{
+#ifdef PARTICLE_SYSTEM_SSE
+				const __m128 dt = _mm_set1_ps(timestep);
+				const __m128 neg_dt = _mm_set1_ps(-timestep);
+
+				for(unsigned int i = 0; i < count; i += 4)
+				{
+					__m128 a = _mm_add_ps(_mm_loadu_ps(&age[i]), dt);
+					_mm_storeu_ps(&age[i], a);
+
+					__m128 alive = _mm_cmplt_ps(a, _mm_loadu_ps(&max_age[i]));
+
+					__m128 px = _mm_loadu_ps(&x[i]), py = _mm_loadu_ps(&y[i]), pz = _mm_loadu_ps(&z[i]);
+					__m128 ux = _mm_loadu_ps(&vx[i]), uy = _mm_loadu_ps(&vy[i]), uz = _mm_loadu_ps(&vz[i]);
+
+					_mm_storeu_ps(&x[i], Select(alive, _mm_add_ps(px, _mm_mul_ps(ux, dt)), px));
+					_mm_storeu_ps(&y[i], Select(alive, _mm_add_ps(py, _mm_mul_ps(uy, dt)), py));
+					_mm_storeu_ps(&z[i], Select(alive, _mm_add_ps(pz, _mm_mul_ps(uz, dt)), pz));
+
+					__m128 decay = ExpPS(_mm_mul_ps(_mm_loadu_ps(&damp[i]), neg_dt));
+					__m128 fall = _mm_mul_ps(_mm_loadu_ps(&gravity[i]), dt);
+
+					_mm_storeu_ps(&vx[i], Select(alive, _mm_mul_ps(ux, decay), ux));
+					_mm_storeu_ps(&vy[i], Select(alive, _mm_mul_ps(_mm_sub_ps(uy, fall), decay), uy));
+					_mm_storeu_ps(&vz[i], Select(alive, _mm_mul_ps(uz, decay), uz));
+				}
+#else
+				for(unsigned int i = 0; i < count; ++i)
+				{
+					age[i] += timestep;
+					if(age[i] >= max_age[i])
+						continue;
+
+					x[i] += vx[i] * timestep;
+					y[i] += vy[i] * timestep;
+					z[i] += vz[i] * timestep;
+
+					vy[i] -= gravity[i] * timestep;
+
+					float decay = exp(-damp[i] * timestep);
+					vx[i] *= decay;
+					vy[i] *= decay;
+					vz[i] *= decay;
+				}
+#endif
+			}
+
+			// records the particle's current position in its trail
+			void Sample(unsigned int i)
+			{
+				unsigned int k = i * trail_samples + (samples[i] & ~trail_ended);
+
+				tx[k] = x[i];
+				ty[k] = y[i];
+				tz[k] = z[i];
+				tage[k] = age[i];
+
+				++samples[i];
+			}
+
+			// a BillboardTrail adds a node every frame; this spaces the samples out evenly over the particle's lifetime instead
+			void UpdateTrails()
+			{
+				for(unsigned int i = 0; i < count; ++i)
+				{
+					unsigned char s = samples[i];
+					if(s & trail_ended)
+						continue;
+
+					if(age[i] >= max_age[i])
+					{
+						Sample(i);
+						samples[i] |= trail_ended;
+					}
+					else if(age[i] >= s * max_age[i] / (trail_samples - 1))
+						Sample(i);
+				}
+			}
+
+			bool IsFinished(unsigned int i)
+			{
+				if(age[i] < max_age[i])
+					return false;
+				if(trail_material == NULL)
+					return true;
+
+				// wait until the last sample of the trail has faded
+				unsigned int last = i * trail_samples + (samples[i] & ~trail_ended) - 1;
+				return age[i] - tage[last] > max_age[i];
+			}
+
+			void Move(unsigned int from, unsigned int to)
+			{
+				x[to] = x[from];				y[to] = y[from];				z[to] = z[from];
+				vx[to] = vx[from];				vy[to] = vy[from];				vz[to] = vz[from];
+				age[to] = age[from];			max_age[to] = max_age[from];
+				radius[to] = radius[from];		cos_angle[to] = cos_angle[from];	sin_angle[to] = sin_angle[from];
+				gravity[to] = gravity[from];	damp[to] = damp[from];
+
+				if(trail_material != NULL)
+				{
+					unsigned int s = samples[from] & ~trail_ended;
+					for(unsigned int j = 0, a = from * trail_samples, b = to * trail_samples; j < s; ++j, ++a, ++b)
+					{
+						tx[b] = tx[a];
+						ty[b] = ty[a];
+						tz[b] = tz[a];
+						tage[b] = tage[a];
+					}
+					samples[to] = samples[from];
+				}
+			}
+
+			// removes finished particles, by moving the last particle into each one's place
+			void Compact()
+			{
+				for(unsigned int i = 0; i < count; )
+					if(IsFinished(i))
+					{
+						if(i != --count)
+							Move(count, i);
+					}
+					else
+						++i;
+			}
+
+			// gets the points of the particle's trail which haven't faded yet, oldest first, and their ages; returns how many there are
+			unsigned int GetTrail(unsigned int i, Vec3* points, float* ages)
+			{
+				unsigned int n = 0;
+
+				unsigned int s = samples[i] & ~trail_ended;
+				for(unsigned int j = 0, k = i * trail_samples; j < s; ++j, ++k)
+				{
+					float sample_age = age[i] - tage[k];
+					if(sample_age <= max_age[i])
+					{
+						points[n] = Vec3(tx[k], ty[k], tz[k]);
+						ages[n] = sample_age;
+						++n;
+					}
+				}
+
+				// the head of the trail follows the particle until it expires
+				if(!(samples[i] & trail_ended))
+				{
+					points[n] = Vec3(x[i], y[i], z[i]);
+					ages[n] = 0.0f;
+					++n;
+				}
+
+				return n;
+			}
+
+			void Vis(SceneRenderer* renderer)
+			{
+				if(count == 0)
+					return;
+
+				// sort each batch by the average position of its particles
+				Vec3 center;
+				for(unsigned int i = 0; i < count; ++i)
+					center += Vec3(x[i], y[i], z[i]);
+				center /= float(count);
+
+				float distance = Vec3::Dot(renderer->camera->GetForward(), center);
+
+				if(material != NULL)
+				{
+					ParticleMaterialBatch* batch = new (renderer->frame_data.Allocate(sizeof(ParticleMaterialBatch))) ParticleMaterialBatch(count);
+					batch->x = &x[0];
+					batch->y = &y[0];
+					batch->z = &z[0];
+					batch->radius = &radius[0];
+					batch->cos_angle = &cos_angle[0];
+					batch->sin_angle = &sin_angle[0];
+					batch->age = &age[0];
+					batch->max_age = &max_age[0];
+
+					renderer->objects.push_back(RenderNode(material, batch, distance));
+				}
+
+				if(trail_material != NULL)
+				{
+					Vec3 points[trail_samples + 1];
+					float ages[trail_samples + 1];
+
+					unsigned int segment_count = 0;
+					for(unsigned int i = 0; i < count; ++i)
+					{
+						unsigned int n = GetTrail(i, points, ages);
+						if(n > 1)
+							segment_count += n - 1;
+					}
+
+					if(segment_count == 0)
+						return;
+
+					BillboardMaterial::NodeData* segments = (BillboardMaterial::NodeData*)renderer->frame_data.Allocate(sizeof(BillboardMaterial::NodeData) * segment_count);
+
+					unsigned int next = 0;
+					for(unsigned int i = 0; i < count; ++i)
+					{
+						unsigned int n = GetTrail(i, points, ages);
+						for(unsigned int j = 0; j + 1 < n; ++j)
+						{
+							BillboardMaterial::NodeData* segment = new (&segments[next++]) BillboardMaterial::NodeData(points[j + 1], points[j], radius[i]);
+							segment->front_u = ages[j + 1] / max_age[i];
+							segment->back_u = ages[j] / max_age[i];
+						}
+					}
+
+					BillboardMaterial::Batch* batch = new (renderer->frame_data.Allocate(sizeof(BillboardMaterial::Batch))) BillboardMaterial::Batch(segments, segment_count);
+					renderer->objects.push_back(RenderNode(trail_material, batch, distance));
+				}
+			}
+		};
+
+		vector<Pool*> pools;
+
+		Imp() : pools() { }
+		~Imp() { Clear(); }
+
+		void Clear()
+		{
+			for(vector<Pool*>::iterator iter = pools.begin(); iter != pools.end(); ++iter)
+				delete *iter;
+			pools.clear();
+		}
+
+		Pool* GetPool(ParticleMaterial* material, BillboardMaterial* trail_material)
+		{
+			// there are only ever a handful of pools, so a linear search is fine
+			for(vector<Pool*>::iterator iter = pools.begin(); iter != pools.end(); ++iter)
+				if((*iter)->material == material && (*iter)->trail_material == trail_material)
+					return *iter;
+
+			Pool* pool = new Pool(material, trail_material);
+			pools.push_back(pool);
+			return pool;
+		}
+	};
+
+
+
+
+	/*
+	 * ParticleSystem methods
+	 */
+	ParticleSystem::ParticleSystem() : imp(new Imp()) { }
+	ParticleSystem::~ParticleSystem() { delete imp; imp = NULL; }
+
+	void ParticleSystem::Emit(ParticleMaterial* material, BillboardMaterial* trail_material, Vec3 pos, Vec3 vel, float radius, float angle, float lifetime, float gravity, float damp)
+	{
+		if(material == NULL && trail_material == NULL)
+			return;
+
+		imp->GetPool(material, trail_material)->Emit(pos, vel, radius, angle, lifetime, gravity, damp);
+	}
+
+	void ParticleSystem::Update(TimingInfo time)
+	{
+		float timestep = time.elapsed;
+
+		for(vector<Imp::Pool*>::iterator iter = imp->pools.begin(); iter != imp->pools.end(); ++iter)
+		{
+			Imp::Pool* pool = *iter;
+
+			pool->Integrate(timestep);
+			if(pool->trail_material != NULL)
+				pool->UpdateTrails();
+			pool->Compact();
+		}
+	}
+
+	void ParticleSystem::Vis(SceneRenderer* renderer)
+	{
+		for(vector<Imp::Pool*>::iterator iter = imp->pools.begin(); iter != imp->pools.end(); ++iter)
+			(*iter)->Vis(renderer);
+	}
+
+	void ParticleSystem::Clear() { imp->Clear(); }
+
+	unsigned int ParticleSystem::GetParticleCount()
+	{
+		unsigned int total = 0;
+		for(vector<Imp::Pool*>::iterator iter = imp->pools.begin(); iter != imp->pools.end(); ++iter)
+			total += (*iter)->count;
+		return total;
+	}
+}
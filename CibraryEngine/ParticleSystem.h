@@ -0,0 +1,51 @@
+#pragma once
+
+#include "StdAfx.h"
+#include "Component.h"
+
+#include "Vector.h"
+
+namespace CibraryEngine
+{
+	using namespace std;
+
+	class ParticleMaterial;
+	class BillboardMaterial;
+
+	/**
+	 * Component which simulates and draws lots of small, short-lived particles, e.g. the blood and dirt thrown up by gunshots. The
+	 * particles aren't entities; they're kept in flat arrays (one set for each combination of materials), which get updated four at a
+	 * time, and drawn with a single RenderNode per material. A particle with a trail material leaves a trail behind it, the same as a
+	 * BillboardTrail following it would
+	 */
+	class ParticleSystem : public Component
+	{
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+			// not copyable
+			ParticleSystem(const ParticleSystem& other);
+			void operator=(const ParticleSystem& other);
+
+		public:
+
+			ParticleSystem();
+			~ParticleSystem();
+
+			/** Adds a particle; either of the materials may be NULL, but not both */
+			void Emit(ParticleMaterial* material, BillboardMaterial* trail_material, Vec3 pos, Vec3 vel, float radius, float angle, float lifetime, float gravity, float damp);
+
+			/** Moves the particles, and removes the ones which have expired (once their trails have faded away) */
+			void Update(TimingInfo time);
+			/** Adds a RenderNode for each material; the node data points into the particle arrays, so it's only good until the next Update */
+			void Vis(SceneRenderer* renderer);
+
+			/** Removes all of the particles */
+			void Clear();
+
+			/** Number of particles, including expired ones whose trails haven't faded away yet */
+			unsigned int GetParticleCount();
+	};
+}
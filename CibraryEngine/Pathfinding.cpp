@@ -7,60 +7,206 @@
 
 namespace CibraryEngine
 {
-	struct Edge
-	{
-		unsigned int to;
-		float cost;
-
-		Edge() : to(0), cost(0) { }
-		Edge(unsigned int to, float cost) : to(to), cost(cost) { }
-	};
-	struct PriorityQueue
+	/*
+	 * Indexed binary min-heap of node ids, supporting decrease-key; the priorities and heap positions live in the SearchArena
+	 */
+	struct NodeHeap
 	{
-		list<unsigned int> queue;
+		vector<unsigned int> items;
+		vector<unsigned int>* positions;
 		vector<float>* priorities;
 
-		PriorityQueue(vector<float>* priorities) : queue(), priorities(priorities) { }
+		NodeHeap() : items(), positions(NULL), priorities(NULL) { }
+
+		bool Empty() { return items.empty(); }
+		void Clear() { items.clear(); }
+
+		void Insert(unsigned int node)
+		{
+			items.push_back(node);
+			SiftUp(items.size() - 1);
+		}
 
 		unsigned int Pop()
 		{
-			if(queue.empty()) 
+			if(items.empty())
 				return 0;
-			else
+
+			unsigned int result = items[0];
+
+			items[0] = items.back();
+			(*positions)[items[0]] = 0;
+			items.pop_back();
+
+			if(!items.empty())
+				SiftDown(0);
+
+			return result;
+		}
+
+		// the node's priority may only have decreased since it was inserted
+		void DecreaseKey(unsigned int node) { SiftUp((*positions)[node]); }
+
+		void SiftUp(unsigned int i)
+		{
+			unsigned int node = items[i];
+			float priority = (*priorities)[node];
+
+			while(i > 0)
 			{
-				unsigned int result = queue.front();
-				queue.pop_front();
-				return result;
+				unsigned int parent = (i - 1) / 2;
+				if((*priorities)[items[parent]] <= priority)
+					break;
+
+				items[i] = items[parent];
+				(*positions)[items[i]] = i;
+				i = parent;
 			}
+
+			items[i] = node;
+			(*positions)[node] = i;
 		}
 
-		void Insert(unsigned int node)
+		void SiftDown(unsigned int i)
 		{
+			unsigned int count = items.size();
+			unsigned int node = items[i];
 			float priority = (*priorities)[node];
-			list<unsigned int>::iterator iter;
-			for(iter = queue.begin(); iter != queue.end(); ++iter)
-				if((*priorities)[*iter] > priority)
-				{
-					queue.insert(iter, node);
+
+			while(true)
+			{
+				unsigned int child = i * 2 + 1;
+				if(child >= count)
 					break;
-				}
-			if(iter == queue.end())
-				queue.push_back(node);
+				if(child + 1 < count && (*priorities)[items[child + 1]] < (*priorities)[items[child]])
+					++child;
+				if((*priorities)[items[child]] >= priority)
+					break;
+
+				items[i] = items[child];
+				(*positions)[items[i]] = i;
+				i = child;
+			}
+
+			items[i] = node;
+			(*positions)[node] = i;
 		}
+	};
+
+
+
+
+	/*
+	 * Per-search scratch memory, indexed directly by node id; arenas are pooled per-thread and reused, so once
+	 * the pool has warmed up (and the arrays have grown to the size of the graph) a search doesn't allocate
+	 */
+	struct SearchArena
+	{
+		static const unsigned char NS_OPEN =	1;
+		static const unsigned char NS_CLOSED =	2;
+
+		// a node's entries are only meaningful if its stamp matches the current stamp; this way we don't need to clear anything between searches
+		vector<unsigned int> stamps;
+		unsigned int stamp;
+
+		vector<unsigned char> states;
+		vector<unsigned int> parents;
+		vector<float> f_costs;
+		vector<float> g_costs;
+		vector<unsigned int> heap_positions;
+
+		NodeHeap heap;
 
-		bool Empty() { return queue.empty(); }
+		// buffers for NavGraph::GetNodeOutEdges
+		vector<unsigned int> neighbors;
+		vector<float> edge_costs;
 
-		void ChangePriority(unsigned int node)
+		SearchArena() : stamps(), stamp(0), states(), parents(), f_costs(), g_costs(), heap_positions(), heap(), neighbors(), edge_costs()
 		{
-			for(list<unsigned int>::iterator iter = queue.begin(); iter != queue.end(); ++iter)
-				if(*iter == node)
-				{
-					queue.erase(iter);
-					break;
-				}
-			Insert(node);
+			heap.positions = &heap_positions;
+			heap.priorities = &f_costs;
+		}
+
+		void Begin(unsigned int node_id_bound)
+		{
+			Reserve(node_id_bound);
+
+			if(++stamp == 0)
+			{
+				// stamp wrapped around; old stamps could alias the new one, so clear them
+				stamps.assign(stamps.size(), 0);
+				stamp = 1;
+			}
+
+			heap.Clear();
+		}
+
+		void Reserve(unsigned int node_id_bound)
+		{
+			if(stamps.size() < node_id_bound)
+			{
+				stamps.resize(node_id_bound, 0);
+				states.resize(node_id_bound, 0);
+				parents.resize(node_id_bound, 0);
+				f_costs.resize(node_id_bound, 0.0f);
+				g_costs.resize(node_id_bound, 0.0f);
+				heap_positions.resize(node_id_bound, 0);
+			}
+		}
+
+		// returns the state of the node for the current search, marking it unvisited if it hasn't been touched yet
+		unsigned char GetState(unsigned int node)
+		{
+			if(node >= stamps.size())
+				Reserve(node + 1);					// somebody added nodes to the graph while this search was in progress
+
+			if(stamps[node] != stamp)
+			{
+				stamps[node] = stamp;
+				states[node] = 0;
+			}
+			return states[node];
+		}
+	};
+
+	// arenas which aren't currently in use by any search, per thread
+	struct ArenaPool
+	{
+		vector<SearchArena*> free_arenas;
+
+		~ArenaPool()
+		{
+			for(vector<SearchArena*>::iterator iter = free_arenas.begin(); iter != free_arenas.end(); ++iter)
+				delete *iter;
+			free_arenas.clear();
 		}
 	};
+	boost::thread_specific_ptr<ArenaPool> arena_pool;
+
+	SearchArena* AcquireSearchArena()
+	{
+		ArenaPool* pool = arena_pool.get();
+		if(pool == NULL)
+			arena_pool.reset(pool = new ArenaPool());
+
+		if(pool->free_arenas.empty())
+			return new SearchArena();
+		else
+		{
+			SearchArena* result = pool->free_arenas.back();
+			pool->free_arenas.pop_back();
+			return result;
+		}
+	}
+
+	void ReleaseSearchArena(SearchArena* arena)
+	{
+		ArenaPool* pool = arena_pool.get();
+		if(pool == NULL)
+			arena_pool.reset(pool = new ArenaPool());
+
+		pool->free_arenas.push_back(arena);
+	}
 
 
 
@@ -78,13 +224,19 @@ namespace CibraryEngine
 
 		list<unsigned int> solution;
 
-		vector<unsigned int> nodes;
-		vector<Edge*> shortest_path_tree;
-		vector<Edge*> search_frontier;
-		map<unsigned int, unsigned int> node_to_index;
-		vector<float> f_costs;
-		vector<float> g_costs;
-		PriorityQueue pq;
+		// the search reads this rather than the NavGraph itself, so it can run on a worker thread
+		NavGraphSnapshot* snapshot;
+
+		// acquired by the first Think, on whichever thread is running the search
+		SearchArena* arena;
+
+		unsigned int expansions;
+
+		unsigned int ref_count;								// PathSearch handles, the PathService cache, and the PathWorkerPool
+		unsigned int edit_count;							// NavGraph::GetEditCount of the graph when the search began
+
+		// while queued, a PathWorkerPool owns everything below the endpoints; only the main thread reads or writes this flag
+		PathWorkerPool* queued;
 
 		Imp(unsigned int graph, unsigned int source, unsigned int target) :
 			graph(graph),
@@ -92,19 +244,70 @@ namespace CibraryEngine
 			target(target),
 			finished(false),
 			solution(),
-			nodes(NavGraph::GetAllNodes(graph)),
-			shortest_path_tree(nodes.size(), NULL),
-			search_frontier(nodes.size(), NULL),
-			node_to_index(),
-			f_costs(nodes.size(), 0.0f),
-			g_costs(nodes.size(), 0.0f),
-			pq(&f_costs)
+			snapshot(NavGraph::GetSnapshot(graph)),
+			arena(NULL),
+			expansions(0),
+			ref_count(0),
+			edit_count(NavGraph::GetEditCount(graph)),
+			queued(NULL)
+		{
+			// nothing to search if the graph doesn't exist
+			if(snapshot == NULL)
+				finished = true;
+		}
+
+		// a search whose solution is already known
+		Imp(unsigned int graph, unsigned int source, unsigned int target, const list<unsigned int>& solution) :
+			graph(graph),
+			source(source),
+			target(target),
+			finished(true),
+			solution(solution),
+			snapshot(NULL),
+			arena(NULL),
+			expansions(0),
+			ref_count(0),
+			edit_count(NavGraph::GetEditCount(graph)),
+			queued(NULL)
 		{
+		}
+
+		~Imp()
+		{
+			ReleaseArena();
+			ReleaseSnapshot();
+		}
+
+		void ReleaseSnapshot()
+		{
+			if(snapshot != NULL)
+			{
+				snapshot->Release();
+				snapshot = NULL;
+			}
+		}
+
+		void Begin()
+		{
+			arena = AcquireSearchArena();
+			arena->Begin(snapshot->GetNodeIDBound());
+
+			arena->GetState(source);
+			arena->states[source] = SearchArena::NS_OPEN;
+			arena->parents[source] = 0;
+			arena->g_costs[source] = 0.0f;
+			arena->f_costs[source] = 0.0f;
 
-			for(unsigned int i = 0; i < nodes.size(); ++i)
-				node_to_index[nodes[i]] = i;
+			arena->heap.Insert(source);
+		}
 
-			pq.Insert(node_to_index[source]);
+		void ReleaseArena()
+		{
+			if(arena != NULL)
+			{
+				ReleaseSearchArena(arena);
+				arena = NULL;
+			}
 		}
 
 		void Think(int steps)
@@ -113,47 +316,57 @@ namespace CibraryEngine
 			if(finished)
 				return;
 
+			if(arena == NULL)
+				Begin();
+
+			NodeHeap& pq = arena->heap;
+
 			int iteration = 0;
 
 			// if steps < 0, this will loop until the search is finished
 			while(!pq.Empty() && iteration != steps)
 			{
 				unsigned int closest = pq.Pop();
+				++expansions;
 
-				shortest_path_tree[closest] = search_frontier[closest];
-				if(nodes[closest] == target)
+				arena->states[closest] = SearchArena::NS_CLOSED;
+				if(closest == target)
 				{
 					// hooray, found a path; skip to end of loop
 					finished = true;
 					break;
 				}
 
-				Vec3 pos_a = NavGraph::GetNodePosition(graph, nodes[closest]);
+				Vec3 pos_a = snapshot->GetNodePosition(closest);
+				float closest_g_cost = arena->g_costs[closest];
 
-				vector<unsigned int> edges = NavGraph::GetNodeEdges(graph, nodes[closest], NavGraph::PD_OUT);
-				for(vector<unsigned int>::iterator iter = edges.begin(); iter != edges.end(); ++iter)
+				snapshot->GetNodeOutEdges(closest, arena->neighbors, arena->edge_costs);
+				for(unsigned int i = 0; i < arena->neighbors.size(); ++i)
 				{
-					Vec3 pos_b = NavGraph::GetNodePosition(graph, *iter);
-					float edge_cost = NavGraph::GetEdgeCost(graph, nodes[closest], *iter);
-					float g_cost = g_costs[closest] + edge_cost;
+					unsigned int other = arena->neighbors[i];
+					float edge_cost = arena->edge_costs[i];
+					float g_cost = closest_g_cost + edge_cost;
 
-					unsigned int index = node_to_index[*iter];
+					unsigned char state = arena->GetState(other);
 
 					// if this is the first time we are examining a node, we must store the cost we computed
 					// if we've already examined it, we only store the new value if it's cheaper than what we stored before
-					if(search_frontier[index] == NULL || g_cost < g_costs[index] && shortest_path_tree[index] == NULL)
+					if(state == 0 || g_cost < arena->g_costs[other] && state == SearchArena::NS_OPEN)
 					{
+						Vec3 pos_b = snapshot->GetNodePosition(other);
 						float h_cost = (pos_a - pos_b).ComputeMagnitude();				// our heuristic
-						f_costs[index] = g_cost + h_cost;
-						g_costs[index] = g_cost;
-						if(search_frontier[index] == NULL)
-							pq.Insert(index);
-						else
+
+						arena->f_costs[other] = g_cost + h_cost;
+						arena->g_costs[other] = g_cost;
+						arena->parents[other] = closest;
+
+						if(state == 0)
 						{
-							pq.ChangePriority(index);
-							delete search_frontier[index];
+							arena->states[other] = SearchArena::NS_OPEN;
+							pq.Insert(other);
 						}
-						search_frontier[index] = new Edge(nodes[closest], edge_cost);
+						else
+							pq.DecreaseKey(other);
 					}
 				}
 
@@ -167,30 +380,16 @@ namespace CibraryEngine
 			{
 				// collect result path into a list
 				list<unsigned int> results;
-				unsigned int cur = target;
-				while(cur != source)
-				{
-					int index = node_to_index[cur];
-					Edge* edge = shortest_path_tree[index];
-					if(edge != NULL)
-					{
-						results.push_back(cur);
-						cur = edge->to;
-					}
-					else
-					{
-						results.clear();
-						break;
-					}
-				}
-				results.reverse();
-
-				// delete new'd stuffs
-				for(vector<Edge*>::iterator iter = search_frontier.begin(); iter != search_frontier.end(); ++iter)
-					delete *iter;
+				if(target != source && arena->GetState(target) == SearchArena::NS_CLOSED)
+					for(unsigned int cur = target; cur != source; cur = arena->parents[cur])
+						results.push_front(cur);
 
 				// store the path we computed
 				solution = results;
+
+				// nothing else needs the scratch memory; let another search have it
+				ReleaseArena();
+				ReleaseSnapshot();
 			}
 		}
 	};
@@ -198,85 +397,1279 @@ namespace CibraryEngine
 
 
 
+
 	/*
-	 * PathSearch methods
+	 * PathWorkerPool private implementation struct
 	 */
-	PathSearch::PathSearch(unsigned int graph, unsigned int source, unsigned int target) :
-		imp(new Imp(graph, source, target))
+	struct PathWorkerPool::Imp
 	{
-	}
+		typedef PathSearch::Imp Search;
 
-	void PathSearch::Dispose()
-	{
-		delete imp;
-		imp = NULL;
-	}
+		// how many expansions a worker does between checks of the clock
+		static const int steps_per_slice = 64;
 
-	void PathSearch::Think(int steps) { imp->Think(steps); }
+		PathWorkerPool* pool;
 
-	void PathSearch::Solve() { imp->Think(-1); }
+		boost::mutex mutex;									// guards everything from here to the threads
+		boost::condition_variable work_ready;				// a search was queued, a frame began, or someone is waiting
+		boost::condition_variable search_finished;
 
-	int PathSearch::GetGraph() { return imp->graph; }
-	int PathSearch::GetSource() { return imp->source; }
-	int PathSearch::GetTarget() { return imp->target; }
+		list<Search*> pending;
+		vector<Search*> finished;							// finished by a worker, but not yet published
+		unsigned int busy;									// workers which are holding a search
 
-	bool PathSearch::IsFinished() { return imp->finished; }
+		boost::posix_time::ptime deadline;					// workers don't start any more slices after this...
+		unsigned int waiting;								// ...unless the main thread is waiting on them
+		bool stopping;
 
-	list<unsigned int> PathSearch::GetSolution()
-	{
-		list<unsigned int> result;
-		for(list<unsigned int>::iterator iter = imp->solution.begin(); iter != imp->solution.end(); ++iter)
-			result.push_back(*iter);
-		return result;
-	}
+		vector<boost::thread*> threads;
 
+		// only touched by the main thread
+		unsigned int queued_count;
+		unsigned int completed_count;
 
+		Imp(PathWorkerPool* pool, unsigned int thread_count) :
+			pool(pool),
+			mutex(),
+			work_ready(),
+			search_finished(),
+			pending(),
+			finished(),
+			busy(0),
+			deadline(Now()),
+			waiting(0),
+			stopping(false),
+			threads(),
+			queued_count(0),
+			completed_count(0)
+		{
+			for(unsigned int i = 0; i < thread_count; ++i)
+				threads.push_back(new boost::thread(&Imp::WorkerMain, this));
+		}
 
+		~Imp()
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				stopping = true;
+				work_ready.notify_all();
+			}
 
-	/*
-	 * Scripting stuff
-	 */
-	int pathsearch_gc(lua_State* L);
-	int pathsearch_index(lua_State* L);
+			for(vector<boost::thread*>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+			{
+				(*iter)->join();
+				delete *iter;
+			}
+			threads.clear();
 
-	void PushPathSearchHandle(lua_State* L, unsigned int graph, unsigned int source, unsigned int target)
-	{
-		int n = lua_gettop(L);
+			Publish();
 
-		PathSearch* ptr = (PathSearch*)lua_newuserdata(L, sizeof(PathSearch));//new PathSearch(graph, source, target);
-		*ptr = PathSearch(graph, source, target);
+			// whatever didn't get finished goes back to being advanced by PathSearch::Think
+			for(list<Search*>::iterator iter = pending.begin(); iter != pending.end(); ++iter)
+				Unqueue(*iter);
+			pending.clear();
+		}
 
-		lua_getglobal(L, "PathSearchMeta");
-		if(lua_isnil(L, n + 2))
+		static boost::posix_time::ptime Now() { return boost::posix_time::microsec_clock::universal_time(); }
+
+		void WorkerMain()
 		{
-			lua_pop(L, 1);
-			// must create metatable for globals
-			lua_newtable(L);	
-			
-			lua_pushcclosure(L, pathsearch_gc, 0);
-			lua_setfield(L, n + 2, "__gc");
+			Search* search = NULL;
 
-			lua_pushcclosure(L, pathsearch_index, 0);
-			lua_setfield(L, n + 2, "__index");
-			
-			lua_setglobal(L, "PathSearchMeta");
-			lua_getglobal(L, "PathSearchMeta");
+			boost::mutex::scoped_lock lock(mutex);
+			while(true)
+			{
+				while(!stopping && (search == NULL && pending.empty() || waiting == 0 && Now() >= deadline))
+					work_ready.wait(lock);
+
+				if(stopping)
+					break;
+
+				if(search == NULL)
+				{
+					search = pending.front();
+					pending.pop_front();
+
+					++busy;
+				}
+
+				// the search only touches its own arena and its snapshot, so it can run without the lock
+				do
+				{
+					lock.unlock();
+					search->Think(steps_per_slice);
+					lock.lock();
+				} while(!search->finished && !stopping && (waiting != 0 || Now() < deadline));
+
+				if(search->finished)
+				{
+					finished.push_back(search);
+					search = NULL;
+
+					--busy;
+					search_finished.notify_all();
+				}
+			}
+
+			if(search != NULL)
+			{
+				pending.push_front(search);
+				--busy;
+			}
+		}
+
+		void Submit(Search* search)
+		{
+			search->queued = pool;
+			++search->ref_count;
+
+			++queued_count;
+
+			boost::mutex::scoped_lock lock(mutex);
+			pending.push_back(search);
+			work_ready.notify_one();
+		}
+
+		// takes back a search which no worker has started yet; returns false if it's already running or finished
+		bool Cancel(Search* search)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				list<Search*>::iterator found = find(pending.begin(), pending.end(), search);
+				if(found == pending.end())
+					return false;
+
+				pending.erase(found);
+			}
+
+			Unqueue(search);
+			return true;
+		}
+
+		void Unqueue(Search* search)
+		{
+			search->queued = NULL;
+			--queued_count;
+
+			PathService::ReleaseSearch(search);
+		}
+
+		// hands the solutions of finished searches over to the main thread
+		void Publish()
+		{
+			vector<Search*> results;
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				results.swap(finished);
+			}
+
+			for(vector<Search*>::iterator iter = results.begin(); iter != results.end(); ++iter)
+			{
+				Unqueue(*iter);
+				++completed_count;
+			}
+		}
+
+		// runs pending searches on the calling thread, for pools without any worker threads
+		void RunPending(float budget_ms)
+		{
+			boost::posix_time::ptime stop = Now() + boost::posix_time::microseconds((long long)(budget_ms * 1000.0f));
+
+			while(!pending.empty() && (budget_ms < 0 || Now() < stop))
+			{
+				Search* search = pending.front();
+				search->Think(budget_ms < 0 ? -1 : steps_per_slice);
+
+				if(search->finished)
+				{
+					pending.pop_front();
+					finished.push_back(search);
+				}
+			}
+		}
+
+		void Update(float budget_ms)
+		{
+			Publish();
+
+			if(threads.empty())
+			{
+				RunPending(budget_ms);
+				Publish();
+			}
+			else
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				deadline = Now() + boost::posix_time::microseconds((long long)(budget_ms * 1000.0f));
+				work_ready.notify_all();
+			}
+		}
+
+		void Flush()
+		{
+			if(threads.empty())
+				RunPending(-1);
+			else
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				++waiting;
+				work_ready.notify_all();
+
+				while(!pending.empty() || busy != 0)
+					search_finished.wait(lock);
+
+				--waiting;
+			}
+
+			Publish();
+		}
+
+		// waits for one search to finish; if no worker has started it yet, it's run on the calling thread instead
+		void Finish(Search* search)
+		{
+			bool run_here = false;
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				list<Search*>::iterator found = find(pending.begin(), pending.end(), search);
+				if(found != pending.end())
+				{
+					pending.erase(found);
+					run_here = true;
+				}
+				else
+				{
+					++waiting;
+					work_ready.notify_all();
+
+					while(find(finished.begin(), finished.end(), search) == finished.end())
+						search_finished.wait(lock);
+
+					--waiting;
+				}
+			}
+
+			if(run_here)
+			{
+				search->Think(-1);
+
+				boost::mutex::scoped_lock lock(mutex);
+				finished.push_back(search);
+			}
+
+			Publish();
 		}
-		lua_setmetatable(L, n + 1);							// set field of 1; pop; top = 1
+	};
+
+
+
+
+	/*
+	 * PathWorkerPool methods
+	 */
+	PathWorkerPool::PathWorkerPool(unsigned int thread_count) : Disposable(), imp(new Imp(this, thread_count)) { }
+
+	void PathWorkerPool::InnerDispose()
+	{
+		if(PathService::GetWorkerPool() == this)
+			PathService::SetWorkerPool(NULL);
+
+		delete imp;
+		imp = NULL;
+
+		Disposable::InnerDispose();
+	}
+
+	void PathWorkerPool::Update(float budget_ms) { imp->Update(budget_ms); }
+	void PathWorkerPool::Flush() { imp->Flush(); }
+
+	unsigned int PathWorkerPool::GetThreadCount() { return imp->threads.size(); }
+	unsigned int PathWorkerPool::GetQueuedCount() { return imp->queued_count; }
+	unsigned int PathWorkerPool::GetCompletedCount() { return imp->completed_count; }
+
+
+
+
+	/*
+	 * PathSearch methods
+	 */
+	PathSearch::PathSearch(unsigned int graph, unsigned int source, unsigned int target) :
+		imp(PathService::AcquireSearch(graph, source, target))
+	{
+	}
+
+	void PathSearch::Dispose()
+	{
+		PathService::ReleaseSearch(imp);
+		imp = NULL;
+	}
+
+	void PathSearch::Think(int steps)
+	{
+		if(imp->queued != NULL)
+		{
+			if(steps < 0)
+				imp->queued->imp->Finish(imp);
+		}
+		else
+			imp->Think(steps);
+	}
+
+	void PathSearch::Solve() { Think(-1); }
+
+	int PathSearch::GetGraph() { return imp->graph; }
+	int PathSearch::GetSource() { return imp->source; }
+	int PathSearch::GetTarget() { return imp->target; }
+
+	bool PathSearch::IsFinished() { return imp->queued == NULL && imp->finished; }
+
+	list<unsigned int> PathSearch::GetSolution()
+	{
+		list<unsigned int> result;
+		if(imp->queued == NULL)
+			for(list<unsigned int>::iterator iter = imp->solution.begin(); iter != imp->solution.end(); ++iter)
+				result.push_back(*iter);
+		return result;
+	}
+
+	unsigned int PathSearch::GetExpansions() { return imp->queued == NULL ? imp->expansions : 0; }
+
+
+
+
+	/*
+	 * PathService private implementation struct
+	 */
+	struct PathService::Imp
+	{
+		struct PathKey
+		{
+			unsigned int graph, source, target;
+
+			PathKey(unsigned int graph, unsigned int source, unsigned int target) : graph(graph), source(source), target(target) { }
+
+			bool operator <(const PathKey& other) const
+			{
+				if(graph != other.graph)
+					return graph < other.graph;
+				else if(target != other.target)
+					return target < other.target;
+				else
+					return source < other.source;
+			}
+		};
+
+		typedef pair<unsigned int, unsigned int> TargetKey;			// graph, target
+
+		// shortest path tree of every node which can reach the target; next_hop is indexed by node id
+		struct FlowField
+		{
+			unsigned int edit_count;
+			unsigned int target;
+			vector<unsigned int> next_hop;
+			vector<unsigned char> reached;
+
+			FlowField() : edit_count(0), target(0), next_hop(), reached() { }
+
+			bool GetPath(unsigned int source, list<unsigned int>& path)
+			{
+				path.clear();
+				if(source >= reached.size() || !reached[source])
+					return false;
+
+				for(unsigned int cur = source; cur != target; )
+				{
+					cur = next_hop[cur];
+					path.push_back(cur);
+				}
+				return true;
+			}
+		};
+
+		struct TargetDemand
+		{
+			unsigned int edit_count;
+			unsigned int sources;
+
+			TargetDemand() : edit_count(0), sources(0) { }
+		};
+
+		static map<PathKey, PathSearch::Imp*> searches;				// in progress and completed; each holds a reference
+		static map<TargetKey, FlowField*> flow_fields;
+		static map<TargetKey, TargetDemand> demand;
+
+		static Stats stats;
+
+		static PathWorkerPool* worker_pool;
+
+		static FlowField* GetFlowField(unsigned int graph, unsigned int target, unsigned int edit_count)
+		{
+			map<TargetKey, FlowField*>::iterator found = flow_fields.find(TargetKey(graph, target));
+			if(found == flow_fields.end())
+				return NULL;
+			else if(found->second->edit_count != edit_count)
+			{
+				delete found->second;
+				flow_fields.erase(found);
+				return NULL;
+			}
+			else
+				return found->second;
+		}
+
+		static void BuildFlowField(unsigned int graph, unsigned int target)
+		{
+			unsigned int edit_count = NavGraph::GetEditCount(graph);
+			unsigned int bound = NavGraph::GetNodeIDBound(graph);
+
+			FlowField*& field = flow_fields[TargetKey(graph, target)];
+			if(field == NULL)
+				field = new FlowField();
+
+			field->edit_count = edit_count;
+			field->target = target;
+			field->next_hop.assign(bound, 0);
+			field->reached.assign(bound, 0);
+
+			// Dijkstra over the reversed edges, so every node learns the cost of its best path to the target
+			SearchArena* arena = AcquireSearchArena();
+			arena->Begin(bound);
+
+			arena->GetState(target);
+			arena->states[target] = SearchArena::NS_OPEN;
+			arena->g_costs[target] = arena->f_costs[target] = 0.0f;
+			arena->heap.Insert(target);
+
+			while(!arena->heap.Empty())
+			{
+				unsigned int closest = arena->heap.Pop();
+				++stats.flow_field_expansions;
+
+				arena->states[closest] = SearchArena::NS_CLOSED;
+				field->reached[closest] = 1;
+				field->next_hop[closest] = arena->parents[closest];
+
+				float closest_g_cost = arena->g_costs[closest];
+
+				NavGraph::GetNodeInEdges(graph, closest, arena->neighbors, arena->edge_costs);
+				for(unsigned int i = 0; i < arena->neighbors.size(); ++i)
+				{
+					unsigned int other = arena->neighbors[i];
+					float g_cost = closest_g_cost + arena->edge_costs[i];
+
+					unsigned char state = arena->GetState(other);
+					if(state == 0 || g_cost < arena->g_costs[other] && state == SearchArena::NS_OPEN)
+					{
+						arena->g_costs[other] = arena->f_costs[other] = g_cost;
+						arena->parents[other] = closest;
+
+						if(state == 0)
+						{
+							arena->states[other] = SearchArena::NS_OPEN;
+							arena->heap.Insert(other);
+						}
+						else
+							arena->heap.DecreaseKey(other);
+					}
+				}
+			}
+
+			ReleaseSearchArena(arena);
+
+			++stats.flow_fields_built;
+		}
+
+		// drops the cache's references to searches nobody else is using; unfinished ones are cancelled, unless a worker is running them
+		static void EvictUnreferenced()
+		{
+			for(map<PathKey, PathSearch::Imp*>::iterator iter = searches.begin(); iter != searches.end(); )
+			{
+				PathSearch::Imp* search = iter->second;
+
+				// referenced only by the cache and the pool it's queued on
+				if(search->queued != NULL && search->ref_count == 2)
+					search->queued->imp->Cancel(search);
+
+				if(search->queued == NULL && search->ref_count == 1)
+				{
+					delete search;
+					searches.erase(iter++);
+				}
+				else
+					++iter;
+			}
+		}
+
+		static PathSearch::Imp* Acquire(unsigned int graph, unsigned int source, unsigned int target)
+		{
+			++stats.requests;
+
+			unsigned int edit_count = NavGraph::GetEditCount(graph);
+			PathKey key(graph, source, target);
+
+			map<PathKey, PathSearch::Imp*>::iterator found = searches.find(key);
+			if(found != searches.end())
+			{
+				PathSearch::Imp* search = found->second;
+				if(search->edit_count == edit_count)
+				{
+					if(search->queued == NULL && search->finished)
+						++stats.cache_hits;
+					else
+						++stats.shared_hits;
+
+					++search->ref_count;
+					return search;
+				}
+
+				// the graph has changed since this search began; existing handles keep it, but it won't be shared anymore
+				searches.erase(found);
+				Release(search);
+			}
+
+			if(searches.size() >= max_cached_paths)
+				EvictUnreferenced();
+
+			PathSearch::Imp* search;
+
+			list<unsigned int> path;
+			FlowField* field = flow_field_threshold == 0 ? NULL : GetFlowField(graph, target, edit_count);
+			if(field != NULL)
+			{
+				field->GetPath(source, path);
+				search = new PathSearch::Imp(graph, source, target, path);
+
+				++stats.flow_field_hits;
+			}
+			else
+			{
+				search = new PathSearch::Imp(graph, source, target);
+
+				++stats.misses;
+
+				// a new source wants a path to this target; if enough have, sweep the whole graph from the target once
+				TargetDemand& target_demand = demand[TargetKey(graph, target)];
+				if(target_demand.edit_count != edit_count)
+				{
+					target_demand.edit_count = edit_count;
+					target_demand.sources = 0;
+				}
+				if(flow_field_threshold != 0 && ++target_demand.sources >= flow_field_threshold)
+				{
+					BuildFlowField(graph, target);
+					demand.erase(TargetKey(graph, target));
+				}
+			}
+
+			search->ref_count = 2;				// the caller's handle and the cache
+			searches[key] = search;
+
+			if(worker_pool != NULL && !search->finished)
+				worker_pool->imp->Submit(search);
+
+			return search;
+		}
+
+		static void Release(PathSearch::Imp* search)
+		{
+			if(search != NULL && --search->ref_count == 0)
+				delete search;
+		}
+
+		static void Clear()
+		{
+			for(map<PathKey, PathSearch::Imp*>::iterator iter = searches.begin(); iter != searches.end(); ++iter)
+				Release(iter->second);
+			searches.clear();
+
+			for(map<TargetKey, FlowField*>::iterator iter = flow_fields.begin(); iter != flow_fields.end(); ++iter)
+				delete iter->second;
+			flow_fields.clear();
+
+			demand.clear();
+		}
+	};
+
+	map<PathService::Imp::PathKey, PathSearch::Imp*> PathService::Imp::searches = map<PathService::Imp::PathKey, PathSearch::Imp*>();
+	map<PathService::Imp::TargetKey, PathService::Imp::FlowField*> PathService::Imp::flow_fields = map<PathService::Imp::TargetKey, PathService::Imp::FlowField*>();
+	map<PathService::Imp::TargetKey, PathService::Imp::TargetDemand> PathService::Imp::demand = map<PathService::Imp::TargetKey, PathService::Imp::TargetDemand>();
+
+	PathService::Stats PathService::Imp::stats = PathService::Stats();
+
+	PathWorkerPool* PathService::Imp::worker_pool = NULL;
+
+
+
+
+	/*
+	 * PathService methods
+	 */
+	unsigned int PathService::flow_field_threshold = 8;
+	unsigned int PathService::max_cached_paths = 512;
+
+	PathService::Stats::Stats() :
+		requests(0),
+		cache_hits(0),
+		shared_hits(0),
+		flow_field_hits(0),
+		misses(0),
+		flow_fields_built(0),
+		flow_field_expansions(0)
+	{
+	}
+
+	PathSearch::Imp* PathService::AcquireSearch(unsigned int graph, unsigned int source, unsigned int target) { return Imp::Acquire(graph, source, target); }
+	void PathService::ReleaseSearch(PathSearch::Imp* search) { Imp::Release(search); }
+
+	PathService::Stats PathService::GetStats() { return Imp::stats; }
+	void PathService::ResetStats() { Imp::stats = Stats(); }
+
+	void PathService::BuildFlowField(unsigned int graph, unsigned int target) { Imp::BuildFlowField(graph, target); }
+
+	void PathService::ClearCache() { Imp::Clear(); }
+
+	void PathService::SetWorkerPool(PathWorkerPool* pool) { Imp::worker_pool = pool; }
+	PathWorkerPool* PathService::GetWorkerPool() { return Imp::worker_pool; }
+
+
+
+
+	/*
+	 * NavHierarchy private implementation struct
+	 */
+	struct NavHierarchy::Imp
+	{
+		static const unsigned int INVALID_INDEX = 0xFFFFFFFF;
+
+		struct AbstractEdge
+		{
+			unsigned int to;
+			float cost;
+
+			AbstractEdge(unsigned int to, float cost) : to(to), cost(cost) { }
+		};
+
+		unsigned int graph;
+		unsigned int edit_count;
+
+		float cluster_size;
+		Vec3 origin;
+
+		vector<unsigned int> node_clusters;							// node id --> cluster index
+		vector<unsigned int> node_entrances;						// node id --> entrance index, or INVALID_INDEX
+
+		vector<vector<unsigned int> > cluster_entrances;			// cluster index --> entrance indices
+		vector<unsigned int> entrance_nodes;						// entrance index --> node id
+		vector<vector<AbstractEdge> > abstract_edges;				// entrance index --> outgoing edges of the abstract graph
+
+		vector<unsigned int> neighbors;
+		vector<float> edge_costs;
+
+		// one reference for the NavHierarchy, and one for each HierarchicalPathSearch using it; searches may outlive the NavHierarchy
+		unsigned int ref_count;
+
+		Imp(unsigned int graph, float cluster_size, Vec3 origin) :
+			graph(graph),
+			edit_count(NavGraph::GetEditCount(graph)),
+			cluster_size(cluster_size),
+			origin(origin),
+			node_clusters(),
+			node_entrances(),
+			cluster_entrances(),
+			entrance_nodes(),
+			abstract_edges(),
+			neighbors(),
+			edge_costs(),
+			ref_count(1)
+		{
+			Build();
+		}
+
+		void AddRef() { ++ref_count; }
+		void Release()
+		{
+			if(--ref_count == 0)
+				delete this;
+		}
+
+		bool IsStale() { return NavGraph::GetEditCount(graph) != edit_count; }
+
+		unsigned int GetCluster(unsigned int node) { return node < node_clusters.size() ? node_clusters[node] : INVALID_INDEX; }
+
+		unsigned int GetEntrance(unsigned int node)
+		{
+			if(node_entrances[node] == INVALID_INDEX)
+			{
+				node_entrances[node] = entrance_nodes.size();
+				entrance_nodes.push_back(node);
+				abstract_edges.push_back(vector<AbstractEdge>());
+
+				cluster_entrances[node_clusters[node]].push_back(node_entrances[node]);
+			}
+			return node_entrances[node];
+		}
+
+		void Build()
+		{
+			vector<unsigned int> nodes = NavGraph::GetAllNodes(graph);
+			sort(nodes.begin(), nodes.end());						// so cluster and entrance indices don't depend on hash order
+
+			unsigned int node_id_bound = NavGraph::GetNodeIDBound(graph);
+			node_clusters.assign(node_id_bound, INVALID_INDEX);
+			node_entrances.assign(node_id_bound, INVALID_INDEX);
+
+			// assign each node to the grid cell it's in
+			map<pair<int, int>, unsigned int> cell_clusters;
+			for(vector<unsigned int>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+			{
+				Vec3 pos = NavGraph::GetNodePosition(graph, *iter) - origin;
+				pair<int, int> cell((int)floor(pos.x / cluster_size), (int)floor(pos.z / cluster_size));
+
+				map<pair<int, int>, unsigned int>::iterator found = cell_clusters.find(cell);
+				if(found == cell_clusters.end())
+				{
+					unsigned int index = cell_clusters.size();
+					cell_clusters[cell] = index;
+
+					node_clusters[*iter] = index;
+				}
+				else
+					node_clusters[*iter] = found->second;
+			}
+			cluster_entrances.resize(cell_clusters.size());
+
+			// edges between clusters become edges of the abstract graph
+			for(vector<unsigned int>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter)
+			{
+				NavGraph::GetNodeOutEdges(graph, *iter, neighbors, edge_costs);
+				for(unsigned int i = 0; i < neighbors.size(); ++i)
+					if(node_clusters[neighbors[i]] != node_clusters[*iter])
+					{
+						unsigned int from = GetEntrance(*iter);
+						unsigned int to = GetEntrance(neighbors[i]);
+
+						abstract_edges[from].push_back(AbstractEdge(to, edge_costs[i]));
+					}
+			}
+
+			// precompute the cost of getting between each pair of entrances within a cluster
+			SearchArena* arena = AcquireSearchArena();
+			for(unsigned int cluster = 0; cluster < cluster_entrances.size(); ++cluster)
+			{
+				vector<unsigned int>& entrances = cluster_entrances[cluster];
+				for(vector<unsigned int>::iterator iter = entrances.begin(); iter != entrances.end(); ++iter)
+				{
+					unsigned int expansions = 0;
+					ClusterDijkstra(arena, entrance_nodes[*iter], 0, NavGraph::PD_OUT, expansions);
+
+					for(vector<unsigned int>::iterator jter = entrances.begin(); jter != entrances.end(); ++jter)
+					{
+						unsigned int other = entrance_nodes[*jter];
+						if(jter != iter && arena->GetState(other) == SearchArena::NS_CLOSED)
+							abstract_edges[*iter].push_back(AbstractEdge(*jter, arena->g_costs[other]));
+					}
+				}
+			}
+			ReleaseSearchArena(arena);
+		}
+
+		/**
+		 * Dijkstra's algorithm from the given node, without leaving its cluster; if dir is PD_IN, follows edges backwards
+		 * Stops early if target is nonzero and gets reached; afterward, costs and parents of reached nodes are in the arena
+		 */
+		void ClusterDijkstra(SearchArena* arena, unsigned int source, unsigned int target, NavGraph::PathDirection dir, unsigned int& expansions)
+		{
+			unsigned int cluster = node_clusters[source];
+
+			arena->Begin(node_clusters.size());
+
+			arena->GetState(source);
+			arena->states[source] = SearchArena::NS_OPEN;
+			arena->parents[source] = 0;
+			arena->g_costs[source] = arena->f_costs[source] = 0.0f;
+			arena->heap.Insert(source);
+
+			while(!arena->heap.Empty())
+			{
+				unsigned int closest = arena->heap.Pop();
+				++expansions;
+
+				arena->states[closest] = SearchArena::NS_CLOSED;
+				if(closest == target)
+					break;
+
+				if(dir == NavGraph::PD_OUT)
+					NavGraph::GetNodeOutEdges(graph, closest, arena->neighbors, arena->edge_costs);
+				else
+					NavGraph::GetNodeInEdges(graph, closest, arena->neighbors, arena->edge_costs);
+
+				for(unsigned int i = 0; i < arena->neighbors.size(); ++i)
+				{
+					unsigned int other = arena->neighbors[i];
+					if(GetCluster(other) != cluster)
+						continue;
+
+					float g_cost = arena->g_costs[closest] + arena->edge_costs[i];
+
+					unsigned char state = arena->GetState(other);
+					if(state == 0 || g_cost < arena->g_costs[other] && state == SearchArena::NS_OPEN)
+					{
+						arena->g_costs[other] = arena->f_costs[other] = g_cost;
+						arena->parents[other] = closest;
+
+						if(state == 0)
+						{
+							arena->states[other] = SearchArena::NS_OPEN;
+							arena->heap.Insert(other);
+						}
+						else
+							arena->heap.DecreaseKey(other);
+					}
+				}
+			}
+		}
+	};
+
+
+
+
+	const unsigned int NavHierarchy::Imp::INVALID_INDEX;
+
+
+
+
+	/*
+	 * NavHierarchy methods
+	 */
+	NavHierarchy::NavHierarchy(unsigned int graph, float cluster_size, Vec3 origin) : imp(new Imp(graph, cluster_size, origin)) { }
+
+	void NavHierarchy::InnerDispose() { imp->Release(); imp = NULL; }
+
+	unsigned int NavHierarchy::GetGraph() { return imp->graph; }
+	bool NavHierarchy::IsStale() { return imp->IsStale(); }
+
+	unsigned int NavHierarchy::GetClusterCount() { return imp->cluster_entrances.size(); }
+	unsigned int NavHierarchy::GetEntranceCount() { return imp->entrance_nodes.size(); }
+
+
+
+
+	/*
+	 * HierarchicalPathSearch private implementation struct
+	 */
+	struct HierarchicalPathSearch::Imp
+	{
+		typedef NavHierarchy::Imp::AbstractEdge AbstractEdge;
+
+		enum Phase { Connect, Abstract, Refine, Done };
+
+		NavHierarchy::Imp* hierarchy;
+
+		unsigned int graph;
+		unsigned int source;
+		unsigned int target;
+
+		bool finished;
+		Phase phase;
+
+		list<unsigned int> solution;
+
+		unsigned int expansions;
+
+		// used instead of the abstract graph if the endpoints share a cluster, or if the hierarchy is (or becomes) stale
+		PathSearch* flat_search;
+
+		// abstract graph search; the source and target get the indices after the last entrance
+		unsigned int abstract_source, abstract_target;
+		vector<AbstractEdge> source_links;
+		vector<AbstractEdge> target_links;
+		SearchArena* arena;
+		Vec3 target_pos;
+
+		vector<unsigned int> abstract_path;					// node ids along the abstract path, from source to target
+		unsigned int refine_index;
+
+		Imp(NavHierarchy* hierarchy_, unsigned int source, unsigned int target) :
+			hierarchy(hierarchy_->imp),
+			graph(hierarchy_->imp->graph),
+			source(source),
+			target(target),
+			finished(false),
+			phase(Connect),
+			solution(),
+			expansions(0),
+			flat_search(NULL),
+			abstract_source(0),
+			abstract_target(0),
+			source_links(),
+			target_links(),
+			arena(NULL),
+			target_pos(NavGraph::GetNodePosition(hierarchy_->imp->graph, target)),
+			abstract_path(),
+			refine_index(0)
+		{
+			hierarchy->AddRef();
+
+			unsigned int source_cluster = hierarchy->GetCluster(source);
+			unsigned int target_cluster = hierarchy->GetCluster(target);
+
+			if(hierarchy->IsStale() || source_cluster == NavHierarchy::Imp::INVALID_INDEX || target_cluster == NavHierarchy::Imp::INVALID_INDEX || source_cluster == target_cluster)
+				flat_search = new PathSearch(graph, source, target);
+		}
+
+		~Imp()
+		{
+			if(flat_search != NULL)
+			{
+				flat_search->Dispose();
+				delete flat_search;
+				flat_search = NULL;
+			}
+
+			ReleaseArena();
+
+			hierarchy->Release();
+		}
+
+		void ReleaseArena()
+		{
+			if(arena != NULL)
+			{
+				ReleaseSearchArena(arena);
+				arena = NULL;
+			}
+		}
+
+		// once the graph has been edited, neither the abstract graph nor the path refined so far can be trusted; start over with plain A*
+		void FallBack()
+		{
+			ReleaseArena();
+
+			solution.clear();
+			abstract_path.clear();
+			phase = Done;
+
+			flat_search = new PathSearch(graph, source, target);
+		}
+
+		unsigned int AbstractToNode(unsigned int index)
+		{
+			if(index == abstract_source)
+				return source;
+			else if(index == abstract_target)
+				return target;
+			else
+				return hierarchy->entrance_nodes[index];
+		}
+
+		// find the costs from the source to the entrances of its cluster, and from the entrances of the target's cluster to the target
+		void ConnectEndpoints()
+		{
+			abstract_source = hierarchy->entrance_nodes.size();
+			abstract_target = abstract_source + 1;
+
+			SearchArena* temp = AcquireSearchArena();
+
+			hierarchy->ClusterDijkstra(temp, source, 0, NavGraph::PD_OUT, expansions);
+
+			vector<unsigned int>& source_entrances = hierarchy->cluster_entrances[hierarchy->GetCluster(source)];
+			for(vector<unsigned int>::iterator iter = source_entrances.begin(); iter != source_entrances.end(); ++iter)
+			{
+				unsigned int node = hierarchy->entrance_nodes[*iter];
+				if(temp->GetState(node) == SearchArena::NS_CLOSED)
+					source_links.push_back(AbstractEdge(*iter, temp->g_costs[node]));
+			}
+
+			hierarchy->ClusterDijkstra(temp, target, 0, NavGraph::PD_IN, expansions);
+
+			vector<unsigned int>& target_entrances = hierarchy->cluster_entrances[hierarchy->GetCluster(target)];
+			for(vector<unsigned int>::iterator iter = target_entrances.begin(); iter != target_entrances.end(); ++iter)
+			{
+				unsigned int node = hierarchy->entrance_nodes[*iter];
+				if(temp->GetState(node) == SearchArena::NS_CLOSED)
+					target_links.push_back(AbstractEdge(*iter, temp->g_costs[node]));
+			}
+
+			ReleaseSearchArena(temp);
+
+			// get the abstract search ready
+			arena = AcquireSearchArena();
+			arena->Begin(abstract_target + 1);
+
+			arena->GetState(abstract_source);
+			arena->states[abstract_source] = SearchArena::NS_OPEN;
+			arena->g_costs[abstract_source] = arena->f_costs[abstract_source] = 0.0f;
+			arena->heap.Insert(abstract_source);
+
+			phase = Abstract;
+		}
+
+		void Relax(unsigned int from, unsigned int to, float edge_cost)
+		{
+			float g_cost = arena->g_costs[from] + edge_cost;
+
+			unsigned char state = arena->GetState(to);
+			if(state == 0 || g_cost < arena->g_costs[to] && state == SearchArena::NS_OPEN)
+			{
+				float h_cost = to == abstract_target ? 0.0f : (NavGraph::GetNodePosition(graph, AbstractToNode(to)) - target_pos).ComputeMagnitude();
+
+				arena->g_costs[to] = g_cost;
+				arena->f_costs[to] = g_cost + h_cost;
+				arena->parents[to] = from;
+
+				if(state == 0)
+				{
+					arena->states[to] = SearchArena::NS_OPEN;
+					arena->heap.Insert(to);
+				}
+				else
+					arena->heap.DecreaseKey(to);
+			}
+		}
+
+		// one step of A* on the abstract graph
+		void AbstractStep()
+		{
+			if(arena->heap.Empty())
+			{
+				// no path
+				ReleaseArena();
+
+				phase = Done;
+				return;
+			}
+
+			unsigned int closest = arena->heap.Pop();
+			++expansions;
+
+			arena->states[closest] = SearchArena::NS_CLOSED;
+			if(closest == abstract_target)
+			{
+				for(unsigned int cur = abstract_target; cur != abstract_source; cur = arena->parents[cur])
+					abstract_path.push_back(AbstractToNode(cur));
+				abstract_path.push_back(source);
+				reverse(abstract_path.begin(), abstract_path.end());
+
+				ReleaseArena();
+
+				phase = Refine;
+				return;
+			}
+
+			if(closest == abstract_source)
+			{
+				for(vector<AbstractEdge>::iterator iter = source_links.begin(); iter != source_links.end(); ++iter)
+					Relax(closest, iter->to, iter->cost);
+			}
+			else
+			{
+				vector<AbstractEdge>& edges = hierarchy->abstract_edges[closest];
+				for(vector<AbstractEdge>::iterator iter = edges.begin(); iter != edges.end(); ++iter)
+					Relax(closest, iter->to, iter->cost);
+
+				for(vector<AbstractEdge>::iterator iter = target_links.begin(); iter != target_links.end(); ++iter)
+					if(iter->to == closest)
+						Relax(closest, abstract_target, iter->cost);
+			}
+		}
+
+		// expand one segment of the abstract path into NavGraph nodes
+		void RefineStep()
+		{
+			if(refine_index + 1 >= abstract_path.size())
+			{
+				phase = Done;
+				return;
+			}
+
+			unsigned int from = abstract_path[refine_index];
+			unsigned int to = abstract_path[refine_index + 1];
+			++refine_index;
+
+			if(from == to)
+				return;														// source or target was itself an entrance
+
+			if(hierarchy->GetCluster(from) != hierarchy->GetCluster(to))
+			{
+				solution.push_back(to);										// an edge between clusters
+				return;
+			}
+
+			SearchArena* temp = AcquireSearchArena();
+			hierarchy->ClusterDijkstra(temp, from, to, NavGraph::PD_OUT, expansions);
+
+			// the parents are only meaningful if the segment's end was actually reached
+			if(temp->GetState(to) == SearchArena::NS_CLOSED)
+			{
+				list<unsigned int> segment;
+				for(unsigned int cur = to; cur != from; cur = temp->parents[cur])
+					segment.push_front(cur);
+				solution.splice(solution.end(), segment);
+
+				ReleaseSearchArena(temp);
+			}
+			else
+			{
+				ReleaseSearchArena(temp);
+				FallBack();
+			}
+		}
+
+		void Think(int steps)
+		{
+			if(finished)
+				return;
+
+			if(flat_search == NULL)
+			{
+				unsigned int start = expansions;
+
+				// if steps < 0, this will loop until the search is finished
+				while(flat_search == NULL && phase != Done && (steps < 0 || expansions - start < (unsigned int)steps))
+				{
+					if(hierarchy->IsStale())
+					{
+						FallBack();
+						break;
+					}
+
+					switch(phase)
+				{
+						case Connect:
+							ConnectEndpoints();
+							break;
+						case Abstract:
+							AbstractStep();
+							break;
+						case Refine:
+							RefineStep();
+							break;
+						default:
+							break;
+					}
+				}
+
+				if(flat_search == NULL)
+				{
+					if(phase == Done)
+						finished = true;
+					return;
+				}
+
+				// the search fell back to plain A* partway through; let it have whatever is left of the budget
+				if(steps >= 0)
+				{
+					if(expansions - start >= (unsigned int)steps)
+						return;
+					steps -= expansions - start;
+				}
+			}
+
+			unsigned int before = flat_search->GetExpansions();
+			flat_search->Think(steps);
+			expansions += flat_search->GetExpansions() - before;
+
+			if(flat_search->IsFinished())
+			{
+				solution = flat_search->GetSolution();
+				finished = true;
+			}
+		}
+	};
+
+
+
+
+	/*
+	 * HierarchicalPathSearch methods
+	 */
+	HierarchicalPathSearch::HierarchicalPathSearch(NavHierarchy* hierarchy, unsigned int source, unsigned int target) :
+		imp(new Imp(hierarchy, source, target))
+	{
+	}
+
+	void HierarchicalPathSearch::Dispose()
+	{
+		delete imp;
+		imp = NULL;
+	}
+
+	void HierarchicalPathSearch::Think(int steps) { imp->Think(steps); }
+
+	void HierarchicalPathSearch::Solve() { imp->Think(-1); }
+
+	int HierarchicalPathSearch::GetGraph() { return imp->graph; }
+	int HierarchicalPathSearch::GetSource() { return imp->source; }
+	int HierarchicalPathSearch::GetTarget() { return imp->target; }
+
+	bool HierarchicalPathSearch::IsFinished() { return imp->finished; }
+
+	list<unsigned int> HierarchicalPathSearch::GetSolution() { return imp->solution; }
+
+	unsigned int HierarchicalPathSearch::GetExpansions() { return imp->expansions; }
+
+
+
+
+	/*
+	 * Scripting stuff; the same glue serves PathSearch and HierarchicalPathSearch
+	 */
+	template<class S> int pathsearch_gc(lua_State* L);
+	template<class S> int pathsearch_index(lua_State* L);
+
+	template<class S> void SetPathSearchMetatable(lua_State* L, const char* meta_name)
+	{
+		int n = lua_gettop(L);								// the userdata is on top of the stack
+
+		lua_getglobal(L, meta_name);
+		if(lua_isnil(L, n + 1))
+		{
+			lua_pop(L, 1);
+			// must create metatable for globals
+			lua_newtable(L);	
+			
+			lua_pushcclosure(L, pathsearch_gc<S>, 0);
+			lua_setfield(L, n + 1, "__gc");
+
+			lua_pushcclosure(L, pathsearch_index<S>, 0);
+			lua_setfield(L, n + 1, "__index");
+			
+			lua_setglobal(L, meta_name);
+			lua_getglobal(L, meta_name);
+		}
+		lua_setmetatable(L, n);								// set field of the userdata; pop
+	}
+
+	void PushPathSearchHandle(lua_State* L, unsigned int graph, unsigned int source, unsigned int target)
+	{
+		PathSearch* ptr = (PathSearch*)lua_newuserdata(L, sizeof(PathSearch));//new PathSearch(graph, source, target);
+		*ptr = PathSearch(graph, source, target);
+
+		SetPathSearchMetatable<PathSearch>(L, "PathSearchMeta");
+	}
+
+	void PushHierarchicalPathSearchHandle(lua_State* L, NavHierarchy* hierarchy, unsigned int source, unsigned int target)
+	{
+		HierarchicalPathSearch* ptr = (HierarchicalPathSearch*)lua_newuserdata(L, sizeof(HierarchicalPathSearch));
+		*ptr = HierarchicalPathSearch(hierarchy, source, target);
+
+		SetPathSearchMetatable<HierarchicalPathSearch>(L, "HierarchicalPathSearchMeta");
 	}
 
-	int pathsearch_gc(lua_State* L)
+	template<class S> int pathsearch_gc(lua_State* L)
 	{
-		PathSearch* path_search = (PathSearch*)lua_touserdata(L, 1);
+		S* path_search = (S*)lua_touserdata(L, 1);
 		path_search->Dispose();
 
 		lua_settop(L, 0);
 		return 0;
 	}
 
-	int pathsearch_think(lua_State* L)
+	template<class S> int pathsearch_think(lua_State* L)
 	{
-		PathSearch* path_search = (PathSearch*)lua_touserdata(L, lua_upvalueindex(1));
+		S* path_search = (S*)lua_touserdata(L, lua_upvalueindex(1));
 		
 		int n = lua_gettop(L);
 		if(n == 1)
@@ -292,9 +1685,9 @@ namespace CibraryEngine
 		return 0;
 	}
 
-	int pathsearch_index(lua_State* L)
+	template<class S> int pathsearch_index(lua_State* L)
 	{
-		PathSearch* path_search = (PathSearch*)lua_touserdata(L, 1);
+		S* path_search = (S*)lua_touserdata(L, 1);
 
 		if(lua_isstring(L, 2))
 		{
@@ -305,7 +1698,8 @@ namespace CibraryEngine
 			if		(key == "finished") { lua_pushboolean(L, path_search->IsFinished()); return 1; }
 			else if	(key == "source") { PushNavNodeHandle(L, path_search->GetGraph(), path_search->GetSource()); return 1; }
 			else if	(key == "target") { PushNavNodeHandle(L, path_search->GetGraph(), path_search->GetTarget()); return 1; }
-			else if (key == "think") { lua_pushlightuserdata(L, path_search); lua_pushcclosure(L, pathsearch_think, 1); return 1; }
+			else if	(key == "expansions") { lua_pushnumber(L, path_search->GetExpansions()); return 1; }
+			else if (key == "think") { lua_pushlightuserdata(L, path_search); lua_pushcclosure(L, pathsearch_think<S>, 1); return 1; }
 			else if	(key == "solution")
 			{
 				lua_settop(L, 0);
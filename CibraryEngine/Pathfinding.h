@@ -2,13 +2,21 @@
 
 #include "StdAfx.h"
 
+#include "Disposable.h"
+#include "Vector.h"
+
 namespace CibraryEngine
 {
 	using namespace std;
 
+	class PathWorkerPool;
+
 	// not implementing Disposable due to stupid stuff that happened with inheritance and lua_newuserdata
 	class PathSearch
 	{
+		friend class PathService;
+		friend class PathWorkerPool;
+
 		private:
 			struct Imp;
 			Imp* imp;
@@ -19,6 +27,7 @@ namespace CibraryEngine
 
 			void Dispose();
 
+			/** Advances the search by the given number of steps; if the search is queued on a PathWorkerPool, this does nothing unless steps < 0, in which case it waits for the search to finish */
 			void Think(int steps);
 			void Solve();
 
@@ -26,10 +35,172 @@ namespace CibraryEngine
 			int GetSource();
 			int GetTarget();
 
+			/** For a search queued on a PathWorkerPool, this only becomes true during PathWorkerPool::Update */
 			bool IsFinished();
 
 			list<unsigned int> GetSolution();
+
+			/** Gets the number of nodes this search has expanded so far (0 while it is queued on a PathWorkerPool); if the search is shared with other PathSearch handles, this includes their expansions too */
+			unsigned int GetExpansions();
+	};
+
+	/**
+	 * Shares work between PathSearch handles: a request with the same graph and endpoints as a search that is still
+	 * in progress shares that search, completed paths are cached until their graph is edited, and once enough sources
+	 * have requested paths to the same target, a flow field (one reverse Dijkstra sweep from the target) answers the
+	 * rest of them immediately
+	 */
+	class PathService
+	{
+		friend class PathSearch;
+		friend class PathWorkerPool;
+
+		private:
+
+			struct Imp;
+
+			static PathSearch::Imp* AcquireSearch(unsigned int graph, unsigned int source, unsigned int target);
+			static void ReleaseSearch(PathSearch::Imp* search);
+
+		public:
+
+			struct Stats
+			{
+				unsigned int requests;
+				unsigned int cache_hits;				// answered by a completed path
+				unsigned int shared_hits;				// joined a search which was already in progress
+				unsigned int flow_field_hits;			// answered by a flow field
+				unsigned int misses;					// started a new search
+
+				unsigned int flow_fields_built;
+				unsigned int flow_field_expansions;
+
+				Stats();
+			};
+
+			/** Number of distinct sources which must request paths to a target (without the graph changing) before a flow field is built for it; 0 disables flow fields */
+			static unsigned int flow_field_threshold;
+			/** Number of searches (finished or not) which may be cached before unreferenced ones are evicted; only ones a worker is running at the time are kept */
+			static unsigned int max_cached_paths;
+
+			static Stats GetStats();
+			static void ResetStats();
+
+			/** Builds (or rebuilds) the flow field toward target, so that requests for paths to it are answered immediately */
+			static void BuildFlowField(unsigned int graph, unsigned int target);
+
+			/** Forgets all cached paths and flow fields; searches in progress are unaffected */
+			static void ClearCache();
+
+			/** While a worker pool is set, new searches are queued on it instead of waiting for Think */
+			static void SetWorkerPool(PathWorkerPool* pool);
+			static PathWorkerPool* GetWorkerPool();
+	};
+
+	/**
+	 * Runs queued PathSearches on background threads, within a time budget each frame. Every search reads an
+	 * immutable NavGraphSnapshot, and is run from start to finish by a single worker, so its solution doesn't
+	 * depend on the number of threads or on how long anything took
+	 */
+	class PathWorkerPool : public Disposable
+	{
+		friend class PathSearch;
+		friend class PathService;
+
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+		protected:
+
+			/** Stops the workers; searches which hadn't finished are handed back to the main thread, to be advanced by Think */
+			void InnerDispose();
+
+		public:
+
+			/** Starts thread_count worker threads; with 0 threads, queued searches are run on the calling thread during Update */
+			PathWorkerPool(unsigned int thread_count);
+
+			/**
+			 * Call once per frame, from the main thread; publishes the solutions of searches which have finished since
+			 * the last call, then lets each worker run for up to budget_ms milliseconds
+			 */
+			void Update(float budget_ms);
+
+			/** Waits until every queued search has finished, and publishes their solutions */
+			void Flush();
+
+			unsigned int GetThreadCount();
+			unsigned int GetQueuedCount();				// searches queued or in progress
+			unsigned int GetCompletedCount();			// searches whose solutions have been published, ever
+	};
+
+	/**
+	 * Cluster abstraction of a NavGraph, for hierarchical pathfinding; nodes are partitioned into clusters by their
+	 * x-z position on a grid, and the nodes with edges leading into other clusters become "entrances" of the abstract
+	 * graph, with the costs of the shortest paths between entrances of the same cluster computed in advance
+	 */
+	class NavHierarchy : public Disposable
+	{
+		friend class HierarchicalPathSearch;
+
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+		protected:
+
+			/** HierarchicalPathSearches using this keep its data alive, so it may be disposed while they are still in progress */
+			void InnerDispose();
+
+		public:
+
+			/** Builds the cluster abstraction of a graph; the grid of clusters has cells cluster_size across, with a corner at origin */
+			NavHierarchy(unsigned int graph, float cluster_size, Vec3 origin = Vec3());
+
+			unsigned int GetGraph();
+
+			/** Whether the graph has been modified since this was built; if so, searches using it fall back to plain A*, starting over at their next step */
+			bool IsStale();
+
+			unsigned int GetClusterCount();
+			unsigned int GetEntranceCount();
+	};
+
+	/**
+	 * Path search which plans on a NavHierarchy's abstract graph, and then refines each step of the abstract path
+	 * within its cluster; Think has the same budget semantics as PathSearch, except that a step spent connecting
+	 * the endpoints to the abstract graph, or refining a path segment, runs to completion within its cluster
+	 */
+	class HierarchicalPathSearch
+	{
+		private:
+			struct Imp;
+			Imp* imp;
+
+		public:
+
+			HierarchicalPathSearch(NavHierarchy* hierarchy, unsigned int source, unsigned int target);
+
+			void Dispose();
+
+			void Think(int steps);
+			void Solve();
+
+			int GetGraph();
+			int GetSource();
+			int GetTarget();
+
+			bool IsFinished();
+
+			list<unsigned int> GetSolution();
+
+			/** Gets the number of nodes (of both the abstract graph and the NavGraph) this search has expanded so far */
+			unsigned int GetExpansions();
 	};
 
 	void PushPathSearchHandle(lua_State* L, unsigned int graph, unsigned int source, unsigned int target);
+	void PushHierarchicalPathSearchHandle(lua_State* L, NavHierarchy* hierarchy, unsigned int source, unsigned int target);
 }
@@ -5,30 +5,246 @@
 
 #include "DebugLog.h"
 #include "Serialize.h"
+#include "TaskPool.h"
 
 #include "btBulletWorldImporter.h"
 #include "btBulletFile.h"
 
 namespace CibraryEngine
 {
+	/*
+	 * Solves the simulation islands of a dynamics world in parallel; islands don't share any dynamic bodies, contacts, or constraints,
+	 * so each one can go to a different btSequentialImpulseConstraintSolver, on a different thread
+	 */
+	struct ParallelIslandSolver
+	{
+		struct Island
+		{
+			unsigned int first_body, body_count;			// index into bodies
+			btPersistentManifold** manifolds;
+			int manifold_count;
+			btTypedConstraint** constraints;
+			int constraint_count;
+			int island_id;
+
+			unsigned int GetCost() const { return body_count + manifold_count + constraint_count; }
+		};
+
+		// gathers the islands as the island manager finds them, without solving them yet
+		struct IslandCollector : public btSimulationIslandManager::IslandCallback
+		{
+			ParallelIslandSolver* solver;
+
+			IslandCollector(ParallelIslandSolver* solver) : solver(solver) { }
+
+			void processIsland(btCollisionObject** bodies, int num_bodies, btPersistentManifold** manifolds, int num_manifolds, int island_id)
+			{
+				// the island manager reuses its array of bodies for the next island, so they have to be copied
+				Island island;
+				island.first_body = solver->bodies.size();
+				island.body_count = num_bodies;
+				island.manifolds = manifolds;
+				island.manifold_count = num_manifolds;
+				island.constraints = NULL;
+				island.constraint_count = 0;
+				island.island_id = island_id;
+
+				solver->bodies.insert(solver->bodies.end(), bodies, bodies + num_bodies);
+				solver->islands.push_back(island);
+			}
+		};
+
+		struct SolveTask : public TaskPool::Task
+		{
+			ParallelIslandSolver* solver;
+			const btContactSolverInfo* info;
+			btIDebugDraw* debug_drawer;
+			btStackAlloc* stack_alloc;
+			btDispatcher* dispatcher;
+			unsigned int chunks;
+
+			SolveTask(ParallelIslandSolver* solver, const btContactSolverInfo* info, btIDebugDraw* debug_drawer, btStackAlloc* stack_alloc, btDispatcher* dispatcher, unsigned int chunks) : solver(solver), info(info), debug_drawer(debug_drawer), stack_alloc(stack_alloc), dispatcher(dispatcher), chunks(chunks) { }
+
+			// each chunk has a solver of its own, and takes every chunks-th island, from the biggest down
+			void Run(unsigned int chunk)
+			{
+				btSequentialImpulseConstraintSolver* chunk_solver = solver->solvers[chunk];
+				for(unsigned int i = chunk; i < solver->order.size(); i += chunks)
+				{
+					Island& island = solver->islands[solver->order[i]];
+					btCollisionObject** island_bodies = island.body_count > 0 ? &solver->bodies[island.first_body] : NULL;
+
+					chunk_solver->solveGroup(island_bodies, island.body_count, island.manifolds, island.manifold_count, island.constraints, island.constraint_count, *info, debug_drawer, stack_alloc, dispatcher);
+				}
+			}
+		};
+
+		TaskPool* pool;
+		vector<btSequentialImpulseConstraintSolver*> solvers;		// one for each thread, plus the calling thread
+
+		// reused from one step to the next
+		vector<Island> islands;
+		vector<btCollisionObject*> bodies;
+		vector<btTypedConstraint*> sorted_constraints;
+		vector<unsigned int> order;
+
+		ParallelIslandSolver(unsigned int threads) : pool(new TaskPool(threads)), solvers(), islands(), bodies(), sorted_constraints(), order()
+		{
+			for(unsigned int i = 0; i <= threads; ++i)
+				solvers.push_back(new btSequentialImpulseConstraintSolver());
+		}
+
+		~ParallelIslandSolver()
+		{
+			pool->Dispose();
+			delete pool;
+
+			for(vector<btSequentialImpulseConstraintSolver*>::iterator iter = solvers.begin(); iter != solvers.end(); ++iter)
+				delete *iter;
+		}
+
+		// a constraint belongs to the island of whichever of its bodies isn't static
+		static int GetConstraintIsland(const btTypedConstraint* constraint)
+		{
+			int a = constraint->getRigidBodyA().getIslandTag();
+			return a >= 0 ? a : constraint->getRigidBodyB().getIslandTag();
+		}
+		static bool ConstraintIslandLess(const btTypedConstraint* a, const btTypedConstraint* b) { return GetConstraintIsland(a) < GetConstraintIsland(b); }
+		static bool ConstraintIslandBefore(const btTypedConstraint* constraint, int island) { return GetConstraintIsland(constraint) < island; }
+
+		bool IslandCostMore(unsigned int a, unsigned int b) const { return islands[a].GetCost() > islands[b].GetCost(); }
+		struct CostMore
+		{
+			const ParallelIslandSolver* solver;
+			CostMore(const ParallelIslandSolver* solver) : solver(solver) { }
+			bool operator()(unsigned int a, unsigned int b) const { return solver->IslandCostMore(a, b); }
+		};
+
+		/** Does what btDiscreteDynamicsWorld::solveConstraints does, but with the islands solved in parallel */
+		void Solve(btSimulationIslandManager* island_manager, btCollisionWorld* collision_world, const btAlignedObjectArray<btTypedConstraint*>& constraints, const btContactSolverInfo& info, btIDebugDraw* debug_drawer, btStackAlloc* stack_alloc)
+		{
+			btDispatcher* dispatcher = collision_world->getDispatcher();
+
+			islands.clear();
+			bodies.clear();
+
+			IslandCollector collector(this);
+			island_manager->buildAndProcessIslands(dispatcher, collision_world, &collector);
+
+			// give each island its constraints; with island id -1 (the islands weren't split), that's all of them
+			sorted_constraints.resize(constraints.size());
+			for(int i = 0; i < constraints.size(); ++i)
+				sorted_constraints[i] = constraints[i];
+			sort(sorted_constraints.begin(), sorted_constraints.end(), ConstraintIslandLess);
+
+			for(vector<Island>::iterator iter = islands.begin(); iter != islands.end(); ++iter)
+			{
+				vector<btTypedConstraint*>::iterator begin = sorted_constraints.begin(), end = sorted_constraints.end();
+				if(iter->island_id >= 0)
+				{
+					begin = lower_bound(begin, end, iter->island_id, ConstraintIslandBefore);
+					end = begin;
+					while(end != sorted_constraints.end() && GetConstraintIsland(*end) == iter->island_id)
+						++end;
+				}
+
+				iter->constraint_count = end - begin;
+				iter->constraints = iter->constraint_count > 0 ? &*begin : NULL;
+			}
+
+			// biggest islands first, so the chunks come out about even
+			order.resize(islands.size());
+			for(unsigned int i = 0; i < order.size(); ++i)
+				order[i] = i;
+			sort(order.begin(), order.end(), CostMore(this));
+
+			unsigned int chunks = min((unsigned int)solvers.size(), (unsigned int)islands.size());
+			SolveTask task(this, &info, debug_drawer, stack_alloc, dispatcher, chunks);
+			pool->Run(task, chunks);
+		}
+	};
+
+
+
+
 	/*
 	 * PhysicsWorld private implementation struct
 	 */
 	struct PhysicsWorld::Imp
 	{
-		btBroadphaseInterface* broadphase;
+		// a dynamics world which counts its substeps, keeps track of how long it spends in the constraint solver, and lets the
+		// PhysicsWorld save everything's transforms before each substep, for interpolation
+		struct TimedDynamicsWorld : public btDiscreteDynamicsWorld
+		{
+			PhysicsWorld::Imp* owner;
+
+			/** If not NULL, the islands are solved in parallel by this, instead of one after another by the world's solver */
+			ParallelIslandSolver* parallel_solver;
+
+			unsigned int substeps;
+			float solver_ms;
+
+			TimedDynamicsWorld(PhysicsWorld::Imp* owner, btDispatcher* dispatcher, btBroadphaseInterface* broadphase, btConstraintSolver* solver, btCollisionConfiguration* collision_configuration) : btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collision_configuration), owner(owner), parallel_solver(NULL), substeps(0), solver_ms(0) { }
+
+			/** Simulation time accumulated but not yet stepped */
+			float GetRemainder() { return m_localTime; }
+			void SetRemainder(float remainder) { m_localTime = remainder; }
+
+			void internalSingleStepSimulation(btScalar time_step)
+			{
+				owner->SaveTransforms();
+				btDiscreteDynamicsWorld::internalSingleStepSimulation(time_step);
+
+				++substeps;
+			}
+
+			void solveConstraints(btContactSolverInfo& solver_info)
+			{
+				boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+				if(parallel_solver != NULL)
+					parallel_solver->Solve(m_islandManager, getCollisionWorld(), m_constraints, solver_info, m_debugDrawer, m_stackAlloc);
+				else
+					btDiscreteDynamicsWorld::solveConstraints(solver_info);
+
+				solver_ms += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 0.001f;
+			}
+		};
+
+		btDbvtBroadphase* broadphase;
 		btDefaultCollisionConfiguration* collision_configuration;
 		btCollisionDispatcher* dispatcher;
 		btSequentialImpulseConstraintSolver* solver;
-		btDynamicsWorld* dynamics_world;
+		TimedDynamicsWorld* dynamics_world;
 
 		boost::unordered_set<RigidBodyInfo*> rigid_bodies;			// List of all of the rigid bodies in the physical simulation
+		unsigned int body_edit_count;								// incremented whenever a body is added or removed
+
+		RigidBodyTransforms transforms;
+		vector<RigidBodyInfo*> transform_owners;					// which body each entry of transforms belongs to
+
+		float fixed_step;					// 0 means one variable-length step per Update
+		unsigned int max_substeps;
+
+		PhysicsStepStats stats;
 
-		Imp();
+		Imp(unsigned int solver_threads);
 		~Imp();
 
+		void SetSolverThreads(unsigned int threads);
+
 		void AddRigidBody(RigidBodyInfo* body);
 		bool RemoveRigidBody(RigidBodyInfo* body);
+
+		void Update(float elapsed);
+
+		// sets each body's previous transform to its current one; called before each substep
+		void SaveTransforms();
+		// sets each body's motion state and published transform to somewhere between its previous and current transform
+		void InterpolateTransforms(float alpha);
+
+		void Snapshot(ostream& stream);
+		int Restore(istream& stream);
 	};
 
 
@@ -49,9 +265,26 @@ namespace CibraryEngine
 
 		MassInfo mass_info;
 
-		Imp() : shape(NULL), body(NULL), motion_state(NULL), mass_info() { }
-		Imp(btCollisionShape* shape, MassInfo mass_info, Vec3 pos = Vec3(), Quaternion ori = Quaternion::Identity()) : shape(shape), body(NULL), motion_state(NULL), mass_info(mass_info)
+		/** The transform as of the previous simulation step, for interpolation; the current one is the body's world transform */
+		btTransform previous_xform;
+
+		/** Bullet's collision filter group and mask for this object */
+		short collision_group, collision_mask;
+
+		/** Where this body's transform is published, while it's in a PhysicsWorld; NULL otherwise */
+		RigidBodyTransforms* transforms;
+		unsigned int transform_index;
+		/** Whether the body is asleep, and the transform it went to sleep with has already been published */
+		bool at_rest;
+
+		Imp() : shape(NULL), body(NULL), motion_state(NULL), mass_info(), collision_group(btBroadphaseProxy::DefaultFilter), collision_mask(btBroadphaseProxy::AllFilter), transforms(NULL), transform_index(0), at_rest(false) { }
+		Imp(btCollisionShape* shape, MassInfo mass_info, Vec3 pos, Quaternion ori, short collision_groups) : shape(shape), body(NULL), motion_state(NULL), mass_info(mass_info), transforms(NULL), transform_index(0), at_rest(false)
 		{
+			// the same group and mask Bullet would pick for a static or dynamic body, plus the extra groups, which aren't in the mask
+			bool is_dynamic = mass_info.mass != 0.0f;
+			collision_group = (is_dynamic ? btBroadphaseProxy::DefaultFilter : btBroadphaseProxy::StaticFilter) | collision_groups;
+			collision_mask = (is_dynamic ? btBroadphaseProxy::AllFilter : btBroadphaseProxy::AllFilter ^ btBroadphaseProxy::StaticFilter) & ~collision_groups;
+
 			float mass = mass_info.mass;
 			Vec3 inertia = mass_info.GetDiagonalMoI();
 
@@ -59,6 +292,8 @@ namespace CibraryEngine
 
 			body = new btRigidBody(btRigidBody::btRigidBodyConstructionInfo(mass, NULL, shape, btVector3(inertia.x, inertia.y, inertia.z)));
 			body->setMotionState(motion_state);
+
+			previous_xform = body->getWorldTransform();
 		}
 
 		~Imp()
@@ -68,8 +303,38 @@ namespace CibraryEngine
 			delete motion_state;
 		}
 
+		void Publish(const btTransform& xform)
+		{
+			btVector3 origin = xform.getOrigin();
+			btQuaternion rot = xform.getRotation();
+
+			Vec3 pos((float)origin.getX(), (float)origin.getY(), (float)origin.getZ());
+			Quaternion ori(rot.getW(), rot.getX(), rot.getY(), rot.getZ());
+
+			transforms->positions[transform_index] = pos;
+			transforms->orientations[transform_index] = ori;
+
+			Mat4 mat = Mat4::FromPositionAndOrientation(pos, ori);
+			memcpy(&transforms->matrices[transform_index * 12], mat.values, 12 * sizeof(float));
+		}
+
+		// after a teleport, the body shouldn't be interpolated from where it was before, and the new transform should be published
+		void Teleported()
+		{
+			previous_xform = body->getWorldTransform();
+
+			if(transforms != NULL)
+			{
+				Publish(previous_xform);
+				at_rest = false;
+			}
+		}
+
 		Vec3 GetPosition()
 		{
+			if(transforms != NULL)
+				return transforms->positions[transform_index];
+
 			btTransform transform;
 			motion_state->getWorldTransform(transform);
 			btVector3 origin = transform.getOrigin();
@@ -85,10 +350,14 @@ namespace CibraryEngine
 			motion_state->setWorldTransform(transform);
 
 			body->setMotionState(motion_state);
+			Teleported();
 		}
 
 		Quaternion GetOrientation()
 		{
+			if(transforms != NULL)
+				return transforms->orientations[transform_index];
+
 			btTransform transform;
 			motion_state->getWorldTransform(transform);
 
@@ -104,10 +373,21 @@ namespace CibraryEngine
 			motion_state->setWorldTransform(transform);
 
 			body->setMotionState(motion_state);
+			Teleported();
 		}
 
 		Mat4 GetTransformationMatrix()
 		{
+			if(transforms != NULL)
+			{
+				Mat4 result;
+				memcpy(result.values, &transforms->matrices[transform_index * 12], 12 * sizeof(float));
+				result.values[12] = result.values[13] = result.values[14] = 0.0f;
+				result.values[15] = 1.0f;
+
+				return result;
+			}
+
 			btTransform transform;
 			motion_state->getWorldTransform(transform);
 			btVector3 offset = transform.getOrigin();
@@ -150,18 +430,137 @@ namespace CibraryEngine
 
 
 
+	/*
+	 * PhysicsWorld::RayTestBatch implementation; this goes through the broadphase's trees directly, because btDbvtBroadphase::rayTest
+	 * keeps its traversal stack in the tree, so two threads can't use it at once
+	 */
+	static bool RayHitCloser(const RayHit& a, const RayHit& b) { return a.fraction < b.fraction; }
+
+	// collects the hits of one ray; only the nearest hit on each object is kept
+	struct RayBatchCallback : public btCollisionWorld::RayResultCallback
+	{
+		vector<RayHit>* hits;
+		unsigned int object_first;				// where the hits on the object currently being tested start
+		bool closest_only;
+
+		RayBatchCallback(vector<RayHit>* hits, bool closest_only) : hits(hits), object_first(hits->size()), closest_only(closest_only) { }
+
+		btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
+		{
+			float fraction = rayResult.m_hitFraction;
+
+			btVector3 normal = rayResult.m_hitNormalLocal;
+			if(!normalInWorldSpace)
+				normal = rayResult.m_collisionObject->getWorldTransform().getBasis() * normal;
+
+			RayHit hit(rayResult.m_collisionObject->getUserPointer(), fraction, Vec3(normal.getX(), normal.getY(), normal.getZ()));
+
+			if(hits->size() > object_first)
+			{
+				if(fraction < hits->back().fraction)
+					hits->back() = hit;
+			}
+			else
+				hits->push_back(hit);
+
+			// anything farther away than this won't be reported anymore
+			if(closest_only && fraction < m_closestHitFraction)
+			{
+				m_closestHitFraction = fraction;
+				m_collisionObject = rayResult.m_collisionObject;
+			}
+
+			return m_closestHitFraction;
+		}
+	};
+
+	// called for each broadphase proxy whose bounding box the ray passes through
+	struct RayBatchCollider : public btDbvt::ICollide
+	{
+		RayBatchCallback* callback;
+		short mask;
+		btTransform from, to;
+
+		RayBatchCollider(RayBatchCallback* callback, const RayQuery& ray) : callback(callback), mask(ray.mask), from(), to()
+		{
+			from.setIdentity();
+			from.setOrigin(btVector3(ray.from.x, ray.from.y, ray.from.z));
+			to.setIdentity();
+			to.setOrigin(btVector3(ray.to.x, ray.to.y, ray.to.z));
+		}
+
+		void Process(const btDbvtNode* leaf)
+		{
+			btBroadphaseProxy* proxy = (btBroadphaseProxy*)leaf->data;
+			if((proxy->m_collisionFilterGroup & mask) == 0)
+				return;
+
+			btCollisionObject* object = (btCollisionObject*)proxy->m_clientObject;
+
+			// with closest_only, every object shares one hit
+			if(!callback->closest_only)
+				callback->object_first = callback->hits->size();
+
+			btCollisionWorld::rayTestSingle(from, to, object, object->getCollisionShape(), object->getWorldTransform(), *callback);
+		}
+	};
+
+	struct RayBatchTask : public TaskPool::Task
+	{
+		static const unsigned int chunk_size = 32;
+
+		btDbvtBroadphase* broadphase;
+		const RayQuery* rays;
+		unsigned int count;
+		RayBatchResult& results;
+
+		RayBatchTask(btDbvtBroadphase* broadphase, const RayQuery* rays, unsigned int count, RayBatchResult& results) : broadphase(broadphase), rays(rays), count(count), results(results) { }
+
+		void Run(unsigned int chunk)
+		{
+			vector<RayHit>& hits = results.chunk_hits[chunk];
+			hits.clear();
+
+			unsigned int begin = chunk * chunk_size, end = min(count, begin + chunk_size);
+			for(unsigned int i = begin; i < end; ++i)
+			{
+				const RayQuery& ray = rays[i];
+				unsigned int ray_first = hits.size();
+
+				RayBatchCallback callback(&hits, ray.closest_only);
+				RayBatchCollider collider(&callback, ray);
+
+				btVector3 from(ray.from.x, ray.from.y, ray.from.z), to(ray.to.x, ray.to.y, ray.to.z);
+				for(unsigned int j = 0; j < 2; ++j)					// the broadphase keeps moving and stationary objects in separate trees
+					btDbvt::rayTest(broadphase->m_sets[j].m_root, from, to, collider);
+
+				sort(hits.begin() + ray_first, hits.end(), RayHitCloser);
+				results.hit_counts[i] = hits.size() - ray_first;
+			}
+		}
+	};
+
+
+
+
 	/*
 	 * PhysicsWorld and PhysicsWorld::Imp methods
 	 */
-	PhysicsWorld::Imp::Imp() :
+	PhysicsWorld::Imp::Imp(unsigned int solver_threads) :
 		broadphase(new btDbvtBroadphase()),
 		collision_configuration(new btDefaultCollisionConfiguration()),
 		dispatcher(new btCollisionDispatcher(collision_configuration)),
 		solver(new btSequentialImpulseConstraintSolver()),
-		dynamics_world(new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collision_configuration)),
-		rigid_bodies()
+		dynamics_world(new TimedDynamicsWorld(this, dispatcher, broadphase, solver, collision_configuration)),
+		rigid_bodies(),
+		body_edit_count(0),
+		fixed_step(1.0f / 60.0f),
+		max_substeps(4),
+		stats()
 	{
 		dynamics_world->setGravity(btVector3(0, -9.8f, 0));
+
+		SetSolverThreads(solver_threads);
 	}
 
 	PhysicsWorld::Imp::~Imp()
@@ -173,6 +572,8 @@ namespace CibraryEngine
 		}
 		rigid_bodies.clear();
 
+		SetSolverThreads(0);
+
 		delete dynamics_world;
 		delete solver;
 		delete dispatcher;
@@ -180,6 +581,30 @@ namespace CibraryEngine
 		delete broadphase;
 	}
 
+	void PhysicsWorld::Imp::SetSolverThreads(unsigned int threads)
+	{
+		if(dynamics_world->parallel_solver != NULL)
+		{
+			delete dynamics_world->parallel_solver;
+			dynamics_world->parallel_solver = NULL;
+		}
+
+#ifndef BT_NO_PROFILE
+		// Bullet's profiler (BT_PROFILE, inside the solver) keeps a single global tree of timers, so it can't be used from more than one thread at once
+		if(threads > 0)
+		{
+			stringstream ss;
+			ss << "PhysicsWorld::SetSolverThreads: Bullet's profiler is enabled (BT_NO_PROFILE isn't defined); ignoring request for " << threads << " solver threads" << endl;
+			Debug(ss.str());
+
+			threads = 0;
+		}
+#endif
+
+		if(threads > 0)
+			dynamics_world->parallel_solver = new ParallelIslandSolver(threads);
+	}
+
 	void PhysicsWorld::Imp::AddRigidBody(RigidBodyInfo* r)
 	{
 		if(r == NULL)
@@ -188,8 +613,21 @@ namespace CibraryEngine
 		if(rigid_bodies.find(r) != rigid_bodies.end())
 			return;
 
-		dynamics_world->addRigidBody(r->imp->body);
+		dynamics_world->addRigidBody(r->imp->body, r->imp->collision_group, r->imp->collision_mask);
 		rigid_bodies.insert(r);
+		++body_edit_count;
+
+		// give it an entry in the published transforms
+		RigidBodyInfo::Imp* rimp = r->imp;
+		rimp->transforms = &transforms;
+		rimp->transform_index = transform_owners.size();
+		transform_owners.push_back(r);
+
+		transforms.positions.push_back(Vec3());
+		transforms.orientations.push_back(Quaternion::Identity());
+		transforms.matrices.resize(transforms.matrices.size() + 12);
+
+		rimp->Teleported();
 	}
 			
 	bool PhysicsWorld::Imp::RemoveRigidBody(RigidBodyInfo* r)
@@ -202,13 +640,252 @@ namespace CibraryEngine
 		{
 			rigid_bodies.erase(found);
 			dynamics_world->removeRigidBody(r->imp->body);
+			++body_edit_count;
+
+			// move the last entry of the published transforms into this one's place
+			RigidBodyInfo::Imp* rimp = r->imp;
+			unsigned int index = rimp->transform_index, last = transform_owners.size() - 1;
+			if(index != last)
+			{
+				RigidBodyInfo* moved = transform_owners[last];
+				transform_owners[index] = moved;
+				moved->imp->transform_index = index;
+
+				transforms.positions[index] = transforms.positions[last];
+				transforms.orientations[index] = transforms.orientations[last];
+				memcpy(&transforms.matrices[index * 12], &transforms.matrices[last * 12], 12 * sizeof(float));
+			}
+			transform_owners.pop_back();
+			transforms.positions.pop_back();
+			transforms.orientations.pop_back();
+			transforms.matrices.resize(last * 12);
+
+			rimp->transforms = NULL;
+			rimp->at_rest = false;
+
 			return true;
 		}
 		else
 			return false;
 	}
 
-	PhysicsWorld::PhysicsWorld() : imp(new Imp()) { }
+	void PhysicsWorld::Imp::Update(float elapsed)
+	{
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		dynamics_world->substeps = 0;
+		dynamics_world->solver_ms = 0;
+
+		if(fixed_step <= 0)
+		{
+			dynamics_world->stepSimulation(elapsed, 0);
+
+			stats.dropped_steps = 0;
+			stats.interpolation = 1.0f;
+		}
+		else
+		{
+			// Bullet accumulates the time, and carries the remainder over; if more steps are due than max_substeps, the rest are dropped
+			int steps_due = dynamics_world->stepSimulation(elapsed, max_substeps, fixed_step);
+
+			stats.dropped_steps = steps_due > (int)max_substeps ? steps_due - max_substeps : 0;
+			stats.interpolation = min(1.0f, dynamics_world->GetRemainder() / fixed_step);
+		}
+		stats.substeps = dynamics_world->substeps;
+
+		// overwrite what Bullet put in the motion states; it extrapolates past the last step, instead of interpolating up to it
+		InterpolateTransforms(stats.interpolation);
+
+		stats.step_ms = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 0.001f;
+		stats.solver_ms = dynamics_world->solver_ms;
+	}
+
+	void PhysicsWorld::Imp::SaveTransforms()
+	{
+		// bodies at rest already have their previous transform equal to their current one
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+		{
+			RigidBodyInfo::Imp* r = (*iter)->imp;
+			if(!r->at_rest && !r->body->isStaticObject())
+				r->previous_xform = r->body->getWorldTransform();
+		}
+	}
+
+	void PhysicsWorld::Imp::InterpolateTransforms(float alpha)
+	{
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+		{
+			RigidBodyInfo::Imp* r = (*iter)->imp;
+			if(r->body->isStaticObject())
+				continue;
+
+			const btTransform& current = r->body->getWorldTransform();
+
+			if(!r->body->isActive())
+			{
+				// it can't move again until it wakes up, so this is the last time it needs publishing until then
+				if(r->at_rest)
+					continue;
+
+				r->previous_xform = current;
+				r->motion_state->setWorldTransform(current);
+				r->Publish(current);
+
+				r->at_rest = true;
+				continue;
+			}
+			r->at_rest = false;
+
+			const btTransform& previous = r->previous_xform;
+
+			btTransform xform;
+			xform.setOrigin(previous.getOrigin() + (current.getOrigin() - previous.getOrigin()) * alpha);
+			xform.setRotation(previous.getRotation().slerp(current.getRotation(), alpha));
+
+			r->motion_state->setWorldTransform(xform);
+			r->Publish(xform);
+		}
+	}
+
+	static void WriteBulletVector(const btVector3& vec, ostream& stream)
+	{
+		WriteSingle((float)vec.getX(), stream);
+		WriteSingle((float)vec.getY(), stream);
+		WriteSingle((float)vec.getZ(), stream);
+	}
+	static btVector3 ReadBulletVector(istream& stream)
+	{
+		float x = ReadSingle(stream), y = ReadSingle(stream), z = ReadSingle(stream);
+		return btVector3(x, y, z);
+	}
+
+	void PhysicsWorld::Imp::Snapshot(ostream& stream)
+	{
+		WriteUInt32(transform_owners.size(), stream);
+		WriteUInt32(dynamics_world->getNumConstraints(), stream);
+		WriteSingle(dynamics_world->GetRemainder(), stream);
+
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+		{
+			btRigidBody* body = (*iter)->imp->body;
+			if(body->isStaticObject())
+				continue;
+
+			// the transform as of the last step, not the interpolated one
+			const btTransform& xform = body->getWorldTransform();
+			btQuaternion rot = xform.getRotation();
+
+			WriteBulletVector(xform.getOrigin(), stream);
+			WriteSingle((float)rot.getX(), stream);
+			WriteSingle((float)rot.getY(), stream);
+			WriteSingle((float)rot.getZ(), stream);
+			WriteSingle((float)rot.getW(), stream);
+
+			WriteBulletVector(body->getLinearVelocity(), stream);
+			WriteBulletVector(body->getAngularVelocity(), stream);
+
+			WriteByte((unsigned char)body->getActivationState(), stream);
+			WriteSingle((float)body->getDeactivationTime(), stream);
+		}
+
+		for(int i = 0; i < dynamics_world->getNumConstraints(); ++i)
+		{
+			btTypedConstraint* constraint = dynamics_world->getConstraint(i);
+
+			WriteBool(constraint->isEnabled(), stream);
+			WriteSingle((float)constraint->internalGetAppliedImpulse(), stream);
+		}
+	}
+
+	int PhysicsWorld::Imp::Restore(istream& stream)
+	{
+		unsigned int body_count = ReadUInt32(stream);
+		unsigned int constraint_count = ReadUInt32(stream);
+		float remainder = ReadSingle(stream);
+
+		if(!stream)
+			return 1;
+		if(body_count != transform_owners.size())
+			return 2;
+		if(constraint_count != (unsigned int)dynamics_world->getNumConstraints())
+			return 3;
+
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+		{
+			RigidBodyInfo::Imp* r = (*iter)->imp;
+			btRigidBody* body = r->body;
+			if(body->isStaticObject())
+				continue;
+
+			btVector3 pos = ReadBulletVector(stream);
+			float rx = ReadSingle(stream), ry = ReadSingle(stream), rz = ReadSingle(stream), rw = ReadSingle(stream);
+			btVector3 linear_vel = ReadBulletVector(stream);
+			btVector3 angular_vel = ReadBulletVector(stream);
+			int activation_state = ReadByte(stream);
+			float deactivation_time = ReadSingle(stream);
+
+			if(!stream)
+				return 1;
+
+			btTransform xform(btQuaternion(rx, ry, rz, rw), pos);
+
+			body->setWorldTransform(xform);
+			body->setInterpolationWorldTransform(xform);
+			body->setLinearVelocity(linear_vel);
+			body->setAngularVelocity(angular_vel);
+			body->setInterpolationLinearVelocity(linear_vel);
+			body->setInterpolationAngularVelocity(angular_vel);
+			body->forceActivationState(activation_state);
+			body->setDeactivationTime(deactivation_time);
+			body->clearForces();
+
+			r->motion_state->setWorldTransform(xform);
+
+			r->Teleported();
+		}
+
+		/*
+		 * Rebuild the broadphase from scratch: the order of its overlapping pairs (and so of the contacts the solver sees) depends on the
+		 * shape of its trees and on everything else that happened to it, and the contacts cached with the pairs would warm-start the
+		 * solver from the state being replaced. With every body taken out, the broadphase can be reset to how it was when it was
+		 * created, and then the bodies go back in, in the order of transform_owners, so everything it does from here on only depends
+		 * on the restored state
+		 */
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+			dynamics_world->removeRigidBody((*iter)->imp->body);
+
+		broadphase->resetPool(dispatcher);
+
+		for(vector<RigidBodyInfo*>::iterator iter = transform_owners.begin(); iter != transform_owners.end(); ++iter)
+		{
+			RigidBodyInfo::Imp* r = (*iter)->imp;
+			dynamics_world->addRigidBody(r->body, r->collision_group, r->collision_mask);
+		}
+
+		solver->reset();
+		if(dynamics_world->parallel_solver != NULL)
+			for(vector<btSequentialImpulseConstraintSolver*>::iterator iter = dynamics_world->parallel_solver->solvers.begin(); iter != dynamics_world->parallel_solver->solvers.end(); ++iter)
+				(*iter)->reset();
+
+		for(int i = 0; i < dynamics_world->getNumConstraints(); ++i)
+		{
+			btTypedConstraint* constraint = dynamics_world->getConstraint(i);
+
+			bool enabled = ReadBool(stream);
+			float applied_impulse = ReadSingle(stream);
+
+			if(!stream)
+				return 1;
+
+			constraint->setEnabled(enabled);
+			constraint->internalSetAppliedImpulse(applied_impulse);
+		}
+
+		dynamics_world->SetRemainder(remainder);
+
+		return 0;
+	}
+
+	PhysicsWorld::PhysicsWorld(unsigned int solver_threads) : imp(new Imp(solver_threads)) { }
 
 	void PhysicsWorld::InnerDispose() { delete imp; imp = NULL; }
 
@@ -218,12 +895,60 @@ namespace CibraryEngine
 	void PhysicsWorld::AddConstraint(ConeTwistConstraint* constraint, bool disable_collision) { imp->dynamics_world->addConstraint(constraint->imp->constraint, disable_collision); }
 	void PhysicsWorld::RemoveConstraint(ConeTwistConstraint* constraint) { imp->dynamics_world->removeConstraint(constraint->imp->constraint); }
 
-	void PhysicsWorld::Update(TimingInfo time) { imp->dynamics_world->stepSimulation(time.elapsed, 20); }
+	void PhysicsWorld::Update(TimingInfo time) { imp->Update(time.elapsed); }
+
+	void PhysicsWorld::Snapshot(ostream& stream) { imp->Snapshot(stream); }
+	int PhysicsWorld::Restore(istream& stream) { return imp->Restore(stream); }
+
+	void PhysicsWorld::SetFixedTimeStep(float step, unsigned int max_substeps)
+	{
+		imp->fixed_step = step;
+		imp->max_substeps = max_substeps;
+	}
+
+	const RigidBodyTransforms& PhysicsWorld::GetTransforms() { return imp->transforms; }
+	const PhysicsStepStats& PhysicsWorld::GetStepStats() { return imp->stats; }
+
+	unsigned int PhysicsWorld::GetBodyEditCount() { return imp->body_edit_count; }
+
+	void PhysicsWorld::SetSolverThreads(unsigned int threads) { imp->SetSolverThreads(threads); }
 
 	void PhysicsWorld::SetDebugDrawer(btIDebugDraw* d) { imp->dynamics_world->setDebugDrawer(d); }
 	void PhysicsWorld::DebugDrawWorld() { imp->dynamics_world->debugDrawWorld(); }
 
 	void PhysicsWorld::RayTest(Vec3 from, Vec3 to, btCollisionWorld::RayResultCallback& callback) { imp->dynamics_world->rayTest(btVector3(from.x, from.y, from.z), btVector3(to.x, to.y, to.z), callback); }
+	void PhysicsWorld::RayTest(Vec3 from, Vec3 to, btCollisionWorld::RayResultCallback& callback, short mask)
+	{
+		// the callback's default needsCollision compares this to each object's group, before any narrowphase tests are done
+		callback.m_collisionFilterMask = mask;
+		RayTest(from, to, callback);
+	}
+
+	void PhysicsWorld::RayTestBatch(const RayQuery* rays, unsigned int count, RayBatchResult& results, TaskPool* pool)
+	{
+		RayBatchTask task(imp->broadphase, rays, count, results);
+
+		unsigned int chunks = (count + RayBatchTask::chunk_size - 1) / RayBatchTask::chunk_size;
+		if(results.chunk_hits.size() < chunks)
+			results.chunk_hits.resize(chunks);
+		results.hit_counts.resize(count);
+
+		if(pool != NULL)
+			pool->Run(task, chunks);
+		else
+			for(unsigned int i = 0; i < chunks; ++i)
+				task.Run(i);
+
+		// put the chunks' hits together, in order
+		results.hits.clear();
+		for(unsigned int i = 0; i < chunks; ++i)
+			results.hits.insert(results.hits.end(), results.chunk_hits[i].begin(), results.chunk_hits[i].end());
+
+		results.first.resize(count + 1);
+		results.first[0] = 0;
+		for(unsigned int i = 0; i < count; ++i)
+			results.first[i + 1] = results.first[i] + results.hit_counts[i];
+	}
 	void PhysicsWorld::ContactTest(RigidBodyInfo* object, btCollisionWorld::ContactResultCallback& callback) { imp->dynamics_world->contactTest(object->imp->body, callback); }
 
 	Vec3 PhysicsWorld::GetGravity()
@@ -240,7 +965,7 @@ namespace CibraryEngine
 	 * RigidBodyInfo methods
 	 */
 	RigidBodyInfo::RigidBodyInfo() : imp(new Imp()) { }
-	RigidBodyInfo::RigidBodyInfo(btCollisionShape* shape, MassInfo mass_info, Vec3 pos, Quaternion ori) : imp(new Imp(shape, mass_info, pos, ori)) { }
+	RigidBodyInfo::RigidBodyInfo(btCollisionShape* shape, MassInfo mass_info, Vec3 pos, Quaternion ori, short collision_groups) : imp(new Imp(shape, mass_info, pos, ori, collision_groups)) { }
 	
 	void RigidBodyInfo::InnerDispose()
 	{
@@ -259,8 +984,10 @@ namespace CibraryEngine
 	void RigidBodyInfo::SetOrientation(Quaternion ori) { imp->SetOrientation(ori); }
 
 	Mat4 RigidBodyInfo::GetTransformationMatrix() { return imp->GetTransformationMatrix(); }
+	unsigned int RigidBodyInfo::GetTransformIndex() { return imp->transform_index; }
 
 	void RigidBodyInfo::Activate() { imp->body->activate(); }
+	bool RigidBodyInfo::IsActive() { return imp->body->isActive(); }
 	void RigidBodyInfo::ApplyImpulse(const Vec3& impulse, const Vec3& local_poi) { imp->body->applyImpulse(btVector3(impulse.x, impulse.y, impulse.z), btVector3(local_poi.x, local_poi.y, local_poi.z)); }
 	void RigidBodyInfo::ApplyCentralImpulse(const Vec3& impulse) { imp->body->applyCentralImpulse(btVector3(impulse.x, impulse.y, impulse.z)); }
 	void RigidBodyInfo::ApplyCentralForce(const Vec3& force) { imp->body->applyCentralForce(btVector3(force.x, force.y, force.z)); }
@@ -283,6 +1010,9 @@ namespace CibraryEngine
 
 	void RigidBodyInfo::SetCustomCollisionEnabled(void* user_object) { imp->SetCustomCollisionEnabled(user_object); }
 
+	short RigidBodyInfo::GetCollisionGroup() { return imp->collision_group; }
+	short RigidBodyInfo::GetCollisionMask() { return imp->collision_mask; }
+
 
 
 
@@ -16,10 +16,80 @@ namespace CibraryEngine
 
 	class RigidBodyInfo;
 	class ConeTwistConstraint;
+	class TaskPool;
 
 	struct Mat4;
 	struct Quaternion;
 
+	/** A ray for PhysicsWorld::RayTestBatch */
+	struct RayQuery
+	{
+		Vec3 from, to;
+
+		/** Only objects whose collision group has one of these bits set can be hit; see the RigidBodyInfo constructor */
+		short mask;
+		/** If true, only the nearest hit is reported, which lets the search skip anything behind it */
+		bool closest_only;
+
+		RayQuery() : from(), to(), mask(-1), closest_only(false) { }
+		RayQuery(Vec3 from, Vec3 to, short mask, bool closest_only = false) : from(from), to(to), mask(mask), closest_only(closest_only) { }
+	};
+
+	/** Something a ray hit; each object is reported once, where the ray first hits it */
+	struct RayHit
+	{
+		void* user_object;				// whatever was passed to RigidBodyInfo::SetCustomCollisionEnabled
+		float fraction;					// how far along the ray the hit is; 0 is at from, 1 is at to
+		Vec3 normal;
+
+		RayHit() : user_object(NULL), fraction(0), normal() { }
+		RayHit(void* user_object, float fraction, Vec3 normal) : user_object(user_object), fraction(fraction), normal(normal) { }
+	};
+
+	/** The results of PhysicsWorld::RayTestBatch; can be reused from one call to the next, to avoid reallocating */
+	struct RayBatchResult
+	{
+		/** The hits of all of the rays; those of each ray are contiguous, and sorted from front to back */
+		vector<RayHit> hits;
+		/** Index into hits of the first hit of each ray, plus one more at the end */
+		vector<unsigned int> first;
+
+		// scratch space for RayTestBatch; the hits of each chunk of rays, and how many each ray got
+		vector<vector<RayHit> > chunk_hits;
+		vector<unsigned int> hit_counts;
+
+		unsigned int GetHitCount(unsigned int ray) const { return first[ray + 1] - first[ray]; }
+		const RayHit& GetHit(unsigned int ray, unsigned int index) const { return hits[first[ray] + index]; }
+	};
+
+	/**
+	 * The transforms of all of the bodies in a PhysicsWorld as of its most recent Update (interpolated, like
+	 * RigidBodyInfo::GetTransformationMatrix), in contiguous arrays indexed by RigidBodyInfo::GetTransformIndex. Each Update only
+	 * rewrites the entries of bodies which may have moved; sleeping and static bodies are left alone
+	 */
+	struct RigidBodyTransforms
+	{
+		vector<Vec3> positions;
+		vector<Quaternion> orientations;
+		/** 12 floats per body; the top three rows of the Mat4 GetTransformationMatrix would return */
+		vector<float> matrices;
+
+		unsigned int Count() const { return positions.size(); }
+	};
+
+	/** What happened during the most recent PhysicsWorld::Update */
+	struct PhysicsStepStats
+	{
+		unsigned int substeps;			// how many fixed-length steps were simulated
+		unsigned int dropped_steps;		// how many steps were skipped because of the max_substeps budget
+		float interpolation;			// how far the render transforms are between the last two steps; 0 = previous, 1 = latest
+
+		float step_ms;					// time spent simulating, in milliseconds
+		float solver_ms;				// the part of step_ms spent solving constraints and contacts
+
+		PhysicsStepStats() : substeps(0), dropped_steps(0), interpolation(1.0f), step_ms(0), solver_ms(0) { }
+	};
+
 	/** Class for a physical simulation */
 	class PhysicsWorld : public Disposable
 	{
@@ -38,20 +108,60 @@ namespace CibraryEngine
 
 		public:
 
-			/** Initializes a PhysicsWorld */
-			PhysicsWorld();
+			/** Initializes a PhysicsWorld; see SetSolverThreads */
+			PhysicsWorld(unsigned int solver_threads = 0);
 
 			/** Adds a rigid body to the simulation */
 			void AddRigidBody(RigidBodyInfo* r);
 			/** Removes a rigid body from the simulation */
 			bool RemoveRigidBody(RigidBodyInfo* r);
+			/** Incremented whenever a body is added or removed; compare it with an earlier value to tell whether ray test results are out of date */
+			unsigned int GetBodyEditCount();
 
 			void AddConstraint(ConeTwistConstraint* constraint, bool disable_collision = false);
 			void RemoveConstraint(ConeTwistConstraint* constraint);
 
-			/** Steps the simulation */
+			/**
+			 * Steps the simulation. In fixed-step mode this runs however many whole steps have accumulated (up to the max_substeps budget),
+			 * carries the remainder over to the next call, and interpolates the transforms the RigidBodyInfos report between the last two steps
+			 */
 			void Update(TimingInfo time);
 
+			/**
+			 * Sets the length of each simulation step, and how many of them an Update may run; any time beyond that is dropped, so a slow
+			 * frame doesn't make the next one slower still. A step of 0 simulates each Update in a single step of variable length
+			 */
+			void SetFixedTimeStep(float step, unsigned int max_substeps);
+
+			/** Gets the transforms of all of the bodies, as of the most recent Update */
+			const RigidBodyTransforms& GetTransforms();
+
+			/** Gets statistics about the most recent Update */
+			const PhysicsStepStats& GetStepStats();
+
+			/**
+			 * Writes the state of the simulation to a stream: every body's transform, velocity and activation state, every constraint's
+			 * state, and the time carried over to the next step. Bodies are written in the order of GetTransforms, and static ones are
+			 * only counted, since they can't move
+			 */
+			void Snapshot(ostream& stream);
+			/**
+			 * Puts back a state written by Snapshot; the world must contain the same bodies and constraints, in the same order, as when it
+			 * was taken. The broadphase is rebuilt from scratch (throwing out cached contacts), so stepping on from a restored state does the
+			 * same thing no matter what the world went through before it was restored, e.g. when rolling back a prediction. Returns 0 if
+			 * ok, or a nonzero int error code (in which case the world may have been partially restored)
+			 */
+			int Restore(istream& stream);
+
+			/**
+			 * Sets how many worker threads solve the simulation islands (e.g. separate ragdolls) in parallel, alongside the thread calling
+			 * Update; with 0, Bullet solves them one after another, as usual. Don't call this during an Update
+			 *
+			 * The solver's profiling calls aren't thread-safe, so this only has an effect if Bullet and CibraryEngine are both built with
+			 * BT_NO_PROFILE defined; otherwise the islands are always solved on one thread
+			 */
+			void SetSolverThreads(unsigned int threads);
+
 			void SetDebugDrawer(btIDebugDraw* d);
 			void DebugDrawWorld();
 
@@ -59,6 +169,13 @@ namespace CibraryEngine
 			void SetGravity(const Vec3& gravity);
 
 			void RayTest(Vec3 from, Vec3 to, btCollisionWorld::RayResultCallback& callback);
+			/** Like RayTest, but objects whose collision group doesn't share any bits with mask are skipped, without any narrowphase tests */
+			void RayTest(Vec3 from, Vec3 to, btCollisionWorld::RayResultCallback& callback, short mask);
+			/**
+			 * Tests lots of rays at once. Objects whose collision group doesn't match a ray's mask are skipped in the broadphase, without
+			 * looking at their shapes; if pool isn't NULL, the rays are divided among its threads. The world mustn't change until it returns
+			 */
+			void RayTestBatch(const RayQuery* rays, unsigned int count, RayBatchResult& results, TaskPool* pool = NULL);
 			void ContactTest(RigidBodyInfo* object, btCollisionWorld::ContactResultCallback& callback);
 	};
 
@@ -83,8 +200,14 @@ namespace CibraryEngine
 
 			/** Default constructor for a RigidBodyInfo; the constructed RigidBodyInfo will not work without setting the fields manually */
 			RigidBodyInfo();
-			/** Initializes a rigid body with the specified collision shape, mass properties, and optional position and orientation */
-			RigidBodyInfo(btCollisionShape* shape, MassInfo mass_info, Vec3 pos = Vec3(), Quaternion ori = Quaternion::Identity());
+			/**
+			 * Initializes a rigid body with the specified collision shape, mass properties, and optional position and orientation
+			 *
+			 * The collision_groups bits tag what sort of object this is, so ray tests can skip everything else by group; they're added to
+			 * Bullet's default group for a static or dynamic body, and left out of its mask, so they don't change what it collides with.
+			 * Bullet uses the lowest 6 bits itself
+			 */
+			RigidBodyInfo(btCollisionShape* shape, MassInfo mass_info, Vec3 pos = Vec3(), Quaternion ori = Quaternion::Identity(), short collision_groups = 0);
 
 			/** Disposes of this rigid body without disposing of and deleting the collision shape; by default RigidBodyInfo::Dispose will dispose of and delete the collision shape! */
 			void DisposePreservingCollisionShape();
@@ -102,10 +225,18 @@ namespace CibraryEngine
 			Vec3 GetLinearVelocity();
 			void SetLinearVelocity(const Vec3& vel);
 
-			/** Gets a 4x4 transformation matrix representing the position and orientation of this rigid body */
+			/** Gets a 4x4 transformation matrix representing the position and orientation of this rigid body, interpolated for rendering */
 			Mat4 GetTransformationMatrix();
 
+			/**
+			 * Gets the index of this body in its PhysicsWorld's RigidBodyTransforms; this changes when other bodies are removed from the
+			 * world, so it should be looked up again after anything has been removed
+			 */
+			unsigned int GetTransformIndex();
+
 			void Activate();
+			/** Whether the body is awake; Bullet puts bodies to sleep after they've been still for their deactivation time */
+			bool IsActive();
 			void ApplyImpulse(const Vec3& impulse, const Vec3& local_poi);
 			void ApplyCentralImpulse(const Vec3& impulse);
 			void ApplyCentralForce(const Vec3& force);
@@ -120,6 +251,11 @@ namespace CibraryEngine
 			void SetSleepingThresholds(float linear, float angular);
 
 			void SetCustomCollisionEnabled(void* user_object);
+
+			/** Gets the collision filter group this body is added to a PhysicsWorld with, including the bits passed to the constructor */
+			short GetCollisionGroup();
+			/** Gets the collision filter mask this body is added to a PhysicsWorld with */
+			short GetCollisionMask();
 	};
 
 	/** Class representing the mass properties of an object */
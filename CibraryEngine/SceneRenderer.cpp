@@ -7,9 +7,39 @@
 
 namespace CibraryEngine
 {
-	// Comparison type for render nodes
-	struct RNDistanceComp { bool operator() (RenderNode& lhs, RenderNode& rhs) { return lhs.distance < rhs.distance; } };
+	// maps a float to an unsigned int which sorts in the same order
+	static unsigned int SortableFloatBits(float f)
+	{
+		unsigned int bits;
+		memcpy(&bits, &f, sizeof(unsigned int));
+
+		return bits & 0x80000000 ? ~bits : bits | 0x80000000;
+	}
+
+	static unsigned int HashMaterial(Material* mat) { return (unsigned int)(((size_t)mat >> 4) * 2654435761u); }
 
+	/*
+	 * Sort key layout:
+	 *   opaque:      0 | material class (15 bits) | material index (16 bits) | distance (32 bits)
+	 *   translucent: 1 | distance (32 bits) | material class (15 bits) | material index (16 bits)
+	 */
+	static unsigned long long MakeSortKey(bool translucent, unsigned int mclass_id, unsigned int mat_index, float distance)
+	{
+		unsigned long long mat_bits = ((unsigned long long)(mclass_id & 0x7FFF) << 16) | (mat_index & 0xFFFF);
+		unsigned long long distance_bits = SortableFloatBits(distance);
+
+		if(translucent)
+			return (1ULL << 63) | (distance_bits << 31) | mat_bits;
+		else
+			return (mat_bits << 32) | distance_bits;
+	}
+
+
+
+
+	/*
+	 * SceneRenderer methods
+	 */
 	void SceneRenderer::Render()
 	{
 		BeginRender();
@@ -22,55 +52,144 @@ namespace CibraryEngine
 		GLDEBUG();
 	}
 
-	void SceneRenderer::BeginRender()
+	unsigned int SceneRenderer::GetMaterialIndex(Material* mat)
 	{
-		// group the models by material
-		material_model_lists = map<Material*, vector<RenderNode> >();
-		for(vector<RenderNode>::iterator iter = objects.begin(); iter != objects.end(); ++iter)
+		// keep the table at most half full; growing it only happens while warming up
+		if(material_slots.size() < (material_count + 1) * 2)
 		{
-			RenderNode model = *iter;
-			if (material_model_lists.find(model.material) == material_model_lists.end())
-				material_model_lists[model.material] = vector<RenderNode>();
-			material_model_lists[model.material].push_back(model);
+			vector<Material*> old_slots;
+			vector<unsigned int> old_indices, old_stamps;
+			old_slots.swap(material_slots);
+			old_indices.swap(material_slot_indices);
+			old_stamps.swap(material_slot_stamps);
+
+			unsigned int size = max<unsigned int>(64, old_slots.size() * 2);
+			material_slots.assign(size, NULL);
+			material_slot_indices.assign(size, 0);
+			material_slot_stamps.assign(size, 0);
+
+			for(unsigned int i = 0; i < old_slots.size(); ++i)
+				if(old_stamps[i] == material_stamp)
+				{
+					unsigned int slot = HashMaterial(old_slots[i]) & (size - 1);
+					while(material_slot_stamps[slot] == material_stamp)
+						slot = (slot + 1) & (size - 1);
+
+					material_slots[slot] = old_slots[i];
+					material_slot_indices[slot] = old_indices[i];
+					material_slot_stamps[slot] = material_stamp;
+				}
 		}
 
-		translucent_items = map<Material*, vector<RenderNode> >();
-		opaque_items = map<Material*, vector<RenderNode> >();
-		for(map<Material*, vector<RenderNode> >::iterator iter = material_model_lists.begin(); iter != material_model_lists.end(); ++iter)
+		unsigned int mask = material_slots.size() - 1;
+		unsigned int slot = HashMaterial(mat) & mask;
+		while(material_slot_stamps[slot] == material_stamp)
 		{
-			Material* mat = iter->first;
+			if(material_slots[slot] == mat)
+				return material_slot_indices[slot];
+			slot = (slot + 1) & mask;
+		}
 
-			assert(mat && "Material must not be NULL!");
+		material_slots[slot] = mat;
+		material_slot_indices[slot] = material_count;
+		material_slot_stamps[slot] = material_stamp;
+
+		return material_count++;
+	}
+
+	// LSD radix sort of the render queue, a byte at a time; stable, and skips bytes which are the same for every key
+	void SceneRenderer::SortRenderQueue()
+	{
+		unsigned int count = render_queue.size();
+		if(count < 2)
+			return;
+
+		unsigned int histograms[8][256];
+		memset(histograms, 0, sizeof(histograms));
 
-			if (mat->blend_style == Opaque)
-				opaque_items[mat] = material_model_lists[mat];
-			else
-				translucent_items[mat] = material_model_lists[mat];
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			unsigned long long key = render_queue[i].key;
+			for(unsigned int byte = 0; byte < 8; ++byte)
+				++histograms[byte][(key >> (byte * 8)) & 0xFF];
 		}
 
-		sorted_translucent_items = list<RenderNode>();
-		for(map<Material*, vector<RenderNode> >::iterator iter = translucent_items.begin(); iter != translucent_items.end(); ++iter)
-			sorted_translucent_items.insert(sorted_translucent_items.end(), iter->second.begin(), iter->second.end());
+		sort_scratch.resize(count);
 
-		sorted_translucent_items.sort<RNDistanceComp>(RNDistanceComp());
+		for(unsigned int byte = 0; byte < 8; ++byte)
+		{
+			unsigned int* histogram = histograms[byte];
+			if(histogram[(render_queue[0].key >> (byte * 8)) & 0xFF] == count)
+				continue;
+
+			unsigned int offsets[256];
+			for(unsigned int i = 0, total = 0; i < 256; ++i)
+			{
+				offsets[i] = total;
+				total += histogram[i];
+			}
+
+			QueueItem* from = &render_queue[0];
+			QueueItem* to = &sort_scratch[0];
+			for(unsigned int i = 0; i < count; ++i)
+				to[offsets[(from[i].key >> (byte * 8)) & 0xFF]++] = from[i];
+
+			render_queue.swap(sort_scratch);
+		}
 	}
 
-	void SceneRenderer::RenderOpaque()
+	void SceneRenderer::BeginRender()
 	{
-		GLDEBUG();
+		// a new stamp empties the material table without touching it
+		if(++material_stamp == 0)
+		{
+			material_slot_stamps.assign(material_slot_stamps.size(), 0);
+			material_stamp = 1;
+		}
+		material_count = 0;
 
-		for(map<Material*, vector<RenderNode> >::iterator iter = opaque_items.begin(); iter != opaque_items.end(); ++iter)
+		render_queue.resize(objects.size());
+		translucent_begin = 0;
+
+		for(unsigned int i = 0; i < objects.size(); ++i)
+		{
+			Material* mat = objects[i].material;
+
+			assert(mat && "Material must not be NULL!");
+
+			bool translucent = mat->blend_style != Opaque;
+			if(!translucent)
+				++translucent_begin;
+
+			QueueItem& item = render_queue[i];
+			item.key = MakeSortKey(translucent, mat->mclass_id, GetMaterialIndex(mat), objects[i].distance);
+			item.node = i;
+		}
+
+		SortRenderQueue();
+	}
+
+	void SceneRenderer::DrawOpaqueItems()
+	{
+		// items using the same material are adjacent in the queue
+		for(unsigned int i = 0; i < translucent_begin; )
 		{
-			Material* mat = iter->first;
-			vector<RenderNode>& node_list = iter->second;
+			Material* mat = objects[render_queue[i].node].material;
 
 			mat->BeginDraw(this);
 
-			for(vector<RenderNode>::iterator jter = node_list.begin(); jter != node_list.end(); ++jter)
-				mat->Draw(*jter);
+			for(; i < translucent_begin && objects[render_queue[i].node].material == mat; ++i)
+				mat->Draw(objects[render_queue[i].node]);
 
 			mat->EndDraw();
 		}
+	}
+
+	void SceneRenderer::RenderOpaque()
+	{
+		GLDEBUG();
+
+		DrawOpaqueItems();
 
 		GLDEBUG();
 	}
@@ -81,9 +200,9 @@ namespace CibraryEngine
 
 		// translucent stuff is sorted, now get to drawing it!
 		Material* current_mat = NULL;
-		for(list<RenderNode>::iterator iter = sorted_translucent_items.begin(); iter != sorted_translucent_items.end(); ++iter)
+		for(unsigned int i = translucent_begin; i < render_queue.size(); ++i)
 		{
-			RenderNode model = *iter;
+			RenderNode& model = objects[render_queue[i].node];
 
 			assert (model.material != NULL);
 
@@ -120,18 +239,7 @@ namespace CibraryEngine
 		else
 			glColorMask(false, false, false, false);
 
-		for(map<Material*, vector<RenderNode> >::iterator iter = opaque_items.begin(); iter != opaque_items.end(); ++iter)
-		{
-			Material* mat = iter->first;
-			vector<RenderNode>& node_list = iter->second;
-
-			mat->BeginDraw(this);
-
-			for(vector<RenderNode>::iterator jter = node_list.begin(); jter != node_list.end(); ++jter)
-				mat->Draw(*jter);
-
-			mat->EndDraw();
-		}
+		DrawOpaqueItems();
 
 		in_depth_draw = false;
 
@@ -145,9 +253,13 @@ namespace CibraryEngine
 		for(vector<RenderNode>::iterator iter = objects.begin(); iter != objects.end(); ++iter)
 			iter->material->Cleanup(*iter);
 
-		material_model_lists.clear();
-		opaque_items.clear();
-		translucent_items.clear();
-		sorted_translucent_items.clear();
+		// clear() keeps the capacity, for the next frame
+		objects.clear();
+		lights.clear();
+
+		frame_data.Reset();
+
+		render_queue.clear();
+		translucent_begin = 0;
 	}
 }
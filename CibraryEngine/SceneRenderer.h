@@ -3,6 +3,7 @@
 #include "StdAfx.h"
 
 #include "MathTypes.h"
+#include "FrameAllocator.h"
 
 namespace CibraryEngine
 {
@@ -38,10 +39,33 @@ namespace CibraryEngine
 
 			bool in_depth_draw;
 
-			map<Material*, vector<RenderNode> > material_model_lists;
-			map<Material*, vector<RenderNode> > opaque_items;
-			map<Material*, vector<RenderNode> > translucent_items;
-			list<RenderNode> sorted_translucent_items;
+			/** An entry in the render queue; node is an index into objects */
+			struct QueueItem
+			{
+				unsigned long long key;
+				unsigned int node;
+			};
+
+			/**
+			 * Every object, sorted by a packed key; opaque items come first, grouped by material class and material
+			 * (and front-to-back within a material), then translucent items by distance. The buffers keep their
+			 * capacity from one frame to the next, so a SceneRenderer which is reused doesn't allocate once warmed up
+			 */
+			vector<QueueItem> render_queue;
+			vector<QueueItem> sort_scratch;
+			unsigned int translucent_begin;
+
+			// open-addressed table giving each material a dense index for the frame, for the material identity field of the keys
+			vector<Material*> material_slots;
+			vector<unsigned int> material_slot_indices;
+			vector<unsigned int> material_slot_stamps;
+			unsigned int material_stamp;
+			unsigned int material_count;
+
+			unsigned int GetMaterialIndex(Material* mat);
+
+			void SortRenderQueue();
+			void DrawOpaqueItems();
 
 		public:
 
@@ -53,8 +77,11 @@ namespace CibraryEngine
 			/** Collection of all the lights in the scene, to be populated by the Vis function of entities */
 			vector<LightSource*> lights;
 
+			/** Where the Vis functions of entities should allocate the data of their RenderNodes; it's all released by Cleanup */
+			FrameAllocator frame_data;
+
 			/** Initializes a SceneRenderer */
-			SceneRenderer(CameraView* camera) : in_depth_draw(false), material_model_lists(), opaque_items(), translucent_items(), sorted_translucent_items(), camera(camera), objects(), lights() { }
+			SceneRenderer(CameraView* camera) : in_depth_draw(false), render_queue(), sort_scratch(), translucent_begin(0), material_slots(), material_slot_indices(), material_slot_stamps(), material_stamp(0), material_count(0), camera(camera), objects(), lights(), frame_data() { }
 			virtual ~SceneRenderer() { }
 
 			/** Renders everything in the scene */
@@ -68,7 +95,7 @@ namespace CibraryEngine
 			virtual void RenderDepth(bool colors);
 			bool DrawingDepth();
 
-			/** Calls the cleanup functions of the various materials */
+			/** Calls the cleanup functions of the various materials, releases frame_data, and empties objects and lights so the SceneRenderer can be reused */
 			void Cleanup();
 	};
 }
@@ -5,11 +5,56 @@
 #include "Serialize.h"
 
 #include "Texture1D.h"
+#include "Texture2D.h"
 #include "Model.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#define SKELETAL_ANIMATION_SSE			// blend poses and quantize bone matrices four floats at a time
+	#include <emmintrin.h>
+#endif
+
 namespace CibraryEngine
 {
-	using boost::unordered_map;
+	/*
+	 * Affine transform utility functions; an affine transform is stored as 12 floats, the top three rows of the equivalent Mat4
+	 * (the bottom row is always 0 0 0 1)
+	 */
+
+	// the transform of a bone relative to its parent; without one, it's relative to the world, and the rest position doesn't apply
+	static void GetLocalBoneXform(Bone* bone, bool has_parent, float* result)
+	{
+		Mat3 rot = (bone->rest_ori * bone->ori).ToMat3();
+		Vec3 trans = has_parent ? bone->rest_pos + rot * (bone->pos - bone->rest_pos) : bone->pos;
+
+		result[0] = rot[0];		result[1] = rot[1];		result[2] = rot[2];		result[3] = trans.x;
+		result[4] = rot[3];		result[5] = rot[4];		result[6] = rot[5];		result[7] = trans.y;
+		result[8] = rot[6];		result[9] = rot[7];		result[10] = rot[8];	result[11] = trans.z;
+	}
+
+	// result = a * b; result mustn't be either of the inputs
+	static void MultiplyAffineXforms(const float* a, const float* b, float* result)
+	{
+		for(int row = 0; row < 12; row += 4)
+		{
+			float a0 = a[row], a1 = a[row + 1], a2 = a[row + 2];
+
+			result[row] = a0 * b[0] + a1 * b[4] + a2 * b[8];
+			result[row + 1] = a0 * b[1] + a1 * b[5] + a2 * b[9];
+			result[row + 2] = a0 * b[2] + a1 * b[6] + a2 * b[10];
+			result[row + 3] = a0 * b[3] + a1 * b[7] + a2 * b[11] + a[row + 3];
+		}
+	}
+
+	static void AffineXformToMat4(const float* xform, Mat4& result)
+	{
+		memcpy(result.values, xform, 12 * sizeof(float));
+
+		result.values[12] = result.values[13] = result.values[14] = 0.0f;
+		result.values[15] = 1.0f;
+	}
+
+
+
 
 	/*
 	 * Bone methods
@@ -18,19 +63,20 @@ namespace CibraryEngine
 
 	Mat4 Bone::GetTransformationMatrix()
 	{
-		Quaternion rotation = rest_ori * ori;
+		float xform[12], local[12], temp[12];
+		GetLocalBoneXform(this, parent != NULL, xform);
 
-		if (parent == NULL)
-			return Mat4::Translation(pos) * Mat4::FromQuaternion(rotation);
-		else
+		// work up the parent chain, applying each ancestor's transform in turn
+		for(Bone* ancestor = parent; ancestor != NULL; ancestor = ancestor->parent)
 		{
-			Mat4 parent_xform = parent->GetTransformationMatrix();
-			Mat4 to_rest_pos = Mat4::Translation(rest_pos);
-			Mat4 from_rest_pos = Mat4::Translation(-rest_pos);
-			Mat4 rotation_mat = Mat4::FromQuaternion(rotation);
-			Mat4 offset = Mat4::Translation(pos);
-			return parent_xform * to_rest_pos * rotation_mat * offset * from_rest_pos;
+			GetLocalBoneXform(ancestor, ancestor->parent != NULL, local);
+			MultiplyAffineXforms(local, xform, temp);
+			memcpy(xform, temp, sizeof(xform));
 		}
+
+		Mat4 result;
+		AffineXformToMat4(xform, result);
+		return result;
 	}
 
 	StringTable Bone::string_table = StringTable();
@@ -38,12 +84,141 @@ namespace CibraryEngine
 
 
 
+	/*
+	 * Skeleton private implementation struct
+	 */
+	struct Skeleton::Imp
+	{
+		// the hierarchy as of the last GetBoneMatrices; it's worked out again if any bone's parent changes, or bones are added or removed
+		vector<Bone*> parents;
+		vector<int> parent_indices;				// -1 if the bone has no parent in this skeleton
+		vector<unsigned int> order;				// indices of the bones, with every bone after its parent
+
+		// what each bone's matrix was last computed from
+		vector<Quaternion> oris, rest_oris;
+		vector<Vec3> poss, rest_poss;
+
+		vector<float> xforms;					// 12 floats per bone; see the affine transform utility functions
+		vector<Mat4> matrices;
+		vector<bool> recomputed;				// which bones' matrices changed during the current pass
+
+		Imp() : parents(), parent_indices(), order(), oris(), rest_oris(), poss(), rest_poss(), xforms(), matrices(), recomputed() { }
+
+		bool HierarchyChanged(const vector<Bone*>& bones)
+		{
+			if(bones.size() != parents.size())
+				return true;
+
+			for(unsigned int i = 0; i < bones.size(); ++i)
+				if(bones[i]->parent != parents[i])
+					return true;
+
+			return false;
+		}
+
+		void BuildHierarchy(const vector<Bone*>& bones)
+		{
+			unsigned int count = bones.size();
+
+			parents.resize(count);
+			parent_indices.assign(count, -1);
+			for(unsigned int i = 0; i < count; ++i)
+			{
+				parents[i] = bones[i]->parent;
+				for(unsigned int j = 0; j < count; ++j)
+					if(bones[j] == parents[i])
+					{
+						parent_indices[i] = j;
+						break;
+					}
+			}
+
+			// each bone goes in after its ancestors; the depth limit stops a cycle from going around forever
+			order.clear();
+			vector<bool> placed(count, false);
+			vector<unsigned int> chain;
+			for(unsigned int i = 0; i < count; ++i)
+			{
+				chain.clear();
+				for(int j = i; j >= 0 && !placed[j] && chain.size() < count; j = parent_indices[j])
+					chain.push_back(j);
+
+				for(vector<unsigned int>::reverse_iterator iter = chain.rbegin(); iter != chain.rend(); ++iter)
+					if(!placed[*iter])
+					{
+						placed[*iter] = true;
+						order.push_back(*iter);
+					}
+			}
+
+			oris.resize(count);
+			rest_oris.resize(count);
+			poss.resize(count);
+			rest_poss.resize(count);
+
+			xforms.resize(count * 12);
+			matrices.resize(count);
+			recomputed.resize(count);
+		}
+
+		static bool SameQuaternion(const Quaternion& a, const Quaternion& b) { return a.w == b.w && a.x == b.x && a.y == b.y && a.z == b.z; }
+
+		void Compute(const vector<Bone*>& bones)
+		{
+			// after the hierarchy changes, everything gets recomputed
+			bool rebuilt = HierarchyChanged(bones);
+			if(rebuilt)
+				BuildHierarchy(bones);
+
+			float local[12];
+			for(vector<unsigned int>::iterator iter = order.begin(); iter != order.end(); ++iter)
+			{
+				unsigned int i = *iter;
+				Bone* bone = bones[i];
+				int parent_index = parent_indices[i];
+
+				// a parent from outside the skeleton could have moved without us knowing, so those bones are always recomputed
+				bool foreign_parent = parent_index < 0 && bone->parent != NULL;
+				bool changed = rebuilt || foreign_parent || (parent_index >= 0 && recomputed[parent_index]) ||
+					!SameQuaternion(bone->ori, oris[i]) || !(bone->pos == poss[i]) || !SameQuaternion(bone->rest_ori, rest_oris[i]) || !(bone->rest_pos == rest_poss[i]);
+				recomputed[i] = changed;
+
+				if(!changed)
+					continue;
+
+				oris[i] = bone->ori;
+				poss[i] = bone->pos;
+				rest_oris[i] = bone->rest_ori;
+				rest_poss[i] = bone->rest_pos;
+
+				float* xform = &xforms[i * 12];
+				if(parent_index >= 0)
+				{
+					GetLocalBoneXform(bone, true, local);
+					MultiplyAffineXforms(&xforms[parent_index * 12], local, xform);
+				}
+				else if(foreign_parent)
+				{
+					Mat4 mat = bone->GetTransformationMatrix();
+					memcpy(xform, mat.values, 12 * sizeof(float));
+				}
+				else
+					GetLocalBoneXform(bone, false, xform);
+
+				AffineXformToMat4(xform, matrices[i]);
+			}
+		}
+	};
+
+
+
+
 	/*
 	 * Skeleton methods
 	 */
-	Skeleton::Skeleton() : bone_matrices(NULL), bones() { }
+	Skeleton::Skeleton() : imp(NULL), bone_matrices(NULL), bones() { }
 
-	Skeleton::Skeleton(Skeleton* prototype)			// hope that prototype is never NULL
+	Skeleton::Skeleton(Skeleton* prototype) : imp(NULL), bone_matrices(NULL), bones()			// hope that prototype is never NULL
 	{
 		unsigned int bone_count = prototype->bones.size();
 		for(unsigned int i = 0; i < bone_count; ++i)
@@ -68,6 +243,12 @@ namespace CibraryEngine
 			delete *iter;
 
 		bones.clear();
+
+		if(imp != NULL)
+		{
+			delete imp;
+			imp = NULL;
+		}
 	}
 
 	Bone* Skeleton::AddBone(unsigned int bone_name, Quaternion ori, Vec3 attach) { return AddBone(bone_name, NULL, ori, attach); }
@@ -88,18 +269,13 @@ namespace CibraryEngine
 		return NULL;
 	}
 
-	vector<Mat4> Skeleton::GetBoneMatrices()
+	const vector<Mat4>& Skeleton::GetBoneMatrices()
 	{
-		vector<Mat4> matrices = vector<Mat4>();
+		if(imp == NULL)
+			imp = new Imp();
 
-		unsigned int bones_count = bones.size();
-		for(unsigned int i = 0; i < bones_count; ++i)
-		{
-			Mat4 mat = bones[i]->GetTransformationMatrix();
-			matrices.push_back(mat);
-		}
-
-		return matrices;
+		imp->Compute(bones);
+		return imp->matrices;
 	}
 
 	int Skeleton::ReadSkeleton(ifstream& file, Skeleton** skeleton)
@@ -181,8 +357,14 @@ namespace CibraryEngine
 	/*
 	 * SkinnedCharacter methods
 	 */
+	static const unsigned int max_bones = 128;				// the most matrices a bone matrix texture can hold
+
+	// UpdatePoses adds up BoneInfluences as 7 consecutive floats; this fails to compile if padding or new members break that
+	typedef char BoneInfluenceMustBeSevenFloats[sizeof(BoneInfluence) == 7 * sizeof(float) ? 1 : -1];
+
 	SkinnedCharacter::SkinnedCharacter(SkinnedModel* skin) :
-		bone_matrices(NULL),
+		blend(),
+		blended(),
 		skin(skin),
 		skeleton(new Skeleton(skeleton)),
 		active_poses()
@@ -190,7 +372,8 @@ namespace CibraryEngine
 	}
 
 	SkinnedCharacter::SkinnedCharacter(Skeleton* skeleton) :
-		bone_matrices(NULL),
+		blend(),
+		blended(),
 		skin(NULL),
 		skeleton(skeleton),
 		active_poses()
@@ -201,14 +384,6 @@ namespace CibraryEngine
 	{
 		skeleton->Dispose();
 		delete skeleton;
-
-		if(bone_matrices != NULL)
-		{
-			bone_matrices->Dispose();
-			delete bone_matrices;
-
-			bone_matrices = NULL;
-		}
 	}
 
 	void SkinnedCharacter::UpdatePoses(TimingInfo time)
@@ -224,86 +399,241 @@ namespace CibraryEngine
 				iter = active_poses.erase(iter);
 		}
 
-		unordered_map<unsigned int, BoneInfluence> bone_states;
+		// sum the influences into blend, indexed by bone; each bone gets ori.xyz, pos.x in the first four floats, and pos.xyz, div
+		// in the last four, so that a BoneInfluence (7 consecutive floats) can be added with two overlapping unaligned loads
+		unsigned int bone_count = skeleton->bones.size();
+		if(blend.size() < bone_count * 8)
+			blend.resize(bone_count * 8);
+		blended.assign(bone_count, false);
+
+		float* blend_ptr = bone_count > 0 ? &blend[0] : NULL;
+		memset(blend_ptr, 0, bone_count * 8 * sizeof(float));
 
 		for(list<Pose*>::iterator iter = active_poses.begin(); iter != active_poses.end(); ++iter)
 		{
 			Pose* pose = *iter;
-			for(unordered_map<unsigned int, BoneInfluence>::iterator jter = pose->bones.begin(); jter != pose->bones.end(); ++jter)
+
+			const vector<int>& indices = pose->GetSkeletonIndices(skeleton);
+			unsigned int slots = indices.size();
+			for(unsigned int i = 0; i < slots; ++i)
 			{
-				unsigned int name = jter->first;
+				int index = indices[i];
+				if(index == -1)
+					continue;
+
+				const float* influence = &pose->bone_influences[i].ori.x;
+				float* sum = blend_ptr + index * 8;
+#ifdef SKELETAL_ANIMATION_SSE
+				_mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), _mm_loadu_ps(influence)));
+				_mm_storeu_ps(sum + 4, _mm_add_ps(_mm_loadu_ps(sum + 4), _mm_loadu_ps(influence + 3)));
+#else
+				for(int j = 0; j < 4; ++j)
+				{
+					sum[j] += influence[j];
+					sum[j + 4] += influence[j + 3];
+				}
+#endif
+				blended[index] = true;
+			}
+		}
 
-				if(bone_states.find(name) == bone_states.end())
-					bone_states[name] = BoneInfluence();
+		for(unsigned int i = 0; i < bone_count; ++i)
+			if(blended[i])
+			{
+				Bone* bone = skeleton->bones[i];
+				const float* sum = blend_ptr + i * 8;
 
-				bone_states[name] += jter->second;
+				bone->ori = Quaternion::FromPYR(Vec3(sum[0], sum[1], sum[2]));
+				bone->pos = Vec3(sum[4], sum[5], sum[6]);
 			}
-		}
+	}
+
+	Texture1D* SkinnedCharacter::MatricesToTexture1D(const vector<Mat4>& matrices)
+	{
+		unsigned int matrix_count = min((unsigned int)matrices.size(), max_bones);
+
+		unsigned int size = matrix_count * 24;
+		unsigned int use_size = 4;
+		while(use_size < size)
+			use_size <<= 1;				// multiply by 2, lol
 
-		int i = 0;
-		for(vector<Bone*>::iterator iter = skeleton->bones.begin(); iter != skeleton->bones.end(); ++iter, ++i)
+		unsigned char* array = new unsigned char[use_size];
+		if(matrix_count > 0)
+			PackMatrices(&matrices[0], matrix_count, array);
+
+		return new Texture1D(use_size / 4, array);
+	}
+
+	void SkinnedCharacter::PackMatrices(const Mat4* matrices, unsigned int count, unsigned char* target)
+	{
+#ifdef SKELETAL_ANIMATION_SSE
+		// same arithmetic as below, NaNs included (they come out as 65535); the values are offset by -32768 to fit the signed
+		// saturating pack, and flipped back after, and x86 is little-endian, so the shorts can be stored as they are
+		const __m128 scale = _mm_set1_ps(4096.0f), offset = _mm_set1_ps(32768.0f), half = _mm_set1_ps(0.5f);
+		const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(65535.0f);
+		const __m128i bias = _mm_set1_epi32(32768), flip = _mm_set1_epi16((short)0x8000);
+
+		for(unsigned int i = 0; i < count; ++i, target += 24)
 		{
-			Bone* bone = *iter;
+			const float* values = matrices[i].values;
 
-			unsigned int name = bone->name;
-			unordered_map<unsigned int, BoneInfluence>::iterator found = bone_states.find(name);
+			__m128i rows[3];
+			for(int j = 0; j < 3; ++j)
+			{
+				__m128 expanded = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + j * 4), scale), offset);
+				__m128 clamped = _mm_max_ps(_mm_min_ps(_mm_add_ps(expanded, half), hi), lo);
+				rows[j] = _mm_sub_epi32(_mm_cvttps_epi32(clamped), bias);
+			}
 
-			if(found != bone_states.end())
+			_mm_storeu_si128((__m128i*)target, _mm_xor_si128(_mm_packs_epi32(rows[0], rows[1]), flip));
+			_mm_storel_epi64((__m128i*)(target + 16), _mm_xor_si128(_mm_packs_epi32(rows[2], rows[2]), flip));
+		}
+#else
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			const Mat4& mat = matrices[i];
+			for(unsigned int j = 0; j < 12; ++j)
 			{
-				BoneInfluence state = found->second;
-				bone->ori = Quaternion::FromPYR(state.ori);
-				bone->pos = state.pos;
+				float val = mat.values[j];								// get value from the matrix
+				float expanded = val * 4096.0f + 32768.0f;		// scale to reasonable range
+
+				unsigned int int_val = (unsigned int)(max(0.0, min(65535.0, expanded + 0.5)));			// offset by 0.5 so it rounds nicely
+				*(target++) = (unsigned char)(int_val & 0xFF);
+				*(target++) = (unsigned char)(int_val >> 8);
 			}
 		}
+#endif
+	}
+
+
 
-		if(bone_matrices != NULL)
+
+	/*
+	 * Pose methods
+	 */
+	unsigned int Pose::GetBoneSlot(unsigned int which)
+	{
+		// poses tend to set the same bones in the same order every frame, so looking where the last one left off usually hits right away
+		unsigned int slots = bone_names.size();
+		for(unsigned int i = 0; i < slots; ++i)
 		{
-			bone_matrices->Dispose();
-			delete bone_matrices;
+			unsigned int slot = next_slot + i;
+			if(slot >= slots)
+				slot -= slots;
 
-			bone_matrices = NULL;
+			if(bone_names[slot] == which)
+			{
+				next_slot = slot + 1 < slots ? slot + 1 : 0;
+				return slot;
+			}
 		}
+
+		bone_names.push_back(which);
+		bone_influences.push_back(BoneInfluence());
+		next_slot = 0;
+
+		return slots;
 	}
 
-	Texture1D* SkinnedCharacter::GetBoneMatrices()
+	const vector<int>& Pose::GetSkeletonIndices(Skeleton* skeleton)
 	{
-		if(bone_matrices == NULL)
+		if(skeleton != remap_skeleton || skeleton->bones.size() != remap_bone_count)
+		{
+			remap_skeleton = skeleton;
+			remap_bone_count = skeleton->bones.size();
+			remap.clear();
+		}
+
+		for(unsigned int i = remap.size(); i < bone_names.size(); ++i)
 		{
-			vector<Mat4> matrices = skeleton->GetBoneMatrices();
-			bone_matrices = SkinnedCharacter::MatricesToTexture1D(matrices);
+			int index = -1;
+			for(unsigned int j = 0; j < remap_bone_count; ++j)
+				if(skeleton->bones[j]->name == bone_names[i])
+				{
+					index = (int)j;
+					break;
+				}
+
+			remap.push_back(index);
 		}
-		return bone_matrices;
+
+		return remap;
 	}
 
-	Texture1D* SkinnedCharacter::MatricesToTexture1D(vector<Mat4>& matrices)
+
+
+
+	/*
+	 * BonePalette methods
+	 */
+	BonePalette::BonePalette() : texture(NULL), count(0), changed(false) { Clear(); }
+
+	void BonePalette::InnerDispose()
 	{
-		unsigned int matrix_count = matrices.size();
-		const unsigned int max_bones = 128;
+		if(texture != NULL)
+		{
+			texture->Dispose();
+			delete texture;
 
-		matrix_count = matrix_count > max_bones ? max_bones : matrix_count;
+			texture = NULL;
+		}
+	}
 
-		unsigned int size = matrix_count * 24;
-		unsigned int use_size = 4;
-		while(use_size < size)
-			use_size <<= 1;				// multiply by 2, lol
+	void BonePalette::Grow(unsigned int min_count)
+	{
+		unsigned int height = texture != NULL ? texture->height : 4;
+		while(height * width < min_count * 6)
+			height <<= 1;
 
-		unsigned char* array = new unsigned char[use_size];
-		unsigned char* target = array;
+		unsigned char* data = new unsigned char[height * width * 4];
+		memset(data, 0, height * width * 4);
 
-		for(unsigned int i = 0; i < matrix_count; ++i)
+		if(texture != NULL)
 		{
-			Mat4& mat = matrices[i];
-			for(unsigned int j = 0; j < 12; ++j)
-			{
-				float val = mat[j];								// get value from the matrix
-				float expanded = val * 4096.0f + 32768.0f;		// scale to reasonable range
+			memcpy(data, texture->byte_data, count * 24);
 
-				unsigned int int_val = (unsigned int)(max(0.0, min(65535.0, expanded + 0.5)));			// offset by 0.5 so it rounds nicely
-				for(int k = 0; k < 2; ++k)
-					*(target++) = (unsigned char)((int_val & (0xFF << (k * 8))) >> (k * 8));
-			}
+			texture->Dispose();
+			delete texture;
 		}
 
-		return new Texture1D(use_size / 4, array);
+		texture = new Texture2D(width, height, data, false, true);
+	}
+
+	void BonePalette::Clear()
+	{
+		count = 0;
+
+		vector<Mat4> identity(1, Mat4::Identity());
+		Add(identity);
+	}
+
+	unsigned int BonePalette::Add(const vector<Mat4>& matrices)
+	{
+		unsigned int offset = count;
+		if(matrices.empty())
+			return offset;
+
+		unsigned int new_count = count + matrices.size();
+		if(texture == NULL || (unsigned int)texture->height * width < new_count * 6)
+			Grow(new_count);
+
+		SkinnedCharacter::PackMatrices(&matrices[0], matrices.size(), texture->byte_data + offset * 24);
+		count = new_count;
+		changed = true;
+
+		return offset;
+	}
+
+	unsigned int BonePalette::GetCount() { return count; }
+	const unsigned char* BonePalette::GetData() { return texture->byte_data; }
+
+	Texture2D* BonePalette::GetTexture()
+	{
+		if(changed)
+		{
+			texture->InvalidateData();
+			changed = false;
+		}
+		return texture;
 	}
 }
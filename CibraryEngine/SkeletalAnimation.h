@@ -18,6 +18,7 @@ namespace CibraryEngine
 	using boost::unordered_map;
 
 	class Texture1D;
+	class Texture2D;
 
 	/** Class representing a bone of a skeleton */
 	class Bone
@@ -54,6 +55,11 @@ namespace CibraryEngine
 	/** Class representing an arrangement of bones */
 	class Skeleton : public Disposable
 	{
+		private:
+
+			struct Imp;
+			Imp* imp;
+
 		protected:
 
 			void InnerDispose();
@@ -82,7 +88,12 @@ namespace CibraryEngine
 			/** Writes a skeleton from a stream, and returns 0 if ok or an int error code */
 			static int WriteSkeleton(ofstream& file, Skeleton* skeleton);
 
-			vector<Mat4> GetBoneMatrices();
+			/**
+			 * Gets the transformation matrices of all of the bones, in the same order as bones, computed in a single pass with parents
+			 * before their children; bones whose pose, rest pose and parent haven't changed since the last call (and whose ancestors'
+			 * haven't either) aren't recomputed. The result is only valid until the next call
+			 */
+			const vector<Mat4>& GetBoneMatrices();
 	};
 
 	class SkinnedModel;
@@ -93,14 +104,18 @@ namespace CibraryEngine
 	/** Class containing a skinned model, a skeleton, and a collection of active poses affecting it */
 	class SkinnedCharacter : public Disposable
 	{
+		private:
+
+			// the sum of the active poses' influences on each bone, kept from one UpdatePoses to the next to avoid reallocating
+			vector<float> blend;				// 8 floats per bone; see UpdatePoses
+			vector<bool> blended;
+
 		protected:
 
 			void InnerDispose();
 
 		public:
 
-			Texture1D* bone_matrices;
-
 			/** The model for this character */
 			SkinnedModel* skin;
 			/** A copy of the Skeleton from the SkinnedModel, with orientations and offsets specified by the character's active poses */
@@ -118,10 +133,55 @@ namespace CibraryEngine
 			/** Updates the poses of this character */
 			void UpdatePoses(TimingInfo time);
 
-			Texture1D* GetBoneMatrices();
-
 			/** Static utility function to generate a 1-dimensional texture which encodes several transformation matrices, for use by my awesome vertex shader; remember to dispose of and delete the result! */
-			static Texture1D* MatricesToTexture1D(vector<Mat4>& matrices);
+			static Texture1D* MatricesToTexture1D(const vector<Mat4>& matrices);
+
+			/**
+			 * Encodes matrices the way MatricesToTexture1D does, into an existing buffer; each matrix takes 24 bytes, the top three rows
+			 * as 16-bit fixed point, little-endian. Doesn't allocate anything
+			 */
+			static void PackMatrices(const Mat4* matrices, unsigned int count, unsigned char* target);
+	};
+
+	/**
+	 * Class holding the bone matrices of lots of characters in a single texture, packed the way SkinnedCharacter::PackMatrices does,
+	 * each at its own offset, so they can all be drawn without switching textures; meant to be refilled every frame
+	 */
+	class BonePalette : public Disposable
+	{
+		private:
+
+			Texture2D* texture;
+			unsigned int count;
+			bool changed;
+
+			// replaces the texture with a taller one, big enough for at least min_count matrices, keeping what's been added so far
+			void Grow(unsigned int min_count);
+
+		protected:
+
+			void InnerDispose();
+
+		public:
+
+			/** How many texels wide the texture is; each matrix takes 6 texels, and may straddle two rows */
+			static const unsigned int width = 1024;
+
+			BonePalette();
+
+			/** Empties the palette, except for offset 0, which always holds an identity matrix (for models that aren't skinned); call this at the start of each frame */
+			void Clear();
+
+			/** Packs the matrices into the palette, and returns the offset of the first one; the vertex shader finds bone i at offset + i */
+			unsigned int Add(const vector<Mat4>& matrices);
+
+			/** Gets how many matrices are in the palette, including the identity matrix at offset 0 */
+			unsigned int GetCount();
+			/** Gets the packed matrices, 24 bytes each */
+			const unsigned char* GetData();
+
+			/** Gets the texture, with anything added since the last call uploaded to it */
+			Texture2D* GetTexture();
 	};
 
 	/** Class representing how a Pose affects a certain Bone */
@@ -152,15 +212,30 @@ namespace CibraryEngine
 
 			bool active;
 
+			unsigned int next_slot;				// where SetBonePose starts looking for the bone's slot
+
+			// which bone of remap_skeleton each slot is for (or -1 if it doesn't have that bone); see GetSkeletonIndices
+			Skeleton* remap_skeleton;
+			unsigned int remap_bone_count;
+			vector<int> remap;
+
 		public:
 
-			/** For these bone names, a BoneInfluence may be specified */
-			unordered_map<unsigned int, BoneInfluence> bones;
+			/** The names of the bones this Pose affects, in the order they were first set; each one's "slot" is its index here */
+			vector<unsigned int> bone_names;
+			/** How this Pose affects each of the bones in bone_names */
+			vector<BoneInfluence> bone_influences;
+
+			Pose() : active(true), next_slot(0), remap_skeleton(NULL), remap_bone_count(0), remap(), bone_names(), bone_influences() { }
+
+			/** Gets the slot for the named bone, adding one if this Pose doesn't affect it yet; quickest when bones are looked up in the same order every time */
+			unsigned int GetBoneSlot(unsigned int which);
 
-			Pose() : active(true), bones() { }
+			/** Sets how this Pose will affect the specified bone */
+			void SetBonePose(unsigned int which, Vec3 ori, Vec3 pos, float weight) { bone_influences[GetBoneSlot(which)] = BoneInfluence(ori, pos, weight); }
 
-			/** Sets how this Pose will affect the specified bone, by modifying the bones map */
-			void SetBonePose(unsigned int which, Vec3 ori, Vec3 pos, float weight) { bones[which] = BoneInfluence(ori, pos, weight); }
+			/** Gets the index in skeleton->bones of the bone for each slot, or -1 if there's no such bone; only new slots are looked up, unless the skeleton changes */
+			const vector<int>& GetSkeletonIndices(Skeleton* skeleton);
 
 			/** Abstract function where you can call SetBonePose */
 			virtual void UpdatePose(TimingInfo time) = 0;
@@ -41,6 +41,7 @@
 #include <set>
 #include <cmath>
 #include <stack>
+#include <algorithm>
 #include <cassert>
 #include <string>
 
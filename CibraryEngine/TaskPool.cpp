@@ -0,0 +1,193 @@
+#include "StdAfx.h"
+#include "TaskPool.h"
+
+namespace CibraryEngine
+{
+	/*
+	 * TaskPool private implementation struct
+	 */
+	struct TaskPool::Imp
+	{
+		// a contiguous range of indices; the owner takes them from the front, thieves take them from the back
+		struct Queue
+		{
+			boost::mutex mutex;
+			unsigned int begin, end;
+
+			Queue() : mutex(), begin(0), end(0) { }
+
+			bool Pop(unsigned int& index)
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				if(begin == end)
+					return false;
+
+				index = begin++;
+				return true;
+			}
+
+			bool Steal(unsigned int& index)
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				if(begin == end)
+					return false;
+
+				index = --end;
+				return true;
+			}
+		};
+
+		vector<Queue*> queues;								// one for each worker, and the last one for the thread calling Run
+
+		boost::mutex mutex;									// guards everything from here to the threads
+		boost::condition_variable work_ready;
+		boost::condition_variable work_done;
+
+		Task* task;
+		unsigned int generation;							// incremented by each call to Run, so the workers know there's something new
+		unsigned int active;								// workers which haven't finished with the current call to Run
+		bool stopping;
+
+		vector<boost::thread*> threads;
+
+		Imp(unsigned int thread_count) :
+			queues(),
+			mutex(),
+			work_ready(),
+			work_done(),
+			task(NULL),
+			generation(0),
+			active(0),
+			stopping(false),
+			threads()
+		{
+			for(unsigned int i = 0; i <= thread_count; ++i)
+				queues.push_back(new Queue());
+
+			for(unsigned int i = 0; i < thread_count; ++i)
+				threads.push_back(new boost::thread(&Imp::WorkerMain, this, i));
+		}
+
+		~Imp()
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				stopping = true;
+				work_ready.notify_all();
+			}
+
+			for(vector<boost::thread*>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+			{
+				(*iter)->join();
+				delete *iter;
+			}
+			threads.clear();
+
+			for(vector<Queue*>::iterator iter = queues.begin(); iter != queues.end(); ++iter)
+				delete *iter;
+			queues.clear();
+		}
+
+		void WorkerMain(unsigned int queue)
+		{
+			unsigned int done_generation = 0;
+
+			boost::mutex::scoped_lock lock(mutex);
+			while(true)
+			{
+				while(!stopping && generation == done_generation)
+					work_ready.wait(lock);
+
+				if(stopping)
+					break;
+
+				done_generation = generation;
+				Task* current = task;
+
+				lock.unlock();
+				Work(queue, current);
+				lock.lock();
+
+				if(--active == 0)
+					work_done.notify_all();
+			}
+		}
+
+		// runs tasks from our own queue, then steals from the others until they're all empty
+		void Work(unsigned int queue, Task* current)
+		{
+			unsigned int count = queues.size();
+			unsigned int index;
+
+			while(true)
+			{
+				if(!queues[queue]->Pop(index))
+				{
+					bool stole = false;
+					for(unsigned int i = 1; i < count && !stole; ++i)
+						stole = queues[(queue + i) % count]->Steal(index);
+
+					if(!stole)
+						return;
+				}
+
+				current->Run(index);
+			}
+		}
+
+		void Run(Task& job, unsigned int count)
+		{
+			if(threads.empty() || count < 2)
+			{
+				for(unsigned int i = 0; i < count; ++i)
+					job.Run(i);
+				return;
+			}
+
+			// the workers are all idle, so this doesn't need the queues' locks; taking the main lock below publishes it
+			unsigned int queue_count = queues.size();
+			for(unsigned int i = 0; i < queue_count; ++i)
+			{
+				queues[i]->begin = count * i / queue_count;
+				queues[i]->end = count * (i + 1) / queue_count;
+			}
+
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				task = &job;
+				active = threads.size();
+				++generation;
+
+				work_ready.notify_all();
+			}
+
+			Work(queue_count - 1, &job);
+
+			// wait for every worker to have finished with the task before it goes out of scope
+			boost::mutex::scoped_lock lock(mutex);
+			while(active != 0)
+				work_done.wait(lock);
+
+			task = NULL;
+		}
+	};
+
+
+
+
+	/*
+	 * TaskPool methods
+	 */
+	TaskPool::TaskPool(unsigned int thread_count) : imp(new Imp(thread_count)) { }
+
+	void TaskPool::InnerDispose()
+	{
+		delete imp;
+		imp = NULL;
+	}
+
+	void TaskPool::Run(Task& task, unsigned int count) { imp->Run(task, count); }
+
+	unsigned int TaskPool::GetThreadCount() { return imp->threads.size(); }
+}
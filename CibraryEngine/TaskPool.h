@@ -0,0 +1,44 @@
+#pragma once
+
+#include "StdAfx.h"
+#include "Disposable.h"
+
+namespace CibraryEngine
+{
+	using namespace std;
+
+	/**
+	 * Worker threads for running lots of small, independent tasks, e.g. updating entities in parallel. Each call to Run
+	 * splits the range of indices evenly between the workers and the calling thread; whoever runs out of work steals
+	 * from the end of somebody else's range, so one slow task doesn't hold up everybody else
+	 */
+	class TaskPool : public Disposable
+	{
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+		protected:
+
+			/** Stops the worker threads */
+			void InnerDispose();
+
+		public:
+
+			/** Something to be done once for each index in a range; Run may be called concurrently for different indices */
+			struct Task
+			{
+				virtual ~Task() { }
+				virtual void Run(unsigned int index) = 0;
+			};
+
+			/** Starts thread_count worker threads; with 0 threads, Run does everything on the calling thread */
+			TaskPool(unsigned int thread_count);
+
+			/** Runs the task for every index from 0 to count - 1, and returns once they're all finished; not reentrant */
+			void Run(Task& task, unsigned int count);
+
+			unsigned int GetThreadCount();
+	};
+}
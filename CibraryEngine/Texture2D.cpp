@@ -11,6 +11,7 @@ namespace CibraryEngine
 	 */
 	Texture2D::Texture2D(int width, int height, unsigned char* byte_data, bool mipmaps, bool clamp) :
 		Texture(),
+		data_changed(false),
 		width(width),
 		height(height),
 		byte_data(byte_data),
@@ -31,8 +32,32 @@ namespace CibraryEngine
 		}
 	}
 
+	void Texture2D::InvalidateData() { data_changed = true; }
+
 	unsigned int Texture2D::GetGLName()
 	{
+		if(gl_name != 0 && data_changed)
+		{
+			GLDEBUG();
+
+			bool were_textures_enabled = glIsEnabled(GL_TEXTURE_2D) == GL_TRUE;
+			glEnable(GL_TEXTURE_2D);
+
+			glBindTexture(GL_TEXTURE_2D, gl_name);
+
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, byte_data);
+
+			if(mipmaps)
+				glGenerateMipmap(GL_TEXTURE_2D);
+
+			if (!were_textures_enabled)
+				glDisable(GL_TEXTURE_2D);
+
+			GLDEBUG();
+		}
+		data_changed = false;
+
 		if(gl_name == 0)
 		{
 			GLDEBUG();
@@ -8,6 +8,10 @@ namespace CibraryEngine
 	/** Class representing a 2-dimensional texture */
 	class Texture2D : public Texture
 	{
+		private:
+
+			bool data_changed;
+
 		protected:
 
 			void InnerDispose();
@@ -27,6 +31,9 @@ namespace CibraryEngine
 
 			Texture2D(int width, int height, unsigned char* byte_data, bool mipmaps, bool clamp);
 
+			/** Call this after changing the contents of byte_data (but not the size); the next GetGLName will upload them into the existing texture, instead of making a new one */
+			void InvalidateData();
+
 			unsigned int GetGLName();
 	};
 
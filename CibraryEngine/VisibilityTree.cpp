@@ -0,0 +1,618 @@
+#include "StdAfx.h"
+#include "VisibilityTree.h"
+
+#include "Entity.h"
+#include "CameraView.h"
+
+#include "Sphere.h"
+#include "AABB.h"
+#include "Plane.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+	#define VISIBILITY_TREE_SSE				// test the bounding spheres of the leaves against the frustum four at a time
+	#include <xmmintrin.h>
+#endif
+
+namespace CibraryEngine
+{
+	/*
+	 * VisibilityTree private implementation struct
+	 */
+	struct VisibilityTree::Imp
+	{
+		struct Node
+		{
+			AABB aabb;
+
+			int parent;
+			int child1, child2;				// both are -1 if this is a leaf
+			int proxy;						// only meaningful for leaves
+			int height;						// leaves have height 0
+
+			bool IsLeaf() { return child1 == -1; }
+		};
+
+		struct Proxy
+		{
+			Entity* entity;					// NULL if this proxy isn't in use
+			Sphere bounds;
+			int leaf;						// -1 if the entity doesn't have a bounding sphere
+			int unbounded_index;			// index into the unbounded list, if leaf is -1
+		};
+
+		vector<Node> nodes;
+		vector<int> free_nodes;
+		int root;
+
+		vector<Proxy> proxies;
+		vector<int> free_proxies;
+
+		vector<int> unbounded;				// proxies of entities which don't have a bounding sphere, and therefore are never culled
+		unsigned int bounded_count;
+
+		// scratch space for Cull, kept around so it doesn't have to be reallocated every frame
+		vector<int> stack;					// node index, plane mask, node index, plane mask...
+		vector<int> candidates;				// proxies whose leaves straddle one of the frustum planes
+		vector<float> cx, cy, cz, cr;
+
+		unsigned int visible_count, culled_count;
+
+		Imp() : nodes(), free_nodes(), root(-1), proxies(), free_proxies(), unbounded(), bounded_count(0), stack(), candidates(), cx(), cy(), cz(), cr(), visible_count(0), culled_count(0) { }
+
+		static AABB Union(const AABB& a, const AABB& b)
+		{
+			return AABB(
+				Vec3(min(a.min.x, b.min.x), min(a.min.y, b.min.y), min(a.min.z, b.min.z)),
+				Vec3(max(a.max.x, b.max.x), max(a.max.y, b.max.y), max(a.max.z, b.max.z)));
+		}
+
+		static float SurfaceArea(const AABB& a)
+		{
+			float dx = a.max.x - a.min.x, dy = a.max.y - a.min.y, dz = a.max.z - a.min.z;
+			return 2.0f * (dx * dy + dy * dz + dz * dx);
+		}
+
+		static bool ContainsSphere(const AABB& a, const Sphere& s)
+		{
+			return	s.center.x - s.radius >= a.min.x && s.center.x + s.radius <= a.max.x &&
+					s.center.y - s.radius >= a.min.y && s.center.y + s.radius <= a.max.y &&
+					s.center.z - s.radius >= a.min.z && s.center.z + s.radius <= a.max.z;
+		}
+
+		static AABB FatAABB(const Sphere& s)
+		{
+			float r = s.radius + aabb_margin;
+			return AABB(s.center - Vec3(r, r, r), s.center + Vec3(r, r, r));
+		}
+
+		int AllocateNode()
+		{
+			int index;
+			if(free_nodes.empty())
+			{
+				index = nodes.size();
+				nodes.push_back(Node());
+			}
+			else
+			{
+				index = free_nodes.back();
+				free_nodes.pop_back();
+			}
+
+			Node& node = nodes[index];
+			node.parent = node.child1 = node.child2 = node.proxy = -1;
+			node.height = 0;
+
+			return index;
+		}
+
+		void FreeNode(int index) { free_nodes.push_back(index); }
+
+
+
+		// the insertion, removal and rotations are the same as in Box2D's b2DynamicTree, except in 3D
+		void InsertLeaf(int leaf)
+		{
+			if(root == -1)
+			{
+				root = leaf;
+				nodes[root].parent = -1;
+				return;
+			}
+
+			// find the best sibling for the new leaf, by the surface area heuristic
+			AABB leaf_aabb = nodes[leaf].aabb;
+			int index = root;
+			while(!nodes[index].IsLeaf())
+			{
+				Node& node = nodes[index];
+				int child1 = node.child1, child2 = node.child2;
+
+				float area = SurfaceArea(node.aabb);
+				float combined_area = SurfaceArea(Union(node.aabb, leaf_aabb));
+
+				float cost = 2.0f * combined_area;							// cost of making a new parent for this node and the new leaf
+				float inheritance_cost = 2.0f * (combined_area - area);		// minimum cost of pushing the leaf further down the tree
+
+				float cost1 = SurfaceArea(Union(leaf_aabb, nodes[child1].aabb)) + inheritance_cost;
+				if(!nodes[child1].IsLeaf())
+					cost1 -= SurfaceArea(nodes[child1].aabb);
+
+				float cost2 = SurfaceArea(Union(leaf_aabb, nodes[child2].aabb)) + inheritance_cost;
+				if(!nodes[child2].IsLeaf())
+					cost2 -= SurfaceArea(nodes[child2].aabb);
+
+				if(cost < cost1 && cost < cost2)
+					break;
+
+				index = cost1 < cost2 ? child1 : child2;
+			}
+			int sibling = index;
+
+			// make a new parent for the leaf and its sibling
+			int old_parent = nodes[sibling].parent;
+			int new_parent = AllocateNode();
+
+			Node& parent_node = nodes[new_parent];
+			parent_node.parent = old_parent;
+			parent_node.aabb = Union(leaf_aabb, nodes[sibling].aabb);
+			parent_node.height = nodes[sibling].height + 1;
+			parent_node.child1 = sibling;
+			parent_node.child2 = leaf;
+
+			if(old_parent != -1)
+			{
+				if(nodes[old_parent].child1 == sibling)
+					nodes[old_parent].child1 = new_parent;
+				else
+					nodes[old_parent].child2 = new_parent;
+			}
+			else
+				root = new_parent;
+
+			nodes[sibling].parent = new_parent;
+			nodes[leaf].parent = new_parent;
+
+			Refit(new_parent);
+		}
+
+		void RemoveLeaf(int leaf)
+		{
+			if(leaf == root)
+			{
+				root = -1;
+				return;
+			}
+
+			int parent = nodes[leaf].parent;
+			int grandparent = nodes[parent].parent;
+			int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+			// the sibling takes the parent's place
+			if(grandparent != -1)
+			{
+				if(nodes[grandparent].child1 == parent)
+					nodes[grandparent].child1 = sibling;
+				else
+					nodes[grandparent].child2 = sibling;
+				nodes[sibling].parent = grandparent;
+
+				FreeNode(parent);
+				Refit(grandparent);
+			}
+			else
+			{
+				root = sibling;
+				nodes[sibling].parent = -1;
+
+				FreeNode(parent);
+			}
+		}
+
+		// recomputes the heights and AABBs of the given node and its ancestors, rebalancing along the way
+		void Refit(int index)
+		{
+			while(index != -1)
+			{
+				index = Balance(index);
+
+				Node& node = nodes[index];
+				Node& child1 = nodes[node.child1];
+				Node& child2 = nodes[node.child2];
+
+				node.height = 1 + max(child1.height, child2.height);
+				node.aabb = Union(child1.aabb, child2.aabb);
+
+				index = node.parent;
+			}
+		}
+
+		// if one child of node a is more than one level taller than the other, does a rotation; returns the index of the node which takes a's place
+		int Balance(int ia)
+		{
+			Node& a = nodes[ia];
+			if(a.IsLeaf() || a.height < 2)
+				return ia;
+
+			int ib = a.child1, ic = a.child2;
+			Node& b = nodes[ib];
+			Node& c = nodes[ic];
+
+			int balance = c.height - b.height;
+
+			if(balance > 1)
+			{
+				// rotate c up
+				int jf = c.child1, jg = c.child2;
+				Node& f = nodes[jf];
+				Node& g = nodes[jg];
+
+				c.child1 = ia;
+				c.parent = a.parent;
+				a.parent = ic;
+
+				ReplaceChild(c.parent, ia, ic);
+
+				if(f.height > g.height)
+				{
+					c.child2 = jf;
+					a.child2 = jg;
+					g.parent = ia;
+
+					a.aabb = Union(b.aabb, g.aabb);
+					c.aabb = Union(a.aabb, f.aabb);
+					a.height = 1 + max(b.height, g.height);
+					c.height = 1 + max(a.height, f.height);
+				}
+				else
+				{
+					c.child2 = jg;
+					a.child2 = jf;
+					f.parent = ia;
+
+					a.aabb = Union(b.aabb, f.aabb);
+					c.aabb = Union(a.aabb, g.aabb);
+					a.height = 1 + max(b.height, f.height);
+					c.height = 1 + max(a.height, g.height);
+				}
+
+				return ic;
+			}
+			else if(balance < -1)
+			{
+				// rotate b up
+				int jd = b.child1, je = b.child2;
+				Node& d = nodes[jd];
+				Node& e = nodes[je];
+
+				b.child1 = ia;
+				b.parent = a.parent;
+				a.parent = ib;
+
+				ReplaceChild(b.parent, ia, ib);
+
+				if(d.height > e.height)
+				{
+					b.child2 = jd;
+					a.child1 = je;
+					e.parent = ia;
+
+					a.aabb = Union(c.aabb, e.aabb);
+					b.aabb = Union(a.aabb, d.aabb);
+					a.height = 1 + max(c.height, e.height);
+					b.height = 1 + max(a.height, d.height);
+				}
+				else
+				{
+					b.child2 = je;
+					a.child1 = jd;
+					d.parent = ia;
+
+					a.aabb = Union(c.aabb, d.aabb);
+					b.aabb = Union(a.aabb, e.aabb);
+					a.height = 1 + max(c.height, d.height);
+					b.height = 1 + max(a.height, e.height);
+				}
+
+				return ib;
+			}
+
+			return ia;
+		}
+
+		void ReplaceChild(int parent, int old_child, int new_child)
+		{
+			if(parent == -1)
+				root = new_child;
+			else if(nodes[parent].child1 == old_child)
+				nodes[parent].child1 = new_child;
+			else
+				nodes[parent].child2 = new_child;
+		}
+
+
+
+		void CreateLeaf(int proxy, const Sphere& bounds)
+		{
+			int leaf = AllocateNode();
+			nodes[leaf].aabb = FatAABB(bounds);
+			nodes[leaf].proxy = proxy;
+
+			proxies[proxy].bounds = bounds;
+			proxies[proxy].leaf = leaf;
+
+			InsertLeaf(leaf);
+			++bounded_count;
+		}
+
+		void DestroyLeaf(int proxy)
+		{
+			int leaf = proxies[proxy].leaf;
+
+			RemoveLeaf(leaf);
+			FreeNode(leaf);
+
+			proxies[proxy].leaf = -1;
+			--bounded_count;
+		}
+
+		void AddUnbounded(int proxy)
+		{
+			proxies[proxy].unbounded_index = unbounded.size();
+			unbounded.push_back(proxy);
+		}
+
+		void RemoveUnbounded(int proxy)
+		{
+			int index = proxies[proxy].unbounded_index;
+
+			unbounded[index] = unbounded.back();
+			proxies[unbounded[index]].unbounded_index = index;
+			unbounded.pop_back();
+		}
+
+
+
+		// does the exact sphere tests for the leaves which straddle a frustum plane; a sphere is visible if it's not entirely behind any of the planes
+		void TestCandidates(const Plane* planes, vector<Entity*>& results)
+		{
+			unsigned int count = candidates.size();
+			if(count == 0)
+				return;
+
+			// copy the spheres into SoA form, padded to a multiple of four
+			unsigned int padded = (count + 3) & ~3;
+			cx.resize(padded);
+			cy.resize(padded);
+			cz.resize(padded);
+			cr.resize(padded);
+
+			for(unsigned int i = 0; i < count; ++i)
+			{
+				const Sphere& s = proxies[candidates[i]].bounds;
+				cx[i] = s.center.x;
+				cy[i] = s.center.y;
+				cz[i] = s.center.z;
+				cr[i] = s.radius;
+			}
+			for(unsigned int i = count; i < padded; ++i)
+				cx[i] = cy[i] = cz[i] = cr[i] = 0.0f;
+
+#ifdef VISIBILITY_TREE_SSE
+			__m128 nx[6], ny[6], nz[6], offset[6];
+			for(int p = 0; p < 6; ++p)
+			{
+				nx[p] = _mm_set1_ps(planes[p].normal.x);
+				ny[p] = _mm_set1_ps(planes[p].normal.y);
+				nz[p] = _mm_set1_ps(planes[p].normal.z);
+				offset[p] = _mm_set1_ps(planes[p].offset);
+			}
+			__m128 zero = _mm_setzero_ps();
+
+			for(unsigned int i = 0; i < padded; i += 4)
+			{
+				__m128 x = _mm_loadu_ps(&cx[i]);
+				__m128 y = _mm_loadu_ps(&cy[i]);
+				__m128 z = _mm_loadu_ps(&cz[i]);
+				__m128 r = _mm_loadu_ps(&cr[i]);
+
+				int inside = 0xF;
+				for(int p = 0; p < 6 && inside != 0; ++p)
+				{
+					// PointDistance(center) + radius > 0
+					__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, nx[p]), _mm_mul_ps(y, ny[p])), _mm_mul_ps(z, nz[p]));
+					dist = _mm_add_ps(_mm_sub_ps(dist, offset[p]), r);
+
+					inside &= _mm_movemask_ps(_mm_cmpgt_ps(dist, zero));
+				}
+
+				for(unsigned int j = 0; j < 4 && i + j < count; ++j)
+					if(inside & (1 << j))
+						results.push_back(proxies[candidates[i + j]].entity);
+			}
+#else
+			for(unsigned int i = 0; i < count; ++i)
+			{
+				bool inside = true;
+				for(int p = 0; p < 6 && inside; ++p)
+					inside = planes[p].normal.x * cx[i] + planes[p].normal.y * cy[i] + planes[p].normal.z * cz[i] - planes[p].offset + cr[i] > 0.0f;
+
+				if(inside)
+					results.push_back(proxies[candidates[i]].entity);
+			}
+#endif
+		}
+
+		void Cull(CameraView* camera, vector<Entity*>& results)
+		{
+			unsigned int first = results.size();
+
+			Plane planes[6] = { camera->GetNearPlane(), camera->GetFarPlane(), camera->GetLeftPlane(), camera->GetRightPlane(), camera->GetTopPlane(), camera->GetBottomPlane() };
+
+			candidates.clear();
+
+			// each node on the stack has a mask of the planes it still has to be tested against; once a node is completely in front of a plane, so are its children
+			if(root != -1)
+			{
+				stack.clear();
+				stack.push_back(root);
+				stack.push_back(0x3F);
+
+				while(!stack.empty())
+				{
+					int mask = stack.back();
+					stack.pop_back();
+					int index = stack.back();
+					stack.pop_back();
+
+					Node& node = nodes[index];
+
+					if(mask != 0)
+					{
+						Vec3 center = (node.aabb.min + node.aabb.max) * 0.5f;
+						Vec3 extent = (node.aabb.max - node.aabb.min) * 0.5f;
+
+						bool outside = false;
+						for(int p = 0; p < 6; ++p)
+							if(mask & (1 << p))
+							{
+								const Vec3& n = planes[p].normal;
+
+								float dist = n.x * center.x + n.y * center.y + n.z * center.z - planes[p].offset;
+								float radius = fabs(n.x) * extent.x + fabs(n.y) * extent.y + fabs(n.z) * extent.z;
+
+								if(dist + radius <= 0.0f)
+								{
+									outside = true;
+									break;
+								}
+								else if(dist - radius > 0.0f)
+									mask &= ~(1 << p);
+							}
+
+						if(outside)
+							continue;
+					}
+
+					if(node.IsLeaf())
+					{
+						if(mask == 0)
+							results.push_back(proxies[node.proxy].entity);
+						else
+							candidates.push_back(node.proxy);
+					}
+					else
+					{
+						stack.push_back(node.child1);
+						stack.push_back(mask);
+						stack.push_back(node.child2);
+						stack.push_back(mask);
+					}
+				}
+			}
+
+			TestCandidates(planes, results);
+
+			visible_count = results.size() - first;
+			culled_count = bounded_count - visible_count;
+
+			for(vector<int>::iterator iter = unbounded.begin(); iter != unbounded.end(); ++iter)
+				results.push_back(proxies[*iter].entity);
+
+			visible_count += unbounded.size();
+		}
+	};
+
+
+
+
+	/*
+	 * VisibilityTree methods
+	 */
+	float VisibilityTree::aabb_margin = 0.5f;
+
+	VisibilityTree::VisibilityTree() : imp(new Imp()) { }
+
+	void VisibilityTree::InnerDispose()
+	{
+		delete imp;
+		imp = NULL;
+	}
+
+	int VisibilityTree::Insert(Entity* entity)
+	{
+		int proxy;
+		if(imp->free_proxies.empty())
+		{
+			proxy = imp->proxies.size();
+			imp->proxies.push_back(Imp::Proxy());
+		}
+		else
+		{
+			proxy = imp->free_proxies.back();
+			imp->free_proxies.pop_back();
+		}
+
+		Imp::Proxy& p = imp->proxies[proxy];
+		p.entity = entity;
+		p.leaf = -1;
+
+		Sphere bounds;
+		if(entity->GetVisBounds(bounds))
+			imp->CreateLeaf(proxy, bounds);
+		else
+			imp->AddUnbounded(proxy);
+
+		return proxy;
+	}
+
+	void VisibilityTree::Remove(int proxy)
+	{
+		if(imp->proxies[proxy].leaf != -1)
+			imp->DestroyLeaf(proxy);
+		else
+			imp->RemoveUnbounded(proxy);
+
+		imp->proxies[proxy].entity = NULL;
+		imp->free_proxies.push_back(proxy);
+	}
+
+	void VisibilityTree::Update(int proxy)
+	{
+		Imp::Proxy& p = imp->proxies[proxy];
+
+		Sphere bounds;
+		if(!p.entity->GetVisBounds(bounds))
+		{
+			if(p.leaf != -1)
+			{
+				imp->DestroyLeaf(proxy);
+				imp->AddUnbounded(proxy);
+			}
+		}
+		else if(p.leaf == -1)
+		{
+			imp->RemoveUnbounded(proxy);
+			imp->CreateLeaf(proxy, bounds);
+		}
+		else
+		{
+			p.bounds = bounds;
+
+			// only touch the tree if the sphere has left the leaf's AABB
+			if(!Imp::ContainsSphere(imp->nodes[p.leaf].aabb, bounds))
+			{
+				int leaf = p.leaf;
+
+				imp->RemoveLeaf(leaf);
+				imp->nodes[leaf].aabb = Imp::FatAABB(bounds);
+				imp->InsertLeaf(leaf);
+			}
+		}
+	}
+
+	void VisibilityTree::Cull(CameraView* camera, vector<Entity*>& results) { imp->Cull(camera, results); }
+
+	unsigned int VisibilityTree::GetVisibleCount() { return imp->visible_count; }
+	unsigned int VisibilityTree::GetCulledCount() { return imp->culled_count; }
+}
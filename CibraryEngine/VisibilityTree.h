@@ -0,0 +1,53 @@
+#pragma once
+
+#include "StdAfx.h"
+#include "Disposable.h"
+
+namespace CibraryEngine
+{
+	using namespace std;
+
+	class Entity;
+	class CameraView;
+
+	/**
+	 * Dynamic bounding volume hierarchy of the bounding spheres of entities, used to find which entities are inside a camera's frustum
+	 *
+	 * Each entity's sphere is kept in a leaf whose AABB has some margin around it, so entities which move a little don't change the
+	 * tree at all; an entity which leaves its leaf's AABB is removed and reinserted. Entities whose GetVisBounds returns false are
+	 * never culled.
+	 */
+	class VisibilityTree : public Disposable
+	{
+		private:
+
+			struct Imp;
+			Imp* imp;
+
+		protected:
+
+			void InnerDispose();
+
+		public:
+
+			/** How far the AABB of a leaf extends beyond the entity's bounding sphere */
+			static float aabb_margin;
+
+			VisibilityTree();
+
+			/** Adds an entity to the tree, and returns a proxy index with which to refer to it in calls to Update and Remove */
+			int Insert(Entity* entity);
+			/** Removes the entity with the given proxy index from the tree */
+			void Remove(int proxy);
+			/** Calls GetVisBounds on the entity with the given proxy index, and moves it within the tree if necessary */
+			void Update(int proxy);
+
+			/** Appends to results every entity whose bounding sphere intersects the camera's frustum, as well as every entity which doesn't have a bounding sphere */
+			void Cull(CameraView* camera, vector<Entity*>& results);
+
+			/** How many entities the last call to Cull found to be visible */
+			unsigned int GetVisibleCount();
+			/** How many entities the last call to Cull found to be outside the frustum */
+			unsigned int GetCulledCount();
+	};
+}
@@ -4,37 +4,32 @@
 
 #include "DebugLog.h"
 
-#include "Entity.h"
 #include "Physics.h"
 
 namespace CibraryEngine
 {
 	bool VisionBlocker::CheckLineOfSight(PhysicsWorld* physics, Vec3 from, Vec3 to)
 	{
-		// define a callback for when a ray intersects an object
+		// define a callback for when a ray intersects an object; only VisionBlockers are in this group, so there's no need to check what was hit
 		struct : btCollisionWorld::RayResultCallback
 		{
-			float result;
+			bool blocked;
 
 			btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
 			{
-				void* void_pointer = rayResult.m_collisionObject->getUserPointer();
-				if(void_pointer != NULL)
-				{
-					VisionBlocker* vb = dynamic_cast<VisionBlocker*>((Entity*)void_pointer);
-					if(vb != NULL)
-					{
-						float frac = rayResult.m_hitFraction;
-						if(frac > result)
-							result = frac;
-					}
-				}
-				return 1;
+				// a hit right where the ray starts (e.g. the ground under a nav node) doesn't count; keep looking past it
+				if(rayResult.m_hitFraction == 0.0f)
+					return 1;
+
+				// anything else is enough; stop the test here
+				blocked = true;
+				m_closestHitFraction = 0;
+				return 0;
 			}
 		} ray_callback;
 
-		ray_callback.result = 0.0f;
-		physics->RayTest(from, to, ray_callback);				// run that function for anything on this ray...
-		return ray_callback.result == 0.0f;						// if it's still zero, that means nothing is between those two points
+		ray_callback.blocked = false;
+		physics->RayTest(from, to, ray_callback, collision_group);
+		return !ray_callback.blocked;
 	}
 }
@@ -11,6 +11,9 @@ namespace CibraryEngine
 	{
 		public:
 
+			/** Collision group bit for the rigid bodies of VisionBlockers; see the RigidBodyInfo constructor */
+			static const short collision_group = 0x40;
+
 			/**
 			 * Checks if there is line-of-sight between two points (based on VisionBlocker objects only);
 			 * Returns true if LoS is unobstructed, false otherwise
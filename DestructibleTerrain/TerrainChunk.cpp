@@ -211,7 +211,10 @@ namespace DestructibleTerrain
 		}
 
 		if(model != NULL)
-			renderer->objects.push_back(RenderNode(material, new VoxelMaterialNodeData(model, Vec3(float(chunk_x * ChunkSize), float(chunk_y * ChunkSize), float(chunk_z * ChunkSize)), main_xform * xform), 0));
+		{
+			void* node_data = renderer->frame_data.Allocate(sizeof(VoxelMaterialNodeData));
+			renderer->objects.push_back(RenderNode(material, new (node_data) VoxelMaterialNodeData(model, Vec3(float(chunk_x * ChunkSize), float(chunk_y * ChunkSize), float(chunk_z * ChunkSize)), main_xform * xform), 0));
+		}
 	}
 
 
@@ -90,7 +90,7 @@ namespace DestructibleTerrain
 		GLDEBUG(); 
 	}
 
-	void VoxelMaterial::Cleanup(RenderNode node) { delete (VoxelMaterialNodeData*)node.data; }
+	void VoxelMaterial::Cleanup(RenderNode node) { }
 
 	bool VoxelMaterial::Equals(Material* material) { return mclass_id == material->mclass_id; }
 }
@@ -2,7 +2,6 @@
 #include "Corpse.h"
 #include "Shot.h"
 #include "TestGame.h"
-#include "Particle.h"
 
 namespace Test
 {
@@ -19,14 +18,16 @@ namespace Test
 		bool GetShot(Shot* shot, Vec3 poi, Vec3 momentum)
 		{
 			if(blood_material != NULL)
+			{
+				ParticleSystem* particles = ((TestGame*)corpse->game_state)->particle_system;
 				for (int i = 0; i < 8; ++i)
 				{
-					Particle* p = new Particle(corpse->game_state, poi, Random3D::RandomNormalizedVector(Random3D::Rand(5)) + momentum * Random3D::Rand(), NULL, blood_material, Random3D::Rand(0.05f, 0.15f), 0.25f);
-					p->gravity = 9.8f;
-					p->damp = 0.05f;
+					Vec3 vel = Random3D::RandomNormalizedVector(Random3D::Rand(5)) + momentum * Random3D::Rand();
+					float radius = Random3D::Rand(0.05f, 0.15f);
 
-					corpse->game_state->Spawn(p);
+					particles->Emit(NULL, blood_material, poi, vel, radius, Random3D::Rand(float(2 * M_PI)), 0.25f, 9.8f, 0.05f);
 				}
+			}
 
 			Mat4 xform;
 			{
@@ -61,6 +62,43 @@ namespace Test
 	 */
 	struct Corpse::Imp
 	{
+		/**
+		 * How the corpse is simulated: as a full ragdoll; merged into a single rigid body, with the bones fixed in whatever pose they
+		 * were in at the time (when it's far from the camera); or frozen, as a static body (once everything has gone to sleep)
+		 */
+		enum PhysicsMode { Ragdoll, Merged, Frozen };
+
+		// distance from the camera past which a ragdoll gets merged, and within which a merged one gets split up again
+		static const float merge_distance, unmerge_distance;
+
+		// stands in for all of the bones while the corpse is merged or frozen, and wakes the ragdoll back up when shot
+		struct LODShootable : Entity, Shootable
+		{
+			Corpse::Imp* imp;
+
+			LODShootable(GameState* gs, Corpse::Imp* imp) : Entity(gs), imp(imp) { }
+
+			bool GetShot(Shot* shot, Vec3 poi, Vec3 momentum)
+			{
+				imp->Expand();
+
+				// let the nearest bone deal with it
+				unsigned int nearest = 0;
+				float nearest_dist = -1;
+				for(unsigned int i = 0; i < imp->rigid_bodies.size(); ++i)
+				{
+					float dist = (imp->rigid_bodies[i]->GetPosition() - poi).ComputeMagnitudeSquared();
+					if(nearest_dist < 0 || dist < nearest_dist)
+					{
+						nearest = i;
+						nearest_dist = dist;
+					}
+				}
+
+				return imp->shootables[nearest]->GetShot(shot, poi, momentum);
+			}
+		};
+
 		Corpse* corpse;
 
 		vector<Material*> materials;
@@ -85,6 +123,15 @@ namespace Test
 		vector<ConeTwistConstraint*> constraints;
 		vector<unsigned int> bone_indices;
 
+		PhysicsMode mode;
+		vector<btCollisionShape*> bone_shapes;
+		float total_mass;
+
+		RigidBodyInfo* lod_body;								// NULL unless merged or frozen
+		btCompoundShape* lod_shape;
+		btAlignedObjectArray<btTransform> lod_bone_xforms;		// each bone's transform relative to lod_body
+		LODShootable* lod_shootable;
+
 		// constructor with big long initializer list
 		Imp(Corpse* corpse, GameState* gs, Dood* dood, float ttl) : 
 			corpse(corpse),
@@ -99,7 +146,14 @@ namespace Test
 			physics(NULL),
 			rigid_bodies(),
 			bone_offsets(),
-			constraints()
+			constraints(),
+			mode(Ragdoll),
+			bone_shapes(),
+			total_mass(0),
+			lod_body(NULL),
+			lod_shape(NULL),
+			lod_bone_xforms(),
+			lod_shootable(NULL)
 		{
 			character->active_poses.clear();
 			dood->character = NULL;
@@ -120,6 +174,12 @@ namespace Test
 				delete shootables[i];
 			shootables.clear();
 
+			if(lod_shootable != NULL)
+			{
+				delete lod_shootable;
+				lod_shootable = NULL;
+			}
+
 			character->Dispose();
 			delete character;
 			character = NULL;
@@ -134,19 +194,40 @@ namespace Test
 			float now = time.total;
 			if (now > character_pose_time)
 			{
-				origin = rigid_bodies[0]->GetPosition();
+				// the physics world publishes every body's transform after each step
+				const RigidBodyTransforms& xforms = physics->GetTransforms();
+
+				btTransform lod_xform;
+				if(mode != Ragdoll)
+				{
+					lod_xform = ToBulletTransform(lod_body->GetPosition(), lod_body->GetOrientation());
+					origin = FromBulletTransform(lod_xform * lod_bone_xforms[0]).first;
+				}
+				else
+					origin = xforms.positions[rigid_bodies[0]->GetTransformIndex()];
 
 				// TODO: Fix this:
 				// Sometimes a bone will appear to "slip" from the joint, but in the physics debug view it shows as being in the correct place
 
 				for(unsigned int i = 0; i < rigid_bodies.size(); ++i)
 				{
-					RigidBodyInfo* body = rigid_bodies[i];
 					unsigned int bone_index = bone_indices[i];
 					Bone* bone = character->skeleton->bones[bone_index];
 
-					Quaternion rigid_body_ori = body->GetOrientation();
-					Vec3 rigid_body_pos = body->GetPosition();
+					Quaternion rigid_body_ori;
+					Vec3 rigid_body_pos;
+					if(mode != Ragdoll)
+					{
+						pair<Vec3, Quaternion> bone_xform = FromBulletTransform(lod_xform * lod_bone_xforms[i]);
+						rigid_body_pos = bone_xform.first;
+						rigid_body_ori = bone_xform.second;
+					}
+					else
+					{
+						unsigned int xform_index = rigid_bodies[i]->GetTransformIndex();
+						rigid_body_ori = xforms.orientations[xform_index];
+						rigid_body_pos = xforms.positions[xform_index];
+					}
 
 					bone->ori = rigid_body_ori;
 
@@ -167,13 +248,14 @@ namespace Test
 
 			// get bone pos/ori info
 			vector<Mat4> mats = vector<Mat4>();
+			const vector<Mat4>& bone_matrices = character->skeleton->GetBoneMatrices();
 			unsigned int count = character->skeleton->bones.size();
 			for(unsigned int i = 0; i < count; ++i)
 			{
 				Bone* bone = character->skeleton->bones[i];
 
 				bone_offsets.push_back(bone->rest_pos);
-				mats.push_back(whole_xform * bone->GetTransformationMatrix());
+				mats.push_back(whole_xform * bone_matrices[i]);
 			}
 
 			UberModel::BonePhysics** bone_physes = new UberModel::BonePhysics* [count];
@@ -201,7 +283,9 @@ namespace Test
 					btCollisionShape* shape = phys->shape;
 					if(shape != NULL)
 					{
-						RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo::FromCollisionShape(shape, phys->mass), bone_pos, bone->ori);
+						RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo::FromCollisionShape(shape, phys->mass), bone_pos, bone->ori, Shootable::collision_group);
+						bone_shapes.push_back(shape);
+						total_mass += phys->mass;
 
 						rigid_body->SetLinearVelocity(initial_vel);
 
@@ -280,11 +364,14 @@ namespace Test
 
 		void DeSpawned()
 		{
-			// clear constraints
+			DisposeLODBody();
+
+			// clear constraints; they're only in the world while the corpse is a ragdoll
 			for(unsigned int i = 0; i < constraints.size(); ++i)
 			{
 				ConeTwistConstraint* c = constraints[i];
-				physics->RemoveConstraint(c);
+				if(mode == Ragdoll)
+					physics->RemoveConstraint(c);
 
 				c->Dispose();
 				delete c;
@@ -304,27 +391,211 @@ namespace Test
 			rigid_bodies.clear();
 		}
 
+		static btTransform ToBulletTransform(const Vec3& pos, const Quaternion& ori) { return btTransform(btQuaternion(ori.x, ori.y, ori.z, ori.w), btVector3(pos.x, pos.y, pos.z)); }
+		static pair<Vec3, Quaternion> FromBulletTransform(const btTransform& xform)
+		{
+			const btVector3& origin = xform.getOrigin();
+			btQuaternion rot = xform.getRotation();
+
+			return pair<Vec3, Quaternion>(Vec3(origin.getX(), origin.getY(), origin.getZ()), Quaternion(rot.getW(), rot.getX(), rot.getY(), rot.getZ()));
+		}
+
+		// replaces the ragdoll with a single body, either dynamic (merged) or static (frozen), with the bones in their current pose
+		void Collapse(PhysicsMode new_mode)
+		{
+			// the new body goes at the centroid of the bones
+			Vec3 center;
+			Vec3 vel;
+			for(unsigned int i = 0; i < rigid_bodies.size(); ++i)
+			{
+				center += rigid_bodies[i]->GetPosition();
+				vel += rigid_bodies[i]->GetLinearVelocity();
+			}
+			center /= float(rigid_bodies.size());
+			vel /= float(rigid_bodies.size());
+
+			lod_shape = new btCompoundShape();
+			lod_bone_xforms.resize(rigid_bodies.size());
+			for(unsigned int i = 0; i < rigid_bodies.size(); ++i)
+			{
+				btTransform local = ToBulletTransform(rigid_bodies[i]->GetPosition() - center, rigid_bodies[i]->GetOrientation());
+
+				lod_bone_xforms[i] = local;
+				lod_shape->addChildShape(local, bone_shapes[i]);
+			}
+
+			for(unsigned int i = 0; i < constraints.size(); ++i)
+				physics->RemoveConstraint(constraints[i]);
+			for(unsigned int i = 0; i < rigid_bodies.size(); ++i)
+				physics->RemoveRigidBody(rigid_bodies[i]);
+
+			CreateLODBody(new_mode, center, Quaternion::Identity(), vel);
+		}
+
+		void CreateLODBody(PhysicsMode new_mode, Vec3 pos, Quaternion ori, Vec3 vel)
+		{
+			mode = new_mode;
+
+			MassInfo mass_info = mode == Merged ? MassInfo::FromCollisionShape(lod_shape, total_mass) : MassInfo();
+			lod_body = new RigidBodyInfo(lod_shape, mass_info, pos, ori, Shootable::collision_group);
+
+			if(mode == Merged)
+			{
+				lod_body->SetLinearVelocity(vel);
+
+				// same as the bones
+				lod_body->SetDamping(0.05f, 0.85f);
+				lod_body->SetDeactivationTime(0.8f);
+				lod_body->SetSleepingThresholds(1.6f, 2.5f);
+			}
+
+			lod_body->SetFriction(1.0f);
+			lod_body->SetRestitution(0.01f);
+
+			if(lod_shootable == NULL)
+				lod_shootable = new LODShootable(corpse->game_state, this);
+			lod_body->SetCustomCollisionEnabled(lod_shootable);
+
+			physics->AddRigidBody(lod_body);
+		}
+
+		// takes the merged or frozen body out of the world; the compound shape is deleted too, but not the bones' shapes in it
+		void DisposeLODBody()
+		{
+			if(lod_body != NULL)
+			{
+				physics->RemoveRigidBody(lod_body);
+
+				lod_body->Dispose();
+				delete lod_body;
+				lod_body = NULL;
+
+				lod_shape = NULL;
+			}
+		}
+
+		// a merged corpse which has gone to sleep becomes a static body, where it lies
+		void Freeze()
+		{
+			Vec3 pos = lod_body->GetPosition();
+			Quaternion ori = lod_body->GetOrientation();
+
+			physics->RemoveRigidBody(lod_body);
+			lod_body->DisposePreservingCollisionShape();
+			delete lod_body;
+
+			CreateLODBody(Frozen, pos, ori, Vec3());
+		}
+
+		// puts the ragdoll back into the world, with the bones wherever the merged or frozen body has taken them
+		void Expand()
+		{
+			if(mode == Ragdoll)
+				return;
+
+			btTransform lod_xform = ToBulletTransform(lod_body->GetPosition(), lod_body->GetOrientation());
+			Vec3 vel = mode == Merged ? lod_body->GetLinearVelocity() : Vec3();
+
+			DisposeLODBody();
+
+			for(unsigned int i = 0; i < rigid_bodies.size(); ++i)
+			{
+				RigidBodyInfo* body = rigid_bodies[i];
+				pair<Vec3, Quaternion> xform = FromBulletTransform(lod_xform * lod_bone_xforms[i]);
+
+				body->SetPosition(xform.first);
+				body->SetOrientation(xform.second);
+				body->SetLinearVelocity(vel);
+
+				physics->AddRigidBody(body);
+				body->Activate();
+			}
+			for(unsigned int i = 0; i < constraints.size(); ++i)
+				physics->AddConstraint(constraints[i], true);
+
+			mode = Ragdoll;
+		}
+
+		Vec3 GetPhysicsPosition() { return mode == Ragdoll ? rigid_bodies[0]->GetPosition() : lod_body->GetPosition(); }
+
 		void Update(TimingInfo time)
 		{
 			if(time.total > fizzle_time)
 				corpse->is_valid = false;
+
+			if(rigid_bodies.empty())
+				return;
+
+			TestGame* game = (TestGame*)corpse->game_state;
+			float dist = (GetPhysicsPosition() - game->camera_position).ComputeMagnitude();
+
+			switch(mode)
+			{
+				case Ragdoll:
+				{
+					bool all_asleep = true;
+					for(unsigned int i = 0; i < rigid_bodies.size() && all_asleep; ++i)
+						all_asleep = !rigid_bodies[i]->IsActive();
+
+					if(all_asleep)
+						Collapse(Frozen);
+					else if(dist > merge_distance)
+						Collapse(Merged);
+
+					break;
+				}
+
+				case Merged:
+				{
+					if(dist < unmerge_distance)
+						Expand();
+					else if(!lod_body->IsActive())
+						Freeze();
+
+					break;
+				}
+
+				case Frozen:
+					break;					// stays put until it gets shot
+			}
+
+			// count how many bones are simulated which way
+			unsigned int bones = rigid_bodies.size();
+			switch(mode)
+			{
+				case Ragdoll:	game->corpse_bodies_active += bones;	break;
+				case Merged:	game->corpse_bodies_merged += bones;	break;
+				case Frozen:	game->corpse_bodies_frozen += bones;	break;
+			}
 		}
 
 		void Vis(SceneRenderer* renderer)
 		{
 			PoseCharacter();
 
-			Vec3 pos = origin;
-			Sphere bs = Sphere(pos, 2.5);
+			((TestGame*)corpse->game_state)->VisUberModel(renderer, model, 0, Mat4::Translation(origin), character, &materials);
+		}
+
+		// the origin only gets updated when the corpse is drawn, so this uses the position of the root bone's rigid body instead
+		bool GetVisBounds(Sphere& bounds)
+		{
+			if(rigid_bodies.empty())
+				return false;
 
-			if(renderer->camera->CheckSphereVisibility(bs))
-				((TestGame*)corpse->game_state)->VisUberModel(renderer, model, 0, Mat4::Translation(pos), character, &materials);
+			bounds = Sphere(GetPhysicsPosition(), 2.5f);
+			return true;
 		}
 	};
 
 
 
 
+	const float Corpse::Imp::merge_distance = 40.0f;
+	const float Corpse::Imp::unmerge_distance = 30.0f;
+
+
+
+
 	/*
 	 * Corpse methods
 	 */
@@ -334,5 +605,6 @@ namespace Test
 	void Corpse::DeSpawned() { imp->DeSpawned(); }
 	void Corpse::Update(TimingInfo time) { imp->Update(time); }
 	void Corpse::Vis(SceneRenderer* renderer) { imp->Vis(renderer); }
+	bool Corpse::GetVisBounds(Sphere& bounds) { return imp->GetVisBounds(bounds); }
 	Vec3 Corpse::GetPosition() { return imp->origin; }
 }
@@ -29,6 +29,7 @@ namespace Test
 			void DeSpawned();
 
 			void Vis(SceneRenderer* renderer);
+			bool GetVisBounds(Sphere& bounds);
 
 			Vec3 GetPosition();
 	};
@@ -6,14 +6,7 @@ namespace Test
 	/*
 	 * Static stuff...
 	 */
-	Texture1D* CreateDefaultBoneMatrices()
-	{
-		vector<Mat4> matrices = vector<Mat4>();
-		matrices.push_back(Mat4::Identity());
-
-		return SkinnedCharacter::MatricesToTexture1D(matrices);
-	}
-	Texture1D* DSNMaterial::default_bone_matrices = NULL;
+	BonePalette* DSNMaterial::bone_palette = NULL;
 
 
 
@@ -30,9 +23,6 @@ namespace Test
 		normal(normal),
 		blend_style(blend_style)
 	{
-		// now would be a good time to init the default bone matrices (we have an OpenGL context, nay?)
-		if(default_bone_matrices == NULL)
-			default_bone_matrices = CreateDefaultBoneMatrices();
 	}
 
 	void DSNMaterial::InnerDispose()
@@ -98,9 +88,11 @@ namespace Test
 
 		GLDEBUG();
 
-		use_shader->SetUniform<Texture1D>("bone_matrices", default_bone_matrices);
+		// every skinned character's bones are in the same texture, so it only has to be set once
+		use_shader->SetUniform<Texture2D>("bone_palette", GetBonePalette()->GetTexture());
 
-		int bone_count = 1;
+		int bone_offset = 0, bone_count = 1;
+		use_shader->SetUniform<int>("bone_offset", &bone_offset);
 		use_shader->SetUniform<int>("bone_count", &bone_count);
 
 		ShaderProgram::SetActiveProgram(use_shader);
@@ -142,9 +134,8 @@ namespace Test
 
 	void DrawNodeData(DSNMaterialNodeData* data, ShaderProgram* use_shader)
 	{
-		use_shader->SetUniform<Texture1D>("bone_matrices", data->bone_matrices);
-
-		int bone_count = data->bone_count;
+		int bone_offset = data->bone_offset, bone_count = data->bone_count;
+		use_shader->SetUniform<int>("bone_offset", &bone_offset);
 		use_shader->SetUniform<int>("bone_count", &bone_count);
 
 		use_shader->UpdateUniforms();
@@ -154,13 +145,20 @@ namespace Test
 		GLDEBUG();
 	}
 
-	void DSNMaterial::Cleanup(RenderNode node) { delete (DSNMaterialNodeData*)node.data; }
+	void DSNMaterial::Cleanup(RenderNode node) { }
 
 	bool DSNMaterial::Equals(Material* material)
 	{
 		return mclass_id == material->mclass_id && diffuse->GetGLName() == ((DSNMaterial*)material)->diffuse->GetGLName()  && specular->GetGLName() == ((DSNMaterial*)material)->specular->GetGLName() && normal->GetGLName() == ((DSNMaterial*)material)->normal->GetGLName();
 	}
 
+	BonePalette* DSNMaterial::GetBonePalette()
+	{
+		if(bone_palette == NULL)
+			bone_palette = new BonePalette();
+		return bone_palette;
+	}
+
 
 
 
@@ -171,16 +169,16 @@ namespace Test
 		model(model),
 		xform(xform),
 		bs(bs),
-		bone_matrices(DSNMaterial::default_bone_matrices),
+		bone_offset(0),
 		bone_count(1)
 	{
 	}
 
-	DSNMaterialNodeData::DSNMaterialNodeData(VertexBuffer* model, Mat4 xform, Sphere bs, Texture1D* bone_matrices, int bone_count) :
+	DSNMaterialNodeData::DSNMaterialNodeData(VertexBuffer* model, Mat4 xform, Sphere bs, int bone_offset, int bone_count) :
 		model(model),
 		xform(xform),
 		bs(bs),
-		bone_matrices(bone_matrices),
+		bone_offset(bone_offset),
 		bone_count(bone_count)
 	{
 	}
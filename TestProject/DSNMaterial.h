@@ -13,11 +13,11 @@ namespace Test
 
 		Sphere bs;
 
-		Texture1D* bone_matrices;
+		int bone_offset;				// where the bone matrices are in DSNMaterial's bone palette
 		int bone_count;
 
 		DSNMaterialNodeData(VertexBuffer* model, Mat4 xform, Sphere bs);
-		DSNMaterialNodeData(VertexBuffer* model, Mat4 xform, Sphere bs, Texture1D* bone_matrices, int bone_count);
+		DSNMaterialNodeData(VertexBuffer* model, Mat4 xform, Sphere bs, int bone_offset, int bone_count);
 
 		void Draw();
 	};
@@ -29,6 +29,8 @@ namespace Test
 			vector<DSNMaterialNodeData*> node_data;
 			SceneRenderer* scene;
 
+			static BonePalette* bone_palette;
+
 		protected:
 
 			void InnerDispose();
@@ -54,6 +56,7 @@ namespace Test
 
 			bool Equals(Material* material);
 
-			static Texture1D* default_bone_matrices;
+			/** Gets the palette holding the bone matrices of every skinned character drawn this frame; clear it at the start of each frame */
+			static BonePalette* GetBonePalette();
 	};
 }
@@ -10,7 +10,6 @@
 #include "Shot.h"
 #include "Damage.h"
 
-#include "Particle.h"
 #include "Corpse.h"
 
 namespace Test
@@ -265,19 +264,17 @@ namespace Test
 
 		if(character != NULL)		// character will be null right when it becomes dead
 		{
-			Sphere bs = Sphere(pos, 2.5);
-			if(renderer->camera->CheckSphereVisibility(bs))
-			{
-				double dist = (renderer->camera->GetPosition() - pos).ComputeMagnitude();
-				int use_lod = dist < 45.0f ? 0 : 1;
+			double dist = (renderer->camera->GetPosition() - pos).ComputeMagnitude();
+			int use_lod = dist < 45.0f ? 0 : 1;
 
-				((TestGame*)game_state)->VisUberModel(renderer, model, use_lod, Mat4::Translation(pos), character, &materials);
-			}
+			((TestGame*)game_state)->VisUberModel(renderer, model, use_lod, Mat4::Translation(pos), character, &materials);
 		}
 	}
 
 	void Dood::VisCleanup() { }
 
+	bool Dood::GetVisBounds(Sphere& bounds) { bounds = Sphere(pos, 2.5f); return true; }
+
 	Mat4 Dood::GetViewMatrix()
 	{
 		Mat4 flip = Mat4::FromQuaternion(Quaternion::FromPYR(0, float(M_PI), 0));
@@ -342,7 +339,7 @@ namespace Test
 
 		MassInfo mass_info = MassInfo(Vec3(0, 1, 0), mass);			// point mass; has zero MoI, which Bullet treats like infinite MoI
 
-		RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, mass_info, pos);
+		RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, mass_info, pos, Quaternion::Identity(), Shootable::collision_group);
 		rigid_body->SetCustomCollisionEnabled(this);
 
 		physics->AddRigidBody(rigid_body);
@@ -401,14 +398,16 @@ namespace Test
 	void Dood::Splatter(Shot* shot, Vec3 poi, Vec3 momentum)
 	{
 		if(blood_material != NULL)
+		{
+			ParticleSystem* particles = ((TestGame*)game_state)->particle_system;
 			for (int i = 0; i < 8; ++i)
 			{
-				Particle* p = new Particle(game_state, poi, Random3D::RandomNormalizedVector(Random3D::Rand(5)) + momentum * Random3D::Rand(), NULL, blood_material, Random3D::Rand(0.05f, 0.15f), 0.25f);
-				p->gravity = 9.8f;
-				p->damp = 0.05f;
+				Vec3 vel = Random3D::RandomNormalizedVector(Random3D::Rand(5)) + momentum * Random3D::Rand();
+				float radius = Random3D::Rand(0.05f, 0.15f);
 
-				game_state->Spawn(p);
+				particles->Emit(NULL, blood_material, poi, vel, radius, Random3D::Rand(float(2 * M_PI)), 0.25f, 9.8f, 0.05f);
 			}
+		}
 	}
 
 	void Dood::Die(Damage cause)
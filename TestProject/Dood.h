@@ -74,6 +74,7 @@ namespace Test
 
 			void Vis(SceneRenderer* renderer);
 			void VisCleanup();
+			bool GetVisBounds(Sphere& bounds);
 			Mat4 GetViewMatrix();
 
 			SoundSource* PlayDoodSound(SoundBuffer* buffer, float vol, bool looping);
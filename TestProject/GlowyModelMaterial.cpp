@@ -76,7 +76,7 @@ namespace Test
 
 	void GlowyModelMaterial::Draw(RenderNode node) { ((GlowyModelMaterialNodeData*)node.data)->Draw(); }
 
-	void GlowyModelMaterial::Cleanup(RenderNode node) { delete (GlowyModelMaterialNodeData*)node.data; }
+	void GlowyModelMaterial::Cleanup(RenderNode node) { }
 
 	bool GlowyModelMaterial::Equals(Material* material)
 	{
@@ -146,19 +146,26 @@ namespace Test
 	{
 		VisCleanup();				// just in case
 
-		Sphere bs = Sphere(pos, 3);
-		if (renderer->camera->CheckSphereVisibility(bs))
-		{
-			if(gun_model != NULL)
-				((TestGame*)game_state)->VisUberModel(renderer, gun_model, 0, gun_xform, NULL, &gun_materials);
+		if(gun_model != NULL)
+			((TestGame*)game_state)->VisUberModel(renderer, gun_model, 0, gun_xform, NULL, &gun_materials);
 
-			if(mflash_model != NULL && mflash_size > 0)
-			{
-				Mat4 mflash_xform = gun_xform * Mat4::Translation(0, 0.03f, 0.5f) * Mat4::FromQuaternion(Quaternion::FromPYR(0, 0, -float(M_PI) * 0.5f)) * Mat4::UniformScale(mflash_size);
-				renderer->objects.push_back(RenderNode(mflash_material, new GlowyModelMaterialNodeData(mflash_model, mflash_xform), Vec3::Dot(renderer->camera->GetPosition(), bs.center)));
-			}
+		if(mflash_model != NULL && mflash_size > 0)
+		{
+			Mat4 mflash_xform = gun_xform * Mat4::Translation(0, 0.03f, 0.5f) * Mat4::FromQuaternion(Quaternion::FromPYR(0, 0, -float(M_PI) * 0.5f)) * Mat4::UniformScale(mflash_size);
+			void* node_data = renderer->frame_data.Allocate(sizeof(GlowyModelMaterialNodeData));
+			renderer->objects.push_back(RenderNode(mflash_material, new (node_data) GlowyModelMaterialNodeData(mflash_model, mflash_xform), Vec3::Dot(renderer->camera->GetPosition(), pos)));
 		}
 	}
 
 	void Gun::VisCleanup() { }
+
+	// pos is only set when the owner poses its character, i.e. when it's drawn, so go by the owner's position instead
+	bool Gun::GetVisBounds(Sphere& bounds)
+	{
+		if(owner == NULL)
+			return false;
+
+		bounds = Sphere(owner->pos, 3.0f);
+		return true;
+	}
 }
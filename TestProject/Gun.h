@@ -33,6 +33,7 @@ namespace Test
 
 			virtual void Vis(SceneRenderer* renderer);
 			virtual void VisCleanup();
+			virtual bool GetVisBounds(Sphere& bounds);
 
 			virtual Shot* CreateShot(Vec3 origin, Vec3 weapon_vel, Vec3 direction) = 0;
 			virtual void Fire(float total_inaccuracy, float now);
@@ -25,11 +25,13 @@ namespace Test
 		shader->AddUniform<Texture2D>(new UniformTexture2D("diffuse", 0));
 		shader->AddUniform<Texture2D>(new UniformTexture2D("specular", 1));
 		shader->AddUniform<Texture2D>(new UniformTexture2D("normal_map", 2));
-		shader->AddUniform<Texture1D>(new UniformTexture1D("bone_matrices", 4));
+		shader->AddUniform<Texture2D>(new UniformTexture2D("bone_palette", 4));
+		shader->AddUniform<int>(new UniformInt("bone_offset"));
 		shader->AddUniform<int>(new UniformInt("bone_count"));
 
 		ShaderProgram* shadow_shader = new ShaderProgram(vertex_shader, shadow_fragment_shader);
-		shadow_shader->AddUniform<Texture1D>(new UniformTexture1D("bone_matrices", 0));
+		shadow_shader->AddUniform<Texture2D>(new UniformTexture2D("bone_palette", 0));
+		shadow_shader->AddUniform<int>(new UniformInt("bone_offset"));
 		shadow_shader->AddUniform<int>(new UniformInt("bone_count"));
 
 		dsn_opaque_loader = new DSNLoader(man, shader, shadow_shader, tex_cache->Load("default-n"), tex_cache->Load("default-s"), Opaque);
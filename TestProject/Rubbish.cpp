@@ -3,7 +3,6 @@
 #include "Rubbish.h"
 #include "DSNMaterial.h"
 #include "TestGame.h"
-#include "Particle.h"
 
 namespace Test
 {
@@ -43,12 +42,13 @@ namespace Test
 	{
 		VisCleanup();				// just in case
 
-		if(renderer->camera->CheckSphereVisibility(Sphere(xform.TransformVec3(bs.center, 1.0), bs.radius)))
-			((TestGame*)game_state)->VisUberModel(renderer, model, 0, xform, NULL, &materials);
+		((TestGame*)game_state)->VisUberModel(renderer, model, 0, xform, NULL, &materials);
 	}
 
 	void Rubbish::VisCleanup() { }
 
+	bool Rubbish::GetVisBounds(Sphere& bounds) { bounds = Sphere(xform.TransformVec3(bs.center, 1.0), bs.radius); return true; }
+
 	void Rubbish::Spawned()
 	{
 		physics = game_state->physics_world;
@@ -71,7 +71,7 @@ namespace Test
 			Vec3 c = xform.TransformVec3(0, 0, 1, 0);
 			float values[] = { a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
 
-			rigid_body = new RigidBodyInfo(shape, mass_info, pos, Quaternion::FromRotationMatrix(Mat3(values)));
+			rigid_body = new RigidBodyInfo(shape, mass_info, pos, Quaternion::FromRotationMatrix(Mat3(values)), Shootable::collision_group);
 			rigid_body->SetCustomCollisionEnabled(this);
 
 			//rigid_body->SetDamping(0.05f, 0.85f);
@@ -95,15 +95,9 @@ namespace Test
 
 	bool Rubbish::GetShot(Shot* shot, Vec3 poi, Vec3 momentum)
 	{
+		ParticleSystem* particles = ((TestGame*)game_state)->particle_system;
 		for (int i = 0; i < 6; ++i)
-		{
-			Particle* p = new Particle(game_state, poi, Random3D::RandomNormalizedVector(5), dirt_particle, NULL, 0.05f, 1);
-			p->gravity = 9.8f;
-			p->damp = 2.0f;
-			p->angle = -float(M_PI) * 0.5f;
-
-			game_state->Spawn(p);
-		}
+			particles->Emit(dirt_particle, NULL, poi, Random3D::RandomNormalizedVector(5), 0.05f, -float(M_PI) * 0.5f, 1.0f, 9.8f, 2.0f);
 
 		Vec3 pos = xform.TransformVec3(0, 0, 0, 1);
 		Vec3 x_axis = xform.TransformVec3(1, 0, 0, 0);
@@ -29,6 +29,7 @@ namespace Test
 
 			void Vis(SceneRenderer* renderer);
 			void VisCleanup();
+			bool GetVisBounds(Sphere& bounds);
 
 			void Spawned();
 			void DeSpawned();
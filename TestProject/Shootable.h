@@ -11,6 +11,10 @@ namespace Test
 	class Shootable
 	{
 		public:
+
+			// Collision group bit for the rigid bodies of Shootables, so shots don't have to test anything else
+			static const short collision_group = 0x80;
+
 			// Handles how an entity responds to getting shot
 			// Return true to allow the shot to hit, false to prevent it from hitting
 			virtual bool GetShot(Shot* shot, Vec3 poi, Vec3 momentum) = 0;
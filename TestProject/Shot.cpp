@@ -5,6 +5,7 @@
 #include "Damage.h"
 #include "Shootable.h"
 #include "Dood.h"
+#include "TestGame.h"
 
 namespace Test
 {
@@ -25,6 +26,8 @@ namespace Test
 		causer(firer),
 		firer(firer),
 		mass(0.05f),
+		shot_index(0),
+		traced(false),
 		trail_head(NULL)
 	{
 	}
@@ -42,47 +45,69 @@ namespace Test
 
 		trail_head = new TrailHead(this);
 		game_state->Spawn(new BillboardTrail(game_state, trail_head, material, 0.03f));
+
+		vector<Shot*>& shots = ((TestGame*)game_state)->shots;
+		shot_index = shots.size();
+		shots.push_back(this);
+	}
+
+	void Shot::DeSpawned()
+	{
+		// move the last shot into this one's place
+		vector<Shot*>& shots = ((TestGame*)game_state)->shots;
+		Shot* last = shots.back();
+		shots[shot_index] = last;
+		last->shot_index = shot_index;
+		shots.pop_back();
 	}
 
+	RayQuery Shot::GetRay(float elapsed) { return RayQuery(pos, pos + vel * elapsed, Shootable::collision_group); }
+
 	void Shot::Update(TimingInfo time)
 	{
 		Entity::Update(time);
 
 		Vec3 end_pos = pos + vel * time.elapsed;
 
-		MyRayResultCallback callback = MyRayResultCallback(this);
-		physics->RayTest(pos, end_pos, callback);
+		// normally TestGame traces the rays of all the shots at once; if it didn't get this one, or bodies have been added or removed
+		// since, trace it now
+		TestGame* game = (TestGame*)game_state;
 
-		// sort hit objects from front to back (bubble sort... hopefully not too many objects need sorting)
-		unsigned int hits_count = callback.hits.size(); 
-		if(hits_count > 0)
+		RayBatchResult single_hits;
+		const RayBatchResult* hits = &game->shot_hits;
+		unsigned int ray = shot_index;
+		if(!traced || physics->GetBodyEditCount() != game->shot_hits_edit_count)
 		{
-			for(unsigned int i = 0; i < hits_count; ++i)
-				for(unsigned int j = 0; j < hits_count - i - 1; ++j)
-				{
-					HitObject temp = callback.hits[j];
-					if(callback.hits[j + 1].time < temp.time)
-					{
-						callback.hits[j] = callback.hits[j + 1];
-						callback.hits[j + 1] = temp;
-					}
-				}
-			for(unsigned int i = 0; i < hits_count; ++i)
+			RayQuery query = GetRay(time.elapsed);
+			physics->RayTestBatch(&query, 1, single_hits);
+
+			hits = &single_hits;
+			ray = 0;
+		}
+		traced = false;
+
+		// hits are sorted from front to back
+		for(unsigned int i = 0, hits_count = hits->GetHitCount(ray); i < hits_count; ++i)
+		{
+			const RayHit& hit = hits->GetHit(ray, i);
+			if(hit.user_object == firer)
+				continue;
+
+			Shootable* shootable = dynamic_cast<Shootable*>((Entity*)hit.user_object);
+			if(shootable == NULL)
+				continue;
+
+			Vec3 poi = pos + (end_pos - pos) * hit.fraction;
+			if(shootable->GetShot(this, poi, GetMomentum()))
 			{
-				float fraction = callback.hits[i].time;
-				Vec3 poi = pos + (end_pos - pos) * fraction;
-				Shootable* hit = callback.hits[i].obj;
-				if(hit->GetShot(this, poi, GetMomentum()))
+				if(trail_head != NULL)
 				{
-					if(trail_head != NULL)
-					{
-						trail_head->end_pos = poi;
-						trail_head->shot = NULL;
-					}
-
-					is_valid = false;
-					return;
+					trail_head->end_pos = poi;
+					trail_head->shot = NULL;
 				}
+
+				is_valid = false;
+				return;
 			}
 		}
 
@@ -123,34 +148,4 @@ namespace Test
 			return true;
 		}
 	}
-
-
-
-
-	/*
-	 * Shot::MyRayResultCallback methods
-	 */
-	Shot::MyRayResultCallback::MyRayResultCallback(Shot* shot) : shot(shot), hits() { }
-	btScalar Shot::MyRayResultCallback::addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
-	{
-		if (shot->is_valid)
-		{
-			void* void_pointer = rayResult.m_collisionObject->getUserPointer();
-			if(void_pointer != NULL)
-			{
-				Shootable* hit = dynamic_cast<Shootable*>((Entity*)void_pointer);
-				if (hit != NULL && hit != shot->firer)
-				{
-					float fraction = rayResult.m_hitFraction;
-					if(fraction >= 0 && fraction < m_closestHitFraction)
-					{
-						m_closestHitFraction = fraction;
-						m_collisionObject = rayResult.m_collisionObject;
-						hits.push_back(HitObject(hit, fraction));
-					}
-				}
-			}
-		}
-		return 1;
-	}
 }
@@ -40,9 +40,13 @@ namespace Test
 
 			float mass;
 
+			unsigned int shot_index;			// index into TestGame::shots, and of this shot's ray in TestGame::shot_hits
+			bool traced;						// whether TestGame has traced this shot's ray for the current update
+
 			Shot(GameState* gs, VertexBuffer* model, BillboardMaterial* material, Vec3 origin, Vec3 vel, Quaternion ori, Dood* firer);
 
 			void Spawned();
+			void DeSpawned();
 
 			virtual void Update(TimingInfo time);
 
@@ -61,21 +65,7 @@ namespace Test
 			};
 			TrailHead* trail_head;
 
-			struct HitObject
-			{
-				Shootable* obj;
-				float time;
-
-				HitObject(Shootable* obj, float time) : obj(obj), time(time) { }
-			};
-
-			struct MyRayResultCallback : public btCollisionWorld::RayResultCallback
-			{
-				Shot* shot;
-				vector<HitObject> hits;
-
-				MyRayResultCallback(Shot* shot);
-				btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace);
-			};
+			/** Gets the ray this shot will travel along during an update; only Shootable objects can be hit */
+			RayQuery GetRay(float elapsed);
 	};
 }
\ No newline at end of file
@@ -3,7 +3,6 @@
 
 #include "DSNMaterial.h"
 #include "TestGame.h"
-#include "Particle.h"
 #include "Rubbish.h"
 
 namespace Test
@@ -52,10 +51,10 @@ namespace Test
 	{
 		VisCleanup();				// just in case
 
-		if(renderer->camera->CheckSphereVisibility(bs))
-			((TestGame*)game_state)->VisUberModel(renderer, model, 0, Mat4::FromPositionAndOrientation(pos, ori), NULL, &materials);
+		((TestGame*)game_state)->VisUberModel(renderer, model, 0, Mat4::FromPositionAndOrientation(pos, ori), NULL, &materials);
 	}
 	void StaticLevelGeometry::VisCleanup() { }
+	bool StaticLevelGeometry::GetVisBounds(Sphere& bounds) { bounds = bs; return true; }
 
 	void StaticLevelGeometry::Spawned() 
 	{
@@ -64,7 +63,7 @@ namespace Test
 		{
 			btCollisionShape* shape = model->bone_physics[0].shape;
 
-			RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo(), pos, ori);
+			RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo(), pos, ori, StaticLevelGeometry::collision_group | Shootable::collision_group | VisionBlocker::collision_group);
 			rigid_body->SetCustomCollisionEnabled(this);
 
 			rigid_body->SetFriction(1.0f);
@@ -82,15 +81,9 @@ namespace Test
 
 	bool StaticLevelGeometry::GetShot(Shot* shot, Vec3 poi, Vec3 momentum)
 	{
+		ParticleSystem* particles = ((TestGame*)game_state)->particle_system;
 		for (int i = 0; i < 6; ++i)
-		{
-			Particle* p = new Particle(game_state, poi, Random3D::RandomNormalizedVector(5), dirt_particle, NULL, 0.05f, 1);
-			p->gravity = 9.8f;
-			p->damp = 2.0f;
-			p->angle = -float(M_PI) * 0.5f;
-
-			game_state->Spawn(p);
-		}
+			particles->Emit(dirt_particle, NULL, poi, Random3D::RandomNormalizedVector(5), 0.05f, -float(M_PI) * 0.5f, 1.0f, 9.8f, 2.0f);
 
 //		game_state->Spawn(new Rubbish(game_state, ((TestGame*)game_state)->ubermodel_cache->Load("dummycube"), poi + Vec3(0, 0.5f, 0), Quaternion::FromPYR(0, Random3D::Rand(2.0 * M_PI), 0), dirt_particle));
 
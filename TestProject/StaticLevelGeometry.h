@@ -14,6 +14,9 @@ namespace Test
 
 		public:
 
+			// Collision group bit for level geometry, i.e. the ground; hides the Shootable and VisionBlocker bits, which it also has
+			static const short collision_group = 0x100;
+
 			UberModel* model;
 			vector<Material*> materials;
 			ParticleMaterial* dirt_particle;
@@ -30,6 +33,7 @@ namespace Test
 
 			void Vis(SceneRenderer* renderer);
 			void VisCleanup();
+			bool GetVisBounds(Sphere& bounds);
 
 			void Spawned();
 			void DeSpawned();
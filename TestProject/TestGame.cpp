@@ -11,6 +11,7 @@
 #include "GlowyModelMaterial.h"
 #include "Sun.h"
 #include "Weapon.h"
+#include "Shot.h"
 
 #include "ConverterWhiz.h"
 
@@ -143,6 +144,11 @@ namespace Test
 		RenderTarget* render_target;
 		RenderTarget* shadow_render_target;
 
+		// reused every frame, so its render queue doesn't have to be reallocated
+		SceneRenderer renderer;
+		// the entities which passed frustum culling this frame
+		vector<Entity*> visible_entities;
+
 		ShaderProgram* deferred_ambient;
 		ShaderProgram* deferred_lighting;
 
@@ -156,7 +162,9 @@ namespace Test
 			player_damage_handler(),
 			alive(true),
 			render_target(NULL),
-			shadow_render_target(NULL)
+			shadow_render_target(NULL),
+			renderer(NULL),
+			visible_entities()
 		{
 		}
 
@@ -292,6 +300,18 @@ namespace Test
 		chapter_text(),
 		chapter_sub_text(),
 		nav_graph(0),
+		nav_hierarchy(NULL),
+		path_workers(NULL),
+		update_workers(NULL),
+		particle_system(new ParticleSystem()),
+		shots(),
+		shot_rays(),
+		shot_hits(),
+		shot_hits_edit_count(0),
+		camera_position(),
+		corpse_bodies_active(0),
+		corpse_bodies_merged(0),
+		corpse_bodies_frozen(0),
 		tex2d_cache(screen->window->content->GetCache<Texture2D>()),
 		vtn_cache(screen->window->content->GetCache<VertexBuffer>()),
 		ubermodel_cache(screen->window->content->GetCache<UberModel>()),
@@ -307,6 +327,17 @@ namespace Test
 
 		physics_world->SetDebugDrawer(&debug_renderer);
 		debug_renderer.setDebugMode(btIDebugDraw::DBG_DrawWireframe | btIDebugDraw::DBG_DrawConstraints);
+
+		// leave a core for the main thread; with only one core, searches get run during Update instead
+		unsigned int cores = boost::thread::hardware_concurrency();
+		path_workers = new PathWorkerPool(cores > 1 ? cores - 1 : 0);
+		PathService::SetWorkerPool(path_workers);
+
+		update_workers = new TaskPool(cores > 1 ? cores - 1 : 0);
+		update_pool = update_workers;
+
+		// ragdolls are separate simulation islands and could be solved in parallel with SetSolverThreads, but that needs a Bullet
+		// built with BT_NO_PROFILE; the physics world's default of 0 solver threads is kept until the project is set up for that
 	}
 
 	void TestGame::Load()
@@ -590,10 +621,15 @@ namespace Test
 #define NGDEBUG() DebugNavGraphError(__LINE__, __FILE__)
 
 	string script_string;
+	// how long the path workers may spend on searches each frame
+	const float path_budget_ms = 2.0f;
+
 	void TestGame::Update(TimingInfo time)
 	{
 		NGDEBUG();
 
+		path_workers->Update(path_budget_ms);
+
 		float elapsed = min((float)time.elapsed, 0.1f);
 		total_game_time += elapsed;
 		elapsed_game_time = elapsed;
@@ -605,7 +641,11 @@ namespace Test
 		if(elapsed > 0)
 		{
 			stringstream fps_counter_ss;
-			fps_counter_ss << "FPS = " << (int)(1.0 / time.elapsed);
+			fps_counter_ss << "FPS = " << (int)(1.0 / time.elapsed) << "; entities visible = " << vis_tree->GetVisibleCount() << ", culled = " << vis_tree->GetCulledCount() << "; particles = " << particle_system->GetParticleCount();
+
+			const PhysicsStepStats& physics_stats = physics_world->GetStepStats();
+			fps_counter_ss << "; physics substeps = " << physics_stats.substeps << " (" << physics_stats.dropped_steps << " dropped), " << physics_stats.step_ms << " ms, solver = " << physics_stats.solver_ms << " ms";
+			fps_counter_ss << "; corpse bones active = " << corpse_bodies_active << ", merged = " << corpse_bodies_merged << ", frozen = " << corpse_bodies_frozen;
 			debug_text = fps_counter_ss.str();
 		}
 
@@ -613,7 +653,22 @@ namespace Test
 			GetFileString("Files/Scripts/update.lua", &script_string);
 		ScriptSystem::GetGlobalState().DoString(script_string);
 
+		// nothing moves until the physics step, so the shots can be traced ahead of time, all together; but bodies may still be added or
+		// removed before a shot updates (e.g. an earlier shot spawns or wakes a corpse), in which case Shot::Update traces it again
+		shot_hits_edit_count = physics_world->GetBodyEditCount();
+		shot_rays.resize(shots.size());
+		for(unsigned int i = 0; i < shots.size(); ++i)
+		{
+			shot_rays[i] = shots[i]->GetRay(elapsed);
+			shots[i]->traced = true;
+		}
+		if(!shot_rays.empty())
+			physics_world->RayTestBatch(&shot_rays[0], shot_rays.size(), shot_hits, update_pool);
+
+		corpse_bodies_active = corpse_bodies_merged = corpse_bodies_frozen = 0;
+
 		GameState::Update(clamped_time);
+		particle_system->Update(clamped_time);
 		ik_solver->Update(clamped_time);
 
 		NGDEBUG();
@@ -644,6 +699,8 @@ namespace Test
 		Mat4 proj_t = camera.GetProjectionMatrix().Transpose();
 		Mat4 view_t = camera.GetViewMatrix().Transpose();
 
+		camera_position = camera.GetPosition();
+
 		// TODO: find a better place for this sound-related code?
 		sound_system->SetListenerPos(-camera.GetViewMatrix().TransformVec3(0, 0, 0, 1));
 		sound_system->SetListenerUp(camera.GetViewMatrix().TransformVec3(0, 1, 0, 0));
@@ -697,10 +754,19 @@ namespace Test
 			imp->sun->view_matrix = camera.GetViewMatrix();
 			imp->DrawBackground(camera.GetViewMatrix().Transpose());
 
-			SceneRenderer renderer(&camera);
+			SceneRenderer& renderer = imp->renderer;
+			renderer.camera = &camera;
+
+			vector<Entity*>& visible_entities = imp->visible_entities;
+			visible_entities.clear();
+			vis_tree->Cull(&camera, visible_entities);
 
-			for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+			// the skinned characters' bone matrices are added as they're vis'd
+			DSNMaterial::GetBonePalette()->Clear();
+
+			for(vector<Entity*>::iterator iter = visible_entities.begin(); iter != visible_entities.end(); ++iter)
 				(*iter)->Vis(&renderer);
+			particle_system->Vis(&renderer);
 			renderer.lights.push_back(imp->sun);
 
 			renderer.BeginRender();
@@ -783,7 +849,7 @@ namespace Test
 			renderer.RenderTranslucent();
 			GLDEBUG();
 
-			for(list<Entity*>::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+			for(vector<Entity*>::iterator iter = visible_entities.begin(); iter != visible_entities.end(); ++iter)
 				(*iter)->VisCleanup();
 
 			renderer.Cleanup();
@@ -890,24 +956,17 @@ namespace Test
 
 	float TestGame::GetTerrainHeight(float x, float z)
 	{
-		// define a callback for when a ray intersects an object
+		// define a callback for when a ray intersects an object; only level geometry gets this far
 		struct : btCollisionWorld::RayResultCallback
 		{
 			float result;
 
 			btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
 			{
-				void* void_pointer = rayResult.m_collisionObject->getUserPointer();
-				if(void_pointer != NULL)
-				{
-					StaticLevelGeometry* slg = dynamic_cast<StaticLevelGeometry*>((Entity*)void_pointer);
-					if(slg != NULL)
-					{
-						float frac = rayResult.m_hitFraction;
-						if(frac > result)
-							result = frac;
-					}
-				}
+				float frac = rayResult.m_hitFraction;
+				if(frac > result)
+					result = frac;
+
 				return 1;
 			}
 		} ray_callback;
@@ -916,7 +975,7 @@ namespace Test
 
 		// run that function for anything on this ray...
 		float top = 1000;
-		physics_world->RayTest(Vec3(x, 0, z), Vec3(x, top, z), ray_callback);
+		physics_world->RayTest(Vec3(x, 0, z), Vec3(x, top, z), ray_callback, StaticLevelGeometry::collision_group);
 
 		if(ray_callback.result >= 0)
 			return ray_callback.result * top;
@@ -940,10 +999,41 @@ namespace Test
 			hud = NULL;
 		}
 
+		if(nav_hierarchy != NULL)
+		{
+			nav_hierarchy->Dispose();
+			delete nav_hierarchy;
+			nav_hierarchy = NULL;
+		}
+
+		if(path_workers != NULL)
+		{
+			path_workers->Dispose();
+			delete path_workers;
+			path_workers = NULL;
+		}
+
+		if(update_workers != NULL)
+		{
+			update_pool = NULL;
+
+			update_workers->Dispose();
+			delete update_workers;
+			update_workers = NULL;
+		}
+
+		if(particle_system != NULL)
+		{
+			delete particle_system;
+			particle_system = NULL;
+		}
+
 		if(nav_graph != 0)
 		{
 			NavGraph::DeleteNavGraph(nav_graph);
 			nav_graph = 0;
+
+			PathService::ClearCache();
 		}		
 
 		GameState::InnerDispose();
@@ -980,6 +1070,14 @@ namespace Test
 
 		vector<MaterialModelPair>* mmps = use_lod->GetVBOs();
 
+		// all of the parts share the same bone matrices
+		int bone_offset = 0, bone_count = 1;
+		if(character != NULL)
+		{
+			bone_offset = DSNMaterial::GetBonePalette()->Add(character->skeleton->GetBoneMatrices());
+			bone_count = character->skeleton->bones.size();
+		}
+
 		for(vector<MaterialModelPair>::iterator iter = mmps->begin(); iter != mmps->end(); ++iter)
 		{
 			MaterialModelPair& mmp = *iter;
@@ -989,12 +1087,12 @@ namespace Test
 
 			if(character != NULL)
 			{
-				DSNMaterialNodeData* node_data = new DSNMaterialNodeData(vbo, xform, bs, character->GetBoneMatrices(), character->skeleton->bones.size());
+				DSNMaterialNodeData* node_data = new (renderer->frame_data.Allocate(sizeof(DSNMaterialNodeData))) DSNMaterialNodeData(vbo, xform, bs, bone_offset, bone_count);
 				renderer->objects.push_back(RenderNode(material, node_data, Vec3::Dot(renderer->camera->GetForward(), bs.center)));
 			}
 			else
 			{
-				DSNMaterialNodeData* node_data = new DSNMaterialNodeData(vbo, xform, bs);
+				DSNMaterialNodeData* node_data = new (renderer->frame_data.Allocate(sizeof(DSNMaterialNodeData))) DSNMaterialNodeData(vbo, xform, bs);
 				renderer->objects.push_back(RenderNode(material, node_data, Vec3::Dot(renderer->camera->GetForward(), bs.center)));
 			}
 		}
@@ -1012,6 +1110,8 @@ namespace Test
 	int gs_setNavEditMode(lua_State* L);
 	int gs_setDebugDrawMode(lua_State* L);
 	int gs_newPathSearch(lua_State* L);
+	int gs_newHierarchicalPathSearch(lua_State* L);
+	int gs_getPathStats(lua_State* L);
 	int gs_checkLineOfSight(lua_State* L);
 
 	void TestGame::SetupScripting(ScriptingState& state)
@@ -1068,6 +1168,14 @@ namespace Test
 		lua_pushcclosure(L, gs_newPathSearch, 1);
 		lua_setfield(L, 1, "newPathSearch");
 
+		lua_pushlightuserdata(L, (void*)this);
+		lua_pushcclosure(L, gs_newHierarchicalPathSearch, 1);
+		lua_setfield(L, 1, "newHierarchicalPathSearch");
+
+		lua_pushlightuserdata(L, (void*)this);
+		lua_pushcclosure(L, gs_getPathStats, 1);
+		lua_setfield(L, 1, "getPathStats");
+
 		lua_pushlightuserdata(L, (void*)this);
 		lua_pushcclosure(L, gs_checkLineOfSight, 1);
 		lua_setfield(L, 1, "checkLineOfSight");
@@ -1392,7 +1500,7 @@ namespace Test
 	const float min_ceiling_height = 2.0f;
 	vector<float> GetNavGraphHeights(TestGame* game, float x, float z)
 	{
-		// define a callback for when a ray intersects an object
+		// define a callback for when a ray intersects an object; only level geometry gets this far
 		list<float> results;
 		struct : btCollisionWorld::RayResultCallback
 		{
@@ -1400,13 +1508,7 @@ namespace Test
 
 			btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace)
 			{
-				void* void_pointer = rayResult.m_collisionObject->getUserPointer();
-				if(void_pointer != NULL)
-				{
-					StaticLevelGeometry* slg = dynamic_cast<StaticLevelGeometry*>((Entity*)void_pointer);
-					if(slg != NULL)
-						results->push_back(rayResult.m_hitFraction);
-				}
+				results->push_back(rayResult.m_hitFraction);
 				return 1;
 			}
 		} ray_callback;
@@ -1415,7 +1517,7 @@ namespace Test
 
 		// run that function for anything on this ray...
 		float top = 1000;
-		game->physics_world->RayTest(Vec3(x, 0, z), Vec3(x, top, z), ray_callback);
+		game->physics_world->RayTest(Vec3(x, 0, z), Vec3(x, top, z), ray_callback, StaticLevelGeometry::collision_group);
 
 		results.sort();
 		results.reverse();
@@ -1447,18 +1549,22 @@ namespace Test
 		return false;
 	}
 
+	// layout of the grid of nav nodes generated by BuildNavGraph
+	const unsigned int grid_res = 50;
+	const float grid_min = -98.0f, grid_max = 98.0f, grid_size = grid_max - grid_min;
+	const float grid_coeff = grid_size / grid_res;
+
+	// each NavHierarchy cluster covers this many columns of the nav grid on a side
+	const unsigned int nav_cluster_res = 8;
+
 	unsigned int BuildNavGraph(TestGame* test_game)
 	{
 		unsigned int graph = NavGraph::NewNavGraph(test_game);
 
-		const unsigned int grid_res = 50;
 		const unsigned int grm1 = grid_res - 1;
 
 		vector<unsigned int>* nodes = new vector<unsigned int>[grid_res * grid_res];
 
-		const float grid_min = -98.0f, grid_max = 98.0f, grid_size = grid_max - grid_min;
-		const float grid_coeff = grid_size / grid_res;
-
 		// place all of the nodes
 		for(unsigned int i = 0; i < grid_res; ++i)
 		{
@@ -1538,6 +1644,73 @@ namespace Test
 		return 0;
 	}
 
+	int gs_getPathStats(lua_State* L)
+	{
+		int n = lua_gettop(L);
+		if(n == 0)
+		{
+			PathService::Stats stats = PathService::GetStats();
+
+			lua_newtable(L);							// push; top = 1
+
+			lua_pushnumber(L, stats.requests);
+			lua_setfield(L, 1, "requests");
+			lua_pushnumber(L, stats.cache_hits);
+			lua_setfield(L, 1, "cache_hits");
+			lua_pushnumber(L, stats.shared_hits);
+			lua_setfield(L, 1, "shared_hits");
+			lua_pushnumber(L, stats.flow_field_hits);
+			lua_setfield(L, 1, "flow_field_hits");
+			lua_pushnumber(L, stats.misses);
+			lua_setfield(L, 1, "misses");
+			lua_pushnumber(L, stats.flow_fields_built);
+			lua_setfield(L, 1, "flow_fields_built");
+
+			return 1;
+		}
+
+		Debug("gs.getPathStats doesn't take any arguments; returning nil\n");
+		return 0;
+	}
+
+	NavHierarchy* TestGame::GetNavHierarchy()
+	{
+		// searches which are still using the old hierarchy keep it alive, and fall back to plain A* since it's stale
+		if(nav_hierarchy != NULL && (nav_hierarchy->IsStale() || nav_hierarchy->GetGraph() != nav_graph))
+		{
+			nav_hierarchy->Dispose();
+			delete nav_hierarchy;
+			nav_hierarchy = NULL;
+		}
+
+		// clusters line up with the columns of the grid BuildNavGraph makes; the origin is offset by half a column so nodes aren't right on the boundaries
+		if(nav_hierarchy == NULL && nav_graph != 0)
+			nav_hierarchy = new NavHierarchy(nav_graph, grid_coeff * nav_cluster_res, Vec3(grid_min - grid_coeff * 0.5f, 0, grid_min - grid_coeff * 0.5f));
+
+		return nav_hierarchy;
+	}
+
+	int gs_newHierarchicalPathSearch(lua_State* L)
+	{
+		int n = lua_gettop(L);
+		if(n == 2)
+		{
+			TestGame* game_state = (TestGame*)lua_touserdata(L, lua_upvalueindex(1));
+			LuaNavNode* a = (LuaNavNode*)lua_touserdata(L, 1);
+			LuaNavNode* b = (LuaNavNode*)lua_touserdata(L, 2);
+
+			if(a->graph == b->graph && a->graph == game_state->nav_graph)
+			{
+				PushHierarchicalPathSearchHandle(L, game_state->GetNavHierarchy(), a->node, b->node);
+
+				return 1;
+			}
+		}
+		
+		Debug("gs.newHierarchicalPathSearch takes exactly 2 arguments, nav points on the game's nav graph; returning nil\n");
+		return 0;
+	}
+
 	/*
 	 * NavGraph Pathfinding function! Uses A* (in theory)
 	 */
@@ -1545,6 +1718,10 @@ namespace Test
 	{
 		PathSearch search(graph, source, target);
 		search.Solve();
-		return search.GetSolution();
+
+		list<unsigned int> result = search.GetSolution();
+		search.Dispose();
+
+		return result;
 	}
 }
@@ -15,6 +15,7 @@ namespace Test
 	class DSNMaterial;
 	class GlowyModelMaterial;
 	class Sun;
+	class Shot;
 
 	class TestGame : public GameState
 	{
@@ -53,6 +54,24 @@ namespace Test
 			string chapter_text, chapter_sub_text;
 
 			unsigned int nav_graph;
+			NavHierarchy* nav_hierarchy;				// built the first time a script asks for a hierarchical path search
+
+			NavHierarchy* GetNavHierarchy();
+
+			PathWorkerPool* path_workers;				// runs the path searches scripts start, in the background
+			TaskPool* update_workers;					// updates the thread-safe entities (trails) in parallel
+
+			ParticleSystem* particle_system;			// blood and dirt thrown up by gunshots
+
+			vector<Shot*> shots;						// shots in flight; their rays are all traced at once, before the entities update
+			vector<RayQuery> shot_rays;
+			RayBatchResult shot_hits;
+			unsigned int shot_hits_edit_count;			// PhysicsWorld::GetBodyEditCount when shot_hits was traced
+
+			Vec3 camera_position;						// as of the last Draw; corpses far from it get simplified physics
+
+			// how many corpse bones are simulated as ragdolls, merged into one body per corpse, or frozen in place; counted by the corpses each update
+			unsigned int corpse_bodies_active, corpse_bodies_merged, corpse_bodies_frozen;
 
 			Cache<Texture2D>* tex2d_cache;
 			Cache<VertexBuffer>* vtn_cache;
@@ -14,7 +14,7 @@ namespace Test
 	{
 		btStaticPlaneShape* shape = new btStaticPlaneShape(btVector3(plane.normal.x, plane.normal.y, plane.normal.z), 0);
 
-		RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo(), Vec3(plane.normal * plane.offset));
+		RigidBodyInfo* rigid_body = new RigidBodyInfo(shape, MassInfo(), Vec3(plane.normal * plane.offset), Quaternion::Identity(), Shootable::collision_group);
 		rigid_body->SetCustomCollisionEnabled(this);
 
 		rigid_body->SetFriction(0);
@@ -0,0 +1,81 @@
+#include "../CibraryEngine/StdAfx.h"
+#include "../CibraryEngine/SkeletalAnimation.h"
+#include "../CibraryEngine/Matrix.h"
+
+/*
+ * Checks SkinnedCharacter::PackMatrices (SSE or scalar, whichever this is built with) against the byte layout
+ * MatricesToTexture1D used to produce, with ordinary values, values exactly halfway between two steps, values past
+ * the ends of the 16-bit range, infinities and NaN. Returns nonzero if any byte differs
+ */
+using namespace CibraryEngine;
+using namespace std;
+
+namespace
+{
+	// how MatricesToTexture1D used to encode each matrix, before PackMatrices
+	void ReferencePack(const vector<Mat4>& matrices, unsigned char* target)
+	{
+		for(unsigned int i = 0; i < matrices.size(); ++i)
+		{
+			const Mat4& mat = matrices[i];
+			for(unsigned int j = 0; j < 12; ++j)
+			{
+				float val = mat.values[j];
+				float expanded = val * 4096.0f + 32768.0f;
+
+				unsigned int int_val = (unsigned int)(max(0.0, min(65535.0, expanded + 0.5)));
+				for(int k = 0; k < 2; ++k)
+					*(target++) = (unsigned char)((int_val & (0xFF << (k * 8))) >> (k * 8));
+			}
+		}
+	}
+
+	unsigned int rng_state = 12345;
+	unsigned int NextRandom() { rng_state = rng_state * 1664525 + 1013904223; return rng_state >> 8; }
+	float NextFloat(float min, float max) { return min + (max - min) * (NextRandom() & 0xFFFF) / 65536.0f; }
+
+	float NextValue()
+	{
+		static const float zero = 0.0f;
+		static const float special[] =
+		{
+			zero / zero, 1.0f / zero, -1.0f / zero,					// NaN and infinities
+			8.0f, -8.0f, 7.99987793f, -8.0001f, 1e30f, -1e30f,		// at and past the ends of the range
+			0.0f, -0.0f, 1.0f, -1.0f
+		};
+
+		switch(NextRandom() % 4)
+		{
+			case 0:		return special[NextRandom() % (sizeof(special) / sizeof(float))];
+			case 1:		return float(int(NextRandom() % 131072) - 65536) / 8192.0f;		// exactly halfway between two steps, half the time
+			case 2:		return NextFloat(-20.0f, 20.0f);
+			default:	return NextFloat(-2.0f, 2.0f);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int matrix_count = 100000;
+
+	vector<Mat4> matrices(matrix_count);
+	for(unsigned int i = 0; i < matrix_count; ++i)
+		for(unsigned int j = 0; j < 16; ++j)
+			matrices[i].values[j] = NextValue();
+
+	vector<unsigned char> packed(matrix_count * 24), reference(matrix_count * 24);
+	SkinnedCharacter::PackMatrices(&matrices[0], matrix_count, &packed[0]);
+	ReferencePack(matrices, &reference[0]);
+
+	unsigned int mismatches = 0;
+	for(unsigned int i = 0; i < packed.size(); ++i)
+		if(packed[i] != reference[i])
+		{
+			if(mismatches < 10)
+				printf("byte %u differs: %u instead of %u (value %g)\n", i, packed[i], reference[i], matrices[i / 24].values[(i % 24) / 2]);
+			++mismatches;
+		}
+
+	printf("%u of %u bytes differ\n", mismatches, packed.size());
+	return mismatches == 0 ? 0 : 1;
+}
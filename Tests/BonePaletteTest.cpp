@@ -0,0 +1,96 @@
+#include "../CibraryEngine/StdAfx.h"
+#include "../CibraryEngine/SkeletalAnimation.h"
+#include "../CibraryEngine/Matrix.h"
+#include "../CibraryEngine/Texture2D.h"
+
+/*
+ * Checks BonePalette on the CPU side (nothing is uploaded): offset 0 holds the identity matrix, each Add returns the
+ * offset just past the one before, the packed bytes at each offset are what SkinnedCharacter::PackMatrices makes of
+ * those matrices, growing the texture keeps what was added before, and Clear starts over without giving up the texture.
+ * Returns nonzero if any check fails
+ */
+using namespace CibraryEngine;
+using namespace std;
+
+namespace
+{
+	unsigned int failures = 0;
+
+	void Check(bool ok, const char* what)
+	{
+		if(!ok)
+		{
+			printf("FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	vector<Mat4> MakeMatrices(unsigned int count, unsigned int seed)
+	{
+		vector<Mat4> matrices(count);
+		for(unsigned int i = 0; i < count; ++i)
+			for(unsigned int j = 0; j < 16; ++j)
+				matrices[i].values[j] = float((seed * 31 + i * 7 + j) % 200) * 0.01f - 1.0f;
+		return matrices;
+	}
+
+	bool PackedAt(BonePalette& palette, unsigned int offset, const vector<Mat4>& matrices)
+	{
+		vector<unsigned char> expected(matrices.size() * 24);
+		SkinnedCharacter::PackMatrices(&matrices[0], matrices.size(), &expected[0]);
+
+		return memcmp(palette.GetData() + offset * 24, &expected[0], expected.size()) == 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BonePalette palette;
+
+	vector<Mat4> identity(1, Mat4::Identity());
+	Check(palette.GetCount() == 1, "a new palette holds only the identity matrix");
+	Check(PackedAt(palette, 0, identity), "offset 0 is the identity matrix");
+
+	Check(palette.Add(vector<Mat4>()) == 1 && palette.GetCount() == 1, "adding no matrices changes nothing");
+
+	// enough characters that the texture has to grow partway through
+	const unsigned int characters = 30, bones = 40;
+	int first_height = palette.GetTexture()->height;
+
+	vector<vector<Mat4> > added;
+	vector<unsigned int> offsets;
+	for(unsigned int i = 0; i < characters; ++i)
+	{
+		added.push_back(MakeMatrices(bones, i));
+		offsets.push_back(palette.Add(added.back()));
+	}
+
+	bool sequential = true, packed = true;
+	for(unsigned int i = 0; i < characters; ++i)
+	{
+		sequential &= offsets[i] == 1 + i * bones;
+		packed &= PackedAt(palette, offsets[i], added[i]);
+	}
+	Check(sequential, "each Add returns the offset just past the one before");
+	Check(packed, "each character's matrices are packed at its offset, after the texture grows");
+	Check(PackedAt(palette, 0, identity), "growing keeps the identity matrix at offset 0");
+	Check(palette.GetCount() == 1 + characters * bones, "the count includes every matrix added");
+
+	Texture2D* texture = palette.GetTexture();
+	Check(texture->height > first_height, "the texture grew when it ran out of room");
+	Check((unsigned int)texture->width == BonePalette::width && (unsigned int)texture->height * BonePalette::width >= palette.GetCount() * 6, "the texture is big enough for every matrix");
+
+	// the next frame
+	palette.Clear();
+	Check(palette.GetCount() == 1, "Clear leaves only the identity matrix");
+	Check(PackedAt(palette, 0, identity), "Clear puts the identity matrix back at offset 0");
+
+	vector<Mat4> again = MakeMatrices(bones, 99);
+	Check(palette.Add(again) == 1 && PackedAt(palette, 1, again), "after Clear, offsets start over at 1");
+	Check(palette.GetTexture() == texture, "Clear keeps the texture, so it isn't reallocated every frame");
+
+	palette.Dispose();
+
+	printf("%u checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#include "../CibraryEngine/StdAfx.h"
+#include "../CibraryEngine/GameState.h"
+#include "../CibraryEngine/Entity.h"
+#include "../CibraryEngine/TaskPool.h"
+
+/*
+ * Checks that GameState::Update gives the same results whether its parallel update stages run on the main thread or are
+ * divided among a TaskPool's threads. A fixed-seed population of entities is simulated for 600 frames: leaders (stage 0,
+ * updated serially) wander around; followers (stage 1) chase a leader, and every so often ask for a MergeUpdate, in which
+ * they either die and spawn two more followers, or pick a new leader; watchers (stage 2) keep a running total of a
+ * follower's position, and pick a new one in MergeUpdate when theirs is gone. All of the randomness comes from one
+ * generator which is only used on the main thread. This is done with update_pool NULL, and with pools of 0, 1 and 4
+ * threads, and the state of every entity that ever existed has to come out bit-for-bit the same. Returns nonzero if any
+ * check fails
+ */
+using namespace CibraryEngine;
+using namespace std;
+
+namespace
+{
+	const unsigned int leader_count = 20;
+	const unsigned int follower_count = 2000;
+	const unsigned int watcher_count = 500;
+	const unsigned int max_followers = 4000;
+	const unsigned int frames = 600;
+
+	unsigned int failures = 0;
+
+	void Check(bool ok, const char* what)
+	{
+		if(!ok)
+		{
+			printf("FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	// an entity's id and state, as of when it was despawned
+	struct Record
+	{
+		unsigned int id;
+		unsigned int type;
+		float values[4];
+		bool is_valid;
+
+		bool operator ==(const Record& other) const { return id == other.id && type == other.type && is_valid == other.is_valid && memcmp(values, other.values, sizeof(values)) == 0; }
+	};
+
+	class Leader;
+	class Follower;
+
+	// everything one run shares, which is only touched on the main thread
+	struct World
+	{
+		GameState* game_state;
+
+		unsigned int rng_state;
+		unsigned int next_id;
+
+		vector<Leader*> leaders;
+		vector<EntityHandle> followers;			// not necessarily still alive
+		vector<Follower*> spawned;				// followers spawned during the current Update, which don't have handles yet
+		unsigned int live_followers;
+
+		map<unsigned int, Record> records;
+
+		World(GameState* game_state) : game_state(game_state), rng_state(12345), next_id(0), leaders(), followers(), spawned(), live_followers(0), records() { }
+
+		unsigned int NextRandom() { rng_state = rng_state * 1664525 + 1013904223; return rng_state >> 8; }
+		float NextRandom(float min, float max) { return min + (max - min) * (NextRandom() & 0xFFFF) / 65536.0f; }
+
+		void Spawn(Entity* e);
+	};
+
+	class TestEntity : public Entity
+	{
+		public:
+
+			World* world;
+			unsigned int id, type;
+			float values[4];
+
+			TestEntity(World* world, unsigned int type, unsigned int stage) : Entity(world->game_state), world(world), id(world->next_id++), type(type)
+			{
+				update_stage = stage;
+				for(unsigned int i = 0; i < 4; ++i)
+					values[i] = 0.0f;
+			}
+
+			void DeSpawned()
+			{
+				Record record;
+				record.id = id;
+				record.type = type;
+				memcpy(record.values, values, sizeof(values));
+				record.is_valid = is_valid;
+
+				world->records[id] = record;
+			}
+	};
+
+	// values: x, y, speed, phase
+	class Leader : public TestEntity
+	{
+		public:
+
+			Leader(World* world) : TestEntity(world, 0, 0)
+			{
+				values[0] = world->NextRandom(-100, 100);
+				values[1] = world->NextRandom(-100, 100);
+				values[2] = world->NextRandom(1, 10);
+				values[3] = world->NextRandom(0, 6.283f);
+			}
+
+			void Update(TimingInfo time)
+			{
+				values[0] += values[2] * cosf(time.total * 0.7f + values[3]) * time.elapsed;
+				values[1] += values[2] * sinf(time.total * 0.3f + values[3]) * time.elapsed;
+			}
+	};
+
+	// values: x, y, age, lifetime
+	class Follower : public TestEntity
+	{
+		public:
+
+			Leader* leader;
+			float rate;
+
+			Follower(World* world, float x, float y) : TestEntity(world, 1, 1), leader(NULL), rate(world->NextRandom(0.1f, 2.0f))
+			{
+				values[0] = x;
+				values[1] = y;
+				values[3] = world->NextRandom(0.5f, 4.0f);
+				PickLeader();
+			}
+
+			void PickLeader() { leader = world->leaders[world->NextRandom() % world->leaders.size()]; }
+
+			void Update(TimingInfo time)
+			{
+				// leaders are updated in stage 0, so they're safe to read here
+				values[0] += (leader->values[0] - values[0]) * rate * time.elapsed;
+				values[1] += (leader->values[1] - values[1]) * rate * time.elapsed;
+
+				values[2] += time.elapsed;
+				if(values[2] >= values[3])
+					needs_merge = true;
+			}
+
+			void MergeUpdate(TimingInfo time)
+			{
+				if(world->NextRandom() % 3 == 0 && world->live_followers < max_followers)
+				{
+					is_valid = false;
+					--world->live_followers;
+
+					for(unsigned int i = 0; i < 2; ++i)
+						world->Spawn(new Follower(world, values[0] + world->NextRandom(-1, 1), values[1] + world->NextRandom(-1, 1)));
+				}
+				else
+				{
+					values[2] = 0.0f;
+					PickLeader();
+				}
+			}
+	};
+
+	// values: running totals of x and y, how many frames were counted, how many followers it has watched
+	class Watcher : public TestEntity
+	{
+		public:
+
+			EntityHandle watching;
+
+			Watcher(World* world) : TestEntity(world, 2, 2), watching() { PickFollower(); }
+
+			void PickFollower()
+			{
+				watching = world->followers[world->NextRandom() % world->followers.size()];
+				values[3] += 1.0f;
+			}
+
+			void Update(TimingInfo time)
+			{
+				// nothing is added to or removed from the registry during the update stages, so looking things up in it is safe
+				Follower* follower = (Follower*)game_state->GetEntity(watching);
+				if(follower == NULL)
+					needs_merge = true;
+				else
+				{
+					values[0] += follower->values[0];
+					values[1] += follower->values[1];
+					values[2] += 1.0f;
+				}
+			}
+
+			void MergeUpdate(TimingInfo time) { PickFollower(); }
+	};
+
+	void World::Spawn(Entity* e)
+	{
+		game_state->Spawn(e);
+
+		if(Leader* leader = dynamic_cast<Leader*>(e))
+			leaders.push_back(leader);
+		else if(Follower* follower = dynamic_cast<Follower*>(e))
+		{
+			if(follower->GetHandle() == EntityHandle())
+				spawned.push_back(follower);
+			else
+				followers.push_back(follower->GetHandle());
+
+			++live_followers;
+		}
+	}
+
+	/** Simulates the population with the given number of update threads, or without a pool if threads is negative, and returns what became of every entity */
+	map<unsigned int, Record> Run(int threads)
+	{
+		GameState* game_state = new GameState();
+		World world(game_state);
+
+		TaskPool* pool = NULL;
+		if(threads >= 0)
+			game_state->update_pool = pool = new TaskPool(threads);
+
+		// spawned directly, so they have handles right away
+		for(unsigned int i = 0; i < leader_count; ++i)
+			world.Spawn(new Leader(&world));
+		for(unsigned int i = 0; i < follower_count; ++i)
+			world.Spawn(new Follower(&world, world.NextRandom(-100, 100), world.NextRandom(-100, 100)));
+		for(unsigned int i = 0; i < watcher_count; ++i)
+			world.Spawn(new Watcher(&world));
+
+		TimingInfo time(1.0f / 60.0f, 0.0f);
+		for(unsigned int i = 0; i < frames; ++i)
+		{
+			game_state->Update(time);
+			time.total += time.elapsed;
+
+			// followers spawned during the update only got their handles at the end of it
+			for(vector<Follower*>::iterator iter = world.spawned.begin(); iter != world.spawned.end(); ++iter)
+				world.followers.push_back((*iter)->GetHandle());
+			world.spawned.clear();
+		}
+
+		game_state->Dispose();
+		delete game_state;
+
+		if(pool != NULL)
+		{
+			pool->Dispose();
+			delete pool;
+		}
+
+		return world.records;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	map<unsigned int, Record> reference = Run(-1);
+
+	unsigned int alive = 0, types[3] = { 0, 0, 0 };
+	for(map<unsigned int, Record>::iterator iter = reference.begin(); iter != reference.end(); ++iter)
+	{
+		++types[iter->second.type];
+		if(iter->second.is_valid)
+			++alive;
+	}
+	printf("without a pool: %u entities in all (%u leaders, %u followers, %u watchers), %u alive at the end\n", (unsigned int)reference.size(), types[0], types[1], types[2], alive);
+
+	Check(types[1] > follower_count, "followers were spawned during the run");
+	Check(alive < reference.size(), "followers were removed during the run");
+
+	const int thread_counts[] = { 0, 1, 4 };
+	for(unsigned int i = 0; i < sizeof(thread_counts) / sizeof(int); ++i)
+	{
+		map<unsigned int, Record> records = Run(thread_counts[i]);
+
+		unsigned int differences = 0;
+		for(map<unsigned int, Record>::iterator iter = reference.begin(); iter != reference.end(); ++iter)
+		{
+			map<unsigned int, Record>::iterator found = records.find(iter->first);
+			if(found == records.end() || !(found->second == iter->second))
+				++differences;
+		}
+
+		printf("%i threads: %u entities, %u differ\n", thread_counts[i], (unsigned int)records.size(), differences);
+
+		stringstream ss;
+		ss << "with " << thread_counts[i] << " update threads, every entity ends up the same as without a pool";
+		Check(records.size() == reference.size() && differences == 0, ss.str().c_str());
+	}
+
+	printf("%u checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+#include "../CibraryEngine/StdAfx.h"
+#include "../CibraryEngine/ParticleMaterial.h"
+#include "../CibraryEngine/BillboardMaterial.h"
+
+/*
+ * Checks ParticleMaterialBatch::Expand and BillboardMaterial::Batch::Expand (which do four particles or segments at a
+ * time with SSE, where it's available, and the rest one at a time) against a plain one-at-a-time expansion, for every
+ * count from 0 to 21 and a few big ones, so every count modulo 4 is covered: the vertices have to match (to within
+ * rounding), particles with age < 0 or age >= max_age have to be skipped wherever they are in a group of four, and the
+ * returned vertex count has to be what was written. Returns nonzero if any check fails
+ */
+using namespace CibraryEngine;
+using namespace std;
+
+namespace
+{
+	unsigned int failures = 0;
+
+	void Check(bool ok, const char* what)
+	{
+		if(!ok)
+		{
+			printf("FAILED: %s\n", what);
+			++failures;
+		}
+	}
+
+	unsigned int rng_state = 12345;
+	unsigned int NextRandom() { rng_state = rng_state * 1664525 + 1013904223; return rng_state >> 8; }
+	float NextRandom(float min, float max) { return min + (max - min) * (NextRandom() & 0xFFFF) / 65536.0f; }
+
+	bool Close(float a, float b) { return fabs(a - b) <= 1e-4f * max(1.0f, max(fabs(a), fabs(b))); }
+
+	const Vec3 camera_position(3.0f, 20.0f, -40.0f);
+	const Vec3 camera_right = Vec3::Normalize(Vec3(0.8f, 0.0f, 0.6f));
+	const Vec3 camera_up = Vec3::Normalize(Vec3::Cross(camera_right, Vec3(-0.6f, -0.3f, 0.8f)));
+
+	// the particles' arrays, in the layout ParticleMaterialBatch points into
+	struct Particles
+	{
+		vector<float> x, y, z, radius, cos_angle, sin_angle, age, max_age;
+
+		Particles(unsigned int count) : x(count), y(count), z(count), radius(count), cos_angle(count), sin_angle(count), age(count), max_age(count)
+		{
+			for(unsigned int i = 0; i < count; ++i)
+			{
+				x[i] = NextRandom(-50, 50);
+				y[i] = NextRandom(0, 10);
+				z[i] = NextRandom(-50, 50);
+				radius[i] = NextRandom(0.05f, 1.0f);
+
+				float angle = NextRandom(0, 6.283f);
+				cos_angle[i] = cosf(angle);
+				sin_angle[i] = sinf(angle);
+
+				max_age[i] = NextRandom(0.25f, 2.0f);
+				switch(NextRandom() % 6)
+				{
+					case 0:		age[i] = -NextRandom(0.01f, 1.0f); break;			// not emitted yet
+					case 1:		age[i] = max_age[i]; break;							// just expired
+					case 2:		age[i] = max_age[i] + NextRandom(0.01f, 1.0f); break;
+					case 3:		age[i] = 0.0f; break;
+					default:	age[i] = NextRandom(0, max_age[i]); break;
+				}
+			}
+		}
+
+		ParticleMaterialBatch GetBatch() const
+		{
+			unsigned int count = x.size();
+
+			ParticleMaterialBatch batch(count);
+			if(count > 0)
+			{
+				batch.x = &x[0];					batch.y = &y[0];					batch.z = &z[0];
+				batch.radius = &radius[0];
+				batch.cos_angle = &cos_angle[0];	batch.sin_angle = &sin_angle[0];
+				batch.age = &age[0];				batch.max_age = &max_age[0];
+			}
+			return batch;
+		}
+	};
+
+	void PutVertex(vector<ParticleVertex>& out, const Vec3& pos, float u, float v, float w)
+	{
+		ParticleVertex vertex = { pos.x, pos.y, pos.z, u, v, w };
+		out.push_back(vertex);
+	}
+
+	vector<ParticleVertex> ExpandParticles(const Particles& p)
+	{
+		vector<ParticleVertex> out;
+		for(unsigned int i = 0; i < p.x.size(); ++i)
+		{
+			if(p.age[i] < 0 || p.age[i] >= p.max_age[i])
+				continue;
+
+			Vec3 pos(p.x[i], p.y[i], p.z[i]);
+			float w = p.age[i] / p.max_age[i];
+
+			float c = p.cos_angle[i] * p.radius[i], s = p.sin_angle[i] * p.radius[i];
+			Vec3 use_right = camera_right * c + camera_up * s;
+			Vec3 use_up = camera_up * c - camera_right * s;
+
+			PutVertex(out, pos - use_right - use_up, 0, 0, w);
+			PutVertex(out, pos - use_right + use_up, 0, 1, w);
+			PutVertex(out, pos + use_right + use_up, 1, 1, w);
+			PutVertex(out, pos + use_right - use_up, 1, 0, w);
+		}
+		return out;
+	}
+
+	bool Same(const ParticleVertex& a, const ParticleVertex& b) { return Close(a.x, b.x) && Close(a.y, b.y) && Close(a.z, b.z) && a.u == b.u && a.v == b.v && Close(a.w, b.w); }
+
+	vector<BillboardMaterial::NodeData> MakeSegments(unsigned int count)
+	{
+		vector<BillboardMaterial::NodeData> segments;
+		for(unsigned int i = 0; i < count; ++i)
+		{
+			Vec3 front(NextRandom(-50, 50), NextRandom(0, 10), NextRandom(-50, 50));
+			Vec3 back = front + Vec3(NextRandom(-2, 2), NextRandom(-2, 2), NextRandom(-2, 2));
+
+			BillboardMaterial::NodeData segment(front, back, NextRandom(0.01f, 0.5f));
+			segment.red = NextRandom(0, 1);
+			segment.green = NextRandom(0, 1);
+			segment.blue = NextRandom(0, 1);
+			segment.alpha = NextRandom(0, 1);
+			segment.front_u = NextRandom(0, 1);
+			segment.back_u = NextRandom(0, 1);
+
+			segments.push_back(segment);
+		}
+		return segments;
+	}
+
+	void PutVertex(vector<BillboardVertex>& out, const Vec3& pos, float u, float v, const BillboardMaterial::NodeData& s)
+	{
+		BillboardVertex vertex = { pos.x, pos.y, pos.z, u, v, s.red, s.green, s.blue, s.alpha };
+		out.push_back(vertex);
+	}
+
+	vector<BillboardVertex> ExpandSegments(const vector<BillboardMaterial::NodeData>& segments)
+	{
+		vector<BillboardVertex> out;
+		for(unsigned int i = 0; i < segments.size(); ++i)
+		{
+			const BillboardMaterial::NodeData& s = segments[i];
+
+			Vec3 normal = Vec3::Cross(s.front - camera_position, s.front - s.back);
+			normal *= s.width * 0.5f / normal.ComputeMagnitude();
+
+			PutVertex(out, s.front + normal,	s.front_u,	0.0f, s);
+			PutVertex(out, s.front,				s.front_u,	0.5f, s);
+			PutVertex(out, s.back,				s.back_u,	0.5f, s);
+			PutVertex(out, s.back + normal,		s.back_u,	0.0f, s);
+
+			PutVertex(out, s.front,				s.front_u,	0.5f, s);
+			PutVertex(out, s.front - normal,	s.front_u,	1.0f, s);
+			PutVertex(out, s.back - normal,		s.back_u,	1.0f, s);
+			PutVertex(out, s.back,				s.back_u,	0.5f, s);
+		}
+		return out;
+	}
+
+	bool Same(const BillboardVertex& a, const BillboardVertex& b)
+	{
+		return Close(a.x, b.x) && Close(a.y, b.y) && Close(a.z, b.z) && a.u == b.u && a.v == b.v &&
+			a.red == b.red && a.green == b.green && a.blue == b.blue && a.alpha == b.alpha;
+	}
+
+	void CheckParticles(unsigned int count)
+	{
+		Particles particles(count);
+		vector<ParticleVertex> expected = ExpandParticles(particles);
+
+		// one spare vertex past the end, to catch Expand writing more than it says it did
+		vector<ParticleVertex> out(count * 4 + 1);
+		ParticleVertex guard = { -1, -2, -3, -4, -5, -6 };
+		out[count * 4] = guard;
+
+		unsigned int written = particles.GetBatch().Expand(camera_right, camera_up, &out[0]);
+
+		bool same = written == expected.size();
+		for(unsigned int i = 0; same && i < written; ++i)
+			same = Same(out[i], expected[i]);
+
+		stringstream ss;
+		ss << "ParticleMaterialBatch::Expand of " << count << " particles writes " << expected.size() << " vertices, matching the one-at-a-time expansion (wrote " << written << ")";
+		Check(same, ss.str().c_str());
+		Check(written % 4 == 0 && written <= count * 4 && out[count * 4].x == guard.x, "ParticleMaterialBatch::Expand stays within 4 vertices per particle");
+	}
+
+	void CheckSegments(unsigned int count)
+	{
+		vector<BillboardMaterial::NodeData> segments = MakeSegments(count);
+		vector<BillboardVertex> expected = ExpandSegments(segments);
+
+		vector<BillboardVertex> out(count * 8 + 1);
+		BillboardVertex guard = { -1, -2, -3, -4, -5, -6, -7, -8, -9 };
+		out[count * 8] = guard;
+
+		BillboardMaterial::Batch batch(count > 0 ? &segments[0] : NULL, count);
+		unsigned int written = batch.Expand(camera_position, &out[0]);
+
+		bool same = written == expected.size();
+		for(unsigned int i = 0; same && i < written; ++i)
+			same = Same(out[i], expected[i]);
+
+		stringstream ss;
+		ss << "BillboardMaterial::Batch::Expand of " << count << " segments writes " << count * 8 << " vertices, matching the one-at-a-time expansion (wrote " << written << ")";
+		Check(same, ss.str().c_str());
+		Check(out[count * 8].x == guard.x, "BillboardMaterial::Batch::Expand stays within 8 vertices per segment");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int big_counts[] = { 1000, 1001, 1002, 1003, 100000 };
+
+	for(unsigned int count = 0; count <= 21; ++count)
+	{
+		CheckParticles(count);
+		CheckSegments(count);
+	}
+	for(unsigned int i = 0; i < sizeof(big_counts) / sizeof(unsigned int); ++i)
+	{
+		CheckParticles(big_counts[i]);
+		CheckSegments(big_counts[i]);
+	}
+
+	// a group of four where none are drawn, followed by one where only the last is
+	Particles particles(8);
+	for(unsigned int i = 0; i < 7; ++i)
+		particles.age[i] = (i % 2 == 0) ? -1.0f : particles.max_age[i];
+	particles.age[7] = 0.0f;
+
+	vector<ParticleVertex> out(32);
+	unsigned int written = particles.GetBatch().Expand(camera_right, camera_up, &out[0]);
+	Check(written == 4 && Same(out[0], ExpandParticles(particles)[0]), "only the one live particle out of 8 is drawn");
+
+	printf("%u checks failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include "../CibraryEngine/StdAfx.h"
+#include "../CibraryEngine/NavGraph.h"
+#include "../CibraryEngine/Pathfinding.h"
+
+/*
+ * Checks that PathWorkerPool gives the same solutions no matter how many threads it has: 3000 searches between random
+ * nodes of a synthetic 60x60 grid graph (with a few walls in it, which
+ * close off one pocket of it, so some searches find no path) are all queued at once, then run through the pool a
+ * frame at a time, with a small budget each frame, and flushed; this is done with 0, 1 and 4 worker threads, and compared
+ * with solving each search on the calling thread without a pool. Returns nonzero if any solution differs, or any search
+ * doesn't finish
+ */
+using namespace CibraryEngine;
+using namespace std;
+
+namespace
+{
+	const unsigned int grid_res = 60;
+	const float grid_spacing = 2.0f;
+
+	const unsigned int search_count = 3000;
+	const unsigned int frames = 20;
+	const float budget_ms = 1.0f;
+
+	unsigned int rng_state = 12345;
+	unsigned int NextRandom() { rng_state = rng_state * 1664525 + 1013904223; return rng_state >> 8; }
+
+	// a grid with edges to all eight neighbors, except where there are walls; the area bounded by the walls at i = 30, i = 45 and j = 40 is closed off
+	unsigned int BuildGridGraph(vector<unsigned int>& nodes)
+	{
+		unsigned int graph = NavGraph::NewNavGraph(NULL);
+
+		vector<unsigned int> grid(grid_res * grid_res, 0);
+		for(unsigned int i = 0; i < grid_res; ++i)
+			for(unsigned int j = 0; j < grid_res; ++j)
+			{
+				bool wall = (i == 15 && j < 50) || (i == 30 && j > 10) || (i == 45 && (j < 25 || j > 32)) || (j == 40 && i > 30 && i < 58);
+				if(!wall)
+				{
+					grid[i * grid_res + j] = NavGraph::NewNode(graph, Vec3(i * grid_spacing, 0.0f, j * grid_spacing));
+					nodes.push_back(grid[i * grid_res + j]);
+				}
+			}
+
+		for(unsigned int i = 0; i < grid_res; ++i)
+			for(unsigned int j = 0; j < grid_res; ++j)
+			{
+				unsigned int node = grid[i * grid_res + j];
+				if(node == 0)
+					continue;
+
+				for(int di = -1; di <= 1; ++di)
+					for(int dj = -1; dj <= 1; ++dj)
+					{
+						int oi = (int)i + di, oj = (int)j + dj;
+						if((di != 0 || dj != 0) && oi >= 0 && oj >= 0 && oi < (int)grid_res && oj < (int)grid_res && grid[oi * grid_res + oj] != 0)
+							NavGraph::NewEdge(graph, node, grid[oi * grid_res + oj], grid_spacing * sqrtf(float(di * di + dj * dj)));
+					}
+			}
+
+		return graph;
+	}
+
+	/** Runs every search through a pool with the given number of threads, or without a pool if threads is negative; returns false if any didn't finish */
+	bool RunSearches(unsigned int graph, const vector<pair<unsigned int, unsigned int> >& endpoints, int threads, vector<list<unsigned int> >& solutions)
+	{
+		// start from scratch, so no search is answered by one from an earlier run
+		PathService::ClearCache();
+
+		PathWorkerPool* pool = NULL;
+		if(threads >= 0)
+		{
+			pool = new PathWorkerPool(threads);
+			PathService::SetWorkerPool(pool);
+		}
+
+		vector<PathSearch> searches;
+		for(unsigned int i = 0; i < endpoints.size(); ++i)
+			searches.push_back(PathSearch(graph, endpoints[i].first, endpoints[i].second));
+
+		if(pool != NULL)
+		{
+			for(unsigned int i = 0; i < frames; ++i)
+				pool->Update(budget_ms);
+			pool->Flush();
+		}
+		else
+			for(vector<PathSearch>::iterator iter = searches.begin(); iter != searches.end(); ++iter)
+				iter->Solve();
+
+		bool all_finished = true;
+
+		solutions.clear();
+		for(vector<PathSearch>::iterator iter = searches.begin(); iter != searches.end(); ++iter)
+		{
+			all_finished &= iter->IsFinished();
+			solutions.push_back(iter->GetSolution());
+
+			iter->Dispose();
+		}
+
+		if(pool != NULL)
+		{
+			pool->Dispose();
+			delete pool;
+		}
+
+		return all_finished;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	vector<unsigned int> nodes;
+	unsigned int graph = BuildGridGraph(nodes);
+
+	vector<pair<unsigned int, unsigned int> > endpoints;
+	for(unsigned int i = 0; i < search_count; ++i)
+		endpoints.push_back(pair<unsigned int, unsigned int>(nodes[NextRandom() % nodes.size()], nodes[NextRandom() % nodes.size()]));
+
+	vector<list<unsigned int> > reference;
+	unsigned int failures = RunSearches(graph, endpoints, -1, reference) ? 0 : 1;
+
+	unsigned int found = 0;
+	for(vector<list<unsigned int> >::iterator iter = reference.begin(); iter != reference.end(); ++iter)
+		if(!iter->empty())
+			++found;
+
+	printf("%u nodes, %u searches, %u paths found without a pool\n", (unsigned int)nodes.size(), search_count, found);
+
+	const int thread_counts[] = { 0, 1, 4 };
+	for(unsigned int i = 0; i < sizeof(thread_counts) / sizeof(int); ++i)
+	{
+		vector<list<unsigned int> > solutions;
+		if(!RunSearches(graph, endpoints, thread_counts[i], solutions))
+		{
+			printf("FAILED: with %i threads, not every search finished\n", thread_counts[i]);
+			++failures;
+		}
+
+		unsigned int differences = 0;
+		for(unsigned int j = 0; j < search_count; ++j)
+			if(solutions[j] != reference[j])
+				++differences;
+
+		printf("%i threads: %u of %u solutions differ\n", thread_counts[i], differences, search_count);
+		if(differences != 0)
+			++failures;
+	}
+
+	NavGraph::DeleteNavGraph(graph);
+
+	return failures == 0 ? 0 : 1;
+}
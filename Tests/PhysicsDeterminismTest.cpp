@@ -0,0 +1,162 @@
+#include "../Benchmarks/RagdollScene.h"
+
+/*
+ * Checks PhysicsWorld::Snapshot and Restore with 20 ragdolls on the nbridge level:
+ *
+ *  - restoring a snapshot and immediately taking another gives back the same bytes
+ *  - two freshly built worlds, restored from the same snapshot and fed the same recorded input (impulses on random
+ *    bones), end up with byte-identical snapshots
+ *  - the world the snapshot was taken from, after running on for a while, and then rolled back to the snapshot again
+ *    and again (the way a prediction would be), plays the input out the same way as the fresh worlds each time
+ *
+ * Returns nonzero if any check fails
+ */
+using namespace CibraryEngine;
+using namespace Benchmarks;
+
+namespace
+{
+	const unsigned int ragdoll_count = 20;
+	const unsigned int lead_in_frames = 30;
+	const unsigned int replay_frames = 120;
+
+	struct Input
+	{
+		unsigned int frame;
+		unsigned int ragdoll, bone;
+		Vec3 impulse;
+	};
+
+	vector<Input> RecordInput(RagdollScene& scene, BenchmarkRandom& random)
+	{
+		vector<Input> inputs;
+		for(unsigned int frame = 0; frame < replay_frames; frame += 3)
+		{
+			Input input;
+			input.frame = frame;
+			input.ragdoll = random.Next() % scene.ragdolls.size();
+			input.bone = random.Next() % scene.ragdolls[input.ragdoll].bodies.size();
+			input.impulse = Vec3(random.Next(-20, 20), random.Next(0, 30), random.Next(-20, 20));
+
+			inputs.push_back(input);
+		}
+		return inputs;
+	}
+
+	string Replay(PhysicsWorld* world, RagdollScene& scene, const string& start, const vector<Input>& inputs)
+	{
+		stringstream in(start);
+		if(int error = world->Restore(in))
+		{
+			printf("Restore returned error %i\n", error);
+			return string();
+		}
+
+		TimingInfo time(1.0f / 60.0f, 0.0f);
+		vector<Input>::const_iterator next = inputs.begin();
+		for(unsigned int frame = 0; frame < replay_frames; ++frame)
+		{
+			for(; next != inputs.end() && next->frame == frame; ++next)
+			{
+				RigidBodyInfo* body = scene.ragdolls[next->ragdoll].bodies[next->bone];
+				body->Activate();
+				body->ApplyCentralImpulse(next->impulse);
+			}
+
+			world->Update(time);
+			time.total += time.elapsed;
+		}
+
+		stringstream out;
+		world->Snapshot(out);
+		return out.str();
+	}
+
+	// every world is built the same way, so the bodies and constraints are in the same order in all of them
+	PhysicsWorld* NewWorld(RagdollScene*& scene)
+	{
+		PhysicsWorld* world = new PhysicsWorld();
+		scene = new RagdollScene(world);
+		if(!scene->Load())
+			return world;
+
+		BenchmarkRandom random(12345);
+		scene->AddRagdolls(ragdoll_count, random);
+
+		return world;
+	}
+
+	void DeleteWorld(PhysicsWorld* world, RagdollScene* scene)
+	{
+		scene->Dispose();
+		delete scene;
+
+		world->Dispose();
+		delete world;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int failures = 0;
+
+	RagdollScene* scene;
+	PhysicsWorld* world = NewWorld(scene);
+	if(scene->ragdolls.empty())
+	{
+		DeleteWorld(world, scene);
+		return 1;
+	}
+
+	scene->Run(lead_in_frames);
+
+	stringstream snapshot;
+	world->Snapshot(snapshot);
+	string start = snapshot.str();
+
+	BenchmarkRandom random(54321);
+	vector<Input> inputs = RecordInput(*scene, random);
+
+	// round trip
+	{
+		stringstream in(start), out;
+		world->Restore(in);
+		world->Snapshot(out);
+
+		if(out.str() != start)
+		{
+			printf("FAILED: restoring a snapshot and taking another doesn't give back the same bytes\n");
+			++failures;
+		}
+	}
+
+	// replays in fresh worlds
+	string replays[2];
+	for(unsigned int i = 0; i < 2; ++i)
+	{
+		RagdollScene* fresh_scene;
+		PhysicsWorld* fresh_world = NewWorld(fresh_scene);
+		replays[i] = Replay(fresh_world, *fresh_scene, start, inputs);
+		DeleteWorld(fresh_world, fresh_scene);
+	}
+
+	if(replays[0].empty() || replays[0] != replays[1])
+	{
+		printf("FAILED: two fresh worlds replaying the same input from the same snapshot ended up in different states\n");
+		++failures;
+	}
+
+	// replays in the world the snapshot was taken from, after it's run on for a while, and after each replay
+	scene->Run(lead_in_frames);
+	for(unsigned int i = 0; i < 2; ++i)
+		if(Replay(world, *scene, start, inputs) != replays[0])
+		{
+			printf("FAILED: rolling back the world the snapshot was taken from (time %u) and replaying the input didn't match the fresh worlds\n", i + 1);
+			++failures;
+		}
+
+	DeleteWorld(world, scene);
+
+	printf("%u bytes per snapshot, %u checks failed\n", start.size(), failures);
+	return failures == 0 ? 0 : 1;
+}